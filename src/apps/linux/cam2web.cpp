@@ -28,8 +28,21 @@
 
 #include "XV4LCamera.hpp"
 #include "XV4LCameraConfig.hpp"
+#include "XHttpMjpegCamera.hpp"
+#include "XMulticastCamera.hpp"
 #include "XWebServer.hpp"
 #include "XVideoSourceToWeb.hpp"
+#include "XVideoFilterChain.hpp"
+#include "XAsyncVideoSourceListener.hpp"
+#include "XJpegTransformFilter.hpp"
+#include "XTextOverlayFilter.hpp"
+#include "XSharedFrameBus.hpp"
+#include "XRtspServer.hpp"
+#include "XMulticastSender.hpp"
+#include "XFrameHistory.hpp"
+#include "XMjpegRecorder.hpp"
+#include "XRecordingPlayer.hpp"
+#include "XMotionDetector.hpp"
 #include "XObjectConfigurationSerializer.hpp"
 #include "XObjectConfigurationRequestHandler.hpp"
 #include "XManualResetEvent.hpp"
@@ -46,6 +59,7 @@
     #include "jquery.js.h"
     #include "jquery.mobile.js.h"
     #include "jquery.mobile.css.h"
+    #include "tiles.html.h"
 #endif
 
 using namespace std;
@@ -67,12 +81,35 @@ struct
     uint32_t FrameWidth;
     uint32_t FrameHeight;
     uint32_t FrameRate;
+    uint32_t IdleFrameRate;
+    uint32_t JpegQuality;
+    uint32_t EncoderThreads;
+    uint32_t CropX;
+    uint32_t CropY;
+    uint32_t CropWidth;
+    uint32_t CropHeight;
+    XJpegTransformFilter::Transform JpegTransform;
+    XTextOverlayFilter::Position OverlayPosition;
+    uint32_t OverlayScale;
     uint32_t WebPort;
+    uint32_t OnDemandTimeout;
+    uint32_t RtspPort;
+    uint32_t HistorySize;
+    uint32_t RecordingMaxSize;
+    uint32_t RecordingMaxAge;
+    uint32_t MotionRate;
     string   HtRealm;
     string   HtDigestFileName;
     string   CameraConfigFileName;
     string   CustomWebContent;
     string   CameraTitle;
+    string   OverlayText;
+    string   FrameBusName;
+    uint32_t FrameBusMode;
+    string   RelayUrl;
+    string   MulticastGroup;
+    string   RecordingFolder;
+    uint16_t MulticastPort;
     UserGroup ViewersGroup;
     UserGroup ConfigGroup;
 }
@@ -103,6 +140,24 @@ public:
     }
 };
 
+// Split "address:port" string into its parts
+static bool ParseAddressAndPort( const string& str, string& address, uint16_t& port )
+{
+    size_t   colon = str.rfind( ':' );
+    uint32_t value = 0;
+    bool     ret   = false;
+
+    if ( ( colon != string::npos ) && ( colon != 0 ) &&
+         ( sscanf( str.c_str( ) + colon + 1, "%u", &value ) == 1 ) && ( value != 0 ) && ( value <= 65535 ) )
+    {
+        address = str.substr( 0, colon );
+        port    = static_cast<uint16_t>( value );
+        ret     = true;
+    }
+
+    return ret;
+}
+
 // Set default values for settings
 void SetDefaultSettings( )
 {
@@ -112,6 +167,26 @@ void SetDefaultSettings( )
     Settings.FrameRate    = 30;
     Settings.WebPort      = 8000;
 
+    Settings.IdleFrameRate   = 0;
+    Settings.JpegQuality     = 0;
+    Settings.EncoderThreads  = 1;
+    Settings.CropX           = 0;
+    Settings.CropY           = 0;
+    Settings.CropWidth       = 0;
+    Settings.CropHeight      = 0;
+    Settings.JpegTransform   = XJpegTransformFilter::Transform::None;
+    Settings.OverlayPosition = XTextOverlayFilter::Position::TopLeft;
+    Settings.OverlayScale    = 2;
+    Settings.OnDemandTimeout = 0;
+    Settings.RtspPort        = 0;
+    Settings.MulticastPort   = 0;
+    Settings.HistorySize     = 0;
+
+    Settings.RecordingMaxSize = 0;
+    Settings.RecordingMaxAge  = 0;
+
+    Settings.MotionRate = 5;
+
     Settings.HtRealm = "cam2web";
     Settings.HtDigestFileName.clear( );
 
@@ -133,6 +208,9 @@ void SetDefaultSettings( )
 #endif
 
     Settings.CameraTitle = DEVICE_NAME;
+    Settings.FrameBusName.clear( );
+    Settings.FrameBusMode = 0600;
+    Settings.RelayUrl.clear( );
 }
 
 // Parse command line and override default settings
@@ -198,6 +276,99 @@ bool ParseCommandLine( int argc, char* argv[] )
             if ( ( Settings.FrameRate < 1 ) || ( Settings.FrameRate > 30 ) )
                 Settings.FrameRate = 30;
         }
+        else if ( key == "idlefps" )
+        {
+            int scanned = sscanf( value.c_str( ), "%u", &(Settings.IdleFrameRate) );
+
+            if ( scanned != 1 )
+                break;
+
+            if ( Settings.IdleFrameRate > 30 )
+                Settings.IdleFrameRate = 30;
+        }
+        else if ( key == "quality" )
+        {
+            int scanned = sscanf( value.c_str( ), "%u", &(Settings.JpegQuality) );
+
+            if ( scanned != 1 )
+                break;
+
+            if ( ( Settings.JpegQuality < 1 ) || ( Settings.JpegQuality > 100 ) )
+                break;
+        }
+        else if ( key == "encoders" )
+        {
+            int scanned = sscanf( value.c_str( ), "%u", &(Settings.EncoderThreads) );
+
+            if ( scanned != 1 )
+                break;
+
+            if ( ( Settings.EncoderThreads < 1 ) || ( Settings.EncoderThreads > 16 ) )
+                break;
+        }
+        else if ( key == "rotate" )
+        {
+            if ( value == "90" )
+                Settings.JpegTransform = XJpegTransformFilter::Transform::Rotate90;
+            else if ( value == "180" )
+                Settings.JpegTransform = XJpegTransformFilter::Transform::Rotate180;
+            else if ( value == "270" )
+                Settings.JpegTransform = XJpegTransformFilter::Transform::Rotate270;
+            else
+                break;
+        }
+        else if ( key == "flip" )
+        {
+            if ( value == "h" )
+                Settings.JpegTransform = XJpegTransformFilter::Transform::FlipHorizontal;
+            else if ( value == "v" )
+                Settings.JpegTransform = XJpegTransformFilter::Transform::FlipVertical;
+            else
+                break;
+        }
+        else if ( key == "crop" )
+        {
+            int scanned = sscanf( value.c_str( ), "%u,%u,%u,%u", &(Settings.CropX), &(Settings.CropY),
+                                                                &(Settings.CropWidth), &(Settings.CropHeight) );
+
+            if ( ( scanned != 4 ) || ( Settings.CropWidth == 0 ) || ( Settings.CropHeight == 0 ) )
+                break;
+        }
+        else if ( key == "overlay" )
+        {
+            size_t newLine;
+
+            // "\n" sequences split text into lines
+            while ( ( newLine = value.find( "\\n" ) ) != string::npos )
+            {
+                value.replace( newLine, 2, "\n" );
+            }
+
+            Settings.OverlayText = value;
+        }
+        else if ( key == "overlaypos" )
+        {
+            if ( value == "tl" )
+                Settings.OverlayPosition = XTextOverlayFilter::Position::TopLeft;
+            else if ( value == "tr" )
+                Settings.OverlayPosition = XTextOverlayFilter::Position::TopRight;
+            else if ( value == "bl" )
+                Settings.OverlayPosition = XTextOverlayFilter::Position::BottomLeft;
+            else if ( value == "br" )
+                Settings.OverlayPosition = XTextOverlayFilter::Position::BottomRight;
+            else
+                break;
+        }
+        else if ( key == "overlayscale" )
+        {
+            int scanned = sscanf( value.c_str( ), "%u", &(Settings.OverlayScale) );
+
+            if ( scanned != 1 )
+                break;
+
+            if ( ( Settings.OverlayScale < 1 ) || ( Settings.OverlayScale > 8 ) )
+                break;
+        }
         else if ( key == "port" )
         {
             int scanned = sscanf( value.c_str( ), "%u", &(Settings.WebPort) );
@@ -208,6 +379,62 @@ bool ParseCommandLine( int argc, char* argv[] )
             if ( Settings.WebPort > 65535 )
                 Settings.WebPort = 65535;
         }
+        else if ( key == "ondemand" )
+        {
+            int scanned = sscanf( value.c_str( ), "%u", &(Settings.OnDemandTimeout) );
+
+            if ( scanned != 1 )
+                break;
+        }
+        else if ( key == "rtsp" )
+        {
+            int scanned = sscanf( value.c_str( ), "%u", &(Settings.RtspPort) );
+
+            if ( scanned != 1 )
+                break;
+
+            if ( Settings.RtspPort > 65535 )
+                Settings.RtspPort = 65535;
+        }
+        else if ( key == "history" )
+        {
+            int scanned = sscanf( value.c_str( ), "%u", &(Settings.HistorySize) );
+
+            if ( scanned != 1 )
+                break;
+
+            // keep the budget within 32 bit sizes
+            if ( Settings.HistorySize > 2048 )
+                Settings.HistorySize = 2048;
+        }
+        else if ( key == "record" )
+        {
+            Settings.RecordingFolder = value;
+        }
+        else if ( key == "recsize" )
+        {
+            int scanned = sscanf( value.c_str( ), "%u", &(Settings.RecordingMaxSize) );
+
+            if ( scanned != 1 )
+                break;
+        }
+        else if ( key == "recage" )
+        {
+            int scanned = sscanf( value.c_str( ), "%u", &(Settings.RecordingMaxAge) );
+
+            if ( scanned != 1 )
+                break;
+        }
+        else if ( key == "motion" )
+        {
+            int scanned = sscanf( value.c_str( ), "%u", &(Settings.MotionRate) );
+
+            if ( scanned != 1 )
+                break;
+
+            if ( Settings.MotionRate > 30 )
+                Settings.MotionRate = 30;
+        }
         else if ( key == "realm" )
         {
             Settings.HtRealm = value;
@@ -260,6 +487,26 @@ bool ParseCommandLine( int argc, char* argv[] )
         {
             Settings.CameraTitle = value;
         }
+        else if ( key == "shm" )
+        {
+            Settings.FrameBusName = value;
+        }
+        else if ( key == "shmmode" )
+        {
+            int scanned = sscanf( value.c_str( ), "%o", &(Settings.FrameBusMode) );
+
+            if ( ( scanned != 1 ) || ( Settings.FrameBusMode > 0777 ) )
+                break;
+        }
+        else if ( key == "relay" )
+        {
+            Settings.RelayUrl = value;
+        }
+        else if ( key == "mcast" )
+        {
+            if ( !ParseAddressAndPort( value, Settings.MulticastGroup, Settings.MulticastPort ) )
+                break;
+        }
         else
         {
             break;
@@ -301,8 +548,46 @@ bool ParseCommandLine( int argc, char* argv[] )
         printf( "                    the one it supports. \n" );
         printf( "  -fps:<1-30> Sets camera frame rate. Same is used for MJPEG stream. \n" );
         printf( "              Default is 30. \n" );
+        printf( "  -idlefps:<0-30> \n" );
+        printf( "              Frame rate to use while nothing moves in front of camera. \n" );
+        printf( "              Full rate is restored as soon as scene changes. \n" );
+        printf( "              Default is 0 - always use full frame rate. \n" );
+        printf( "  -quality:<1-100> \n" );
+        printf( "              JPEG quality of provided images. JPEG images coming from \n" );
+        printf( "              camera (or relay) are requantized to it if theirs is higher. \n" );
+        printf( "              Default is 85 - JPEG images from camera are provided as is. \n" );
+        printf( "  -encoders:<1-16> \n" );
+        printf( "              Number of threads encoding consecutive uncompressed images \n" );
+        printf( "              concurrently (for high resolution cameras). Default is 1. \n" );
+        printf( "  -rotate:<90|180|270> \n" );
+        printf( "              Rotate JPEG images coming from camera clockwise. \n" );
+        printf( "  -flip:<h|v> Flip JPEG images coming from camera horizontally/vertically. \n" );
+        printf( "  -crop:<x,y,w,h> \n" );
+        printf( "              Provide only the specified rectangle of JPEG images coming \n" );
+        printf( "              from camera (after rotation/flipping). \n" );
+        printf( "              Note: the above are lossless (done on DCT coefficients), so a \n" );
+        printf( "                    few pixels may be trimmed from image edges and crop \n" );
+        printf( "                    position is aligned to 8 or 16 pixels. \n" );
+        printf( "  -overlay:<?> \n" );
+        printf( "              Text to burn into images (camera name, time stamp, etc.). \n" );
+        printf( "              Can contain strftime() fields, like %%Y-%%m-%%d %%H:%%M:%%S, \n" );
+        printf( "              and \\n sequences to start new lines. \n" );
+        printf( "              Note: camera is switched to uncompressed (YUYV) images, which \n" );
+        printf( "                    are then JPEG encoded. Relayed streams are not changed. \n" );
+        printf( "  -overlaypos:<tl|tr|bl|br> \n" );
+        printf( "              Corner of images to put the text into. Default is tl. \n" );
+        printf( "  -overlayscale:<1-8> \n" );
+        printf( "              Scale of the overlay font (7x10 pixels per character \n" );
+        printf( "              at scale 1). Default is 2. \n" );
         printf( "  -port:<num> Port number for web server to listen on. \n" );
         printf( "              Default is 8000. \n" );
+        printf( "  -ondemand:<sec> \n" );
+        printf( "              Start camera only when its images are requested and stop it \n" );
+        printf( "              after the specified number of seconds without requests. \n" );
+        printf( "              Default is 0 - camera runs all the time. \n" );
+        printf( "              Note: only web clients count as requesting images. \n" );
+        printf( "  -rtsp:<num> Port number for RTSP server to listen on (RTP/JPEG streaming). \n" );
+        printf( "              Default is 0 - RTSP server is not started. \n" );
         printf( "  -realm:<?>  HTTP digest authentication domain. \n" );
         printf( "              Default is 'cam2web'. \n" );
         printf( "  -htpass:<?> htdigest file containing list of users to access the camera. \n" );
@@ -322,6 +607,35 @@ bool ParseCommandLine( int argc, char* argv[] )
         printf( "              By default embedded web files are used. \n" );
         printf( "  -title:<?>  Name of the camera to be shown in WebUI. \n" );
         printf( "              Use double quotes if the name contains spaces. \n" );
+        printf( "  -shm:<?>    Name of shared memory object (/dev/shm/<name>) to publish \n" );
+        printf( "              camera frames to for local applications. \n" );
+        printf( "              By default frames are not published. \n" );
+        printf( "  -shmmode:<octal> \n" );
+        printf( "              Access mode of the shared memory object, like 0640 to let \n" );
+        printf( "              the owner's group read frames. Default is 0600 - owner only. \n" );
+        printf( "  -relay:<?>  URL of MJPEG stream to re-stream instead of local camera, \n" );
+        printf( "              like http://host:port/camera/mjpeg, or multicast group \n" );
+        printf( "              to receive frames from, like udp://239.0.0.1:5000. \n" );
+        printf( "  -mcast:<?>  Multicast group and port to send camera images to, \n" );
+        printf( "              like 239.0.0.1:5000. \n" );
+        printf( "              By default images are not sent to multicast group. \n" );
+        printf( "  -history:<mb> \n" );
+        printf( "              Megabytes of memory to keep recent camera images in, \n" );
+        printf( "              which are provided by /camera/history. \n" );
+        printf( "              By default history is not kept. \n" );
+        printf( "  -record:<?> Folder to record camera images to (as segments of MJPEG). \n" );
+        printf( "              Recordings are provided by /camera/recordings. \n" );
+        printf( "              By default images are not recorded. \n" );
+        printf( "  -recsize:<mb> \n" );
+        printf( "              Maximum size of recordings, the oldest are deleted. \n" );
+        printf( "              Default is 0 - no limit. \n" );
+        printf( "  -recage:<hours> \n" );
+        printf( "              Maximum age of recordings, older are deleted. \n" );
+        printf( "              Default is 0 - no limit. \n" );
+        printf( "  -motion:<fps> \n" );
+        printf( "              Number of images to analyse for motion per second, [0, 30]. \n" );
+        printf( "              Motion is provided by /camera/motion and with JPEGs. \n" );
+        printf( "              Default is 5, 0 - don't detect motion. \n" );
         printf( "\n" );
 
         ret = false;
@@ -356,6 +670,37 @@ int main( int argc, char* argv[] )
     shared_ptr<XV4LCamera>           xcamera       = XV4LCamera::Create( );
     shared_ptr<IObjectConfigurator>  xcameraConfig = make_shared<XV4LCameraConfig>( xcamera );
     XObjectConfigurationSerializer   serializer( Settings.CameraConfigFileName, xcameraConfig );
+    shared_ptr<IVideoSource>         videoSource   = xcamera;
+    bool                             isRelay       = !Settings.RelayUrl.empty( );
+
+    // stream of another camera can be used instead of local one
+    if ( isRelay )
+    {
+        static const char* udpPrefix = "udp://";
+
+        if ( Settings.RelayUrl.compare( 0, strlen( udpPrefix ), udpPrefix ) == 0 )
+        {
+            shared_ptr<XMulticastCamera> multicastCamera = XMulticastCamera::Create( );
+            string                       groupAddress;
+            uint16_t                     groupPort;
+
+            if ( !ParseAddressAndPort( Settings.RelayUrl.substr( strlen( udpPrefix ) ), groupAddress, groupPort ) )
+            {
+                printf( "Invalid multicast group: %s \n", Settings.RelayUrl.c_str( ) );
+                return -1;
+            }
+
+            multicastCamera->SetGroup( groupAddress, groupPort );
+            videoSource = multicastCamera;
+        }
+        else
+        {
+            shared_ptr<XHttpMjpegCamera> relayCamera = XHttpMjpegCamera::Create( );
+
+            relayCamera->SetUrl( Settings.RelayUrl );
+            videoSource = relayCamera;
+        }
+    }
 
     // some read-only information about the version
     PropertyMap versionInfo;
@@ -368,10 +713,22 @@ int main( int argc, char* argv[] )
     PropertyMap cameraInfo;
     char        strVideoSize[32];
 
-    sprintf( strVideoSize,      "%u", Settings.FrameWidth );
-    sprintf( strVideoSize + 16, "%u", Settings.FrameHeight );
+    // images of the camera may get rotated and cropped (approximately, since MCU alignment is not known yet)
+    bool     transposed  = ( ( Settings.JpegTransform == XJpegTransformFilter::Transform::Rotate90 ) ||
+                             ( Settings.JpegTransform == XJpegTransformFilter::Transform::Rotate270 ) );
+    uint32_t imageWidth  = ( transposed ) ? Settings.FrameHeight : Settings.FrameWidth;
+    uint32_t imageHeight = ( transposed ) ? Settings.FrameWidth  : Settings.FrameHeight;
 
-    cameraInfo.insert( PropertyMap::value_type( "device", DEVICE_NAME ) );
+    if ( Settings.CropWidth != 0 )
+    {
+        imageWidth  = ( Settings.CropX < imageWidth  ) ? std::min( Settings.CropWidth,  imageWidth  - Settings.CropX ) : 0;
+        imageHeight = ( Settings.CropY < imageHeight ) ? std::min( Settings.CropHeight, imageHeight - Settings.CropY ) : 0;
+    }
+
+    sprintf( strVideoSize,      "%u", imageWidth );
+    sprintf( strVideoSize + 16, "%u", imageHeight );
+
+    cameraInfo.insert( PropertyMap::value_type( "device", ( isRelay ) ? Settings.RelayUrl : DEVICE_NAME ) );
     cameraInfo.insert( PropertyMap::value_type( "title",  Settings.CameraTitle ) );
     cameraInfo.insert( PropertyMap::value_type( "width",  strVideoSize ) );
     cameraInfo.insert( PropertyMap::value_type( "height", strVideoSize + 16 ) );
@@ -382,6 +739,17 @@ int main( int argc, char* argv[] )
     UserGroup           viewersGroup = Settings.ViewersGroup;
     UserGroup           configGroup  = Settings.ConfigGroup;
 
+    if ( Settings.JpegQuality != 0 )
+    {
+        video2web.SetJpegQuality( static_cast<uint16_t>( Settings.JpegQuality ) );
+        video2web.SetJpegTranscoding( true );
+    }
+
+    if ( Settings.EncoderThreads > 1 )
+    {
+        video2web.SetEncoderThreads( Settings.EncoderThreads );
+    }
+
     if ( !Settings.HtRealm.empty( ) )
     {
         server.SetAuthDomain( Settings.HtRealm );
@@ -395,17 +763,62 @@ int main( int argc, char* argv[] )
     xcamera->SetVideoDevice( Settings.DeviceNumber );
     xcamera->SetVideoSize( Settings.FrameWidth, Settings.FrameHeight );
     xcamera->SetFrameRate( Settings.FrameRate );
+    xcamera->SetIdleFrameRate( Settings.IdleFrameRate );
+
+    // text can be burnt only into uncompressed images
+    if ( !Settings.OverlayText.empty( ) )
+    {
+        xcamera->EnableJpegEncoding( false );
+    }
+
+    // restore camera settings (nothing to configure when relaying another stream)
+    if ( !isRelay )
+    {
+        serializer.LoadConfiguration( );
 
-    // restore camera settings
-    serializer.LoadConfiguration( );
+        server.AddHandler( make_shared<XObjectConfigurationRequestHandler>( "/camera/config", xcameraConfig ), configGroup ).
+               AddHandler( make_shared<XObjectInformationRequestHandler>( "/camera/properties", make_shared<XV4LCameraPropsInfo>( xcamera ) ), configGroup );
+    }
 
     // add web handlers
     server.AddHandler( make_shared<XObjectInformationRequestHandler>( "/version", make_shared<XObjectInformationMap>( versionInfo ) ) ).
-           AddHandler( make_shared<XObjectConfigurationRequestHandler>( "/camera/config", xcameraConfig ), configGroup ).
-           AddHandler( make_shared<XObjectInformationRequestHandler>( "/camera/properties", make_shared<XV4LCameraPropsInfo>( xcamera ) ), configGroup ).
            AddHandler( make_shared<XObjectInformationRequestHandler>( "/camera/info", make_shared<XObjectInformationMap>( cameraInfo ) ), viewersGroup ).
            AddHandler( video2web.CreateJpegHandler( "/camera/jpeg" ), viewersGroup ).
-           AddHandler( video2web.CreateMjpegHandler( "/camera/mjpeg", Settings.FrameRate ), viewersGroup );
+           AddHandler( video2web.CreateMjpegHandler( "/camera/mjpeg", Settings.FrameRate ), viewersGroup ).
+           AddHandler( video2web.CreateWebSocketHandler( "/camera/ws", Settings.FrameRate ), viewersGroup ).
+           AddHandler( video2web.CreateTilesStreamHandler( "/camera/tiles", Settings.FrameRate ), viewersGroup ).
+           AddHandler( make_shared<XObjectInformationRequestHandler>( "/camera/stats", video2web.CreateStatsInformation( ) ), viewersGroup );
+
+    // recent images are kept in memory if asked for
+    XFrameHistory frameHistory( video2web, Settings.HistorySize * 1024 * 1024, Settings.FrameRate );
+
+    if ( Settings.HistorySize != 0 )
+    {
+        server.AddHandler( frameHistory.CreateHistoryHandler( "/camera/history" ), viewersGroup );
+    }
+
+    // motion detection runs at its own rate
+    XMotionDetector motionDetector;
+
+    if ( Settings.MotionRate != 0 )
+    {
+        motionDetector.SetAnalysisRate( Settings.MotionRate );
+        video2web.SetMotionDetector( &motionDetector );
+
+        server.AddHandler( make_shared<XObjectInformationRequestHandler>( "/camera/motion", motionDetector.CreateMotionInformation( ) ), viewersGroup );
+    }
+
+    // recordings are provided by the same folder they are written to
+    XRecordingPlayer recordingPlayer( Settings.RecordingFolder );
+
+    if ( !Settings.RecordingFolder.empty( ) )
+    {
+        server.AddHandler( recordingPlayer.CreatePlaybackHandler( "/camera/recordings" ), viewersGroup );
+    }
+
+    // uncompressed images are meant for local applications, so allow them to localhost and admin only
+    server.AddHandler( video2web.CreateRawHandler( "/camera/raw" ), UserGroup::Admin, true ).
+           AddHandler( video2web.CreateRawStreamHandler( "/camera/rawstream", Settings.FrameRate ), UserGroup::Admin, true );
 
     // use custom or embedded web content
     if ( !Settings.CustomWebContent.empty( ) )
@@ -426,35 +839,212 @@ int main( int argc, char* argv[] )
                AddHandler( make_shared<XEmbeddedContentHandler>( "cameraproperties.html", &web_cameraproperties_html ), configGroup ).
                AddHandler( make_shared<XEmbeddedContentHandler>( "jquery.js", &web_jquery_js ), viewersGroup ).
                AddHandler( make_shared<XEmbeddedContentHandler>( "jquery.mobile.js", &web_jquery_mobile_js ), viewersGroup ).
-               AddHandler( make_shared<XEmbeddedContentHandler>( "jquery.mobile.css", &web_jquery_mobile_css ), viewersGroup );
+               AddHandler( make_shared<XEmbeddedContentHandler>( "jquery.mobile.css", &web_jquery_mobile_css ), viewersGroup ).
+               AddHandler( make_shared<XEmbeddedContentHandler>( "tiles.html", &web_tiles_html ), viewersGroup );
     #endif
     }
 
-    // set camera listeners
+    // set camera listeners - all of them get images which passed through the chain of video filters
+    XVideoFilterChain           filterChain;
     XVideoSourceListenerChain   listenerChain;
     CameraErrorListener         cameraErrorListener;
 
+    // JPEG images are rotated/flipped/cropped before anybody else sees them
+    if ( ( Settings.JpegTransform != XJpegTransformFilter::Transform::None ) || ( Settings.CropWidth != 0 ) )
+    {
+        shared_ptr<XJpegTransformFilter> transformFilter = make_shared<XJpegTransformFilter>( Settings.JpegTransform );
+
+        transformFilter->SetCrop( static_cast<int32_t>( Settings.CropX ), static_cast<int32_t>( Settings.CropY ),
+                                  static_cast<int32_t>( Settings.CropWidth ), static_cast<int32_t>( Settings.CropHeight ) );
+        filterChain.Add( transformFilter );
+    }
+
+    // text is put over images after they got their final geometry
+    if ( !Settings.OverlayText.empty( ) )
+    {
+        shared_ptr<XTextOverlayFilter> overlayFilter = make_shared<XTextOverlayFilter>( Settings.OverlayText, Settings.OverlayPosition );
+
+        overlayFilter->SetScale( Settings.OverlayScale );
+        filterChain.Add( overlayFilter );
+    }
+
+    // motion detection gets images on its own thread, so decoding them never delays capture (if it
+    // falls behind, it analyses the latest image)
+    shared_ptr<XAsyncVideoSourceListener> asyncMotionDetector;
+
+    if ( Settings.MotionRate != 0 )
+    {
+        asyncMotionDetector = make_shared<XAsyncVideoSourceListener>( &motionDetector, 1, XQueueOverflowPolicy::DropOldest );
+        listenerChain.Add( asyncMotionDetector.get( ) );
+        video2web.AddListenerQueue( "motion", asyncMotionDetector.get( ) );
+    }
+
     listenerChain.Add( video2web.VideoSourceListener( ) );
     listenerChain.Add( &cameraErrorListener );
-    xcamera->SetListener( &listenerChain );
+
+    // publish frames to local applications if needed (on a separate thread as well, so readers
+    // holding the bus never stall capture)
+    shared_ptr<XSharedFrameWriter>        frameBusWriter;
+    shared_ptr<XAsyncVideoSourceListener> asyncFrameBusWriter;
+
+    if ( !Settings.FrameBusName.empty( ) )
+    {
+        frameBusWriter      = make_shared<XSharedFrameWriter>( Settings.FrameBusName, 4, Settings.FrameBusMode );
+        asyncFrameBusWriter = make_shared<XAsyncVideoSourceListener>( frameBusWriter.get( ), 2, XQueueOverflowPolicy::DropOldest );
+        listenerChain.Add( asyncFrameBusWriter.get( ) );
+        video2web.AddListenerQueue( "frameBus", asyncFrameBusWriter.get( ) );
+    }
+
+    filterChain.SetListener( &listenerChain );
+    videoSource->SetListener( &filterChain );
+
+    // RTSP clients get the same JPEG images as web clients
+    XRtspServer rtspServer( video2web, static_cast<uint16_t>( Settings.RtspPort ), Settings.FrameRate );
+    // multicast receivers too
+    XMulticastSender multicastSender( video2web, Settings.MulticastGroup, Settings.MulticastPort, Settings.FrameRate );
+
+    // recording writes to disk on its own thread, so nothing else waits for it (motion levels are recorded
+    // together with images, so activity could be searched later)
+    XMjpegRecorder recorder( video2web, Settings.RecordingFolder, Settings.FrameRate );
+
+    recorder.SetMaxTotalSize( static_cast<uint64_t>( Settings.RecordingMaxSize ) * 1024 * 1024 ).
+             SetMaxAge( Settings.RecordingMaxAge * 3600 ).
+             SetMotionDetector( ( Settings.MotionRate != 0 ) ? &motionDetector : nullptr );
 
     if ( server.Start( ) )
     {
         printf( "Web server started on port %d ...\n", server.Port( ) );
+
+        if ( Settings.RtspPort != 0 )
+        {
+            if ( rtspServer.Start( ) )
+            {
+                printf( "RTSP server started on port %d ...\n", rtspServer.Port( ) );
+
+                if ( Settings.ViewersGroup != UserGroup::Anyone )
+                {
+                    printf( "Warning: RTSP clients are not authenticated. \n" );
+                }
+
+                if ( transposed )
+                {
+                    // transposed 4:2:2 subsampling becomes 4:4:0, which RTP/JPEG can not carry
+                    printf( "Warning: rotated images can be streamed over RTSP only if camera provides 4:2:0 JPEGs. \n" );
+                }
+            }
+            else
+            {
+                printf( "Failed starting RTSP server on port %d\n", rtspServer.Port( ) );
+            }
+        }
+
+        if ( Settings.MulticastPort != 0 )
+        {
+            if ( multicastSender.Start( ) )
+            {
+                printf( "Sending images to multicast group %s:%d ...\n", Settings.MulticastGroup.c_str( ), Settings.MulticastPort );
+            }
+            else
+            {
+                printf( "Failed sending images to multicast group %s:%d\n", Settings.MulticastGroup.c_str( ), Settings.MulticastPort );
+            }
+        }
+
+        if ( Settings.HistorySize != 0 )
+        {
+            if ( frameHistory.Start( ) )
+            {
+                printf( "Keeping up to %u MB of recent images ...\n", Settings.HistorySize );
+            }
+            else
+            {
+                printf( "Failed allocating %u MB for history of images\n", Settings.HistorySize );
+            }
+        }
+
+        if ( !Settings.RecordingFolder.empty( ) )
+        {
+            if ( recorder.Start( ) )
+            {
+                printf( "Recording images to %s ...\n", Settings.RecordingFolder.c_str( ) );
+            }
+            else
+            {
+                printf( "Failed recording images to %s\n", Settings.RecordingFolder.c_str( ) );
+            }
+        }
+
         printf( "Ctrl+C to stop.\n" );
 
-        xcamera->Start( );
+        if ( Settings.OnDemandTimeout != 0 )
+        {
+            // camera is started by web handlers when somebody wants to see it
+            video2web.EnableOnDemandMode( videoSource );
 
-        while ( !ExitEvent.Wait( 60000 ) )
+            if ( ( Settings.RtspPort != 0 ) || ( Settings.MulticastPort != 0 ) ||
+                 ( Settings.HistorySize != 0 ) || ( !Settings.RecordingFolder.empty( ) ) )
+            {
+                printf( "Warning: RTSP, multicast, history and recording get images only while web clients watch the camera. \n" );
+            }
+        }
+        else
         {
-            // save camera settings from time to time
-            serializer.SaveConfiguration( );
+            videoSource->Start( );
         }
 
-        serializer.SaveConfiguration( );
+        uint32_t secondsSinceSave        = 0;
+        uint32_t secondsSinceRtspWarning = 60;
+        uint32_t rtspRejectedReported    = 0;
+
+        while ( !ExitEvent.Wait( 1000 ) )
+        {
+            // save camera settings from time to time (only running camera can provide them)
+            if ( ++secondsSinceSave >= 60 )
+            {
+                if ( ( !isRelay ) && ( xcamera->IsRunning( ) ) )
+                {
+                    serializer.SaveConfiguration( );
+                }
+                secondsSinceSave = 0;
+            }
+
+            // stop camera if nobody watched it for a while
+            if ( ( Settings.OnDemandTimeout != 0 ) && ( videoSource->IsRunning( ) ) &&
+                 ( video2web.VideoSourceIdleTime( ) >= Settings.OnDemandTimeout * 1000 ) )
+            {
+                if ( !isRelay )
+                {
+                    serializer.SaveConfiguration( );
+                }
+                video2web.StopIdleVideoSource( Settings.OnDemandTimeout * 1000 );
+            }
+
+            // tell (not too often) if RTSP clients get nothing since camera's JPEGs can not be streamed
+            if ( ++secondsSinceRtspWarning >= 60 )
+            {
+                uint32_t rejected = rtspServer.RejectedFramesCount( );
+
+                if ( rejected != rtspRejectedReported )
+                {
+                    printf( "Warning: %u images were not sent to RTSP clients - their JPEG format is not supported by RTP/JPEG \n",
+                            rejected - rtspRejectedReported );
+                    rtspRejectedReported    = rejected;
+                    secondsSinceRtspWarning = 0;
+                }
+            }
+        }
+
+        if ( ( !isRelay ) && ( xcamera->IsRunning( ) ) )
+        {
+            serializer.SaveConfiguration( );
+        }
 
-        xcamera->SignalToStop( );
-        xcamera->WaitForStop( );
+        recorder.Stop( );
+        frameHistory.Stop( );
+        multicastSender.Stop( );
+        rtspServer.Stop( );
+        videoSource->SignalToStop( );
+        videoSource->WaitForStop( );
         server.Stop( );
 
         printf( "Done \n" );
@@ -46,6 +46,7 @@
     #include "jquery.js.h"
     #include "jquery.mobile.js.h"
     #include "jquery.mobile.css.h"
+    #include "tiles.html.h"
 #endif
 
 using namespace std;
@@ -409,7 +410,14 @@ int main( int argc, char* argv[] )
            AddHandler( make_shared<XObjectInformationRequestHandler>( "/camera/properties", make_shared<XRaspiCameraPropsInfo>( xcamera ) ), configGroup ).
            AddHandler( make_shared<XObjectInformationRequestHandler>( "/camera/info", make_shared<XObjectInformationMap>( cameraInfo ) ), viewersGroup ).
            AddHandler( video2web.CreateJpegHandler( "/camera/jpeg" ), viewersGroup ).
-           AddHandler( video2web.CreateMjpegHandler( "/camera/mjpeg", Settings.FrameRate ), viewersGroup );
+           AddHandler( video2web.CreateMjpegHandler( "/camera/mjpeg", Settings.FrameRate ), viewersGroup ).
+           AddHandler( video2web.CreateWebSocketHandler( "/camera/ws", Settings.FrameRate ), viewersGroup ).
+           AddHandler( video2web.CreateTilesStreamHandler( "/camera/tiles", Settings.FrameRate ), viewersGroup ).
+           AddHandler( make_shared<XObjectInformationRequestHandler>( "/camera/stats", video2web.CreateStatsInformation( ) ), viewersGroup );
+
+    // uncompressed images are meant for local applications, so allow them to localhost and admin only
+    server.AddHandler( video2web.CreateRawHandler( "/camera/raw" ), UserGroup::Admin, true ).
+           AddHandler( video2web.CreateRawStreamHandler( "/camera/rawstream", Settings.FrameRate ), UserGroup::Admin, true );
 
     // use custom or embedded web content
     if ( !Settings.CustomWebContent.empty( ) )
@@ -430,7 +438,8 @@ int main( int argc, char* argv[] )
                AddHandler( make_shared<XEmbeddedContentHandler>( "cameraproperties.html", &web_cameraproperties_html ), configGroup ).
                AddHandler( make_shared<XEmbeddedContentHandler>( "jquery.js", &web_jquery_js ), viewersGroup ).
                AddHandler( make_shared<XEmbeddedContentHandler>( "jquery.mobile.js", &web_jquery_mobile_js ), viewersGroup ).
-               AddHandler( make_shared<XEmbeddedContentHandler>( "jquery.mobile.css", &web_jquery_mobile_css ), viewersGroup );
+               AddHandler( make_shared<XEmbeddedContentHandler>( "jquery.mobile.css", &web_jquery_mobile_css ), viewersGroup ).
+               AddHandler( make_shared<XEmbeddedContentHandler>( "tiles.html", &web_tiles_html ), viewersGroup );
     #endif
     }
 
@@ -61,6 +61,7 @@
     #include "jquery.js.h"
     #include "jquery.mobile.js.h"
     #include "jquery.mobile.css.h"
+    #include "tiles.html.h"
 #endif
 
 // Enable visual styles by using ComCtl32.dll version 6 or later
@@ -787,7 +788,14 @@ static bool StartVideoStreaming( )
                       AddHandler( make_shared<XObjectInformationRequestHandler>( "/camera/properties", make_shared<XLocalVideoDevicePropsInfo>( gData->camera ) ), configGroup ).
                       AddHandler( make_shared<XObjectInformationRequestHandler>( "/camera/info", make_shared<XObjectInformationMap>( cameraInfo ) ), viewersGroup ).
                       AddHandler( gData->video2web.CreateJpegHandler( "/camera/jpeg" ), viewersGroup ).
-                      AddHandler( gData->video2web.CreateMjpegHandler( "/camera/mjpeg", gData->appConfig->MjpegFrameRate( ) ), viewersGroup );
+                      AddHandler( gData->video2web.CreateMjpegHandler( "/camera/mjpeg", gData->appConfig->MjpegFrameRate( ) ), viewersGroup ).
+                      AddHandler( gData->video2web.CreateWebSocketHandler( "/camera/ws", gData->appConfig->MjpegFrameRate( ) ), viewersGroup ).
+                      AddHandler( gData->video2web.CreateTilesStreamHandler( "/camera/tiles", gData->appConfig->MjpegFrameRate( ) ), viewersGroup ).
+                      AddHandler( make_shared<XObjectInformationRequestHandler>( "/camera/stats", gData->video2web.CreateStatsInformation( ) ), viewersGroup );
+
+        // uncompressed images are meant for local applications, so allow them to localhost and admin only
+        gData->server.AddHandler( gData->video2web.CreateRawHandler( "/camera/raw" ), UserGroup::Admin, true ).
+                      AddHandler( gData->video2web.CreateRawStreamHandler( "/camera/rawstream", gData->appConfig->MjpegFrameRate( ) ), UserGroup::Admin, true );
 
         // check if custom web content is available
         if ( !gData->appConfig->CustomWebContent( ).empty( ) )
@@ -811,7 +819,8 @@ static bool StartVideoStreaming( )
                           AddHandler( make_shared<XEmbeddedContentHandler>( "cameraproperties.html", &web_cameraproperties_html ), configGroup ).
                           AddHandler( make_shared<XEmbeddedContentHandler>( "jquery.js", &web_jquery_js ), viewersGroup ).
                           AddHandler( make_shared<XEmbeddedContentHandler>( "jquery.mobile.js", &web_jquery_mobile_js ), viewersGroup ).
-                          AddHandler( make_shared<XEmbeddedContentHandler>( "jquery.mobile.css", &web_jquery_mobile_css ), viewersGroup );
+                          AddHandler( make_shared<XEmbeddedContentHandler>( "jquery.mobile.css", &web_jquery_mobile_css ), viewersGroup ).
+                          AddHandler( make_shared<XEmbeddedContentHandler>( "tiles.html", &web_tiles_html ), viewersGroup );
 #endif
         }
 
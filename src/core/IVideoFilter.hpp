@@ -0,0 +1,48 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef IVIDEO_FILTER_HPP
+#define IVIDEO_FILTER_HPP
+
+#include <string>
+#include <memory>
+
+#include "XImage.hpp"
+#include "XImagePool.hpp"
+
+// Interface for filters transforming video frames on their way from video source to consumers
+class IVideoFilter
+{
+public:
+    virtual ~IVideoFilter( ) { }
+
+    // Name of the filter (used for reporting)
+    virtual std::string Name( ) const = 0;
+
+    /* Process the specified video frame.
+
+       The filter can either modify the image in place or put result into an image taken
+       from the pool and then replace the passed image pointer with it. Images which are
+       not supported by the filter (pixel format, etc.) should be left untouched.
+    */
+    virtual XError Process( std::shared_ptr<XImage>& image, XImagePool& pool ) = 0;
+};
+
+#endif // IVIDEO_FILTER_HPP
@@ -0,0 +1,856 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <condition_variable>
+
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/uio.h>
+
+// io_uring is used directly through system calls, so only kernel headers are required
+#if defined( __linux__ ) && defined( __has_include )
+    #if __has_include( <linux/io_uring.h> )
+        #define HAVE_IO_URING
+    #endif
+#endif
+
+#ifdef HAVE_IO_URING
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+    #include <linux/io_uring.h>
+#endif
+
+#include "XAsyncFileWriter.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace Private
+{
+    // Alignment of buffers - file system block size
+    #define BUFFER_ALIGNMENT        (4096)
+    // Number of threads writing files when io_uring is not available
+    #define WRITER_THREADS_COUNT    (2)
+
+    // Write request waiting to be submitted to backend
+    struct WriteRequest
+    {
+        int      File;
+        uint32_t BufferIndex;
+        uint32_t Size;
+        uint64_t Offset;
+    };
+
+    class XAsyncFileWriterData
+    {
+    public:
+        uint32_t                    BuffersCount;
+        uint32_t                    BufferSize;
+        bool                        ForceThreadPool;
+        XAsyncFileWriter::Backend   ActiveBackend;
+        recursive_mutex             StartSync;
+
+        // pool of buffers - free buffers and number of buffers queued to backend
+        uint8_t*                    Buffers;
+        mutex                       PoolGuard;
+        condition_variable          BufferReleased;
+        vector<uint32_t>            FreeBuffers;
+        uint32_t                    InFlightCount;
+        uint32_t                    WriteErrors;
+        uint64_t                    BytesWritten;
+
+        // writes queued by caller, but not submitted yet
+        vector<WriteRequest>        QueuedRequests;
+
+        // thread pool backend - circular queue of submitted requests
+        vector<thread>              Workers;
+        condition_variable          RequestsAvailable;
+        vector<WriteRequest>        SubmittedRequests;
+        uint32_t                    FirstSubmittedRequest;
+        uint32_t                    SubmittedRequestsCount;
+        bool                        WorkersNeedToStop;
+
+    #ifdef HAVE_IO_URING
+        // io_uring backend - the ring and its memory mapped parts
+        int                         Ring;
+        uint8_t*                    SqRing;
+        size_t                      SqRingSize;
+        uint8_t*                    CqRing;
+        size_t                      CqRingSize;
+        struct io_uring_sqe*        Sqes;
+        size_t                      SqesSize;
+        uint32_t*                   SqTail;
+        uint32_t*                   SqMask;
+        uint32_t*                   SqArray;
+        uint32_t*                   CqHead;
+        uint32_t*                   CqTail;
+        uint32_t*                   CqMask;
+        struct io_uring_cqe*        Cqes;
+        bool                        BuffersRegistered;
+        vector<struct iovec>        BufferVectors;
+        // part of every buffer's request, which is still to be written, and number of its bytes already written
+        // (short writes are sent again to write the rest); buffers waiting for that are kept in flight
+        vector<WriteRequest>        RingRequests;
+        vector<uint32_t>            RingWritten;
+        vector<uint32_t>            ShortWrites;
+        vector<uint32_t>            SubmitBatch;
+    #endif
+
+    public:
+        XAsyncFileWriterData( uint32_t buffersCount, uint32_t bufferSize ) :
+            BuffersCount( ( buffersCount < 2 ) ? 2 : buffersCount ),
+            BufferSize( ( bufferSize + BUFFER_ALIGNMENT - 1 ) & ~static_cast<uint32_t>( BUFFER_ALIGNMENT - 1 ) ),
+            ForceThreadPool( false ), ActiveBackend( XAsyncFileWriter::Backend::None ), StartSync( ),
+            Buffers( nullptr ), PoolGuard( ), BufferReleased( ), FreeBuffers( ), InFlightCount( 0 ), WriteErrors( 0 ), BytesWritten( 0 ),
+            QueuedRequests( ), Workers( ), RequestsAvailable( ), SubmittedRequests( ), FirstSubmittedRequest( 0 ), SubmittedRequestsCount( 0 ),
+            WorkersNeedToStop( false )
+        #ifdef HAVE_IO_URING
+            , Ring( -1 ), SqRing( nullptr ), SqRingSize( 0 ), CqRing( nullptr ), CqRingSize( 0 ), Sqes( nullptr ), SqesSize( 0 ),
+            SqTail( nullptr ), SqMask( nullptr ), SqArray( nullptr ), CqHead( nullptr ), CqTail( nullptr ), CqMask( nullptr ),
+            Cqes( nullptr ), BuffersRegistered( false ), BufferVectors( ), RingRequests( ), RingWritten( ), ShortWrites( ), SubmitBatch( )
+        #endif
+        {
+            if ( BufferSize == 0 )
+            {
+                BufferSize = BUFFER_ALIGNMENT;
+            }
+        }
+
+        bool Start( );
+        void Stop( );
+
+        uint8_t* AcquireBuffer( uint32_t msec );
+        void ReleaseBuffer( uint32_t bufferIndex, int32_t result, uint32_t expectedSize );
+        void Submit( );
+        void WaitForCompletion( );
+
+    private:
+        bool StartThreadPool( );
+        void StopThreadPool( );
+        static void WorkerThreadHandler( XAsyncFileWriterData* me );
+
+    #ifdef HAVE_IO_URING
+        bool StartIoUring( );
+        void StopIoUring( );
+        void SubmitToRing( );
+        bool ReapCompletions( );
+        bool WaitForCompletions( uint32_t msec );
+    #endif
+    };
+}
+
+XAsyncFileWriter::XAsyncFileWriter( uint32_t buffersCount, uint32_t bufferSize ) :
+    mData( new Private::XAsyncFileWriterData( buffersCount, bufferSize ) )
+{
+}
+
+XAsyncFileWriter::~XAsyncFileWriter( )
+{
+    mData->Stop( );
+    delete mData;
+}
+
+// Get/Set if thread pool must be used even when io_uring is available
+bool XAsyncFileWriter::ForceThreadPool( ) const
+{
+    return mData->ForceThreadPool;
+}
+XAsyncFileWriter& XAsyncFileWriter::SetForceThreadPool( bool force )
+{
+    lock_guard<recursive_mutex> lock( mData->StartSync );
+
+    if ( mData->ActiveBackend == Backend::None )
+    {
+        mData->ForceThreadPool = force;
+    }
+
+    return *this;
+}
+
+// Start the writer
+bool XAsyncFileWriter::Start( )
+{
+    return mData->Start( );
+}
+
+// Stop the writer, waiting for queued writes
+void XAsyncFileWriter::Stop( )
+{
+    mData->Stop( );
+}
+
+// Backend used by the running writer
+XAsyncFileWriter::Backend XAsyncFileWriter::ActiveBackend( ) const
+{
+    return mData->ActiveBackend;
+}
+
+// Size of every buffer in the pool
+uint32_t XAsyncFileWriter::BufferSize( ) const
+{
+    return mData->BufferSize;
+}
+
+// Get free buffer from the pool
+uint8_t* XAsyncFileWriter::AcquireBuffer( uint32_t msec )
+{
+    return ( mData->ActiveBackend == Backend::None ) ? nullptr : mData->AcquireBuffer( msec );
+}
+
+// Put buffer back into the pool without writing it
+void XAsyncFileWriter::ReleaseBuffer( uint8_t* buffer )
+{
+    if ( ( mData->Buffers != nullptr ) && ( buffer >= mData->Buffers ) &&
+         ( buffer < mData->Buffers + static_cast<size_t>( mData->BuffersCount ) * mData->BufferSize ) )
+    {
+        lock_guard<mutex> lock( mData->PoolGuard );
+
+        mData->FreeBuffers.push_back( static_cast<uint32_t>( ( buffer - mData->Buffers ) / mData->BufferSize ) );
+        mData->BufferReleased.notify_all( );
+    }
+}
+
+// Queue writing of the buffer's data
+XError XAsyncFileWriter::QueueWrite( int file, uint8_t* buffer, uint32_t size, uint64_t offset )
+{
+    XError ret = XError::Success;
+
+    if ( mData->ActiveBackend == Backend::None )
+    {
+        ret = XError::Failed;
+    }
+    else if ( ( buffer < mData->Buffers ) || ( buffer >= mData->Buffers + static_cast<size_t>( mData->BuffersCount ) * mData->BufferSize ) ||
+              ( ( buffer - mData->Buffers ) % mData->BufferSize != 0 ) || ( size > mData->BufferSize ) || ( file < 0 ) )
+    {
+        ret = XError::Failed;
+    }
+    else
+    {
+        Private::WriteRequest request;
+
+        request.File        = file;
+        request.BufferIndex = static_cast<uint32_t>( ( buffer - mData->Buffers ) / mData->BufferSize );
+        request.Size        = size;
+        request.Offset      = offset;
+
+        // there can not be more requests than buffers, so this never allocates
+        mData->QueuedRequests.push_back( request );
+    }
+
+    return ret;
+}
+
+// Send all queued writes to the backend
+void XAsyncFileWriter::Submit( )
+{
+    mData->Submit( );
+}
+
+// Wait till all queued writes complete
+void XAsyncFileWriter::WaitForCompletion( )
+{
+    mData->WaitForCompletion( );
+}
+
+// Number of failed/incomplete writes
+uint32_t XAsyncFileWriter::WriteErrors( ) const
+{
+    lock_guard<mutex> lock( mData->PoolGuard );
+    return mData->WriteErrors;
+}
+
+// Number of written bytes
+uint64_t XAsyncFileWriter::BytesWritten( ) const
+{
+    lock_guard<mutex> lock( mData->PoolGuard );
+    return mData->BytesWritten;
+}
+
+namespace Private
+{
+
+// Allocate buffers and start one of the backends
+bool XAsyncFileWriterData::Start( )
+{
+    lock_guard<recursive_mutex> lock( StartSync );
+
+    if ( ActiveBackend == XAsyncFileWriter::Backend::None )
+    {
+        void* buffers = nullptr;
+
+        if ( posix_memalign( &buffers, BUFFER_ALIGNMENT, static_cast<size_t>( BuffersCount ) * BufferSize ) == 0 )
+        {
+            Buffers = static_cast<uint8_t*>( buffers );
+
+            FreeBuffers.clear( );
+            FreeBuffers.reserve( BuffersCount );
+            for ( uint32_t i = BuffersCount; i > 0; i-- )
+            {
+                FreeBuffers.push_back( i - 1 );
+            }
+
+            QueuedRequests.clear( );
+            QueuedRequests.reserve( BuffersCount );
+
+            InFlightCount = 0;
+            WriteErrors   = 0;
+            BytesWritten  = 0;
+
+        #ifdef HAVE_IO_URING
+            if ( ( !ForceThreadPool ) && ( StartIoUring( ) ) )
+            {
+                ActiveBackend = XAsyncFileWriter::Backend::IoUring;
+            }
+            else
+        #endif
+            if ( StartThreadPool( ) )
+            {
+                ActiveBackend = XAsyncFileWriter::Backend::ThreadPool;
+            }
+            else
+            {
+                free( Buffers );
+                Buffers = nullptr;
+            }
+        }
+    }
+
+    return ( ActiveBackend != XAsyncFileWriter::Backend::None );
+}
+
+// Wait for all writes and stop the backend
+void XAsyncFileWriterData::Stop( )
+{
+    lock_guard<recursive_mutex> lock( StartSync );
+
+    if ( ActiveBackend != XAsyncFileWriter::Backend::None )
+    {
+        WaitForCompletion( );
+
+        if ( ActiveBackend == XAsyncFileWriter::Backend::ThreadPool )
+        {
+            StopThreadPool( );
+        }
+    #ifdef HAVE_IO_URING
+        else
+        {
+            StopIoUring( );
+        }
+    #endif
+
+        free( Buffers );
+        Buffers       = nullptr;
+        ActiveBackend = XAsyncFileWriter::Backend::None;
+    }
+}
+
+// Get free buffer from the pool, waiting for completions if there are none
+uint8_t* XAsyncFileWriterData::AcquireBuffer( uint32_t msec )
+{
+    uint8_t* buffer = nullptr;
+
+    // buffers of the queued writes can not be released till they are submitted
+    Submit( );
+
+#ifdef HAVE_IO_URING
+    if ( ActiveBackend == XAsyncFileWriter::Backend::IoUring )
+    {
+        // completions are reaped by this thread only, so no need to lock
+        if ( ( !ReapCompletions( ) ) && ( FreeBuffers.empty( ) ) && ( InFlightCount != 0 ) )
+        {
+            WaitForCompletions( msec );
+        }
+    }
+    else
+#endif
+    {
+        unique_lock<mutex> lock( PoolGuard );
+
+        if ( ( FreeBuffers.empty( ) ) && ( InFlightCount != 0 ) )
+        {
+            BufferReleased.wait_for( lock, milliseconds( msec ), [this] { return !FreeBuffers.empty( ); } );
+        }
+    }
+
+    {
+        lock_guard<mutex> lock( PoolGuard );
+
+        if ( !FreeBuffers.empty( ) )
+        {
+            buffer = Buffers + static_cast<size_t>( FreeBuffers.back( ) ) * BufferSize;
+            FreeBuffers.pop_back( );
+        }
+    }
+
+    return buffer;
+}
+
+// Put buffer of completed write back into the pool (PoolGuard must be locked)
+void XAsyncFileWriterData::ReleaseBuffer( uint32_t bufferIndex, int32_t result, uint32_t expectedSize )
+{
+    if ( result != static_cast<int32_t>( expectedSize ) )
+    {
+        WriteErrors++;
+    }
+    if ( result > 0 )
+    {
+        BytesWritten += static_cast<uint64_t>( result );
+    }
+
+    FreeBuffers.push_back( bufferIndex );
+    InFlightCount--;
+    BufferReleased.notify_all( );
+}
+
+// Send queued writes to the backend
+void XAsyncFileWriterData::Submit( )
+{
+#ifdef HAVE_IO_URING
+    if ( ActiveBackend == XAsyncFileWriter::Backend::IoUring )
+    {
+        // remainders of short writes are sent again together with new requests
+        if ( ( !QueuedRequests.empty( ) ) || ( !ShortWrites.empty( ) ) )
+        {
+            SubmitToRing( );
+        }
+
+        QueuedRequests.clear( );
+    }
+    else
+#endif
+    if ( !QueuedRequests.empty( ) )
+    {
+        {
+            lock_guard<mutex> lock( PoolGuard );
+            uint32_t          capacity = static_cast<uint32_t>( SubmittedRequests.size( ) );
+
+            for ( const WriteRequest& request : QueuedRequests )
+            {
+                SubmittedRequests[( FirstSubmittedRequest + SubmittedRequestsCount ) % capacity] = request;
+                SubmittedRequestsCount++;
+                InFlightCount++;
+            }
+
+            RequestsAvailable.notify_all( );
+        }
+
+        QueuedRequests.clear( );
+    }
+}
+
+// Wait till all queued writes complete
+void XAsyncFileWriterData::WaitForCompletion( )
+{
+    Submit( );
+
+#ifdef HAVE_IO_URING
+    if ( ActiveBackend == XAsyncFileWriter::Backend::IoUring )
+    {
+        while ( InFlightCount != 0 )
+        {
+            // rest of short writes must be sent again
+            Submit( );
+
+            if ( !ReapCompletions( ) )
+            {
+                WaitForCompletions( 1000 );
+            }
+        }
+    }
+    else
+#endif
+    {
+        unique_lock<mutex> lock( PoolGuard );
+
+        BufferReleased.wait( lock, [this] { return InFlightCount == 0; } );
+    }
+}
+
+// Start threads writing files with pwrite()
+bool XAsyncFileWriterData::StartThreadPool( )
+{
+    SubmittedRequests.resize( BuffersCount );
+    FirstSubmittedRequest  = 0;
+    SubmittedRequestsCount = 0;
+    WorkersNeedToStop      = false;
+
+    for ( uint32_t i = 0; i < WRITER_THREADS_COUNT; i++ )
+    {
+        Workers.push_back( thread( WorkerThreadHandler, this ) );
+    }
+
+    return true;
+}
+
+// Stop writing threads
+void XAsyncFileWriterData::StopThreadPool( )
+{
+    {
+        lock_guard<mutex> lock( PoolGuard );
+        WorkersNeedToStop = true;
+        RequestsAvailable.notify_all( );
+    }
+
+    for ( thread& worker : Workers )
+    {
+        worker.join( );
+    }
+
+    Workers.clear( );
+}
+
+// Thread taking submitted requests and writing them
+void XAsyncFileWriterData::WorkerThreadHandler( XAsyncFileWriterData* me )
+{
+    unique_lock<mutex> lock( me->PoolGuard );
+
+    for ( ; ; )
+    {
+        me->RequestsAvailable.wait( lock, [me] { return ( me->SubmittedRequestsCount != 0 ) || ( me->WorkersNeedToStop ); } );
+
+        if ( me->SubmittedRequestsCount == 0 )
+        {
+            break;
+        }
+
+        WriteRequest   request = me->SubmittedRequests[me->FirstSubmittedRequest];
+        const uint8_t* data    = me->Buffers + static_cast<size_t>( request.BufferIndex ) * me->BufferSize;
+        uint32_t       written = 0;
+        int32_t        result  = 0;
+
+        me->FirstSubmittedRequest = ( me->FirstSubmittedRequest + 1 ) % static_cast<uint32_t>( me->SubmittedRequests.size( ) );
+        me->SubmittedRequestsCount--;
+
+        lock.unlock( );
+
+        while ( written < request.Size )
+        {
+            ssize_t ret = pwrite( request.File, data + written, request.Size - written, static_cast<off_t>( request.Offset + written ) );
+
+            if ( ret < 0 )
+            {
+                if ( errno == EINTR )
+                {
+                    continue;
+                }
+                break;
+            }
+            if ( ret == 0 )
+            {
+                break;
+            }
+
+            written += static_cast<uint32_t>( ret );
+        }
+
+        result = static_cast<int32_t>( written );
+
+        lock.lock( );
+
+        me->ReleaseBuffer( request.BufferIndex, result, request.Size );
+    }
+}
+
+#ifdef HAVE_IO_URING
+
+// Create io_uring, map its queues and register buffers with it
+bool XAsyncFileWriterData::StartIoUring( )
+{
+    struct io_uring_params params;
+    bool                   ret = false;
+
+    memset( &params, 0, sizeof( params ) );
+
+    // every buffer can have only one write in flight, so the queue never overflows
+    Ring = static_cast<int>( syscall( __NR_io_uring_setup, BuffersCount, &params ) );
+
+    if ( Ring >= 0 )
+    {
+        SqRingSize = params.sq_off.array + params.sq_entries * sizeof( uint32_t );
+        CqRingSize = params.cq_off.cqes + params.cq_entries * sizeof( struct io_uring_cqe );
+        SqesSize   = params.sq_entries * sizeof( struct io_uring_sqe );
+
+        if ( params.features & IORING_FEAT_SINGLE_MMAP )
+        {
+            SqRingSize = CqRingSize = ( SqRingSize > CqRingSize ) ? SqRingSize : CqRingSize;
+        }
+
+        void* sqRing = mmap( nullptr, SqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, Ring, IORING_OFF_SQ_RING );
+        void* cqRing = MAP_FAILED;
+        void* sqes   = MAP_FAILED;
+
+        if ( sqRing != MAP_FAILED )
+        {
+            SqRing = static_cast<uint8_t*>( sqRing );
+
+            cqRing = ( params.features & IORING_FEAT_SINGLE_MMAP ) ? sqRing :
+                     mmap( nullptr, CqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, Ring, IORING_OFF_CQ_RING );
+        }
+
+        if ( cqRing != MAP_FAILED )
+        {
+            CqRing = static_cast<uint8_t*>( cqRing );
+            sqes   = mmap( nullptr, SqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, Ring, IORING_OFF_SQES );
+        }
+
+        if ( sqes != MAP_FAILED )
+        {
+            Sqes    = static_cast<struct io_uring_sqe*>( sqes );
+            SqTail  = reinterpret_cast<uint32_t*>( SqRing + params.sq_off.tail );
+            SqMask  = reinterpret_cast<uint32_t*>( SqRing + params.sq_off.ring_mask );
+            SqArray = reinterpret_cast<uint32_t*>( SqRing + params.sq_off.array );
+            CqHead  = reinterpret_cast<uint32_t*>( CqRing + params.cq_off.head );
+            CqTail  = reinterpret_cast<uint32_t*>( CqRing + params.cq_off.tail );
+            CqMask  = reinterpret_cast<uint32_t*>( CqRing + params.cq_off.ring_mask );
+            Cqes    = reinterpret_cast<struct io_uring_cqe*>( CqRing + params.cq_off.cqes );
+
+            RingRequests.assign( BuffersCount, WriteRequest( ) );
+            RingWritten.assign( BuffersCount, 0 );
+            ShortWrites.clear( );
+            ShortWrites.reserve( BuffersCount );
+            SubmitBatch.reserve( BuffersCount );
+
+            BufferVectors.resize( BuffersCount );
+            for ( uint32_t i = 0; i < BuffersCount; i++ )
+            {
+                BufferVectors[i].iov_base = Buffers + static_cast<size_t>( i ) * BufferSize;
+                BufferVectors[i].iov_len  = BufferSize;
+            }
+
+            // registered buffers are mapped by kernel once instead of doing it for every write; if it
+            // is not possible (locked memory limit, for example), then plain vectored writes are used
+            BuffersRegistered = ( syscall( __NR_io_uring_register, Ring, IORING_REGISTER_BUFFERS, BufferVectors.data( ), BuffersCount ) == 0 );
+
+            ret = true;
+        }
+        else
+        {
+            StopIoUring( );
+        }
+    }
+
+    return ret;
+}
+
+// Unmap queues and close the ring
+void XAsyncFileWriterData::StopIoUring( )
+{
+    if ( ( Sqes != nullptr ) )
+    {
+        munmap( Sqes, SqesSize );
+    }
+    if ( ( CqRing != nullptr ) && ( CqRing != SqRing ) )
+    {
+        munmap( CqRing, CqRingSize );
+    }
+    if ( SqRing != nullptr )
+    {
+        munmap( SqRing, SqRingSize );
+    }
+    if ( Ring >= 0 )
+    {
+        // closing the ring unregisters buffers as well
+        close( Ring );
+    }
+
+    Ring              = -1;
+    SqRing            = nullptr;
+    CqRing            = nullptr;
+    Sqes              = nullptr;
+    BuffersRegistered = false;
+}
+
+// Put queued writes (and the rest of short writes) into submission queue and tell kernel about all
+// of them with a single call
+void XAsyncFileWriterData::SubmitToRing( )
+{
+    vector<uint32_t>& buffers     = SubmitBatch;
+    uint32_t          tail        = *SqTail;
+    uint32_t          resubmitted = static_cast<uint32_t>( ShortWrites.size( ) );
+    uint32_t          submitted   = 0;
+
+    // short writes go first - their buffers are already counted as being in flight
+    buffers.assign( ShortWrites.begin( ), ShortWrites.end( ) );
+    ShortWrites.clear( );
+
+    for ( const WriteRequest& request : QueuedRequests )
+    {
+        RingRequests[request.BufferIndex] = request;
+        RingWritten[request.BufferIndex]  = 0;
+        buffers.push_back( request.BufferIndex );
+    }
+
+    for ( uint32_t bufferIndex : buffers )
+    {
+        const WriteRequest&  request = RingRequests[bufferIndex];
+        uint8_t*             data    = Buffers + static_cast<size_t>( bufferIndex ) * BufferSize + RingWritten[bufferIndex];
+        uint32_t             index   = tail & *SqMask;
+        struct io_uring_sqe* sqe     = &Sqes[index];
+
+        memset( sqe, 0, sizeof( *sqe ) );
+
+        sqe->fd        = request.File;
+        sqe->off       = request.Offset;
+        // user data keeps buffer index and size of data to check completion result
+        sqe->user_data = ( static_cast<uint64_t>( bufferIndex ) << 32 ) | request.Size;
+
+        if ( BuffersRegistered )
+        {
+            sqe->opcode    = IORING_OP_WRITE_FIXED;
+            sqe->addr      = reinterpret_cast<uint64_t>( data );
+            sqe->len       = request.Size;
+            sqe->buf_index = static_cast<uint16_t>( bufferIndex );
+        }
+        else
+        {
+            BufferVectors[bufferIndex].iov_base = data;
+            BufferVectors[bufferIndex].iov_len  = request.Size;
+
+            sqe->opcode = IORING_OP_WRITEV;
+            sqe->addr   = reinterpret_cast<uint64_t>( &BufferVectors[bufferIndex] );
+            sqe->len    = 1;
+        }
+
+        SqArray[index] = index;
+        tail++;
+    }
+
+    // make the entries visible to kernel before the new tail
+    __atomic_store_n( SqTail, tail, __ATOMIC_RELEASE );
+
+    while ( submitted != buffers.size( ) )
+    {
+        uint32_t toSubmit = static_cast<uint32_t>( buffers.size( ) ) - submitted;
+        int      ret      = static_cast<int>( syscall( __NR_io_uring_enter, Ring, toSubmit, 0, 0, nullptr, 0 ) );
+
+        if ( ret > 0 )
+        {
+            lock_guard<mutex> lock( PoolGuard );
+            uint32_t          first = ( submitted > resubmitted ) ? submitted : resubmitted;
+
+            // kernel takes entries in order, so only those past short writes add to the writes in flight
+            submitted += static_cast<uint32_t>( ret );
+
+            if ( submitted > first )
+            {
+                InFlightCount += submitted - first;
+            }
+        }
+        else if ( ( ret < 0 ) && ( errno != EINTR ) && ( errno != EAGAIN ) && ( errno != EBUSY ) )
+        {
+            // should not happen with valid requests, but don't spin forever
+            break;
+        }
+        else if ( InFlightCount != 0 )
+        {
+            // kernel is short of resources - let some writes complete
+            ReapCompletions( );
+        }
+    }
+
+    if ( submitted != buffers.size( ) )
+    {
+        lock_guard<mutex> lock( PoolGuard );
+
+        // take back entries kernel did not get and fail their writes
+        __atomic_store_n( SqTail, tail - ( static_cast<uint32_t>( buffers.size( ) ) - submitted ), __ATOMIC_RELEASE );
+
+        for ( uint32_t i = submitted; i < buffers.size( ); i++ )
+        {
+            if ( i < resubmitted )
+            {
+                InFlightCount--;
+            }
+
+            FreeBuffers.push_back( buffers[i] );
+            WriteErrors++;
+        }
+
+        BufferReleased.notify_all( );
+    }
+}
+
+// Take all available completions, releasing their buffers (buffers of short writes are kept till
+// the rest of their data are submitted)
+bool XAsyncFileWriterData::ReapCompletions( )
+{
+    uint32_t head = *CqHead;
+    uint32_t tail = __atomic_load_n( CqTail, __ATOMIC_ACQUIRE );
+    bool     ret  = ( head != tail );
+
+    if ( ret )
+    {
+        lock_guard<mutex> lock( PoolGuard );
+
+        while ( head != tail )
+        {
+            const struct io_uring_cqe* cqe         = &Cqes[head & *CqMask];
+            uint32_t                   bufferIndex = static_cast<uint32_t>( cqe->user_data >> 32 );
+            uint32_t                   size        = static_cast<uint32_t>( cqe->user_data );
+
+            if ( ( cqe->res > 0 ) && ( static_cast<uint32_t>( cqe->res ) < size ) )
+            {
+                WriteRequest& request = RingRequests[bufferIndex];
+
+                request.Offset             += static_cast<uint32_t>( cqe->res );
+                request.Size               -= static_cast<uint32_t>( cqe->res );
+                RingWritten[bufferIndex]   += static_cast<uint32_t>( cqe->res );
+                BytesWritten               += static_cast<uint64_t>( cqe->res );
+
+                ShortWrites.push_back( bufferIndex );
+            }
+            else
+            {
+                ReleaseBuffer( bufferIndex, cqe->res, size );
+            }
+            head++;
+        }
+
+        __atomic_store_n( CqHead, head, __ATOMIC_RELEASE );
+    }
+
+    return ret;
+}
+
+// Wait up to the specified time for completions and reap them
+bool XAsyncFileWriterData::WaitForCompletions( uint32_t msec )
+{
+    struct pollfd pfd;
+
+    // ring's file descriptor gets readable when completion queue is not empty
+    pfd.fd      = Ring;
+    pfd.events  = POLLIN;
+    pfd.revents = 0;
+
+    poll( &pfd, 1, static_cast<int>( msec ) );
+
+    return ReapCompletions( );
+}
+
+#endif // HAVE_IO_URING
+
+} // namespace Private
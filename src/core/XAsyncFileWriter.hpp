@@ -0,0 +1,99 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XASYNC_FILE_WRITER_HPP
+#define XASYNC_FILE_WRITER_HPP
+
+#include <stdint.h>
+
+#include "XInterfaces.hpp"
+#include "XError.hpp"
+
+namespace Private
+{
+    class XAsyncFileWriterData;
+}
+
+/* Writes data to files asynchronously, so the caller does not wait for disk.
+
+   Data must be put into buffers taken from the writer's pool (allocated once, aligned to
+   file system block size). A queued buffer is owned by the writer till the write completes,
+   after which it goes back to the pool. So the pool size limits the amount of data in flight -
+   when all buffers are busy, AcquireBuffer() waits for completions.
+
+   On Linux, io_uring is used if the kernel supports it - buffers are registered with the ring
+   and queued writes are sent to kernel in batches by Submit(). Otherwise (or if asked), writes
+   are done by a pool of threads using pwrite().
+
+   Writes are done at explicit offsets, so they may complete in any order. Other than
+   completion of buffers, the writer's methods are expected to be called from a single thread.
+*/
+class XAsyncFileWriter : private Uncopyable
+{
+public:
+    enum class Backend
+    {
+        None,
+        IoUring,
+        ThreadPool
+    };
+
+public:
+    XAsyncFileWriter( uint32_t buffersCount = 16, uint32_t bufferSize = 256 * 1024 );
+    ~XAsyncFileWriter( );
+
+    // Get/Set if thread pool must be used even when io_uring is available.
+    // Setting is only possible when writer is not running.
+    bool ForceThreadPool( ) const;
+    XAsyncFileWriter& SetForceThreadPool( bool force );
+
+    // Start the writer (allocating buffers and initializing the backend) / stop it, waiting for queued writes
+    bool Start( );
+    void Stop( );
+
+    // Backend used by the running writer
+    Backend ActiveBackend( ) const;
+
+    // Size of every buffer in the pool
+    uint32_t BufferSize( ) const;
+
+    // Get free buffer from the pool, waiting up to the specified time (milliseconds) for earlier
+    // writes to complete. Returns nullptr if no buffer got available.
+    uint8_t* AcquireBuffer( uint32_t msec );
+    // Put buffer back into the pool without writing it
+    void ReleaseBuffer( uint8_t* buffer );
+
+    // Queue writing of the buffer's data to the file at the specified offset. The buffer goes back
+    // to the pool once the write is done.
+    XError QueueWrite( int file, uint8_t* buffer, uint32_t size, uint64_t offset );
+    // Send all queued writes to the backend
+    void Submit( );
+    // Wait till all queued writes complete
+    void WaitForCompletion( );
+
+    // Number of writes, which failed or were incomplete, and the number of written bytes
+    uint32_t WriteErrors( ) const;
+    uint64_t BytesWritten( ) const;
+
+private:
+    Private::XAsyncFileWriterData* mData;
+};
+
+#endif // XASYNC_FILE_WRITER_HPP
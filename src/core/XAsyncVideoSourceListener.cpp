@@ -0,0 +1,301 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#include "XAsyncVideoSourceListener.hpp"
+
+using namespace std;
+
+namespace Private
+{
+    // Image queued for the listener
+    class QueuedImage
+    {
+    public:
+        shared_ptr<XImage> Image;
+        uint64_t           Sequence;
+
+    public:
+        QueuedImage( ) : Image( ), Sequence( 0 ) { }
+    };
+
+    // Error queued for the listener
+    class QueuedError
+    {
+    public:
+        string             Message;
+        bool               Fatal;
+        uint64_t           Sequence;
+
+    public:
+        QueuedError( const string& message, bool fatal, uint64_t sequence ) :
+            Message( message ), Fatal( fatal ), Sequence( sequence ) { }
+    };
+
+    class XAsyncVideoSourceListenerData
+    {
+    public:
+        IVideoSourceListener*   Listener;
+        XQueueOverflowPolicy    Policy;
+        mutable mutex           Sync;
+        condition_variable      NotEmpty;
+        condition_variable      NotFull;
+        // bounded queue of images
+        vector<QueuedImage>     Queue;
+        uint32_t                QueueHead;
+        uint32_t                QueueCount;
+        // errors are rare and are never dropped, so they are kept aside in unbounded queue
+        deque<QueuedError>      Errors;
+        // image to copy new frame into (outside of the lock), swapped with the one it replaces in the queue
+        shared_ptr<XImage>      SpareImage;
+        // events are delivered in the order of their sequence numbers
+        uint64_t                NextSequence;
+        uint32_t                FramesDelivered;
+        uint32_t                FramesDropped;
+        bool                    NeedToStop;
+        thread                  WorkerThread;
+
+    public:
+        XAsyncVideoSourceListenerData( IVideoSourceListener* listener, uint32_t queueSize, XQueueOverflowPolicy policy ) :
+            Listener( listener ), Policy( policy ), Sync( ), NotEmpty( ), NotFull( ),
+            Queue( ( queueSize == 0 ) ? 1 : queueSize ), QueueHead( 0 ), QueueCount( 0 ), Errors( ), SpareImage( ),
+            NextSequence( 0 ), FramesDelivered( 0 ), FramesDropped( 0 ), NeedToStop( false ), WorkerThread( )
+        {
+            WorkerThread = thread( WorkerThreadHandler, this );
+        }
+
+        ~XAsyncVideoSourceListenerData( )
+        {
+            {
+                lock_guard<mutex> lock( Sync );
+                NeedToStop = true;
+            }
+
+            NotEmpty.notify_all( );
+            NotFull.notify_all( );
+
+            if ( WorkerThread.joinable( ) )
+            {
+                WorkerThread.join( );
+            }
+        }
+
+        QueuedImage* ReserveSlot( unique_lock<mutex>& lock, bool wait );
+
+        static void WorkerThreadHandler( XAsyncVideoSourceListenerData* me );
+    };
+}
+
+XAsyncVideoSourceListener::XAsyncVideoSourceListener( IVideoSourceListener* listener, uint32_t queueSize, XQueueOverflowPolicy policy ) :
+    mData( new Private::XAsyncVideoSourceListenerData( listener, queueSize, policy ) )
+{
+}
+
+XAsyncVideoSourceListener::~XAsyncVideoSourceListener( )
+{
+    delete mData;
+}
+
+// New video frame notification - queue a copy of the image
+void XAsyncVideoSourceListener::OnNewImage( const shared_ptr<const XImage>& image )
+{
+    unique_lock<mutex> lock( mData->Sync );
+    shared_ptr<XImage> copy;
+
+    // with Block policy wait for a free slot before spending time on copying
+    if ( ( mData->Policy == XQueueOverflowPolicy::Block ) && ( mData->ReserveSlot( lock, true ) == nullptr ) )
+    {
+        mData->FramesDropped++;
+        return;
+    }
+
+    copy.swap( mData->SpareImage );
+    lock.unlock( );
+
+    // spare image is re-used if the size/format did not change
+    XError copyError = image->CopyDataOrClone( copy );
+
+    lock.lock( );
+
+    Private::QueuedImage* slot = ( copyError == XError::Success ) ? mData->ReserveSlot( lock, true ) : nullptr;
+
+    if ( slot == nullptr )
+    {
+        mData->FramesDropped++;
+    }
+    else
+    {
+        // the image previously kept in the slot becomes the spare one
+        slot->Image.swap( copy );
+        slot->Sequence = mData->NextSequence++;
+
+        mData->QueueCount++;
+        mData->NotEmpty.notify_one( );
+    }
+
+    if ( !mData->SpareImage )
+    {
+        mData->SpareImage.swap( copy );
+    }
+}
+
+// Video source error notification - queue the error
+void XAsyncVideoSourceListener::OnError( const string& errorMessage, bool fatal )
+{
+    lock_guard<mutex> lock( mData->Sync );
+
+    if ( !mData->NeedToStop )
+    {
+        mData->Errors.push_back( Private::QueuedError( errorMessage, fatal, mData->NextSequence++ ) );
+        mData->NotEmpty.notify_one( );
+    }
+}
+
+// Number of events currently waiting in the queue
+uint32_t XAsyncVideoSourceListener::QueueDepth( ) const
+{
+    lock_guard<mutex> lock( mData->Sync );
+    return mData->QueueCount + static_cast<uint32_t>( mData->Errors.size( ) );
+}
+
+// Maximum number of images the queue can hold
+uint32_t XAsyncVideoSourceListener::QueueSize( ) const
+{
+    return static_cast<uint32_t>( mData->Queue.size( ) );
+}
+
+// Number of images passed to the listener
+uint32_t XAsyncVideoSourceListener::FramesDelivered( ) const
+{
+    lock_guard<mutex> lock( mData->Sync );
+    return mData->FramesDelivered;
+}
+
+// Number of images dropped due to queue overflow
+uint32_t XAsyncVideoSourceListener::FramesDropped( ) const
+{
+    lock_guard<mutex> lock( mData->Sync );
+    return mData->FramesDropped;
+}
+
+namespace Private
+{
+
+// Find free slot at the tail of the image queue, making room in it according to the overflow policy
+QueuedImage* XAsyncVideoSourceListenerData::ReserveSlot( unique_lock<mutex>& lock, bool wait )
+{
+    uint32_t     queueSize = static_cast<uint32_t>( Queue.size( ) );
+    QueuedImage* slot      = nullptr;
+
+    if ( QueueCount == queueSize )
+    {
+        if ( Policy == XQueueOverflowPolicy::DropOldest )
+        {
+            QueueHead = ( QueueHead + 1 ) % queueSize;
+            QueueCount--;
+            FramesDropped++;
+        }
+        else if ( ( Policy == XQueueOverflowPolicy::Block ) && ( wait ) )
+        {
+            while ( ( QueueCount == queueSize ) && ( !NeedToStop ) )
+            {
+                NotFull.wait( lock );
+            }
+        }
+    }
+
+    if ( ( QueueCount < queueSize ) && ( !NeedToStop ) )
+    {
+        slot = &Queue[( QueueHead + QueueCount ) % queueSize];
+    }
+
+    return slot;
+}
+
+// Thread passing queued events to the listener
+void XAsyncVideoSourceListenerData::WorkerThreadHandler( XAsyncVideoSourceListenerData* me )
+{
+    unique_lock<mutex> lock( me->Sync );
+    shared_ptr<XImage> image;
+    string             errorMessage;
+    uint32_t           queueSize = static_cast<uint32_t>( me->Queue.size( ) );
+
+    while ( true )
+    {
+        while ( ( me->QueueCount == 0 ) && ( me->Errors.empty( ) ) && ( !me->NeedToStop ) )
+        {
+            me->NotEmpty.wait( lock );
+        }
+
+        if ( me->NeedToStop )
+        {
+            break;
+        }
+
+        // take the earliest event - either error or image
+        bool isError = ( !me->Errors.empty( ) ) &&
+                       ( ( me->QueueCount == 0 ) || ( me->Errors.front( ).Sequence < me->Queue[me->QueueHead].Sequence ) );
+        bool fatal   = false;
+
+        if ( isError )
+        {
+            errorMessage.swap( me->Errors.front( ).Message );
+            fatal = me->Errors.front( ).Fatal;
+            me->Errors.pop_front( );
+        }
+        else
+        {
+            // swap buffers, so no image data is copied
+            image.swap( me->Queue[me->QueueHead].Image );
+
+            me->QueueHead = ( me->QueueHead + 1 ) % queueSize;
+            me->QueueCount--;
+            me->NotFull.notify_one( );
+        }
+
+        lock.unlock( );
+
+        if ( me->Listener != nullptr )
+        {
+            if ( isError )
+            {
+                me->Listener->OnError( errorMessage, fatal );
+            }
+            else
+            {
+                me->Listener->OnNewImage( image );
+            }
+        }
+
+        lock.lock( );
+
+        if ( !isError )
+        {
+            me->FramesDelivered++;
+        }
+    }
+}
+
+} // namespace Private
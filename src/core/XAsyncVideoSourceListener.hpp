@@ -0,0 +1,75 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XASYNC_VIDEO_SOURCE_LISTENER_HPP
+#define XASYNC_VIDEO_SOURCE_LISTENER_HPP
+
+#include <stdint.h>
+
+#include "XInterfaces.hpp"
+#include "IVideoSourceListener.hpp"
+
+namespace Private
+{
+    class XAsyncVideoSourceListenerData;
+}
+
+// What to do with a new event if listener's queue is full
+enum class XQueueOverflowPolicy
+{
+    DropOldest = 0, // discard the oldest queued event
+    DropNewest,     // discard the new event
+    Block           // wait until listener takes something from the queue
+};
+
+/* Video source listener, which passes all events to another listener on a dedicated thread.
+
+   Every image is put into a bounded queue and the source's thread returns immediately (unless
+   Block policy is used), so a slow listener does not delay video source or other listeners.
+   Queued images are copies, which are made outside of the queue's lock into buffers re-used once
+   frame size settles. Errors are never dropped by overflow policy - they are queued separately and
+   delivered in their order relative to images.
+*/
+class XAsyncVideoSourceListener : public IVideoSourceListener, private Uncopyable
+{
+public:
+    XAsyncVideoSourceListener( IVideoSourceListener* listener, uint32_t queueSize = 2,
+                               XQueueOverflowPolicy policy = XQueueOverflowPolicy::DropOldest );
+    ~XAsyncVideoSourceListener( );
+
+    // New video frame notification - queue a copy of the image
+    void OnNewImage( const std::shared_ptr<const XImage>& image );
+    // Video source error notification - queue the error
+    void OnError( const std::string& errorMessage, bool fatal );
+
+    // Number of events currently waiting in the queue
+    uint32_t QueueDepth( ) const;
+    // Maximum number of images the queue can hold
+    uint32_t QueueSize( ) const;
+    // Number of images passed to the listener
+    uint32_t FramesDelivered( ) const;
+    // Number of images dropped due to queue overflow
+    uint32_t FramesDropped( ) const;
+
+private:
+    Private::XAsyncVideoSourceListenerData* mData;
+};
+
+#endif // XASYNC_VIDEO_SOURCE_LISTENER_HPP
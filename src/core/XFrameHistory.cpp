@@ -0,0 +1,625 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <map>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <vector>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "XFrameHistory.hpp"
+#include "XManualResetEvent.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace Private
+{
+    // Expected minimum average size of JPEG frames, which defines capacity of frames' index
+    #define MIN_AVERAGE_FRAME_SIZE  (4096)
+    #define MIN_INDEX_CAPACITY      (16)
+
+    // Maximum time to wait before checking if next frame of history stream is due
+    #define MAX_REPLAY_TIMER        (100)
+
+    // Description of a frame stored in the history's arena
+    struct FrameEntry
+    {
+        uint32_t Id;
+        uint32_t Offset;
+        uint32_t Size;
+        uint64_t Time;
+    };
+
+    // Web request handler providing frames from history
+    class HistoryRequestHandler : public IWebRequestHandler
+    {
+    private:
+        struct Playback
+        {
+            uint32_t                 NextFrameId;
+            uint64_t                 EndTime;
+            uint64_t                 FirstFrameTime;
+            steady_clock::time_point StartTime;
+            bool                     Finished;
+        };
+
+        XFrameHistoryData*          Owner;
+        map<uintptr_t, Playback>    Clients;
+
+    public:
+        HistoryRequestHandler( const string& uri, XFrameHistoryData* owner ) :
+            IWebRequestHandler( uri, false ), Owner( owner ), Clients( )
+        {
+        }
+
+        void HandleHttpRequest( const IWebRequest& request, IWebResponse& response );
+        void HandleTimer( IWebResponse& response );
+        void HandleConnectionClosed( IWebResponse& response );
+
+    private:
+        static bool ParseTime( const string& str, uint64_t now, uint64_t* time );
+    };
+
+    class XFrameHistoryData
+    {
+    public:
+        XVideoSourceToWeb&      Video2Web;
+        uint32_t                MemoryBudget;
+        uint32_t                FrameInterval;
+        recursive_mutex         StartSync;
+        thread                  CollectorThread;
+        XManualResetEvent       NeedToStop;
+        bool                    IsRunning;
+
+        // frames are kept in a single arena and described by circular index sorted by time
+        mutable mutex           HistoryGuard;
+        uint8_t*                Arena;
+        uint32_t                ArenaSize;
+        uint32_t                WritePosition;
+        vector<FrameEntry>      Frames;
+        uint32_t                FirstFrame;
+        uint32_t                FramesCount;
+        uint32_t                NextFrameId;
+
+        uint8_t*                JpegBuffer;
+        uint32_t                JpegBufferSize;
+        uint32_t                JpegSize;
+        uint32_t                LastSequence;
+
+    public:
+        XFrameHistoryData( XVideoSourceToWeb& video2web, uint32_t memoryBudget, uint32_t frameRate ) :
+            Video2Web( video2web ), MemoryBudget( memoryBudget ),
+            FrameInterval( 1000 / ( ( frameRate == 0 ) ? 1 : frameRate ) ),
+            StartSync( ), CollectorThread( ), NeedToStop( ), IsRunning( false ),
+            HistoryGuard( ), Arena( nullptr ), ArenaSize( 0 ), WritePosition( 0 ),
+            Frames( ), FirstFrame( 0 ), FramesCount( 0 ), NextFrameId( 1 ),
+            JpegBuffer( nullptr ), JpegBufferSize( 0 ), JpegSize( 0 ), LastSequence( 0 )
+        {
+        }
+
+        ~XFrameHistoryData( )
+        {
+            free( Arena );
+            free( JpegBuffer );
+        }
+
+        bool Start( );
+        void Stop( );
+
+        void AddFrame( const uint8_t* jpeg, uint32_t size, uint64_t time );
+        const FrameEntry* FindFrame( uint64_t time ) const;
+        const FrameEntry* FrameById( uint32_t id ) const;
+        const FrameEntry* OldestFrame( ) const;
+        const FrameEntry* NewestFrame( ) const;
+
+        static uint64_t Now( );
+
+    private:
+        void CollectFrame( );
+
+        static void CollectorThreadHandler( XFrameHistoryData* me );
+    };
+}
+
+XFrameHistory::XFrameHistory( XVideoSourceToWeb& video2web, uint32_t memoryBudget, uint32_t frameRate ) :
+    mData( new Private::XFrameHistoryData( video2web, memoryBudget, frameRate ) )
+{
+}
+
+XFrameHistory::~XFrameHistory( )
+{
+    mData->Stop( );
+    delete mData;
+}
+
+// Start collecting images
+bool XFrameHistory::Start( )
+{
+    return mData->Start( );
+}
+
+// Stop collecting images
+void XFrameHistory::Stop( )
+{
+    mData->Stop( );
+}
+
+// Number of frames currently kept
+uint32_t XFrameHistory::FramesCount( ) const
+{
+    lock_guard<mutex> lock( mData->HistoryGuard );
+    return mData->FramesCount;
+}
+
+// Time of the oldest frame
+uint64_t XFrameHistory::OldestFrameTime( ) const
+{
+    lock_guard<mutex>           lock( mData->HistoryGuard );
+    const Private::FrameEntry*  entry = mData->OldestFrame( );
+
+    return ( entry == nullptr ) ? 0 : entry->Time;
+}
+
+// Time of the newest frame
+uint64_t XFrameHistory::NewestFrameTime( ) const
+{
+    lock_guard<mutex>           lock( mData->HistoryGuard );
+    const Private::FrameEntry*  entry = mData->NewestFrame( );
+
+    return ( entry == nullptr ) ? 0 : entry->Time;
+}
+
+// Get the first frame taken at or after the specified time
+XError XFrameHistory::GetFrame( uint64_t time, uint8_t** buffer, uint32_t* bufferSize, uint32_t* jpegSize, uint64_t* frameTime )
+{
+    XError ret = XError::Success;
+
+    if ( ( buffer == nullptr ) || ( bufferSize == nullptr ) || ( jpegSize == nullptr ) )
+    {
+        ret = XError::NullPointer;
+    }
+    else
+    {
+        lock_guard<mutex>           lock( mData->HistoryGuard );
+        const Private::FrameEntry*  entry = mData->FindFrame( time );
+
+        if ( entry == nullptr )
+        {
+            ret = XError::DeivceNotReady;
+        }
+        else
+        {
+            if ( ( *buffer == nullptr ) || ( *bufferSize < entry->Size ) )
+            {
+                uint8_t* newBuffer = static_cast<uint8_t*>( realloc( *buffer, entry->Size ) );
+
+                if ( newBuffer == nullptr )
+                {
+                    ret = XError::OutOfMemory;
+                }
+                else
+                {
+                    *buffer     = newBuffer;
+                    *bufferSize = entry->Size;
+                }
+            }
+
+            if ( ret )
+            {
+                memcpy( *buffer, mData->Arena + entry->Offset, entry->Size );
+                *jpegSize = entry->Size;
+
+                if ( frameTime != nullptr )
+                {
+                    *frameTime = entry->Time;
+                }
+            }
+        }
+    }
+
+    return ret;
+}
+
+// Create web request handler to provide frames from history
+shared_ptr<IWebRequestHandler> XFrameHistory::CreateHistoryHandler( const string& uri ) const
+{
+    return make_shared<Private::HistoryRequestHandler>( uri, mData );
+}
+
+namespace Private
+{
+
+// Allocate memory for history (if not done yet) and start collecting thread
+bool XFrameHistoryData::Start( )
+{
+    lock_guard<recursive_mutex> lock( StartSync );
+
+    if ( ( !IsRunning ) && ( Arena == nullptr ) )
+    {
+        uint32_t indexCapacity = MemoryBudget / MIN_AVERAGE_FRAME_SIZE;
+
+        Arena = static_cast<uint8_t*>( malloc( MemoryBudget ) );
+
+        if ( Arena != nullptr )
+        {
+            ArenaSize = MemoryBudget;
+            Frames.resize( ( indexCapacity < MIN_INDEX_CAPACITY ) ? MIN_INDEX_CAPACITY : indexCapacity );
+        }
+    }
+
+    if ( ( !IsRunning ) && ( Arena != nullptr ) )
+    {
+        NeedToStop.Reset( );
+        LastSequence = 0;
+        IsRunning    = true;
+
+        CollectorThread = thread( CollectorThreadHandler, this );
+    }
+
+    return IsRunning;
+}
+
+// Stop collecting thread (collected frames are kept)
+void XFrameHistoryData::Stop( )
+{
+    lock_guard<recursive_mutex> lock( StartSync );
+
+    if ( IsRunning )
+    {
+        NeedToStop.Signal( );
+        CollectorThread.join( );
+
+        IsRunning = false;
+    }
+}
+
+// Current time as milliseconds since Unix epoch
+uint64_t XFrameHistoryData::Now( )
+{
+    return static_cast<uint64_t>( duration_cast<milliseconds>( system_clock::now( ).time_since_epoch( ) ).count( ) );
+}
+
+// Thread collecting the latest camera images at the configured frame rate
+void XFrameHistoryData::CollectorThreadHandler( XFrameHistoryData* me )
+{
+    while ( !me->NeedToStop.IsSignaled( ) )
+    {
+        steady_clock::time_point startTime = steady_clock::now( );
+
+        me->CollectFrame( );
+
+        uint32_t timeTaken = static_cast<uint32_t>( duration_cast<milliseconds>( steady_clock::now( ) - startTime ).count( ) );
+
+        me->NeedToStop.Wait( ( timeTaken < me->FrameInterval ) ? me->FrameInterval - timeTaken : 1 );
+    }
+}
+
+// Put the latest image into history (if it was not done yet)
+void XFrameHistoryData::CollectFrame( )
+{
+    uint32_t sequence;
+
+    if ( ( Video2Web.GetJpegImage( &JpegBuffer, &JpegBufferSize, &JpegSize, &sequence ) ) && ( sequence != LastSequence ) )
+    {
+        LastSequence = sequence;
+        AddFrame( JpegBuffer, JpegSize, Now( ) );
+    }
+}
+
+// Copy frame into the arena, overwriting the oldest frames if needed
+void XFrameHistoryData::AddFrame( const uint8_t* jpeg, uint32_t size, uint64_t time )
+{
+    lock_guard<mutex> lock( HistoryGuard );
+    uint32_t          capacity = static_cast<uint32_t>( Frames.size( ) );
+
+    // wall clock may step backwards (NTP), but the index must stay time ordered for FindFrame( )
+    if ( FramesCount != 0 )
+    {
+        uint64_t newestTime = Frames[( FirstFrame + FramesCount - 1 ) % capacity].Time;
+
+        if ( time < newestTime )
+        {
+            time = newestTime;
+        }
+    }
+
+    if ( ( size != 0 ) && ( size <= ArenaSize ) )
+    {
+        if ( WritePosition + size > ArenaSize )
+        {
+            // frames left at the end of arena are the oldest ones, drop them and start from the beginning
+            while ( ( FramesCount != 0 ) && ( Frames[FirstFrame].Offset >= WritePosition ) )
+            {
+                FirstFrame = ( FirstFrame + 1 ) % capacity;
+                FramesCount--;
+            }
+
+            WritePosition = 0;
+        }
+
+        // drop the oldest frames overlapping with the new one or if the index is full
+        while ( ( FramesCount != 0 ) &&
+                ( ( FramesCount == capacity ) ||
+                  ( ( Frames[FirstFrame].Offset < WritePosition + size ) &&
+                    ( Frames[FirstFrame].Offset + Frames[FirstFrame].Size > WritePosition ) ) ) )
+        {
+            FirstFrame = ( FirstFrame + 1 ) % capacity;
+            FramesCount--;
+        }
+
+        FrameEntry& entry = Frames[( FirstFrame + FramesCount ) % capacity];
+
+        entry.Id     = NextFrameId++;
+        entry.Offset = WritePosition;
+        entry.Size   = size;
+        entry.Time   = time;
+
+        memcpy( Arena + WritePosition, jpeg, size );
+
+        WritePosition += size;
+        FramesCount++;
+    }
+}
+
+// Find the first frame taken at or after the specified time (HistoryGuard must be locked)
+const FrameEntry* XFrameHistoryData::FindFrame( uint64_t time ) const
+{
+    uint32_t capacity = static_cast<uint32_t>( Frames.size( ) );
+    uint32_t low      = 0;
+    uint32_t high     = FramesCount;
+
+    // frames are sorted by time, so do binary search
+    while ( low < high )
+    {
+        uint32_t middle = ( low + high ) / 2;
+
+        if ( Frames[( FirstFrame + middle ) % capacity].Time < time )
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    return ( low < FramesCount ) ? &Frames[( FirstFrame + low ) % capacity] : nullptr;
+}
+
+// Get frame with the specified ID if it is still available (HistoryGuard must be locked)
+const FrameEntry* XFrameHistoryData::FrameById( uint32_t id ) const
+{
+    const FrameEntry* entry = nullptr;
+
+    if ( FramesCount != 0 )
+    {
+        // frame IDs are consecutive, so position in the index can be calculated
+        uint32_t position = id - Frames[FirstFrame].Id;
+
+        if ( position < FramesCount )
+        {
+            entry = &Frames[( FirstFrame + position ) % Frames.size( )];
+        }
+    }
+
+    return entry;
+}
+
+// Get the oldest/newest frame (HistoryGuard must be locked)
+const FrameEntry* XFrameHistoryData::OldestFrame( ) const
+{
+    return ( FramesCount == 0 ) ? nullptr : &Frames[FirstFrame];
+}
+const FrameEntry* XFrameHistoryData::NewestFrame( ) const
+{
+    return ( FramesCount == 0 ) ? nullptr : &Frames[( FirstFrame + FramesCount - 1 ) % Frames.size( )];
+}
+
+// Parse time, which is either milliseconds since Unix epoch or (if negative) milliseconds before now
+bool HistoryRequestHandler::ParseTime( const string& str, uint64_t now, uint64_t* time )
+{
+    char*     end   = nullptr;
+    long long value = strtoll( str.c_str( ), &end, 10 );
+    bool      ret   = ( ( !str.empty( ) ) && ( *end == '\0' ) );
+
+    if ( ret )
+    {
+        if ( value >= 0 )
+        {
+            *time = static_cast<uint64_t>( value );
+        }
+        else
+        {
+            *time = ( static_cast<uint64_t>( -value ) > now ) ? 0 : now - static_cast<uint64_t>( -value );
+        }
+    }
+
+    return ret;
+}
+
+// Handle history request - provide description of history, single frame or start replaying frames
+void HistoryRequestHandler::HandleHttpRequest( const IWebRequest& request, IWebResponse& response )
+{
+    string   fromStr = request.GetVariable( "from" );
+    string   toStr   = request.GetVariable( "to" );
+    uint64_t now     = XFrameHistoryData::Now( );
+    uint64_t from    = 0;
+    uint64_t to      = now;
+
+    lock_guard<mutex> lock( Owner->HistoryGuard );
+
+    if ( fromStr.empty( ) )
+    {
+        const FrameEntry* oldest = Owner->OldestFrame( );
+        const FrameEntry* newest = Owner->NewestFrame( );
+        char              reply[256];
+
+        int length = snprintf( reply, sizeof( reply ), "{\"status\":\"OK\",\"history\":{\"frames\":%u,\"oldest\":%llu,\"newest\":%llu,\"now\":%llu}}",
+                               Owner->FramesCount,
+                               static_cast<unsigned long long>( ( oldest == nullptr ) ? 0 : oldest->Time ),
+                               static_cast<unsigned long long>( ( newest == nullptr ) ? 0 : newest->Time ),
+                               static_cast<unsigned long long>( now ) );
+
+        response.Printf( "HTTP/1.1 200 OK\r\n"
+                         "Content-Type: application/json\r\n"
+                         "Content-Length: %d\r\n"
+                         "Cache-Control: no-store, must-revalidate\r\nPragma: no-cache\r\nExpires: 0\r\n"
+                         "\r\n"
+                         "%s", length, reply );
+    }
+    else if ( ( !ParseTime( fromStr, now, &from ) ) || ( ( !toStr.empty( ) ) && ( !ParseTime( toStr, now, &to ) ) ) )
+    {
+        response.SendError( 400, "Invalid time" );
+    }
+    else
+    {
+        const FrameEntry* entry = Owner->FindFrame( from );
+
+        if ( ( entry == nullptr ) || ( entry->Time > to ) )
+        {
+            response.SendError( 404, "No frames for the specified time" );
+        }
+        else if ( request.GetVariable( "format" ) == "jpeg" )
+        {
+            response.Printf( "HTTP/1.1 200 OK\r\n"
+                             "Content-Type: image/jpeg\r\n"
+                             "Content-Length: %u\r\n"
+                             "X-Frame-Time: %llu\r\n"
+                             "Cache-Control: no-store, must-revalidate\r\nPragma: no-cache\r\nExpires: 0\r\n"
+                             "\r\n", entry->Size, static_cast<unsigned long long>( entry->Time ) );
+
+            response.Send( Owner->Arena + entry->Offset, entry->Size );
+        }
+        else
+        {
+            Playback& client = Clients[response.ConnectionId( )];
+
+            client.NextFrameId    = entry->Id + 1;
+            client.EndTime        = to;
+            client.FirstFrameTime = entry->Time;
+            client.StartTime      = steady_clock::now( );
+            client.Finished       = false;
+
+            response.Printf( "HTTP/1.1 200 OK\r\n"
+                             "Cache-Control: no-store, must-revalidate\r\nPragma: no-cache\r\nExpires: 0\r\n"
+                             "Connection: close\r\n"
+                             "Content-Type: multipart/x-mixed-replace; boundary=--myboundary\r\n"
+                             "\r\n" );
+
+            response.Printf( "--myboundary\r\n"
+                             "Content-Type: image/jpeg\r\n"
+                             "Content-Length: %u\r\n"
+                             "X-Frame-Time: %llu\r\n"
+                             "\r\n", entry->Size, static_cast<unsigned long long>( entry->Time ) );
+
+            response.Send( Owner->Arena + entry->Offset, entry->Size );
+
+            response.SetTimer( 1 );
+        }
+    }
+}
+
+// Timer event for the connection replaying history - provide next frame when it is due
+void HistoryRequestHandler::HandleTimer( IWebResponse& response )
+{
+    map<uintptr_t, Playback>::iterator it = Clients.find( response.ConnectionId( ) );
+
+    if ( it == Clients.end( ) )
+    {
+        response.CloseConnection( );
+    }
+    else
+    {
+        Playback&         client = it->second;
+        lock_guard<mutex> lock( Owner->HistoryGuard );
+        const FrameEntry* entry  = Owner->FrameById( client.NextFrameId );
+        uint32_t          delay  = MAX_REPLAY_TIMER;
+
+        if ( ( entry == nullptr ) && ( Owner->FramesCount != 0 ) && ( client.NextFrameId - Owner->OldestFrame( )->Id > 0x7FFFFFFF ) )
+        {
+            // frame was overwritten while replaying slow - continue from the oldest available
+            entry = Owner->OldestFrame( );
+            client.NextFrameId    = entry->Id;
+            client.FirstFrameTime = entry->Time -
+                static_cast<uint64_t>( duration_cast<milliseconds>( steady_clock::now( ) - client.StartTime ).count( ) );
+        }
+
+        if ( ( ( entry != nullptr ) && ( entry->Time > client.EndTime ) ) ||
+             ( ( entry == nullptr ) && ( XFrameHistoryData::Now( ) > client.EndTime ) ) )
+        {
+            // next frame is out of the requested period (or will be, when it arrives)
+            entry           = nullptr;
+            client.Finished = true;
+        }
+
+        if ( entry != nullptr )
+        {
+            uint64_t elapsed = static_cast<uint64_t>( duration_cast<milliseconds>( steady_clock::now( ) - client.StartTime ).count( ) );
+            uint64_t dueTime = entry->Time - client.FirstFrameTime;
+
+            // keep original timing of frames, but don't try sending too much on slow connections
+            if ( ( dueTime <= elapsed ) && ( response.ToSendDataLength( ) < 2 * entry->Size ) )
+            {
+                response.Printf( "--myboundary\r\n"
+                                 "Content-Type: image/jpeg\r\n"
+                                 "Content-Length: %u\r\n"
+                                 "X-Frame-Time: %llu\r\n"
+                                 "\r\n", entry->Size, static_cast<unsigned long long>( entry->Time ) );
+
+                response.Send( Owner->Arena + entry->Offset, entry->Size );
+
+                client.NextFrameId++;
+                delay = 1;
+            }
+            else if ( dueTime > elapsed )
+            {
+                delay = static_cast<uint32_t>( dueTime - elapsed );
+                if ( delay > MAX_REPLAY_TIMER )
+                {
+                    delay = MAX_REPLAY_TIMER;
+                }
+            }
+        }
+
+        if ( ( client.Finished ) && ( response.ToSendDataLength( ) == 0 ) )
+        {
+            // all frames of the requested period are sent
+            Clients.erase( it );
+            response.CloseConnection( );
+        }
+        else
+        {
+            response.SetTimer( delay );
+        }
+    }
+}
+
+// Connection replaying history has gone
+void HistoryRequestHandler::HandleConnectionClosed( IWebResponse& response )
+{
+    Clients.erase( response.ConnectionId( ) );
+}
+
+} // namespace Private
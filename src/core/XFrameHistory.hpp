@@ -0,0 +1,77 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XFRAME_HISTORY_HPP
+#define XFRAME_HISTORY_HPP
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+
+#include "XInterfaces.hpp"
+#include "XError.hpp"
+#include "XVideoSourceToWeb.hpp"
+#include "XWebServer.hpp"
+
+namespace Private
+{
+    class XFrameHistoryData;
+}
+
+/* Keeps the most recent camera images (JPEGs taken from XVideoSourceToWeb) in memory, so it
+   is possible to look at what happened few seconds/minutes ago.
+
+   Frames are stored one after another in a single memory arena of the specified size, which
+   is allocated once. When the arena (or the index of frames) is full, the oldest frames are
+   overwritten. So the amount of kept history depends on the memory budget, frame rate and
+   size of JPEGs. Frame time is milliseconds since Unix epoch.
+
+   Note: images are taken all the time while history is running, so camera in on-demand
+   mode is kept running as well.
+*/
+class XFrameHistory : private Uncopyable
+{
+public:
+    XFrameHistory( XVideoSourceToWeb& video2web, uint32_t memoryBudget = 64 * 1024 * 1024, uint32_t frameRate = 30 );
+    ~XFrameHistory( );
+
+    // Start/Stop collecting images
+    bool Start( );
+    void Stop( );
+
+    // Number of frames currently kept and time of the oldest/newest frame (0 if there are no frames)
+    uint32_t FramesCount( ) const;
+    uint64_t OldestFrameTime( ) const;
+    uint64_t NewestFrameTime( ) const;
+
+    // Get the first frame taken at or after the specified time. The buffer is (re)allocated with
+    // realloc() if it is too small.
+    XError GetFrame( uint64_t time, uint8_t** buffer, uint32_t* bufferSize, uint32_t* jpegSize, uint64_t* frameTime = nullptr );
+
+    // Create web request handler to provide frames from history. Without "from" variable it provides
+    // JSON description of the history. Otherwise either a single JPEG or MJPEG stream replaying frames
+    // from the specified time with their original timing.
+    std::shared_ptr<IWebRequestHandler> CreateHistoryHandler( const std::string& uri ) const;
+
+private:
+    Private::XFrameHistoryData* mData;
+};
+
+#endif // XFRAME_HISTORY_HPP
@@ -91,6 +91,22 @@ shared_ptr<XImage> XImage::Create( uint8_t* data, int32_t width, int32_t height,
     return shared_ptr<XImage>( new (nothrow) XImage( data, width, height, stride, format, false ) );
 }
 
+// Create image wrapping rectangular part of this image
+shared_ptr<XImage> XImage::SubImage( int32_t x, int32_t y, int32_t width, int32_t height ) const
+{
+    shared_ptr<XImage> subImage;
+
+    if ( ( mData != nullptr ) && ( mFormat != XPixelFormat::JPEG ) && ( x >= 0 ) && ( y >= 0 ) &&
+         ( width > 0 ) && ( height > 0 ) && ( x + width <= mWidth ) && ( y + height <= mHeight ) )
+    {
+        uint8_t* data = mData + y * mStride + ( ( x * XImageBitsPerPixel( mFormat ) ) >> 3 );
+
+        subImage = shared_ptr<XImage>( new (nothrow) XImage( data, width, height, mStride, mFormat, false ) );
+    }
+
+    return subImage;
+}
+
 // Clone image - make a deep copy of it
 shared_ptr<XImage> XImage::Clone( ) const
 {
@@ -145,6 +161,12 @@ XError XImage::CopyData( const shared_ptr<XImage>& copyTo ) const
             srcPtr += mStride;
             dstPtr += dstStride;
         }
+
+        // width of JPEG images is the size of encoded data, so update it to match the copied image
+        if ( mFormat == XPixelFormat::JPEG )
+        {
+            copyTo->mWidth = mWidth;
+        }
     }
 
     return ret;
@@ -58,6 +58,10 @@ public:
     // Create image by wrapping existing memory buffer
     static std::shared_ptr<XImage> Create( uint8_t* data, int32_t width, int32_t height, int32_t stride, XPixelFormat format );
 
+    // Create image wrapping rectangular part of this image (no data are copied, so this image must stay alive
+    // while the sub-image is used). Not supported for JPEG images.
+    std::shared_ptr<XImage> SubImage( int32_t x, int32_t y, int32_t width, int32_t height ) const;
+
     // Clone image - make a deep copy of it
     std::shared_ptr<XImage> Clone( ) const;
     // Copy content of the image - destination image must have same width/height/format
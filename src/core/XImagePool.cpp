@@ -0,0 +1,127 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <vector>
+#include <mutex>
+
+#include "XImagePool.hpp"
+
+using namespace std;
+
+namespace Private
+{
+    class XImagePoolData
+    {
+    public:
+        uint32_t                   MaxImages;
+        mutable mutex              Sync;
+        vector<shared_ptr<XImage>> Images;
+
+    public:
+        XImagePoolData( uint32_t maxImages ) :
+            MaxImages( maxImages ), Sync( ), Images( )
+        {
+            Images.reserve( maxImages );
+        }
+    };
+}
+
+XImagePool::XImagePool( uint32_t maxImages ) :
+    mData( new Private::XImagePoolData( maxImages ) )
+{
+}
+
+XImagePool::~XImagePool( )
+{
+    delete mData;
+}
+
+// Get an image of the specified size and format, which is not used by anyone
+shared_ptr<XImage> XImagePool::Acquire( int32_t width, int32_t height, XPixelFormat format )
+{
+    lock_guard<mutex>  lock( mData->Sync );
+    shared_ptr<XImage> image;
+    size_t             unusedIndex = mData->Images.size( );
+
+    for ( size_t i = 0; i < mData->Images.size( ); i++ )
+    {
+        shared_ptr<XImage>& candidate = mData->Images[i];
+
+        // pool keeps one reference, so the image is free if nobody else has it
+        if ( candidate.use_count( ) == 1 )
+        {
+            if ( ( candidate->Width( ) == width ) && ( candidate->Height( ) == height ) && ( candidate->Format( ) == format ) )
+            {
+                image = candidate;
+                break;
+            }
+
+            unusedIndex = i;
+        }
+    }
+
+    if ( !image )
+    {
+        image = XImage::Allocate( width, height, format );
+
+        if ( image )
+        {
+            if ( unusedIndex != mData->Images.size( ) )
+            {
+                // replace an unused image of different size/format
+                mData->Images[unusedIndex] = image;
+            }
+            else if ( mData->Images.size( ) < mData->MaxImages )
+            {
+                mData->Images.push_back( image );
+            }
+            else
+            {
+                image.reset( );
+            }
+        }
+    }
+
+    return image;
+}
+
+// Release all images not used by anyone
+void XImagePool::Clear( )
+{
+    lock_guard<mutex> lock( mData->Sync );
+    vector<shared_ptr<XImage>> usedImages;
+
+    for ( const auto& image : mData->Images )
+    {
+        if ( image.use_count( ) > 1 )
+        {
+            usedImages.push_back( image );
+        }
+    }
+
+    mData->Images.swap( usedImages );
+}
+
+// Number of images allocated by the pool
+uint32_t XImagePool::Size( ) const
+{
+    lock_guard<mutex> lock( mData->Sync );
+    return static_cast<uint32_t>( mData->Images.size( ) );
+}
@@ -0,0 +1,60 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XIMAGE_POOL_HPP
+#define XIMAGE_POOL_HPP
+
+#include <stdint.h>
+#include <memory>
+
+#include "XInterfaces.hpp"
+#include "XImage.hpp"
+
+namespace Private
+{
+    class XImagePoolData;
+}
+
+/* Pool of images to avoid memory allocation for every processed video frame.
+
+   An image taken from the pool is considered to be in use while anyone holds a reference to it.
+   Once all references are released, the image can be handed out again for the same size/format.
+*/
+class XImagePool : private Uncopyable
+{
+public:
+    XImagePool( uint32_t maxImages = 8 );
+    ~XImagePool( );
+
+    // Get an image of the specified size and format, which is not used by anyone.
+    // Returns empty pointer if all images are in use and pool's limit is reached.
+    std::shared_ptr<XImage> Acquire( int32_t width, int32_t height, XPixelFormat format );
+
+    // Release all images not used by anyone
+    void Clear( );
+
+    // Number of images allocated by the pool
+    uint32_t Size( ) const;
+
+private:
+    Private::XImagePoolData* mData;
+};
+
+#endif // XIMAGE_POOL_HPP
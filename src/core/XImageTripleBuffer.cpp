@@ -0,0 +1,139 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <atomic>
+
+#include "XImageTripleBuffer.hpp"
+
+using namespace std;
+
+namespace Private
+{
+    // Middle buffer's state: index of the buffer and a flag telling if it holds unread image
+    #define INDEX_MASK  (3)
+    #define DIRTY_FLAG  (4)
+
+    class XImageTripleBufferData
+    {
+    public:
+        shared_ptr<XImage> Buffers[3];
+        uint32_t           Sequences[3];
+
+        // owned by producer
+        uint32_t           BackIndex;
+        // owned by consumer
+        uint32_t           FrontIndex;
+        // shared
+        atomic<uint32_t>   MiddleState;
+
+        atomic<uint32_t>   Published;
+        atomic<uint32_t>   Skipped;
+
+    public:
+        XImageTripleBufferData( ) :
+            Buffers( ), Sequences( ), BackIndex( 0 ), FrontIndex( 1 ), MiddleState( 2 ),
+            Published( 0 ), Skipped( 0 )
+        {
+        }
+    };
+}
+
+XImageTripleBuffer::XImageTripleBuffer( ) :
+    mData( new Private::XImageTripleBufferData( ) )
+{
+}
+
+XImageTripleBuffer::~XImageTripleBuffer( )
+{
+    delete mData;
+}
+
+// Producer side: copy the specified image and make it the latest one
+XError XImageTripleBuffer::Publish( const shared_ptr<const XImage>& image )
+{
+    XError ret = XError::NullPointer;
+
+    if ( image )
+    {
+        ret = image->CopyDataOrClone( mData->Buffers[mData->BackIndex] );
+
+        if ( ret == XError::Success )
+        {
+            uint32_t sequence = mData->Published.fetch_add( 1, memory_order_relaxed ) + 1;
+
+            mData->Sequences[mData->BackIndex] = sequence;
+
+            // swap back and middle buffers, marking the new middle one as not read yet
+            uint32_t oldState = mData->MiddleState.exchange( mData->BackIndex | DIRTY_FLAG, memory_order_acq_rel );
+
+            mData->BackIndex = oldState & INDEX_MASK;
+
+            if ( ( oldState & DIRTY_FLAG ) != 0 )
+            {
+                mData->Skipped.fetch_add( 1, memory_order_relaxed );
+            }
+        }
+    }
+
+    return ret;
+}
+
+// Consumer side: check if there is an image, which was not yet acquired
+bool XImageTripleBuffer::IsNewImageAvailable( ) const
+{
+    return ( ( mData->MiddleState.load( memory_order_acquire ) & DIRTY_FLAG ) != 0 );
+}
+
+// Consumer side: get the latest image if it was not acquired yet
+bool XImageTripleBuffer::Acquire( shared_ptr<XImage>& image, uint32_t* sequence )
+{
+    bool ret = false;
+
+    if ( IsNewImageAvailable( ) )
+    {
+        // swap front and middle buffers, marking the new middle one as read
+        uint32_t oldState = mData->MiddleState.exchange( mData->FrontIndex, memory_order_acq_rel );
+
+        mData->FrontIndex = oldState & INDEX_MASK;
+
+        image = mData->Buffers[mData->FrontIndex];
+
+        if ( sequence != nullptr )
+        {
+            *sequence = mData->Sequences[mData->FrontIndex];
+        }
+
+        ret = true;
+    }
+
+    return ret;
+}
+
+// Number of images published so far
+uint32_t XImageTripleBuffer::ImagesPublished( ) const
+{
+    return mData->Published.load( memory_order_relaxed );
+}
+
+// Number of published images overwritten before consumer acquired them
+uint32_t XImageTripleBuffer::ImagesSkipped( ) const
+{
+    return mData->Skipped.load( memory_order_relaxed );
+}
@@ -0,0 +1,66 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XIMAGE_TRIPLE_BUFFER_HPP
+#define XIMAGE_TRIPLE_BUFFER_HPP
+
+#include <stdint.h>
+#include <memory>
+
+#include "XInterfaces.hpp"
+#include "XImage.hpp"
+
+namespace Private
+{
+    class XImageTripleBufferData;
+}
+
+/* Wait-free exchange of the latest image between one producer thread and one consumer thread.
+
+   Producer copies every new image into its own (back) buffer and then swaps it with the middle
+   one, never waiting for the consumer. Consumer swaps its (front) buffer with the middle one only
+   when there is something new, so it always gets the latest complete image. Images published
+   while the previous one was not yet taken by the consumer are counted as skipped.
+*/
+class XImageTripleBuffer : private Uncopyable
+{
+public:
+    XImageTripleBuffer( );
+    ~XImageTripleBuffer( );
+
+    // Producer side: copy the specified image and make it the latest one
+    XError Publish( const std::shared_ptr<const XImage>& image );
+
+    // Consumer side: check if there is an image, which was not yet acquired
+    bool IsNewImageAvailable( ) const;
+    // Consumer side: get the latest image if it was not acquired yet; returns false if nothing new.
+    // Acquired image is not touched by producer until the next successful call.
+    bool Acquire( std::shared_ptr<XImage>& image, uint32_t* sequence = nullptr );
+
+    // Number of images published so far
+    uint32_t ImagesPublished( ) const;
+    // Number of published images overwritten before consumer acquired them
+    uint32_t ImagesSkipped( ) const;
+
+private:
+    Private::XImageTripleBufferData* mData;
+};
+
+#endif // XIMAGE_TRIPLE_BUFFER_HPP
@@ -0,0 +1,1126 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#include "XJpegDcDecoder.hpp"
+
+#include <string.h>
+#include <vector>
+
+using namespace std;
+
+namespace Private
+{
+    // Number of bits used to look up Huffman codes (longer codes are decoded bit by bit)
+    #define HUFFMAN_LOOKUP_BITS  (11)
+    #define HUFFMAN_LOOKUP_SIZE  (1 << HUFFMAN_LOOKUP_BITS)
+    // Maximum number of supported components (Y, Cb, Cr)
+    #define MAX_COMPONENTS       (3)
+    // Lookup entry for AC codes advancing to the end of block
+    #define END_OF_BLOCK         (64)
+
+    // Huffman table with lookup of short codes
+    struct HuffmanTable
+    {
+        // table is defined for the current image (by DHT marker or by default)
+        bool     Defined;
+        // counts of codes and symbols the table was built from (tables of MJPEG frames rarely change)
+        uint8_t  Spec[16 + 256];
+        uint32_t SpecSize;
+        // length (high byte, 0 if the code is longer than lookup bits) and symbol of the code starting
+        // with the lookup bits
+        uint16_t Lookup[HUFFMAN_LOOKUP_SIZE];
+        // AC codes to skip at once - as many codes with their extra bits as fit into the lookup bits
+        // (0 if even the first does not fit), see PackSkipEntry()
+        uint32_t Skip[HUFFMAN_LOOKUP_SIZE];
+        // canonical decoding of longer codes
+        int32_t  MaxCode[17];
+        int32_t  SymbolOffset[17];
+        uint8_t  Symbols[256];
+
+        HuffmanTable( ) : Defined( false ), SpecSize( 0 ) { }
+    };
+
+    /* Skip entry of AC table describes codes starting with the lookup bits:
+         bits  0-4  - number of bits taken by all codes fitting into the lookup bits (with their extra bits);
+         bits  5-11 - number of coefficients they advance by;
+         bits 12-18 - number of coefficients all but the last code advance by (block must not end before
+                      the last code - if it does, the following bits belong to the next block);
+         bits 19-23 - number of bits taken by the first code only;
+         bits 24-30 - number of coefficients the first code advances by.
+    */
+    static inline uint32_t PackSkipEntry( uint32_t length, uint32_t advance, uint32_t prefixAdvance,
+                                          uint32_t firstLength, uint32_t firstAdvance )
+    {
+        return length | ( advance << 5 ) | ( prefixAdvance << 12 ) | ( firstLength << 19 ) | ( firstAdvance << 24 );
+    }
+
+    // Default Huffman tables (JPEG standard, K.3), which MJPEG cameras often rely on without sending DHT
+    static const uint8_t DefaultDcLuminance[] =
+    {
+        0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0,
+        0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11
+    };
+    static const uint8_t DefaultDcChrominance[] =
+    {
+        0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0,
+        0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11
+    };
+    static const uint8_t DefaultAcLuminance[] =
+    {
+        0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7D,
+        0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+        0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xA1, 0x08, 0x23, 0x42, 0xB1, 0xC1, 0x15, 0x52, 0xD1, 0xF0,
+        0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0A, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x25, 0x26, 0x27, 0x28,
+        0x29, 0x2A, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+        0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+        0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+        0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7,
+        0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3, 0xC4, 0xC5,
+        0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA, 0xE1, 0xE2,
+        0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8,
+        0xF9, 0xFA
+    };
+    static const uint8_t DefaultAcChrominance[] =
+    {
+        0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77,
+        0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+        0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xA1, 0xB1, 0xC1, 0x09, 0x23, 0x33, 0x52, 0xF0,
+        0x15, 0x62, 0x72, 0xD1, 0x0A, 0x16, 0x24, 0x34, 0xE1, 0x25, 0xF1, 0x17, 0x18, 0x19, 0x1A, 0x26,
+        0x27, 0x28, 0x29, 0x2A, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+        0x49, 0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+        0x69, 0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+        0x88, 0x89, 0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5,
+        0xA6, 0xA7, 0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3,
+        0xC4, 0xC5, 0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA,
+        0xE2, 0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8,
+        0xF9, 0xFA
+    };
+
+    // Component of the frame
+    struct FrameComponent
+    {
+        uint8_t         Id;
+        uint8_t         H;
+        uint8_t         V;
+        uint8_t         QuantTable;
+        uint8_t         DcTable;
+        uint8_t         AcTable;
+        int32_t         BlocksX;
+        int32_t         BlocksY;
+        int32_t         Predictor;
+        // level shifted and clamped DC values of all blocks
+        vector<uint8_t> Plane;
+    };
+
+    // Reads bits of entropy coded segment, removing stuffed zero bytes and stopping at markers
+    class BitReader
+    {
+    public:
+        const uint8_t* Ptr;
+        const uint8_t* End;
+        uint64_t       Buffer;
+        int32_t        Bits;
+        bool           MarkerHit;
+
+    public:
+        BitReader( ) : Ptr( nullptr ), End( nullptr ), Buffer( 0 ), Bits( 0 ), MarkerHit( false ) { }
+
+        void Start( const uint8_t* ptr, const uint8_t* end )
+        {
+            Ptr       = ptr;
+            End       = end;
+            Buffer    = 0;
+            Bits      = 0;
+            MarkerHit = false;
+        }
+
+        // Make sure there are at least 32 bits in the buffer (zeros are provided after a marker)
+        inline void Fill( )
+        {
+            if ( Bits < 32 )
+            {
+                FillBuffer( );
+            }
+        }
+
+        inline uint32_t Peek( int32_t count ) const
+        {
+            return static_cast<uint32_t>( Buffer >> ( 64 - count ) );
+        }
+
+        inline void Skip( int32_t count )
+        {
+            Buffer <<= count;
+            Bits    -= count;
+        }
+
+        // Get the specified number of bits as signed value (JPEG's "extend" procedure)
+        inline int32_t GetSigned( int32_t count )
+        {
+            int32_t value = 0;
+
+            if ( count != 0 )
+            {
+                value = static_cast<int32_t>( Peek( count ) );
+                Skip( count );
+
+                if ( value < ( 1 << ( count - 1 ) ) )
+                {
+                    value -= ( 1 << count ) - 1;
+                }
+            }
+
+            return value;
+        }
+
+        void Restart( );
+        void FillBuffer( );
+    };
+
+    class XJpegDcDecoderData
+    {
+    public:
+        int32_t        Width;
+        int32_t        Height;
+
+    private:
+        uint16_t       QuantDc[4];
+        HuffmanTable   DcTables[4];
+        HuffmanTable   AcTables[4];
+        FrameComponent Components[MAX_COMPONENTS];
+        int32_t        ComponentCount;
+        int32_t        MaxH;
+        int32_t        MaxV;
+        uint32_t       RestartInterval;
+        bool           FrameFound;
+        BitReader      Reader;
+
+    public:
+        XJpegDcDecoderData( ) :
+            Width( 0 ), Height( 0 ), ComponentCount( 0 ), MaxH( 1 ), MaxV( 1 ), RestartInterval( 0 ), FrameFound( false ), Reader( )
+        {
+        }
+
+        XError Decode( const uint8_t* data, uint32_t size, shared_ptr<XImage>& image, XPixelFormat format );
+
+    private:
+        XError ReadQuantTables( const uint8_t* ptr, uint32_t length );
+        XError ReadHuffmanTables( const uint8_t* ptr, uint32_t length );
+        XError ReadFrameHeader( const uint8_t* ptr, uint32_t length );
+        XError DecodeScan( const uint8_t* ptr, uint32_t length, const uint8_t* end, const uint8_t** scanEnd );
+        bool DecodeBlock( FrameComponent& component, int32_t bx, int32_t by );
+        XError MakeImage( shared_ptr<XImage>& image, XPixelFormat format );
+    };
+
+    static int32_t DecodeSymbol( BitReader& reader, const HuffmanTable& table );
+    static bool SetHuffmanTable( HuffmanTable& table, const uint8_t* spec, bool isAcTable );
+    static bool BuildHuffmanTable( HuffmanTable& table, bool isAcTable );
+}
+
+XJpegDcDecoder::XJpegDcDecoder( ) :
+    mData( new Private::XJpegDcDecoderData( ) )
+{
+}
+
+XJpegDcDecoder::~XJpegDcDecoder( )
+{
+    delete mData;
+}
+
+// Decode the JPEG into image of 1/8 size
+XError XJpegDcDecoder::Decode( const uint8_t* jpegData, uint32_t jpegSize, shared_ptr<XImage>& image, XPixelFormat format )
+{
+    XError ret = XError::Success;
+
+    if ( jpegData == nullptr )
+    {
+        ret = XError::NullPointer;
+    }
+    else if ( ( format != XPixelFormat::Grayscale8 ) && ( format != XPixelFormat::RGB24 ) )
+    {
+        ret = XError::UnsupportedPixelFormat;
+    }
+    else
+    {
+        ret = mData->Decode( jpegData, jpegSize, image, format );
+    }
+
+    return ret;
+}
+
+// Decode JPEG image into image of 1/8 size
+XError XJpegDcDecoder::Decode( const shared_ptr<const XImage>& jpegImage, shared_ptr<XImage>& image, XPixelFormat format )
+{
+    XError ret = XError::Success;
+
+    if ( !jpegImage )
+    {
+        ret = XError::NullPointer;
+    }
+    else if ( jpegImage->Format( ) != XPixelFormat::JPEG )
+    {
+        ret = XError::UnsupportedPixelFormat;
+    }
+    else
+    {
+        ret = Decode( jpegImage->Data( ), static_cast<uint32_t>( jpegImage->Width( ) ), image, format );
+    }
+
+    return ret;
+}
+
+// Get size of the last decoded JPEG
+int32_t XJpegDcDecoder::JpegWidth( ) const
+{
+    return mData->Width;
+}
+int32_t XJpegDcDecoder::JpegHeight( ) const
+{
+    return mData->Height;
+}
+
+namespace Private
+{
+
+// Parse markers of the JPEG, decoding its scans
+XError XJpegDcDecoderData::Decode( const uint8_t* data, uint32_t size, shared_ptr<XImage>& image, XPixelFormat format )
+{
+    const uint8_t* ptr      = data;
+    const uint8_t* end      = data + size;
+    bool           scanDone = false;
+    bool           done     = false;
+    XError         ret      = XError::Success;
+
+    Width           = 0;
+    Height          = 0;
+    ComponentCount  = 0;
+    RestartInterval = 0;
+    FrameFound      = false;
+
+    for ( int i = 0; i < 4; i++ )
+    {
+        QuantDc[i]          = 1;
+        DcTables[i].Defined = false;
+        AcTables[i].Defined = false;
+    }
+
+    if ( ( size < 4 ) || ( ptr[0] != 0xFF ) || ( ptr[1] != 0xD8 ) )
+    {
+        ret = XError::FailedImageDecoding;
+    }
+    else
+    {
+        ptr += 2;
+    }
+
+    while ( ( ret ) && ( !done ) )
+    {
+        // find next marker (skipping fill bytes)
+        while ( ( ptr < end ) && ( *ptr != 0xFF ) )
+        {
+            ptr++;
+        }
+        while ( ( ptr < end ) && ( *ptr == 0xFF ) )
+        {
+            ptr++;
+        }
+
+        if ( ptr >= end )
+        {
+            // missing EOI is tolerated if the image was decoded
+            if ( !scanDone )
+            {
+                ret = XError::FailedImageDecoding;
+            }
+            break;
+        }
+
+        uint8_t marker = *ptr++;
+
+        if ( ( marker == 0xD9 ) || ( ( marker >= 0xD0 ) && ( marker <= 0xD7 ) ) || ( marker == 0x01 ) )
+        {
+            // end of image or stand-alone markers
+            done = ( marker == 0xD9 );
+            continue;
+        }
+
+        if ( end - ptr < 2 )
+        {
+            ret = XError::FailedImageDecoding;
+            break;
+        }
+
+        uint32_t length = ( static_cast<uint32_t>( ptr[0] ) << 8 ) | ptr[1];
+
+        if ( ( length < 2 ) || ( length > static_cast<uint32_t>( end - ptr ) ) )
+        {
+            ret = XError::FailedImageDecoding;
+            break;
+        }
+
+        switch ( marker )
+        {
+        case 0xDB:
+            ret = ReadQuantTables( ptr + 2, length - 2 );
+            break;
+
+        case 0xC4:
+            ret = ReadHuffmanTables( ptr + 2, length - 2 );
+            break;
+
+        case 0xC0:
+        case 0xC1:
+            ret = ReadFrameHeader( ptr + 2, length - 2 );
+            break;
+
+        case 0xC2: case 0xC3: case 0xC5: case 0xC6: case 0xC7:
+        case 0xC9: case 0xCA: case 0xCB: case 0xCD: case 0xCE: case 0xCF:
+            // progressive, lossless, hierarchical or arithmetic coding
+            ret = XError::UnsupportedPixelFormat;
+            break;
+
+        case 0xDD:
+            RestartInterval = ( length >= 4 ) ? ( ( static_cast<uint32_t>( ptr[2] ) << 8 ) | ptr[3] ) : 0;
+            break;
+
+        case 0xDA:
+            {
+                const uint8_t* scanEnd = end;
+
+                ret = DecodeScan( ptr + 2, length - 2, end, &scanEnd );
+
+                if ( ret )
+                {
+                    scanDone = true;
+                    // the loop continues from the marker ending entropy coded segment
+                    ptr      = scanEnd;
+                    length   = 0;
+                }
+            }
+            break;
+
+        default:
+            // application specific data, comments, etc.
+            break;
+        }
+
+        ptr += length;
+    }
+
+    if ( ret )
+    {
+        ret = ( scanDone ) ? MakeImage( image, format ) : XError( XError::FailedImageDecoding );
+    }
+
+    return ret;
+}
+
+// Read DC values of quantization tables (the first value of each table)
+XError XJpegDcDecoderData::ReadQuantTables( const uint8_t* ptr, uint32_t length )
+{
+    XError ret = XError::Success;
+
+    while ( ( ret ) && ( length != 0 ) )
+    {
+        uint32_t precision = ptr[0] >> 4;
+        uint32_t id        = ptr[0] & 0x0F;
+        uint32_t tableSize = ( precision == 0 ) ? 65 : 129;
+
+        if ( ( id > 3 ) || ( precision > 1 ) || ( length < tableSize ) )
+        {
+            ret = XError::FailedImageDecoding;
+        }
+        else
+        {
+            QuantDc[id] = ( precision == 0 ) ? ptr[1] : static_cast<uint16_t>( ( ptr[1] << 8 ) | ptr[2] );
+            ptr    += tableSize;
+            length -= tableSize;
+        }
+    }
+
+    return ret;
+}
+
+// Read Huffman tables
+XError XJpegDcDecoderData::ReadHuffmanTables( const uint8_t* ptr, uint32_t length )
+{
+    XError ret = XError::Success;
+
+    while ( ( ret ) && ( length != 0 ) )
+    {
+        uint32_t tableClass = ptr[0] >> 4;
+        uint32_t id         = ptr[0] & 0x0F;
+        uint32_t count      = 0;
+
+        if ( length < 17 )
+        {
+            ret = XError::FailedImageDecoding;
+            break;
+        }
+
+        for ( int i = 1; i <= 16; i++ )
+        {
+            count += ptr[i];
+        }
+
+        if ( ( id > 3 ) || ( tableClass > 1 ) || ( count > 256 ) || ( length < 17 + count ) )
+        {
+            ret = XError::FailedImageDecoding;
+        }
+        else
+        {
+            HuffmanTable& table = ( tableClass == 0 ) ? DcTables[id] : AcTables[id];
+
+            if ( !SetHuffmanTable( table, ptr + 1, ( tableClass == 1 ) ) )
+            {
+                ret = XError::FailedImageDecoding;
+            }
+
+            ptr    += 17 + count;
+            length -= 17 + count;
+        }
+    }
+
+    return ret;
+}
+
+// Read frame header (baseline/extended sequential DCT)
+XError XJpegDcDecoderData::ReadFrameHeader( const uint8_t* ptr, uint32_t length )
+{
+    XError ret = XError::Success;
+
+    if ( ( FrameFound ) || ( length < 6 ) )
+    {
+        ret = XError::FailedImageDecoding;
+    }
+    else if ( ptr[0] != 8 )
+    {
+        // 12 bit samples are not supported
+        ret = XError::UnsupportedPixelFormat;
+    }
+    else
+    {
+        Height         = ( ptr[1] << 8 ) | ptr[2];
+        Width          = ( ptr[3] << 8 ) | ptr[4];
+        ComponentCount = ptr[5];
+
+        if ( ( ComponentCount != 1 ) && ( ComponentCount != 3 ) )
+        {
+            ret = XError::UnsupportedPixelFormat;
+        }
+        else if ( ( Width == 0 ) || ( Height == 0 ) || ( length < 6 + 3 * static_cast<uint32_t>( ComponentCount ) ) )
+        {
+            // images with height defined by DNL marker are not supported as well
+            ret = XError::FailedImageDecoding;
+        }
+        else
+        {
+            MaxH = 1;
+            MaxV = 1;
+
+            for ( int32_t i = 0; i < ComponentCount; i++ )
+            {
+                FrameComponent& component = Components[i];
+                const uint8_t*  spec      = ptr + 6 + i * 3;
+
+                component.Id         = spec[0];
+                component.H          = spec[1] >> 4;
+                component.V          = spec[1] & 0x0F;
+                component.QuantTable = spec[2] & 0x03;
+
+                if ( ( component.H < 1 ) || ( component.H > 4 ) || ( component.V < 1 ) || ( component.V > 4 ) )
+                {
+                    ret = XError::FailedImageDecoding;
+                    break;
+                }
+
+                if ( component.H > MaxH ) MaxH = component.H;
+                if ( component.V > MaxV ) MaxV = component.V;
+            }
+
+            if ( ret )
+            {
+                // blocks of interleaved scans cover complete MCUs
+                int32_t mcusX = ( Width  + 8 * MaxH - 1 ) / ( 8 * MaxH );
+                int32_t mcusY = ( Height + 8 * MaxV - 1 ) / ( 8 * MaxV );
+
+                for ( int32_t i = 0; i < ComponentCount; i++ )
+                {
+                    FrameComponent& component = Components[i];
+
+                    component.BlocksX = mcusX * component.H;
+                    component.BlocksY = mcusY * component.V;
+                    component.Plane.resize( static_cast<size_t>( component.BlocksX ) * component.BlocksY );
+                }
+
+                FrameFound = true;
+            }
+        }
+    }
+
+    return ret;
+}
+
+// Decode entropy coded segment of a scan, keeping only DC values of blocks
+XError XJpegDcDecoderData::DecodeScan( const uint8_t* ptr, uint32_t length, const uint8_t* end, const uint8_t** scanEnd )
+{
+    FrameComponent* scanComponents[MAX_COMPONENTS];
+    uint32_t        scanComponentCount = ( length != 0 ) ? ptr[0] : 0;
+    XError          ret                = XError::Success;
+
+    if ( ( !FrameFound ) || ( scanComponentCount < 1 ) || ( scanComponentCount > static_cast<uint32_t>( ComponentCount ) ) ||
+         ( length < 4 + 2 * scanComponentCount ) )
+    {
+        ret = XError::FailedImageDecoding;
+    }
+    else
+    {
+        for ( uint32_t i = 0; ( ret ) && ( i < scanComponentCount ); i++ )
+        {
+            uint8_t id = ptr[1 + i * 2];
+
+            scanComponents[i] = nullptr;
+
+            for ( int32_t j = 0; j < ComponentCount; j++ )
+            {
+                if ( Components[j].Id == id )
+                {
+                    scanComponents[i] = &Components[j];
+                }
+            }
+
+            if ( scanComponents[i] == nullptr )
+            {
+                ret = XError::FailedImageDecoding;
+            }
+            else
+            {
+                FrameComponent& component = *scanComponents[i];
+
+                component.DcTable   = ptr[2 + i * 2] >> 4;
+                component.AcTable   = ptr[2 + i * 2] & 0x0F;
+                component.Predictor = 0;
+
+                if ( ( component.DcTable > 3 ) || ( component.AcTable > 3 ) )
+                {
+                    ret = XError::FailedImageDecoding;
+                }
+                else
+                {
+                    // use default tables if the image has none (tables 0 and 1 only)
+                    if ( ( !DcTables[component.DcTable].Defined ) && ( component.DcTable < 2 ) )
+                    {
+                        SetHuffmanTable( DcTables[component.DcTable], ( component.DcTable == 0 ) ? DefaultDcLuminance : DefaultDcChrominance, false );
+                    }
+                    if ( ( !AcTables[component.AcTable].Defined ) && ( component.AcTable < 2 ) )
+                    {
+                        SetHuffmanTable( AcTables[component.AcTable], ( component.AcTable == 0 ) ? DefaultAcLuminance : DefaultAcChrominance, true );
+                    }
+
+                    if ( ( !DcTables[component.DcTable].Defined ) || ( !AcTables[component.AcTable].Defined ) )
+                    {
+                        ret = XError::FailedImageDecoding;
+                    }
+                }
+            }
+        }
+    }
+
+    if ( ret )
+    {
+        int32_t  mcusX, mcusY;
+        uint32_t mcuCounter = 0;
+
+        if ( scanComponentCount == 1 )
+        {
+            // non interleaved scan goes through blocks of the component, which cover the image only
+            FrameComponent* component = scanComponents[0];
+
+            mcusX = ( ( Width  * component->H + MaxH - 1 ) / MaxH + 7 ) / 8;
+            mcusY = ( ( Height * component->V + MaxV - 1 ) / MaxV + 7 ) / 8;
+        }
+        else
+        {
+            mcusX = ( Width  + 8 * MaxH - 1 ) / ( 8 * MaxH );
+            mcusY = ( Height + 8 * MaxV - 1 ) / ( 8 * MaxV );
+        }
+
+        Reader.Start( ptr + length, end );
+
+        for ( int32_t mcuY = 0; ( ret ) && ( mcuY < mcusY ); mcuY++ )
+        {
+            for ( int32_t mcuX = 0; mcuX < mcusX; mcuX++ )
+            {
+                if ( ( RestartInterval != 0 ) && ( mcuCounter == RestartInterval ) )
+                {
+                    Reader.Restart( );
+                    mcuCounter = 0;
+
+                    for ( uint32_t i = 0; i < scanComponentCount; i++ )
+                    {
+                        scanComponents[i]->Predictor = 0;
+                    }
+                }
+
+                if ( scanComponentCount == 1 )
+                {
+                    if ( !DecodeBlock( *scanComponents[0], mcuX, mcuY ) )
+                    {
+                        ret = XError::FailedImageDecoding;
+                    }
+                }
+                else
+                {
+                    for ( uint32_t i = 0; ( ret ) && ( i < scanComponentCount ); i++ )
+                    {
+                        FrameComponent& component = *scanComponents[i];
+
+                        for ( int32_t v = 0; ( ret ) && ( v < component.V ); v++ )
+                        {
+                            for ( int32_t h = 0; h < component.H; h++ )
+                            {
+                                if ( !DecodeBlock( component, mcuX * component.H + h, mcuY * component.V + v ) )
+                                {
+                                    ret = XError::FailedImageDecoding;
+                                    break;
+                                }
+                            }
+                        }
+                    }
+                }
+
+                if ( !ret )
+                {
+                    break;
+                }
+
+                mcuCounter++;
+            }
+        }
+
+        // find where the entropy coded segment ends
+        const uint8_t* markerPtr = Reader.Ptr;
+
+        while ( ( markerPtr + 1 < end ) &&
+                ( ( markerPtr[0] != 0xFF ) || ( markerPtr[1] == 0x00 ) || ( markerPtr[1] == 0xFF ) ||
+                  ( ( markerPtr[1] >= 0xD0 ) && ( markerPtr[1] <= 0xD7 ) ) ) )
+        {
+            markerPtr++;
+        }
+
+        *scanEnd = markerPtr;
+    }
+
+    return ret;
+}
+
+// Decode one block, keeping its DC value and skipping AC coefficients
+bool XJpegDcDecoderData::DecodeBlock( FrameComponent& component, int32_t bx, int32_t by )
+{
+    const uint32_t* skipLookup = AcTables[component.AcTable].Skip;
+    int32_t         symbol;
+    int32_t         k;
+
+    Reader.Fill( );
+
+    symbol = DecodeSymbol( Reader, DcTables[component.DcTable] );
+    if ( ( symbol < 0 ) || ( symbol > 11 ) )
+    {
+        return false;
+    }
+
+    component.Predictor += Reader.GetSigned( symbol );
+
+    if ( ( bx < component.BlocksX ) && ( by < component.BlocksY ) )
+    {
+        int32_t value = 128 + ( ( component.Predictor * QuantDc[component.QuantTable] + 4 ) >> 3 );
+
+        component.Plane[static_cast<size_t>( by ) * component.BlocksX + bx] =
+            static_cast<uint8_t>( ( value < 0 ) ? 0 : ( ( value > 255 ) ? 255 : value ) );
+    }
+
+    // skip AC coefficients - this is where nearly all time goes, so reader's state is kept in locals
+    uint64_t buffer = Reader.Buffer;
+    int32_t  bits   = Reader.Bits;
+
+    for ( k = 1; k < 64; )
+    {
+        if ( bits < 32 )
+        {
+            Reader.Buffer = buffer;
+            Reader.Bits   = bits;
+            Reader.FillBuffer( );
+            buffer = Reader.Buffer;
+            bits   = Reader.Bits;
+        }
+
+        uint32_t entry = skipLookup[buffer >> ( 64 - HUFFMAN_LOOKUP_BITS )];
+
+        if ( entry != 0 )
+        {
+            uint32_t length;
+
+            if ( k + static_cast<int32_t>( ( entry >> 12 ) & 0x7F ) < 64 )
+            {
+                length = entry & 0x1F;
+                k     += ( entry >> 5 ) & 0x7F;
+            }
+            else
+            {
+                length = ( entry >> 19 ) & 0x1F;
+                k     += ( entry >> 24 ) & 0x7F;
+            }
+
+            buffer <<= length;
+            bits    -= length;
+        }
+        else
+        {
+            // long code or too many extra bits
+            Reader.Buffer = buffer;
+            Reader.Bits   = bits;
+
+            symbol = DecodeSymbol( Reader, AcTables[component.AcTable] );
+
+            if ( symbol < 0 )
+            {
+                return false;
+            }
+
+            int32_t run   = symbol >> 4;
+            int32_t extra = symbol & 0x0F;
+
+            if ( extra != 0 )
+            {
+                Reader.Skip( extra );
+                k += run + 1;
+            }
+            else
+            {
+                k += ( run == 15 ) ? 16 : END_OF_BLOCK;
+            }
+
+            buffer = Reader.Buffer;
+            bits   = Reader.Bits;
+        }
+    }
+
+    Reader.Buffer = buffer;
+    Reader.Bits   = bits;
+
+    return true;
+}
+
+// Make output image from DC values of components
+XError XJpegDcDecoderData::MakeImage( shared_ptr<XImage>& image, XPixelFormat format )
+{
+    int32_t outWidth  = ( Width  + 7 ) / 8;
+    int32_t outHeight = ( Height + 7 ) / 8;
+    XError  ret       = XError::Success;
+
+    if ( ( !image ) || ( image->Width( ) != outWidth ) || ( image->Height( ) != outHeight ) || ( image->Format( ) != format ) )
+    {
+        image = XImage::Allocate( outWidth, outHeight, format );
+    }
+
+    if ( !image )
+    {
+        ret = XError::OutOfMemory;
+    }
+    else
+    {
+        const FrameComponent& luma = Components[0];
+
+        for ( int32_t y = 0; y < outHeight; y++ )
+        {
+            uint8_t*       dst   = image->Data( ) + static_cast<size_t>( y ) * image->Stride( );
+            const uint8_t* yRow  = luma.Plane.data( ) + static_cast<size_t>( y * luma.V / MaxV ) * luma.BlocksX;
+
+            if ( ( format == XPixelFormat::Grayscale8 ) || ( ComponentCount == 1 ) )
+            {
+                for ( int32_t x = 0; x < outWidth; x++ )
+                {
+                    uint8_t value = yRow[x * luma.H / MaxH];
+
+                    if ( format == XPixelFormat::Grayscale8 )
+                    {
+                        dst[x] = value;
+                    }
+                    else
+                    {
+                        dst[RedIndex] = dst[GreenIndex] = dst[BlueIndex] = value;
+                        dst += 3;
+                    }
+                }
+            }
+            else
+            {
+                const FrameComponent& cb    = Components[1];
+                const FrameComponent& cr    = Components[2];
+                const uint8_t*        cbRow = cb.Plane.data( ) + static_cast<size_t>( y * cb.V / MaxV ) * cb.BlocksX;
+                const uint8_t*        crRow = cr.Plane.data( ) + static_cast<size_t>( y * cr.V / MaxV ) * cr.BlocksX;
+
+                for ( int32_t x = 0; x < outWidth; x++, dst += 3 )
+                {
+                    // YCbCr to RGB conversion in 16.16 fixed point
+                    int32_t yv = yRow[x * luma.H / MaxH] << 16;
+                    int32_t u  = cbRow[x * cb.H / MaxH] - 128;
+                    int32_t v  = crRow[x * cr.H / MaxH] - 128;
+                    int32_t r  = ( yv + 91881 * v + 32768 ) >> 16;
+                    int32_t g  = ( yv - 22554 * u - 46802 * v + 32768 ) >> 16;
+                    int32_t b  = ( yv + 116130 * u + 32768 ) >> 16;
+
+                    dst[RedIndex]   = static_cast<uint8_t>( ( r < 0 ) ? 0 : ( ( r > 255 ) ? 255 : r ) );
+                    dst[GreenIndex] = static_cast<uint8_t>( ( g < 0 ) ? 0 : ( ( g > 255 ) ? 255 : g ) );
+                    dst[BlueIndex]  = static_cast<uint8_t>( ( b < 0 ) ? 0 : ( ( b > 255 ) ? 255 : b ) );
+                }
+            }
+        }
+    }
+
+    return ret;
+}
+
+// Skip to the next restart marker and reset the reader
+void BitReader::Restart( )
+{
+    Buffer = 0;
+    Bits   = 0;
+
+    while ( ( Ptr + 1 < End ) && ( ( Ptr[0] != 0xFF ) || ( Ptr[1] < 0xD0 ) || ( Ptr[1] > 0xD7 ) ) )
+    {
+        // if some other marker was hit, then data are corrupted - look for restart marker anyway
+        Ptr++;
+    }
+
+    if ( Ptr + 1 < End )
+    {
+        Ptr      += 2;
+        MarkerHit = false;
+    }
+    else
+    {
+        MarkerHit = true;
+    }
+}
+
+// Fill bit buffer with the next bytes of entropy coded segment
+void BitReader::FillBuffer( )
+{
+    while ( Bits <= 56 )
+    {
+        uint32_t byte = 0;
+
+        if ( !MarkerHit )
+        {
+            if ( Ptr >= End )
+            {
+                MarkerHit = true;
+            }
+            else if ( *Ptr != 0xFF )
+            {
+                byte = *Ptr++;
+            }
+            else
+            {
+                uint8_t next = ( Ptr + 1 < End ) ? Ptr[1] : 0xD9;
+
+                if ( next == 0x00 )
+                {
+                    // stuffed zero byte
+                    byte = 0xFF;
+                    Ptr += 2;
+                }
+                else if ( next == 0xFF )
+                {
+                    // fill byte before a marker
+                    Ptr++;
+                    continue;
+                }
+                else
+                {
+                    // marker - provide zeros from now on, keeping pointer at the marker
+                    MarkerHit = true;
+                }
+            }
+        }
+
+        Buffer |= static_cast<uint64_t>( byte ) << ( 56 - Bits );
+        Bits   += 8;
+    }
+}
+
+// Decode next Huffman coded symbol (at least 16 bits must be in reader's buffer)
+static int32_t DecodeSymbol( BitReader& reader, const HuffmanTable& table )
+{
+    uint32_t entry  = table.Lookup[reader.Peek( HUFFMAN_LOOKUP_BITS )];
+    int32_t  length = entry >> 8;
+    int32_t  symbol = -1;
+
+    if ( length != 0 )
+    {
+        reader.Skip( length );
+        symbol = entry & 0xFF;
+    }
+    else
+    {
+        uint32_t bits = reader.Peek( 16 );
+
+        for ( length = HUFFMAN_LOOKUP_BITS + 1; length <= 16; length++ )
+        {
+            int32_t code = static_cast<int32_t>( bits >> ( 16 - length ) );
+
+            if ( code <= table.MaxCode[length] )
+            {
+                reader.Skip( length );
+                symbol = table.Symbols[code + table.SymbolOffset[length]];
+                break;
+            }
+        }
+    }
+
+    return symbol;
+}
+
+// Set Huffman table from its specification as it is stored in DHT marker (16 counts of codes followed
+// by symbols), rebuilding lookups only if it differs from the one the table was built from
+static bool SetHuffmanTable( HuffmanTable& table, const uint8_t* spec, bool isAcTable )
+{
+    uint32_t specSize = 16;
+    bool     ret      = true;
+
+    for ( int i = 0; i < 16; i++ )
+    {
+        specSize += spec[i];
+    }
+
+    if ( ( specSize != table.SpecSize ) || ( memcmp( spec, table.Spec, specSize ) != 0 ) )
+    {
+        memcpy( table.Spec, spec, specSize );
+        table.SpecSize = specSize;
+
+        ret = BuildHuffmanTable( table, isAcTable );
+
+        if ( !ret )
+        {
+            table.SpecSize = 0;
+        }
+    }
+
+    table.Defined = ret;
+
+    return ret;
+}
+
+// Build lookups of Huffman table from its specification
+static bool BuildHuffmanTable( HuffmanTable& table, bool isAcTable )
+{
+    const uint8_t* counts  = table.Spec;
+    const uint8_t* symbols = table.Spec + 16;
+    int32_t        code    = 0;
+    int32_t        index   = 0;
+    bool           ret     = true;
+
+    memset( table.Lookup, 0, sizeof( table.Lookup ) );
+
+    for ( int32_t length = 1; length <= 16; length++ )
+    {
+        int32_t count = counts[length - 1];
+
+        // codes must fit into their length (over-subscribed table would write past the lookup)
+        if ( code + count > ( 1 << length ) )
+        {
+            ret = false;
+            break;
+        }
+
+        table.SymbolOffset[length] = index - code;
+
+        for ( int32_t i = 0; i < count; i++, code++, index++ )
+        {
+            table.Symbols[index] = symbols[index];
+
+            if ( length <= HUFFMAN_LOOKUP_BITS )
+            {
+                int32_t shift = HUFFMAN_LOOKUP_BITS - length;
+
+                for ( int32_t j = code << shift, last = ( code + 1 ) << shift; ( j < last ) && ( j < HUFFMAN_LOOKUP_SIZE ); j++ )
+                {
+                    table.Lookup[j] = static_cast<uint16_t>( ( length << 8 ) | symbols[index] );
+                }
+            }
+        }
+
+        table.MaxCode[length] = ( count != 0 ) ? code - 1 : -1;
+
+        code <<= 1;
+    }
+
+    if ( ( ret ) && ( isAcTable ) )
+    {
+        // find codes (with their extra bits) to skip at once for every value of the lookup bits
+        for ( uint32_t value = 0; value < HUFFMAN_LOOKUP_SIZE; value++ )
+        {
+            uint32_t position     = 0;
+            uint32_t advance      = 0;
+            uint32_t prefix       = 0;
+            uint32_t firstLength  = 0;
+            uint32_t firstAdvance = 0;
+
+            while ( position < HUFFMAN_LOOKUP_BITS )
+            {
+                // codes are prefix free, so one found in the lookup padded with zeros is the right one if it fits
+                uint32_t entry  = table.Lookup[( value << position ) & ( HUFFMAN_LOOKUP_SIZE - 1 )];
+                uint32_t length = entry >> 8;
+                uint32_t run    = ( entry >> 4 ) & 0x0F;
+                uint32_t extra  = entry & 0x0F;
+
+                if ( ( length == 0 ) || ( position + length + extra > HUFFMAN_LOOKUP_BITS ) )
+                {
+                    break;
+                }
+
+                uint32_t codeAdvance = ( extra != 0 ) ? run + 1 : ( ( run == 15 ) ? 16 : END_OF_BLOCK );
+
+                if ( firstLength == 0 )
+                {
+                    firstLength  = length + extra;
+                    firstAdvance = codeAdvance;
+                }
+
+                prefix    = advance;
+                advance  += codeAdvance;
+                position += length + extra;
+
+                if ( advance >= 64 )
+                {
+                    break;
+                }
+            }
+
+            table.Skip[value] = ( firstLength == 0 ) ? 0 : PackSkipEntry( position, advance, prefix, firstLength, firstAdvance );
+        }
+    }
+
+    return ret;
+}
+
+} // namespace Private
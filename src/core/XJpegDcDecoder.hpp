@@ -0,0 +1,75 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#ifndef XJPEG_DC_DECODER_HPP
+#define XJPEG_DC_DECODER_HPP
+
+#include <stdint.h>
+#include <memory>
+
+#include "XInterfaces.hpp"
+#include "XImage.hpp"
+#include "XError.hpp"
+
+namespace Private
+{
+    class XJpegDcDecoderData;
+}
+
+/* Partial JPEG decoder, which takes only DC coefficient of every 8x8 block.
+
+   DC coefficient is the average value of a block, so an image of 1/8 size is made without
+   inverse DCT, upsampling or dequantization of AC coefficients - AC coefficients are only
+   skipped in the entropy coded data, which is what most of the time is spent on. Useful
+   to get a small view of JPEG frames quickly (motion detection, histograms, thumbnails).
+
+   Only baseline JPEGs (Huffman coding, 8 bit samples, single scan) with 1 or 3 components
+   are supported, which is what MJPEG cameras provide. Others (progressive, for example)
+   fail with UnsupportedPixelFormat, so a full decoder could be used instead.
+*/
+class XJpegDcDecoder : private Uncopyable
+{
+public:
+    XJpegDcDecoder( );
+    ~XJpegDcDecoder( );
+
+    /* Decode the JPEG into image of 1/8 size (width and height are rounded up).
+
+       The output image can be Grayscale8 (luma only) or RGB24 (chroma is taken as well).
+       It is reused if it already has the required size and format, otherwise a new one
+       is allocated.
+    */
+    XError Decode( const uint8_t* jpegData, uint32_t jpegSize, std::shared_ptr<XImage>& image,
+                   XPixelFormat format = XPixelFormat::Grayscale8 );
+
+    // Decode JPEG image (XPixelFormat::JPEG, width is the size of its data) into image of 1/8 size
+    XError Decode( const std::shared_ptr<const XImage>& jpegImage, std::shared_ptr<XImage>& image,
+                   XPixelFormat format = XPixelFormat::Grayscale8 );
+
+    // Get size of the last decoded JPEG (full size, not the size of decoded image)
+    int32_t JpegWidth( ) const;
+    int32_t JpegHeight( ) const;
+
+private:
+    Private::XJpegDcDecoderData* mData;
+};
+
+#endif // XJPEG_DC_DECODER_HPP
@@ -0,0 +1,357 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <stdlib.h>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+
+#include "XJpegEncoderPool.hpp"
+#include "XJpegEncoder.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace Private
+{
+    #define INITIAL_BUFFER_SIZE (1024 * 1024)
+
+    class XJpegEncoderPoolData;
+
+    // Encoder of the pool with its thread and the image it works on
+    class EncoderSlot
+    {
+    public:
+        XJpegEncoder        Encoder;
+        shared_ptr<XImage>  Image;
+        uint16_t            Quality;
+        uint32_t            Sequence;
+        uint8_t*            Buffer;
+        uint32_t            BufferSize;
+        uint32_t            JpegSize;
+        XError              Error;
+        // image is submitted and not compressed yet / compressed and not taken yet
+        bool                Pending;
+        bool                Done;
+        condition_variable  Submitted;
+        thread              WorkerThread;
+
+    public:
+        EncoderSlot( uint16_t quality, bool fasterCompression ) :
+            Encoder( quality, fasterCompression ), Image( ), Quality( quality ), Sequence( 0 ),
+            Buffer( nullptr ), BufferSize( 0 ), JpegSize( 0 ), Error( XError::Success ),
+            Pending( false ), Done( false ), Submitted( ), WorkerThread( )
+        {
+        }
+
+        ~EncoderSlot( )
+        {
+            free( Buffer );
+        }
+
+        void Compress( );
+    };
+
+    class XJpegEncoderPoolData
+    {
+    public:
+        mutable mutex                   Sync;
+        condition_variable              Completed;
+        vector<shared_ptr<EncoderSlot>> Slots;
+        uint16_t                        Quality;
+        // the oldest slot in flight and number of slots in flight
+        uint32_t                        Head;
+        uint32_t                        Count;
+        bool                            NeedToStop;
+
+    public:
+        XJpegEncoderPoolData( uint32_t encodersCount, uint16_t quality, bool fasterCompression ) :
+            Sync( ), Completed( ), Slots( ), Quality( ( quality > 100 ) ? 100 : quality ),
+            Head( 0 ), Count( 0 ), NeedToStop( false )
+        {
+            if ( encodersCount == 0 )
+            {
+                encodersCount = 1;
+            }
+
+            for ( uint32_t i = 0; i < encodersCount; i++ )
+            {
+                Slots.push_back( make_shared<EncoderSlot>( Quality, fasterCompression ) );
+            }
+
+            for ( uint32_t i = 0; i < encodersCount; i++ )
+            {
+                Slots[i]->WorkerThread = thread( WorkerThreadHandler, this, Slots[i].get( ) );
+            }
+        }
+
+        ~XJpegEncoderPoolData( )
+        {
+            {
+                lock_guard<mutex> lock( Sync );
+                NeedToStop = true;
+            }
+
+            for ( auto& slot : Slots )
+            {
+                slot->Submitted.notify_one( );
+            }
+            Completed.notify_all( );
+
+            for ( auto& slot : Slots )
+            {
+                if ( slot->WorkerThread.joinable( ) )
+                {
+                    slot->WorkerThread.join( );
+                }
+            }
+        }
+
+        static void WorkerThreadHandler( XJpegEncoderPoolData* me, EncoderSlot* slot );
+    };
+}
+
+XJpegEncoderPool::XJpegEncoderPool( uint32_t encodersCount, uint16_t quality, bool fasterCompression ) :
+    mData( new Private::XJpegEncoderPoolData( encodersCount, quality, fasterCompression ) )
+{
+}
+
+XJpegEncoderPool::~XJpegEncoderPool( )
+{
+    delete mData;
+}
+
+// Number of encoders (maximum number of images in flight)
+uint32_t XJpegEncoderPool::EncodersCount( ) const
+{
+    return static_cast<uint32_t>( mData->Slots.size( ) );
+}
+
+// Get compression quality
+uint16_t XJpegEncoderPool::Quality( ) const
+{
+    lock_guard<mutex> lock( mData->Sync );
+    return mData->Quality;
+}
+
+// Set compression quality (applies to images submitted after)
+void XJpegEncoderPool::SetQuality( uint16_t quality )
+{
+    lock_guard<mutex> lock( mData->Sync );
+    mData->Quality = ( quality > 100 ) ? 100 : quality;
+}
+
+// Number of submitted images, which are not taken yet
+uint32_t XJpegEncoderPool::InFlight( ) const
+{
+    lock_guard<mutex> lock( mData->Sync );
+    return mData->Count;
+}
+
+// Submit copy of the image for compression
+XError XJpegEncoderPool::Submit( const shared_ptr<const XImage>& image, uint32_t sequence )
+{
+    XError ret = XError::Success;
+
+    if ( !image )
+    {
+        ret = XError::NullPointer;
+    }
+    else if ( ( image->Format( ) != XPixelFormat::RGB24 ) && ( image->Format( ) != XPixelFormat::Grayscale8 ) )
+    {
+        ret = XError::UnsupportedPixelFormat;
+    }
+    else
+    {
+        Private::EncoderSlot* slot       = nullptr;
+        uint32_t              slotsCount = static_cast<uint32_t>( mData->Slots.size( ) );
+        uint32_t              slotIndex  = 0;
+
+        {
+            lock_guard<mutex> lock( mData->Sync );
+
+            if ( mData->Count == slotsCount )
+            {
+                ret = XError::DeivceNotReady;
+            }
+            else
+            {
+                // slots are used in turn, so the next one is free (its result was taken); it is reserved
+                // by counting it in flight, while neither its worker nor Take() touch it until it is pending/done
+                slotIndex = ( mData->Head + mData->Count ) % slotsCount;
+                slot      = mData->Slots[slotIndex].get( );
+
+                slot->Quality  = mData->Quality;
+                slot->Sequence = sequence;
+                slot->Done     = false;
+
+                mData->Count++;
+            }
+        }
+
+        if ( slot != nullptr )
+        {
+            // image is copied without holding the lock, so Take() and other workers are not stalled by it
+            ret = image->CopyDataOrClone( slot->Image );
+
+            lock_guard<mutex> lock( mData->Sync );
+
+            if ( ret )
+            {
+                slot->Pending = true;
+                slot->Submitted.notify_one( );
+            }
+            else if ( ( mData->Head + mData->Count - 1 ) % slotsCount == slotIndex )
+            {
+                // nothing was reserved after the slot, so it can be given back
+                mData->Count--;
+            }
+            else
+            {
+                // the slot is followed by others, so it is completed with the error (Take() provides it in order)
+                slot->Error = ret;
+                slot->Done  = true;
+                mData->Completed.notify_all( );
+            }
+        }
+    }
+
+    return ret;
+}
+
+// Take the oldest submitted image once it is compressed
+XError XJpegEncoderPool::Take( uint8_t** buffer, uint32_t* bufferSize, uint32_t* jpegSize, uint32_t* sequence, uint32_t timeout )
+{
+    XError ret = XError::Success;
+
+    if ( ( buffer == nullptr ) || ( bufferSize == nullptr ) || ( jpegSize == nullptr ) )
+    {
+        ret = XError::NullPointer;
+    }
+    else
+    {
+        unique_lock<mutex>       lock( mData->Sync );
+        steady_clock::time_point waitUntil  = steady_clock::now( ) + milliseconds( timeout );
+        uint32_t                 slotsCount = static_cast<uint32_t>( mData->Slots.size( ) );
+
+        while ( ( mData->Count != 0 ) && ( !mData->Slots[mData->Head]->Done ) && ( !mData->NeedToStop ) )
+        {
+            if ( mData->Completed.wait_until( lock, waitUntil ) == cv_status::timeout )
+            {
+                break;
+            }
+        }
+
+        if ( ( mData->Count == 0 ) || ( !mData->Slots[mData->Head]->Done ) )
+        {
+            ret = XError::DeivceNotReady;
+        }
+        else
+        {
+            Private::EncoderSlot* slot     = mData->Slots[mData->Head].get( );
+            uint8_t*              temp     = *buffer;
+            uint32_t              tempSize = *bufferSize;
+
+            ret = slot->Error;
+
+            if ( ret )
+            {
+                // swap buffers, so the encoder re-uses the one caller had
+                *buffer          = slot->Buffer;
+                *bufferSize      = slot->BufferSize;
+                *jpegSize        = slot->JpegSize;
+                slot->Buffer     = temp;
+                slot->BufferSize = tempSize;
+            }
+
+            if ( sequence != nullptr )
+            {
+                *sequence = slot->Sequence;
+            }
+
+            slot->Done  = false;
+            mData->Head = ( mData->Head + 1 ) % slotsCount;
+            mData->Count--;
+        }
+    }
+
+    return ret;
+}
+
+namespace Private
+{
+
+// Compress the submitted image into slot's buffer
+void EncoderSlot::Compress( )
+{
+    uint8_t* originalBuffer = Buffer;
+
+    if ( Buffer == nullptr )
+    {
+        Buffer     = static_cast<uint8_t*>( malloc( INITIAL_BUFFER_SIZE ) );
+        BufferSize = ( Buffer != nullptr ) ? INITIAL_BUFFER_SIZE : 0;
+
+        originalBuffer = Buffer;
+    }
+
+    Encoder.SetQuality( Quality );
+
+    JpegSize = BufferSize;
+    Error    = Encoder.EncodeToMemory( Image, &Buffer, &JpegSize );
+
+    // libjpeg allocates a new buffer instead of expanding the provided one
+    if ( Buffer != originalBuffer )
+    {
+        free( originalBuffer );
+        BufferSize = JpegSize;
+    }
+}
+
+// Thread compressing images submitted to its slot
+void XJpegEncoderPoolData::WorkerThreadHandler( XJpegEncoderPoolData* me, EncoderSlot* slot )
+{
+    unique_lock<mutex> lock( me->Sync );
+
+    while ( true )
+    {
+        while ( ( !slot->Pending ) && ( !me->NeedToStop ) )
+        {
+            slot->Submitted.wait( lock );
+        }
+
+        if ( me->NeedToStop )
+        {
+            break;
+        }
+
+        // the slot is not touched by others until it is done
+        lock.unlock( );
+        slot->Compress( );
+        lock.lock( );
+
+        slot->Pending = false;
+        slot->Done    = true;
+        me->Completed.notify_all( );
+    }
+}
+
+} // namespace Private
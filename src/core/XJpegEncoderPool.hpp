@@ -0,0 +1,81 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XJPEG_ENCODER_POOL_HPP
+#define XJPEG_ENCODER_POOL_HPP
+
+#include <stdint.h>
+#include <memory>
+
+#include "XInterfaces.hpp"
+#include "XImage.hpp"
+#include "XError.hpp"
+
+namespace Private
+{
+    class XJpegEncoderPoolData;
+}
+
+/* Pool of JPEG encoders, which compress consecutive images concurrently.
+
+   A single encoder can not provide more than 1/encode_time images per second, which may be below
+   frame rate of high resolution cameras. The pool runs every XJpegEncoder on its own thread, so
+   throughput scales with number of cores. Submitted images are copied into slots of the encoders
+   (re-used once frame size settles), so callers may reuse their images right away.
+
+   Latency is bounded - there are no more images in flight than encoders, so submitting fails
+   until the oldest result is taken. Results are taken strictly in order of submission, so an
+   older image never replaces a newer one, even if it took longer to compress.
+*/
+class XJpegEncoderPool : private Uncopyable
+{
+public:
+    XJpegEncoderPool( uint32_t encodersCount, uint16_t quality = 85, bool fasterCompression = false );
+    ~XJpegEncoderPool( );
+
+    // Number of encoders (maximum number of images in flight)
+    uint32_t EncodersCount( ) const;
+
+    // Set/get compression quality, [0, 100] (applies to images submitted after)
+    uint16_t Quality( ) const;
+    void SetQuality( uint16_t quality );
+
+    // Number of submitted images, which are not taken yet
+    uint32_t InFlight( ) const;
+
+    // Submit copy of the image for compression. The sequence number is provided back with the result.
+    // Fails with DeivceNotReady error if all encoders are busy.
+    XError Submit( const std::shared_ptr<const XImage>& image, uint32_t sequence );
+
+    /* Take the oldest submitted image once it is compressed
+
+       Waits for it up to the specified time (milliseconds), failing with DeivceNotReady error if
+       it is still not compressed or if nothing was submitted. Caller's buffer is swapped with the
+       encoder's one, so no data is copied - both buffer and its size are updated, while JPEG size
+       is set to size of the compressed image. If the image failed to compress, its error is
+       returned (the image is taken anyway).
+    */
+    XError Take( uint8_t** buffer, uint32_t* bufferSize, uint32_t* jpegSize, uint32_t* sequence = nullptr, uint32_t timeout = 0 );
+
+private:
+    Private::XJpegEncoderPoolData* mData;
+};
+
+#endif // XJPEG_ENCODER_POOL_HPP
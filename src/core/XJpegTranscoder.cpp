@@ -0,0 +1,340 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "XJpegTranscoder.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <jpeglib.h>
+
+using namespace std;
+
+namespace Private
+{
+    class TranscoderException : public exception
+    {
+    public:
+        virtual const char* what( ) const throw( )
+        {
+            return "JPEG transcoding failure";
+        }
+    };
+
+    static void transcoder_error_exit( j_common_ptr /* cinfo */ )
+    {
+        throw TranscoderException( );
+    }
+
+    static void transcoder_output_message( j_common_ptr /* cinfo */ )
+    {
+        // do nothing - kill the message
+    }
+
+    class XJpegTranscoderData
+    {
+    public:
+        uint16_t                      Quality;
+    private:
+        struct jpeg_decompress_struct dinfo;
+        struct jpeg_compress_struct   cinfo;
+        struct jpeg_error_mgr         djerr;
+        struct jpeg_error_mgr         cjerr;
+
+    public:
+        XJpegTranscoderData( uint16_t quality ) :
+            Quality( quality )
+        {
+            if ( Quality > 100 ) Quality = 100;
+            if ( Quality < 1   ) Quality = 1;
+
+            dinfo.err            = jpeg_std_error( &djerr );
+            djerr.error_exit     = transcoder_error_exit;
+            djerr.output_message = transcoder_output_message;
+
+            cinfo.err            = jpeg_std_error( &cjerr );
+            cjerr.error_exit     = transcoder_error_exit;
+            cjerr.output_message = transcoder_output_message;
+
+            jpeg_create_decompress( &dinfo );
+            jpeg_create_compress( &cinfo );
+        }
+
+        ~XJpegTranscoderData( )
+        {
+            jpeg_destroy_compress( &cinfo );
+            jpeg_destroy_decompress( &dinfo );
+        }
+
+        XError TranscodeToMemory( const uint8_t* jpegData, uint32_t jpegSize, uint8_t** buffer, uint32_t* bufferSize );
+
+    private:
+        bool SetTargetTables( );
+        void Requantize( jvirt_barray_ptr* coefficients );
+    };
+
+    static XError CopyToMemory( const uint8_t* jpegData, uint32_t jpegSize, uint8_t** buffer, uint32_t* bufferSize );
+}
+
+XJpegTranscoder::XJpegTranscoder( uint16_t quality ) :
+    mData( new Private::XJpegTranscoderData( quality ) )
+{
+
+}
+
+XJpegTranscoder::~XJpegTranscoder( )
+{
+    delete mData;
+}
+
+// Set/get target quality, [1, 100]
+uint16_t XJpegTranscoder::Quality( ) const
+{
+    return mData->Quality;
+}
+void XJpegTranscoder::SetQuality( uint16_t quality )
+{
+    mData->Quality = quality;
+    if ( mData->Quality > 100 ) mData->Quality = 100;
+    if ( mData->Quality < 1   ) mData->Quality = 1;
+}
+
+// Transcode the specified JPEG into provided buffer
+XError XJpegTranscoder::TranscodeToMemory( const uint8_t* jpegData, uint32_t jpegSize, uint8_t** buffer, uint32_t* bufferSize )
+{
+    return mData->TranscodeToMemory( jpegData, jpegSize, buffer, bufferSize );
+}
+
+// Transcode JPEG image into provided buffer
+XError XJpegTranscoder::TranscodeToMemory( const shared_ptr<const XImage>& jpegImage, uint8_t** buffer, uint32_t* bufferSize )
+{
+    XError ret = XError::NullPointer;
+
+    if ( jpegImage )
+    {
+        if ( jpegImage->Format( ) != XPixelFormat::JPEG )
+        {
+            ret = XError::UnsupportedPixelFormat;
+        }
+        else
+        {
+            ret = mData->TranscodeToMemory( jpegImage->Data( ), static_cast<uint32_t>( jpegImage->Width( ) ), buffer, bufferSize );
+        }
+    }
+
+    return ret;
+}
+
+namespace Private
+{
+
+XError XJpegTranscoderData::TranscodeToMemory( const uint8_t* jpegData, uint32_t jpegSize, uint8_t** buffer, uint32_t* bufferSize )
+{
+    XError ret = XError::Success;
+
+    if ( ( jpegData == nullptr ) || ( buffer == nullptr ) || ( *buffer == nullptr ) || ( bufferSize == nullptr ) )
+    {
+        ret = XError::NullPointer;
+    }
+    else
+    {
+        uint8_t* originalBuffer = *buffer;
+        bool     requantized    = false;
+
+        try
+        {
+            // 1 - read quantized DCT coefficients of the source JPEG
+            jpeg_mem_src( &dinfo, jpegData, static_cast<unsigned long>( jpegSize ) );
+            jpeg_read_header( &dinfo, TRUE );
+
+            jvirt_barray_ptr* coefficients = jpeg_read_coefficients( &dinfo );
+
+            // 2 - set destination parameters from the source and replace its quantization tables
+            jpeg_copy_critical_parameters( &dinfo, &cinfo );
+
+            if ( SetTargetTables( ) )
+            {
+                unsigned long mem_buffer_size = *bufferSize;
+
+                Requantize( coefficients );
+
+                // 3 - entropy code the requantized coefficients
+                jpeg_mem_dest( &cinfo, buffer, &mem_buffer_size );
+                jpeg_write_coefficients( &cinfo, coefficients );
+                jpeg_finish_compress( &cinfo );
+
+                // libjpeg allocates a new buffer instead of expanding the provided one
+                if ( *buffer != originalBuffer )
+                {
+                    free( originalBuffer );
+                    originalBuffer = *buffer;
+                }
+
+                *bufferSize = static_cast<uint32_t>( mem_buffer_size );
+                requantized = true;
+            }
+
+            jpeg_finish_decompress( &dinfo );
+        }
+        catch ( const TranscoderException& )
+        {
+            jpeg_abort_compress( &cinfo );
+            jpeg_abort_decompress( &dinfo );
+
+            // buffer allocated by libjpeg before the failure is not needed
+            if ( *buffer != originalBuffer )
+            {
+                free( *buffer );
+                *buffer = originalBuffer;
+            }
+
+            ret = XError::FailedImageEncoding;
+        }
+
+        if ( ( ret == XError::Success ) && ( !requantized ) )
+        {
+            // source quality is not higher than the target
+            ret = CopyToMemory( jpegData, jpegSize, buffer, bufferSize );
+        }
+    }
+
+    return ret;
+}
+
+// Set quantization tables of the target quality, but not finer than the source ones (which are set
+// by jpeg_copy_critical_parameters()). Returns false if they stay the same.
+bool XJpegTranscoderData::SetTargetTables( )
+{
+    UINT16 sourceTables[NUM_QUANT_TBLS][DCTSIZE2];
+    bool   changed = false;
+    int    i, j;
+
+    for ( i = 0; i < NUM_QUANT_TBLS; i++ )
+    {
+        if ( cinfo.quant_tbl_ptrs[i] != nullptr )
+        {
+            memcpy( sourceTables[i], cinfo.quant_tbl_ptrs[i]->quantval, sizeof( sourceTables[i] ) );
+        }
+    }
+
+    // standard luminance/chrominance tables go to slots 0/1, which is what cameras use as well
+    jpeg_set_quality( &cinfo, static_cast<int>( Quality ), TRUE /* limit to baseline-JPEG values */ );
+
+    for ( i = 0; i < NUM_QUANT_TBLS; i++ )
+    {
+        JQUANT_TBL* table = cinfo.quant_tbl_ptrs[i];
+
+        if ( ( table != nullptr ) && ( dinfo.quant_tbl_ptrs[i] != nullptr ) )
+        {
+            for ( j = 0; j < DCTSIZE2; j++ )
+            {
+                if ( table->quantval[j] <= sourceTables[i][j] )
+                {
+                    table->quantval[j] = sourceTables[i][j];
+                }
+                else
+                {
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    return changed;
+}
+
+// Requantize DCT coefficients of all components from source quantization tables to the target ones
+void XJpegTranscoderData::Requantize( jvirt_barray_ptr* coefficients )
+{
+    for ( int ci = 0; ci < dinfo.num_components; ci++ )
+    {
+        jpeg_component_info* component = &dinfo.comp_info[ci];
+        const UINT16*        sourceQ   = component->quant_table->quantval;
+        const UINT16*        targetQ   = cinfo.quant_tbl_ptrs[cinfo.comp_info[ci].quant_tbl_no]->quantval;
+        // coefficients are scaled by ratio of quantizers - no division and the loop can be vectorized
+        float                ratio[DCTSIZE2];
+        int                  k, lastChanged = -1;
+
+        for ( k = 0; k < DCTSIZE2; k++ )
+        {
+            ratio[k] = static_cast<float>( sourceQ[k] ) / static_cast<float>( targetQ[k] );
+
+            if ( sourceQ[k] != targetQ[k] )
+            {
+                lastChanged = k;
+            }
+        }
+
+        if ( lastChanged == -1 )
+        {
+            continue;
+        }
+
+        for ( JDIMENSION row = 0; row < component->height_in_blocks; row++ )
+        {
+            JBLOCKARRAY blocks = ( *dinfo.mem->access_virt_barray )( reinterpret_cast<j_common_ptr>( &dinfo ),
+                                                                     coefficients[ci], row, 1, TRUE );
+            JBLOCKROW   blockRow = blocks[0];
+
+            for ( JDIMENSION bx = 0; bx < component->width_in_blocks; bx++ )
+            {
+                JCOEF* block = blockRow[bx];
+
+                for ( k = 0; k < DCTSIZE2; k++ )
+                {
+                    // round half away from zero
+                    float value = static_cast<float>( block[k] ) * ratio[k];
+
+                    block[k] = static_cast<JCOEF>( value + ( ( value < 0 ) ? -0.5f : 0.5f ) );
+                }
+            }
+        }
+    }
+}
+
+// Copy JPEG data into provided buffer, re-allocating it if too small
+static XError CopyToMemory( const uint8_t* jpegData, uint32_t jpegSize, uint8_t** buffer, uint32_t* bufferSize )
+{
+    XError ret = XError::Success;
+
+    if ( *bufferSize < jpegSize )
+    {
+        uint8_t* newBuffer = static_cast<uint8_t*>( realloc( *buffer, jpegSize ) );
+
+        if ( newBuffer == nullptr )
+        {
+            ret = XError::OutOfMemory;
+        }
+        else
+        {
+            *buffer = newBuffer;
+        }
+    }
+
+    if ( ret == XError::Success )
+    {
+        memcpy( *buffer, jpegData, jpegSize );
+        *bufferSize = jpegSize;
+    }
+
+    return ret;
+}
+
+} // namespace Private
@@ -0,0 +1,69 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XJPEG_TRANSCODER_HPP
+#define XJPEG_TRANSCODER_HPP
+
+#include <stdint.h>
+#include <memory>
+
+#include "XInterfaces.hpp"
+#include "XImage.hpp"
+#include "XError.hpp"
+
+namespace Private
+{
+    class XJpegTranscoderData;
+}
+
+/* Lowers quality of JPEG images without decoding them to pixels.
+
+   JPEG is entropy decoded to its quantized DCT coefficients only, which are then requantized
+   with quantization tables of the target quality and entropy coded again - no IDCT/FDCT,
+   upsampling or color conversion is done, which makes it few times cheaper than decoding and
+   encoding the image. Quality is never raised - quantizer of every coefficient is the bigger
+   one of the source and the target. If nothing changes, the source JPEG is copied as is.
+*/
+class XJpegTranscoder : private Uncopyable
+{
+public:
+    XJpegTranscoder( uint16_t quality = 85 );
+    ~XJpegTranscoder( );
+
+    // Set/get target quality, [1, 100]
+    uint16_t Quality( ) const;
+    void SetQuality( uint16_t quality );
+
+    /* Transcode the specified JPEG into provided buffer
+
+       On input, buffer size must be set to the size of provided buffer.
+       On output, it is set to the size of transcoded JPEG image. If provided
+       buffer is too small, it will be re-allocated (realloc).
+    */
+    XError TranscodeToMemory( const uint8_t* jpegData, uint32_t jpegSize, uint8_t** buffer, uint32_t* bufferSize );
+
+    // Transcode JPEG image (XPixelFormat::JPEG, width is the size of its data) into provided buffer
+    XError TranscodeToMemory( const std::shared_ptr<const XImage>& jpegImage, uint8_t** buffer, uint32_t* bufferSize );
+
+private:
+    Private::XJpegTranscoderData* mData;
+};
+
+#endif // XJPEG_TRANSCODER_HPP
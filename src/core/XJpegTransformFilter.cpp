@@ -0,0 +1,517 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <mutex>
+#include <jpeglib.h>
+
+#include "XJpegTransformFilter.hpp"
+
+using namespace std;
+
+namespace Private
+{
+    class TransformException : public exception
+    {
+    public:
+        virtual const char* what( ) const throw( )
+        {
+            return "JPEG transform failure";
+        }
+    };
+
+    static void transform_error_exit( j_common_ptr /* cinfo */ )
+    {
+        throw TransformException( );
+    }
+
+    static void transform_output_message( j_common_ptr /* cinfo */ )
+    {
+        // do nothing - kill the message
+    }
+
+    // Placement of component's blocks in the source and the transformed images (in blocks)
+    struct ComponentGeometry
+    {
+        // size of the source component (used only along mirrored axes, where it is trimmed to whole MCUs)
+        JDIMENSION SourceWidth;
+        JDIMENSION SourceHeight;
+        // position of the output's top-left block in the whole transformed component (not zero if cropping)
+        JDIMENSION OffsetX;
+        JDIMENSION OffsetY;
+        // size of the output component and number of rows in its coefficient array (multiple of sampling factor)
+        JDIMENSION Width;
+        JDIMENSION Height;
+        JDIMENSION Rows;
+    };
+
+    class XJpegTransformFilterData
+    {
+    public:
+        mutable mutex                     Sync;
+        XJpegTransformFilter::Transform   Transform;
+        int32_t                           CropX;
+        int32_t                           CropY;
+        int32_t                           CropWidth;
+        int32_t                           CropHeight;
+
+    private:
+        struct jpeg_decompress_struct     dinfo;
+        struct jpeg_compress_struct       cinfo;
+        struct jpeg_error_mgr             djerr;
+        struct jpeg_error_mgr             cjerr;
+
+        // coefficient arrays of the transformed image and rows of blocks of a source/transformed component
+        vector<jvirt_barray_ptr>          OutputArrays;
+        vector<ComponentGeometry>         Geometry;
+        vector<JBLOCKROW>                 SourceRows;
+        vector<JBLOCKROW>                 OutputRows;
+        // transformed JPEG
+        uint8_t*                          Buffer;
+        uint32_t                          BufferSize;
+
+    public:
+        XJpegTransformFilterData( XJpegTransformFilter::Transform transform ) :
+            Sync( ), Transform( transform ), CropX( 0 ), CropY( 0 ), CropWidth( 0 ), CropHeight( 0 ),
+            OutputArrays( ), Geometry( ), SourceRows( ), OutputRows( ), Buffer( nullptr ), BufferSize( 0 )
+        {
+            dinfo.err            = jpeg_std_error( &djerr );
+            djerr.error_exit     = transform_error_exit;
+            djerr.output_message = transform_output_message;
+
+            cinfo.err            = jpeg_std_error( &cjerr );
+            cjerr.error_exit     = transform_error_exit;
+            cjerr.output_message = transform_output_message;
+
+            jpeg_create_decompress( &dinfo );
+            jpeg_create_compress( &cinfo );
+        }
+
+        ~XJpegTransformFilterData( )
+        {
+            jpeg_destroy_compress( &cinfo );
+            jpeg_destroy_decompress( &dinfo );
+
+            if ( Buffer != nullptr )
+            {
+                free( Buffer );
+            }
+        }
+
+        XError Process( shared_ptr<XImage>& image );
+
+    private:
+        XError TransformJpeg( const uint8_t* jpegData, uint32_t jpegSize, XJpegTransformFilter::Transform transform,
+                              int32_t cropX, int32_t cropY, int32_t cropWidth, int32_t cropHeight, uint32_t* outputSize );
+        void TransformComponent( int ci, jvirt_barray_ptr sourceArray, XJpegTransformFilter::Transform transform );
+    };
+
+    static void GetBlockTransform( XJpegTransformFilter::Transform transform, int* index, JCOEF* sign );
+}
+
+XJpegTransformFilter::XJpegTransformFilter( Transform transform ) :
+    mData( new Private::XJpegTransformFilterData( transform ) )
+{
+
+}
+
+XJpegTransformFilter::~XJpegTransformFilter( )
+{
+    delete mData;
+}
+
+// Get/Set transform to apply
+XJpegTransformFilter::Transform XJpegTransformFilter::GetTransform( ) const
+{
+    lock_guard<mutex> lock( mData->Sync );
+    return mData->Transform;
+}
+void XJpegTransformFilter::SetTransform( Transform transform )
+{
+    lock_guard<mutex> lock( mData->Sync );
+    mData->Transform = transform;
+}
+
+// Get/Set crop rectangle (in coordinates of the transformed image)
+void XJpegTransformFilter::GetCrop( int32_t* x, int32_t* y, int32_t* width, int32_t* height ) const
+{
+    lock_guard<mutex> lock( mData->Sync );
+
+    if ( x      != nullptr ) *x      = mData->CropX;
+    if ( y      != nullptr ) *y      = mData->CropY;
+    if ( width  != nullptr ) *width  = mData->CropWidth;
+    if ( height != nullptr ) *height = mData->CropHeight;
+}
+void XJpegTransformFilter::SetCrop( int32_t x, int32_t y, int32_t width, int32_t height )
+{
+    lock_guard<mutex> lock( mData->Sync );
+
+    mData->CropX      = ( x < 0 ) ? 0 : x;
+    mData->CropY      = ( y < 0 ) ? 0 : y;
+    mData->CropWidth  = ( width  < 0 ) ? 0 : width;
+    mData->CropHeight = ( height < 0 ) ? 0 : height;
+}
+
+// Name of the filter
+string XJpegTransformFilter::Name( ) const
+{
+    return "JPEG transform";
+}
+
+// Transform JPEG image, replacing it with the result
+XError XJpegTransformFilter::Process( shared_ptr<XImage>& image, XImagePool& /* pool */ )
+{
+    return mData->Process( image );
+}
+
+namespace Private
+{
+
+// Transform JPEG image, replacing it with the result
+XError XJpegTransformFilterData::Process( shared_ptr<XImage>& image )
+{
+    XJpegTransformFilter::Transform transform;
+    int32_t                         cropX, cropY, cropWidth, cropHeight;
+    XError                          ret = XError::Success;
+
+    {
+        lock_guard<mutex> lock( Sync );
+
+        transform  = Transform;
+        cropX      = CropX;
+        cropY      = CropY;
+        cropWidth  = CropWidth;
+        cropHeight = CropHeight;
+    }
+
+    if ( ( !image ) || ( image->Data( ) == nullptr ) )
+    {
+        ret = XError::NullPointer;
+    }
+    else if ( ( image->Format( ) == XPixelFormat::JPEG ) &&
+              ( ( transform != XJpegTransformFilter::Transform::None ) || ( ( cropWidth != 0 ) && ( cropHeight != 0 ) ) ) )
+    {
+        uint32_t jpegSize = static_cast<uint32_t>( image->Width( ) );
+
+        // transformed image is about the size of the source one, so make sure libjpeg rarely needs to grow the buffer
+        if ( BufferSize < jpegSize )
+        {
+            uint32_t newSize   = jpegSize + jpegSize / 10;
+            uint8_t* newBuffer = static_cast<uint8_t*>( realloc( Buffer, newSize ) );
+
+            if ( newBuffer == nullptr )
+            {
+                ret = XError::OutOfMemory;
+            }
+            else
+            {
+                Buffer     = newBuffer;
+                BufferSize = newSize;
+            }
+        }
+
+        if ( ret )
+        {
+            uint32_t outputSize = 0;
+
+            ret = TransformJpeg( image->Data( ), jpegSize, transform, cropX, cropY, cropWidth, cropHeight, &outputSize );
+
+            if ( ret )
+            {
+                image = XImage::Create( Buffer, static_cast<int32_t>( outputSize ), 1, static_cast<int32_t>( outputSize ), XPixelFormat::JPEG );
+
+                if ( !image )
+                {
+                    ret = XError::OutOfMemory;
+                }
+            }
+        }
+    }
+
+    return ret;
+}
+
+// Transform JPEG image into the buffer
+XError XJpegTransformFilterData::TransformJpeg( const uint8_t* jpegData, uint32_t jpegSize, XJpegTransformFilter::Transform transform,
+                                                int32_t cropX, int32_t cropY, int32_t cropWidth, int32_t cropHeight, uint32_t* outputSize )
+{
+    typedef XJpegTransformFilter::Transform T;
+
+    XError ret = XError::Success;
+
+    try
+    {
+        jpeg_mem_src( &dinfo, jpegData, static_cast<unsigned long>( jpegSize ) );
+        jpeg_read_header( &dinfo, TRUE );
+
+        // source axes which get mirrored - partial MCUs on their far side would end up at the near side,
+        // where they can not be, so the source image is trimmed to whole MCUs along those axes
+        bool       mirrorX    = ( ( transform == T::FlipHorizontal ) || ( transform == T::Rotate180 ) || ( transform == T::Rotate270 ) );
+        bool       mirrorY    = ( ( transform == T::FlipVertical   ) || ( transform == T::Rotate180 ) || ( transform == T::Rotate90  ) );
+        bool       transpose  = ( ( transform == T::Rotate90 ) || ( transform == T::Rotate270 ) );
+        int        maxHSample = dinfo.max_h_samp_factor;
+        int        maxVSample = dinfo.max_v_samp_factor;
+        JDIMENSION srcWidth   = dinfo.image_width;
+        JDIMENSION srcHeight  = dinfo.image_height;
+
+        if ( mirrorX )
+        {
+            srcWidth -= srcWidth % ( maxHSample * DCTSIZE );
+        }
+        if ( mirrorY )
+        {
+            srcHeight -= srcHeight % ( maxVSample * DCTSIZE );
+        }
+
+        // size of the transformed image and its MCU
+        JDIMENSION outWidth   = ( transpose ) ? srcHeight : srcWidth;
+        JDIMENSION outHeight  = ( transpose ) ? srcWidth  : srcHeight;
+        int        outMaxH    = ( transpose ) ? maxVSample : maxHSample;
+        int        outMaxV    = ( transpose ) ? maxHSample : maxVSample;
+        JDIMENSION outX       = 0;
+        JDIMENSION outY       = 0;
+
+        if ( ( cropWidth != 0 ) && ( cropHeight != 0 ) )
+        {
+            JDIMENSION right  = static_cast<JDIMENSION>( cropX ) + static_cast<JDIMENSION>( cropWidth );
+            JDIMENSION bottom = static_cast<JDIMENSION>( cropY ) + static_cast<JDIMENSION>( cropHeight );
+
+            if ( ( static_cast<JDIMENSION>( cropX ) >= outWidth ) || ( static_cast<JDIMENSION>( cropY ) >= outHeight ) )
+            {
+                outWidth = outHeight = 0;
+            }
+            else
+            {
+                outX      = static_cast<JDIMENSION>( cropX ) / ( outMaxH * DCTSIZE ) * ( outMaxH * DCTSIZE );
+                outY      = static_cast<JDIMENSION>( cropY ) / ( outMaxV * DCTSIZE ) * ( outMaxV * DCTSIZE );
+                outWidth  = ( ( right  < outWidth  ) ? right  : outWidth  ) - outX;
+                outHeight = ( ( bottom < outHeight ) ? bottom : outHeight ) - outY;
+            }
+        }
+
+        if ( ( outWidth == 0 ) || ( outHeight == 0 ) )
+        {
+            // image is smaller than MCU or crop rectangle is outside of it
+            jpeg_abort_decompress( &dinfo );
+            ret = XError::ConfigurationNotSupported;
+        }
+        else
+        {
+            // request coefficient arrays of the transformed image (must be done before reading coefficients)
+            OutputArrays.resize( dinfo.num_components );
+            Geometry.resize( dinfo.num_components );
+
+            for ( int ci = 0; ci < dinfo.num_components; ci++ )
+            {
+                jpeg_component_info* component = &dinfo.comp_info[ci];
+                ComponentGeometry&   geometry  = Geometry[ci];
+                int                  hSample   = ( transpose ) ? component->v_samp_factor : component->h_samp_factor;
+                int                  vSample   = ( transpose ) ? component->h_samp_factor : component->v_samp_factor;
+
+                geometry.SourceWidth  = srcWidth  * component->h_samp_factor / ( maxHSample * DCTSIZE );
+                geometry.SourceHeight = srcHeight * component->v_samp_factor / ( maxVSample * DCTSIZE );
+                geometry.OffsetX      = outX / ( outMaxH * DCTSIZE ) * hSample;
+                geometry.OffsetY      = outY / ( outMaxV * DCTSIZE ) * vSample;
+                geometry.Width        = ( outWidth  * hSample + outMaxH * DCTSIZE - 1 ) / ( outMaxH * DCTSIZE );
+                geometry.Height       = ( outHeight * vSample + outMaxV * DCTSIZE - 1 ) / ( outMaxV * DCTSIZE );
+                geometry.Rows         = ( geometry.Height + vSample - 1 ) / vSample * vSample;
+
+                OutputArrays[ci] = ( *dinfo.mem->request_virt_barray )( reinterpret_cast<j_common_ptr>( &dinfo ), JPOOL_IMAGE, FALSE,
+                    ( geometry.Width + hSample - 1 ) / hSample * hSample, geometry.Rows, static_cast<JDIMENSION>( vSample ) );
+            }
+
+            jvirt_barray_ptr* sourceArrays = jpeg_read_coefficients( &dinfo );
+
+            // move blocks of every component
+            for ( int ci = 0; ci < dinfo.num_components; ci++ )
+            {
+                TransformComponent( ci, sourceArrays[ci], transform );
+            }
+
+            // set parameters of the transformed image
+            jpeg_copy_critical_parameters( &dinfo, &cinfo );
+
+            cinfo.image_width  = outWidth;
+            cinfo.image_height = outHeight;
+
+            if ( transpose )
+            {
+                for ( int ci = 0; ci < cinfo.num_components; ci++ )
+                {
+                    int hSample = cinfo.comp_info[ci].h_samp_factor;
+
+                    cinfo.comp_info[ci].h_samp_factor = cinfo.comp_info[ci].v_samp_factor;
+                    cinfo.comp_info[ci].v_samp_factor = hSample;
+                }
+
+                // coefficients are transposed, so quantization tables must be as well
+                for ( int i = 0; i < NUM_QUANT_TBLS; i++ )
+                {
+                    if ( cinfo.quant_tbl_ptrs[i] != nullptr )
+                    {
+                        UINT16* quant = cinfo.quant_tbl_ptrs[i]->quantval;
+
+                        for ( int v = 0; v < DCTSIZE; v++ )
+                        {
+                            for ( int u = v + 1; u < DCTSIZE; u++ )
+                            {
+                                UINT16 temp = quant[v * DCTSIZE + u];
+
+                                quant[v * DCTSIZE + u] = quant[u * DCTSIZE + v];
+                                quant[u * DCTSIZE + v] = temp;
+                            }
+                        }
+                    }
+                }
+            }
+
+            // entropy code the transformed coefficients
+            uint8_t*      originalBuffer  = Buffer;
+            unsigned long mem_buffer_size = BufferSize;
+
+            jpeg_mem_dest( &cinfo, &Buffer, &mem_buffer_size );
+            jpeg_write_coefficients( &cinfo, OutputArrays.data( ) );
+            jpeg_finish_compress( &cinfo );
+            jpeg_finish_decompress( &dinfo );
+
+            // libjpeg allocates a new buffer instead of expanding the provided one
+            if ( Buffer != originalBuffer )
+            {
+                free( originalBuffer );
+                BufferSize = static_cast<uint32_t>( mem_buffer_size );
+            }
+
+            *outputSize = static_cast<uint32_t>( mem_buffer_size );
+        }
+    }
+    catch ( const TransformException& )
+    {
+        jpeg_abort_compress( &cinfo );
+        jpeg_abort_decompress( &dinfo );
+        ret = XError::FailedImageEncoding;
+    }
+
+    return ret;
+}
+
+// Move blocks of a component from the source coefficient array to the output one, transforming their coefficients
+void XJpegTransformFilterData::TransformComponent( int ci, jvirt_barray_ptr sourceArray, XJpegTransformFilter::Transform transform )
+{
+    typedef XJpegTransformFilter::Transform T;
+
+    j_common_ptr             common    = reinterpret_cast<j_common_ptr>( &dinfo );
+    jpeg_component_info*     component = &dinfo.comp_info[ci];
+    const ComponentGeometry& geometry  = Geometry[ci];
+    int                      index[DCTSIZE2];
+    JCOEF                    sign[DCTSIZE2];
+
+    GetBlockTransform( transform, index, sign );
+
+    // all coefficients are kept in memory, so pointers to rows of blocks stay valid
+    SourceRows.resize( component->height_in_blocks );
+    for ( JDIMENSION row = 0; row < component->height_in_blocks; row++ )
+    {
+        SourceRows[row] = ( *dinfo.mem->access_virt_barray )( common, sourceArray, row, 1, FALSE )[0];
+    }
+
+    // padding rows are never read by compressor, but still need to be accessed to become defined
+    OutputRows.resize( geometry.Rows );
+    for ( JDIMENSION row = 0; row < geometry.Rows; row++ )
+    {
+        OutputRows[row] = ( *dinfo.mem->access_virt_barray )( common, OutputArrays[ci], row, 1, TRUE )[0];
+    }
+
+    for ( JDIMENSION y = 0; y < geometry.Height; y++ )
+    {
+        JBLOCKROW  outRow = OutputRows[y];
+        JDIMENSION ty     = y + geometry.OffsetY;
+
+        for ( JDIMENSION x = 0; x < geometry.Width; x++ )
+        {
+            JDIMENSION tx = x + geometry.OffsetX;
+            JDIMENSION sx, sy;
+
+            // source block of the transformed one
+            switch ( transform )
+            {
+            case T::FlipHorizontal:
+                sx = geometry.SourceWidth - 1 - tx;
+                sy = ty;
+                break;
+            case T::FlipVertical:
+                sx = tx;
+                sy = geometry.SourceHeight - 1 - ty;
+                break;
+            case T::Rotate90:
+                sx = ty;
+                sy = geometry.SourceHeight - 1 - tx;
+                break;
+            case T::Rotate180:
+                sx = geometry.SourceWidth  - 1 - tx;
+                sy = geometry.SourceHeight - 1 - ty;
+                break;
+            case T::Rotate270:
+                sx = geometry.SourceWidth - 1 - ty;
+                sy = tx;
+                break;
+            default:
+                sx = tx;
+                sy = ty;
+                break;
+            }
+
+            const JCOEF* src = SourceRows[sy][sx];
+            JCOEF*       dst = outRow[x];
+
+            for ( int k = 0; k < DCTSIZE2; k++ )
+            {
+                dst[k] = src[index[k]] * sign[k];
+            }
+        }
+    }
+}
+
+// Get coefficient transform of a block - coefficient k of the transformed block is the index[k]
+// coefficient of the source block multiplied by sign[k] (odd frequencies change sign when mirrored)
+static void GetBlockTransform( XJpegTransformFilter::Transform transform, int* index, JCOEF* sign )
+{
+    typedef XJpegTransformFilter::Transform T;
+
+    bool transpose = ( ( transform == T::Rotate90 ) || ( transform == T::Rotate270 ) );
+    // mirroring of the transformed block's columns/rows
+    bool mirrorU   = ( ( transform == T::FlipHorizontal ) || ( transform == T::Rotate180 ) || ( transform == T::Rotate90 ) );
+    bool mirrorV   = ( ( transform == T::FlipVertical   ) || ( transform == T::Rotate180 ) || ( transform == T::Rotate270 ) );
+
+    for ( int v = 0; v < DCTSIZE; v++ )
+    {
+        for ( int u = 0; u < DCTSIZE; u++ )
+        {
+            int k = v * DCTSIZE + u;
+
+            index[k] = ( transpose ) ? u * DCTSIZE + v : k;
+            sign[k]  = ( ( ( mirrorU ) && ( u & 1 ) ) != ( ( mirrorV ) && ( v & 1 ) ) ) ? -1 : 1;
+        }
+    }
+}
+
+} // namespace Private
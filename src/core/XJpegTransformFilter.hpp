@@ -0,0 +1,79 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XJPEG_TRANSFORM_FILTER_HPP
+#define XJPEG_TRANSFORM_FILTER_HPP
+
+#include <stdint.h>
+#include <memory>
+
+#include "XInterfaces.hpp"
+#include "IVideoFilter.hpp"
+
+namespace Private
+{
+    class XJpegTransformFilterData;
+}
+
+/* Video filter doing lossless rotation, flipping and cropping of JPEG images.
+
+   Images are transformed on their DCT coefficients (like jpegtran does) - blocks are moved and
+   their coefficients are transposed or negated, so nothing is lost and there is no IDCT/FDCT or
+   color conversion. Since only whole blocks can be moved, partial MCUs at the image edges, which
+   would end up at the top/left of the transformed image, are dropped (a few pixels at most), and
+   the top/left corner of the crop rectangle is aligned down to MCU size.
+
+   Only JPEG images are transformed, images of other pixel formats are left untouched.
+*/
+class XJpegTransformFilter : public IVideoFilter, private Uncopyable
+{
+public:
+    enum class Transform
+    {
+        None = 0,
+        FlipHorizontal,
+        FlipVertical,
+        Rotate90,       // clockwise
+        Rotate180,
+        Rotate270
+    };
+
+public:
+    XJpegTransformFilter( Transform transform = Transform::None );
+    ~XJpegTransformFilter( );
+
+    // Get/Set transform to apply
+    Transform GetTransform( ) const;
+    void SetTransform( Transform transform );
+
+    // Get/Set crop rectangle, which is given in coordinates of the transformed image (zero width or
+    // height - no cropping). The rectangle is clipped to the image.
+    void GetCrop( int32_t* x, int32_t* y, int32_t* width, int32_t* height ) const;
+    void SetCrop( int32_t x, int32_t y, int32_t width, int32_t height );
+
+    // IVideoFilter interface
+    std::string Name( ) const;
+    XError Process( std::shared_ptr<XImage>& image, XImagePool& pool );
+
+private:
+    Private::XJpegTransformFilterData* mData;
+};
+
+#endif // XJPEG_TRANSFORM_FILTER_HPP
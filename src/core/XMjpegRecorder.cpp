@@ -0,0 +1,831 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "XMjpegRecorder.hpp"
+#include "XRecordingFormat.hpp"
+#include "XManualResetEvent.hpp"
+#include "XAsyncFileWriter.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace Private
+{
+    // Number of frames, which can wait for the writer
+    #define FRAME_SLOTS         (16)
+    // Number/size of write buffers and the block size writes are aligned to
+    #define WRITE_BUFFERS_COUNT (16)
+    #define WRITE_BUFFER_SIZE   (1024 * 1024)
+    #define WRITE_BLOCK_SIZE    (4096)
+    // Amount of buffered data, which triggers writing
+    #define WRITE_THRESHOLD     (256 * 1024)
+    // Maximum time data can stay in the write buffer (milliseconds)
+    #define MAX_WRITE_DELAY     (2000)
+    // Number of index entries kept till their frames are written
+    #define INDEX_BUFFER_SIZE   (1024)
+    // Segments are not allowed to grow beyond the offset index entries can keep
+    #define MAX_SEGMENT_SIZE    (0xF0000000u)
+    // Interval of checking for old recordings (milliseconds)
+    #define RETENTION_INTERVAL  (10000)
+
+    // Frame waiting to be written
+    struct FrameSlot
+    {
+        uint8_t* Data;
+        uint32_t BufferSize;
+        uint32_t Size;
+        uint64_t Time;
+        uint8_t  MotionLevel;
+    };
+
+    class XMjpegRecorderData
+    {
+    public:
+        XVideoSourceToWeb&      Video2Web;
+        string                  Folder;
+        uint32_t                FrameInterval;
+        uint32_t                SegmentDuration;
+        uint64_t                MaxTotalSize;
+        uint32_t                MaxAge;
+        const XMotionDetector*  MotionDetector;
+
+        recursive_mutex         StartSync;
+        thread                  CollectorThread;
+        thread                  WriterThread;
+        XManualResetEvent       CollectorNeedToStop;
+        XManualResetEvent       WriterNeedToStop;
+        XManualResetEvent       FramesAvailable;
+        bool                    IsRunning;
+
+        volatile uint32_t       FramesRecorded;
+        volatile uint32_t       FramesDropped;
+        volatile uint32_t       WriteErrors;
+
+        // queue of frames - collector fills the slot after the last filled, writer takes the first one
+        mutex                   SlotsGuard;
+        FrameSlot               Slots[FRAME_SLOTS];
+        uint32_t                FirstFilledSlot;
+        uint32_t                FilledSlotsCount;
+        uint32_t                LastSequence;
+
+        // current segment and its buffered data/index (accessed only by writer thread);
+        // data are put into buffers of the asynchronous writer, which are queued to it when filled
+        XAsyncFileWriter        Writer;
+        int                     DataFile;
+        int                     IndexFile;
+        int                     ActivityFile;
+        string                  SegmentName;
+        uint64_t                SegmentStartTime;
+        uint64_t                SegmentLastTime;
+        uint32_t                SegmentWrittenSize;
+        uint64_t                IndexWrittenSize;
+        bool                    SegmentBroken;
+        uint8_t*                WriteBuffer;
+        uint32_t                WriteBufferFill;
+        steady_clock::time_point WriteBufferTime;
+        XRecordingIndexEntry    IndexBuffer[INDEX_BUFFER_SIZE];
+        uint8_t                 ActivityBuffer[INDEX_BUFFER_SIZE];
+        uint32_t                IndexBufferFill;
+        uint32_t                WriterErrors;
+        steady_clock::time_point LastRetentionTime;
+
+    public:
+        XMjpegRecorderData( XVideoSourceToWeb& video2web, const string& folder, uint32_t frameRate ) :
+            Video2Web( video2web ), Folder( folder ),
+            FrameInterval( 1000 / ( ( frameRate == 0 ) ? 1 : frameRate ) ),
+            SegmentDuration( 600 ), MaxTotalSize( 0 ), MaxAge( 0 ), MotionDetector( nullptr ),
+            StartSync( ), CollectorThread( ), WriterThread( ), CollectorNeedToStop( ), WriterNeedToStop( ), FramesAvailable( ),
+            IsRunning( false ), FramesRecorded( 0 ), FramesDropped( 0 ), WriteErrors( 0 ),
+            SlotsGuard( ), FirstFilledSlot( 0 ), FilledSlotsCount( 0 ), LastSequence( 0 ),
+            Writer( WRITE_BUFFERS_COUNT, WRITE_BUFFER_SIZE ),
+            DataFile( -1 ), IndexFile( -1 ), ActivityFile( -1 ), SegmentName( ), SegmentStartTime( 0 ), SegmentLastTime( 0 ), SegmentWrittenSize( 0 ), IndexWrittenSize( 0 ),
+            SegmentBroken( false ), WriteBuffer( nullptr ), WriteBufferFill( 0 ), WriteBufferTime( ), IndexBufferFill( 0 ), WriterErrors( 0 ), LastRetentionTime( )
+        {
+            memset( Slots, 0, sizeof( Slots ) );
+
+            if ( ( !Folder.empty( ) ) && ( Folder.back( ) != '/' ) )
+            {
+                Folder += '/';
+            }
+        }
+
+        ~XMjpegRecorderData( )
+        {
+            for ( uint32_t i = 0; i < FRAME_SLOTS; i++ )
+            {
+                free( Slots[i].Data );
+            }
+        }
+
+        bool Start( );
+        void Stop( );
+
+    private:
+        void CollectFrame( );
+        void WriteFrame( const FrameSlot& slot );
+        bool OpenSegment( uint64_t time );
+        void CloseSegment( );
+        void FlushWriteBuffer( bool all );
+        void FlushIndexBuffer( );
+        uint8_t* AcquireWriteBuffer( );
+        void DeleteOldSegments( );
+
+        static void CollectorThreadHandler( XMjpegRecorderData* me );
+        static void WriterThreadHandler( XMjpegRecorderData* me );
+    };
+}
+
+XMjpegRecorder::XMjpegRecorder( XVideoSourceToWeb& video2web, const string& folder, uint32_t frameRate ) :
+    mData( new Private::XMjpegRecorderData( video2web, folder, frameRate ) )
+{
+}
+
+XMjpegRecorder::~XMjpegRecorder( )
+{
+    mData->Stop( );
+    delete mData;
+}
+
+// Folder to write recordings to
+string XMjpegRecorder::Folder( ) const
+{
+    return mData->Folder;
+}
+
+// Get/Set duration of a single segment
+uint32_t XMjpegRecorder::SegmentDuration( ) const
+{
+    return mData->SegmentDuration;
+}
+XMjpegRecorder& XMjpegRecorder::SetSegmentDuration( uint32_t seconds )
+{
+    lock_guard<recursive_mutex> lock( mData->StartSync );
+
+    if ( ( !mData->IsRunning ) && ( seconds != 0 ) )
+    {
+        mData->SegmentDuration = seconds;
+    }
+
+    return *this;
+}
+
+// Get/Set maximum total size of recordings
+uint64_t XMjpegRecorder::MaxTotalSize( ) const
+{
+    return mData->MaxTotalSize;
+}
+XMjpegRecorder& XMjpegRecorder::SetMaxTotalSize( uint64_t bytes )
+{
+    lock_guard<recursive_mutex> lock( mData->StartSync );
+
+    if ( !mData->IsRunning )
+    {
+        mData->MaxTotalSize = bytes;
+    }
+
+    return *this;
+}
+
+// Get/Set maximum age of recordings
+uint32_t XMjpegRecorder::MaxAge( ) const
+{
+    return mData->MaxAge;
+}
+XMjpegRecorder& XMjpegRecorder::SetMaxAge( uint32_t seconds )
+{
+    lock_guard<recursive_mutex> lock( mData->StartSync );
+
+    if ( !mData->IsRunning )
+    {
+        mData->MaxAge = seconds;
+    }
+
+    return *this;
+}
+
+// Set motion detector providing motion levels of recorded frames
+XMjpegRecorder& XMjpegRecorder::SetMotionDetector( const XMotionDetector* motionDetector )
+{
+    lock_guard<recursive_mutex> lock( mData->StartSync );
+
+    if ( !mData->IsRunning )
+    {
+        mData->MotionDetector = motionDetector;
+    }
+
+    return *this;
+}
+
+// Start recording
+bool XMjpegRecorder::Start( )
+{
+    return mData->Start( );
+}
+
+// Stop recording
+void XMjpegRecorder::Stop( )
+{
+    mData->Stop( );
+}
+
+// Number of frames written since the start
+uint32_t XMjpegRecorder::FramesRecorded( ) const
+{
+    return mData->FramesRecorded;
+}
+
+// Number of frames dropped because writing was too slow
+uint32_t XMjpegRecorder::FramesDropped( ) const
+{
+    return mData->FramesDropped;
+}
+
+// Number of failed writes
+uint32_t XMjpegRecorder::WriteErrors( ) const
+{
+    return mData->WriteErrors + mData->Writer.WriteErrors( );
+}
+
+namespace Private
+{
+
+// Start asynchronous writer and collecting/writing threads
+bool XMjpegRecorderData::Start( )
+{
+    lock_guard<recursive_mutex> lock( StartSync );
+
+    if ( ( !IsRunning ) && ( !Folder.empty( ) ) && ( Writer.Start( ) ) )
+    {
+        // make sure the folder exists
+        mkdir( Folder.c_str( ), 0755 );
+
+        CollectorNeedToStop.Reset( );
+        WriterNeedToStop.Reset( );
+        FramesAvailable.Reset( );
+
+        FirstFilledSlot   = 0;
+        FilledSlotsCount  = 0;
+        LastSequence      = 0;
+        FramesRecorded    = 0;
+        FramesDropped     = 0;
+        WriteErrors       = 0;
+        WriterErrors      = 0;
+        LastRetentionTime = steady_clock::now( ) - milliseconds( RETENTION_INTERVAL );
+        IsRunning         = true;
+
+        WriterThread    = thread( WriterThreadHandler, this );
+        CollectorThread = thread( CollectorThreadHandler, this );
+    }
+
+    return IsRunning;
+}
+
+// Stop collecting frames and then the writer, once it writes all queued frames
+void XMjpegRecorderData::Stop( )
+{
+    lock_guard<recursive_mutex> lock( StartSync );
+
+    if ( IsRunning )
+    {
+        CollectorNeedToStop.Signal( );
+        CollectorThread.join( );
+
+        WriterNeedToStop.Signal( );
+        FramesAvailable.Signal( );
+        WriterThread.join( );
+
+        Writer.Stop( );
+        IsRunning = false;
+    }
+}
+
+// Thread collecting the latest camera images at the configured frame rate
+void XMjpegRecorderData::CollectorThreadHandler( XMjpegRecorderData* me )
+{
+    while ( !me->CollectorNeedToStop.IsSignaled( ) )
+    {
+        steady_clock::time_point startTime = steady_clock::now( );
+
+        me->CollectFrame( );
+
+        uint32_t timeTaken = static_cast<uint32_t>( duration_cast<milliseconds>( steady_clock::now( ) - startTime ).count( ) );
+
+        me->CollectorNeedToStop.Wait( ( timeTaken < me->FrameInterval ) ? me->FrameInterval - timeTaken : 1 );
+    }
+}
+
+// Put the latest image into the queue (if it was not done yet)
+void XMjpegRecorderData::CollectFrame( )
+{
+    FrameSlot* slot = nullptr;
+    uint32_t   sequence;
+
+    {
+        lock_guard<mutex> lock( SlotsGuard );
+
+        if ( FilledSlotsCount < FRAME_SLOTS )
+        {
+            // the slot is not seen by writer till it is counted as filled
+            slot = &Slots[( FirstFilledSlot + FilledSlotsCount ) % FRAME_SLOTS];
+        }
+    }
+
+    if ( slot == nullptr )
+    {
+        // writer is behind, so the frame is lost
+        FramesDropped++;
+    }
+    else if ( ( Video2Web.GetJpegImage( &slot->Data, &slot->BufferSize, &slot->Size, &sequence ) ) && ( sequence != LastSequence ) )
+    {
+        LastSequence      = sequence;
+        slot->Time        = static_cast<uint64_t>( duration_cast<milliseconds>( system_clock::now( ).time_since_epoch( ) ).count( ) );
+        slot->MotionLevel = ( MotionDetector != nullptr ) ? MotionDetector->MotionLevel( ) : 0;
+
+        {
+            lock_guard<mutex> lock( SlotsGuard );
+            FilledSlotsCount++;
+        }
+
+        FramesAvailable.Signal( );
+    }
+}
+
+// Thread writing queued frames to disk
+void XMjpegRecorderData::WriterThreadHandler( XMjpegRecorderData* me )
+{
+    bool needToStop = false;
+
+    while ( !needToStop )
+    {
+        me->FramesAvailable.Wait( MAX_WRITE_DELAY / 4 );
+        me->FramesAvailable.Reset( );
+
+        // check the stop signal before taking frames, so none are left in the queue
+        needToStop = me->WriterNeedToStop.IsSignaled( );
+
+        for ( ; ; )
+        {
+            FrameSlot* slot = nullptr;
+
+            {
+                lock_guard<mutex> lock( me->SlotsGuard );
+
+                if ( me->FilledSlotsCount != 0 )
+                {
+                    slot = &me->Slots[me->FirstFilledSlot];
+                }
+            }
+
+            if ( slot == nullptr )
+            {
+                break;
+            }
+
+            me->WriteFrame( *slot );
+
+            {
+                lock_guard<mutex> lock( me->SlotsGuard );
+
+                me->FirstFilledSlot = ( me->FirstFilledSlot + 1 ) % FRAME_SLOTS;
+                me->FilledSlotsCount--;
+            }
+        }
+
+        // send data of all taken frames to disk with a single submission
+        me->Writer.Submit( );
+
+        // don't keep data in memory for too long if frames are small/rare
+        if ( ( ( me->WriteBufferFill != 0 ) || ( me->IndexBufferFill != 0 ) ) &&
+             ( duration_cast<milliseconds>( steady_clock::now( ) - me->WriteBufferTime ).count( ) >= MAX_WRITE_DELAY ) )
+        {
+            me->FlushWriteBuffer( true );
+            me->FlushIndexBuffer( );
+
+            if ( me->SegmentBroken )
+            {
+                me->CloseSegment( );
+            }
+        }
+
+        if ( duration_cast<milliseconds>( steady_clock::now( ) - me->LastRetentionTime ).count( ) >= RETENTION_INTERVAL )
+        {
+            me->DeleteOldSegments( );
+            me->LastRetentionTime = steady_clock::now( );
+        }
+    }
+
+    me->CloseSegment( );
+}
+
+// Put frame into write buffer, starting new segment if needed
+void XMjpegRecorderData::WriteFrame( const FrameSlot& slot )
+{
+    uint64_t time = slot.Time;
+
+    if ( ( DataFile != -1 ) && ( IndexBufferFill == INDEX_BUFFER_SIZE ) )
+    {
+        // index entries are written only for written frames, so make room by writing everything
+        FlushWriteBuffer( true );
+        FlushIndexBuffer( );
+    }
+
+    // wall clock may step backwards (NTP), but segment's index must stay time ordered for binary search
+    if ( ( DataFile != -1 ) && ( time < SegmentLastTime ) )
+    {
+        time = SegmentLastTime;
+    }
+
+    // segment is also rotated if some of its data could not be queued for writing, since data following
+    // the lost part would not match offsets kept in the index
+    if ( ( DataFile != -1 ) &&
+         ( ( SegmentBroken ) ||
+           ( time >= SegmentStartTime + static_cast<uint64_t>( SegmentDuration ) * 1000 ) ||
+           ( slot.Size > MAX_SEGMENT_SIZE - ( SegmentWrittenSize + WriteBufferFill ) ) ) )
+    {
+        CloseSegment( );
+        DeleteOldSegments( );
+    }
+
+    if ( ( DataFile != -1 ) || ( OpenSegment( time ) ) )
+    {
+        const uint8_t* data      = slot.Data;
+        uint32_t       remaining = slot.Size;
+
+        if ( ( WriteBufferFill == 0 ) && ( IndexBufferFill == 0 ) )
+        {
+            WriteBufferTime = steady_clock::now( );
+        }
+
+        if ( time < SegmentLastTime )
+        {
+            time = SegmentLastTime;
+        }
+        SegmentLastTime = time;
+
+        IndexBuffer[IndexBufferFill].Time   = time;
+        IndexBuffer[IndexBufferFill].Offset = SegmentWrittenSize + WriteBufferFill;
+        IndexBuffer[IndexBufferFill].Size   = slot.Size;
+        ActivityBuffer[IndexBufferFill]     = slot.MotionLevel;
+        IndexBufferFill++;
+
+        while ( ( remaining != 0 ) && ( !SegmentBroken ) )
+        {
+            if ( WriteBuffer == nullptr )
+            {
+                WriteBuffer = AcquireWriteBuffer( );
+            }
+
+            uint32_t toCopy = min( remaining, static_cast<uint32_t>( WRITE_BUFFER_SIZE ) - WriteBufferFill );
+
+            memcpy( WriteBuffer + WriteBufferFill, data, toCopy );
+            WriteBufferFill += toCopy;
+            data            += toCopy;
+            remaining       -= toCopy;
+
+            if ( WriteBufferFill == WRITE_BUFFER_SIZE )
+            {
+                FlushWriteBuffer( false );
+            }
+        }
+
+        if ( ( WriteBufferFill >= WRITE_THRESHOLD ) && ( !SegmentBroken ) )
+        {
+            FlushWriteBuffer( false );
+        }
+
+        if ( SegmentBroken )
+        {
+            CloseSegment( );
+        }
+        else
+        {
+            FramesRecorded++;
+        }
+    }
+}
+
+// Open data and index files of a new segment
+bool XMjpegRecorderData::OpenSegment( uint64_t time )
+{
+    string name = SegmentName = XRecordingSegment::MakeName( time );
+
+    // writes are done at explicit offsets, so files are not opened for appending
+    DataFile  = open( ( Folder + name + XRecordingSegment::DataExtension ).c_str( ), O_WRONLY | O_CREAT, 0644 );
+    IndexFile = open( ( Folder + name + XRecordingSegment::IndexExtension ).c_str( ), O_RDWR | O_CREAT, 0644 );
+
+    if ( MotionDetector != nullptr )
+    {
+        ActivityFile = open( ( Folder + name + XRecordingSegment::ActivityExtension ).c_str( ), O_WRONLY | O_CREAT, 0644 );
+
+        if ( ActivityFile == -1 )
+        {
+            // recording is still possible without motion levels
+            WriteErrors++;
+        }
+    }
+
+    if ( ( DataFile == -1 ) || ( IndexFile == -1 ) )
+    {
+        WriteErrors++;
+        CloseSegment( );
+    }
+    else
+    {
+        // segment with the same name may exist if recording was restarted quickly
+        off_t existingSize      = lseek( DataFile, 0, SEEK_END );
+        off_t existingIndexSize = lseek( IndexFile, 0, SEEK_END );
+
+        SegmentStartTime   = time;
+        SegmentWrittenSize = ( existingSize > 0 ) ? static_cast<uint32_t>( existingSize ) : 0;
+        IndexWrittenSize   = ( existingIndexSize > 0 ) ?
+                             static_cast<uint64_t>( existingIndexSize ) / sizeof( XRecordingIndexEntry ) * sizeof( XRecordingIndexEntry ) : 0;
+        SegmentLastTime    = time;
+        WriteBufferFill    = 0;
+        IndexBufferFill    = 0;
+        SegmentBroken      = false;
+        WriterErrors       = Writer.WriteErrors( );
+
+        // frames appended to the existing segment must not go before the ones it already has
+        if ( IndexWrittenSize != 0 )
+        {
+            XRecordingIndexEntry lastEntry;
+
+            if ( ( pread( IndexFile, &lastEntry, sizeof( lastEntry ), static_cast<off_t>( IndexWrittenSize - sizeof( lastEntry ) ) ) == sizeof( lastEntry ) ) &&
+                 ( lastEntry.Time > SegmentLastTime ) )
+            {
+                SegmentLastTime = lastEntry.Time;
+            }
+        }
+    }
+
+    return ( DataFile != -1 );
+}
+
+// Write all buffered data and close segment's files
+void XMjpegRecorderData::CloseSegment( )
+{
+    if ( ( DataFile != -1 ) && ( IndexFile != -1 ) )
+    {
+        FlushWriteBuffer( true );
+        FlushIndexBuffer( );
+    }
+
+    // files can not be closed while there are writes to them in flight
+    Writer.WaitForCompletion( );
+
+    if ( DataFile != -1 )
+    {
+        close( DataFile );
+        DataFile = -1;
+    }
+    if ( IndexFile != -1 )
+    {
+        close( IndexFile );
+        IndexFile = -1;
+    }
+    if ( ActivityFile != -1 )
+    {
+        close( ActivityFile );
+        ActivityFile = -1;
+    }
+
+    if ( WriteBuffer != nullptr )
+    {
+        Writer.ReleaseBuffer( WriteBuffer );
+        WriteBuffer = nullptr;
+    }
+
+    WriteBufferFill = 0;
+    IndexBufferFill = 0;
+    SegmentBroken   = false;
+}
+
+// Queue buffered data for writing - either everything or only the part ending at block boundary
+// of the file (the rest is moved into a new buffer)
+void XMjpegRecorderData::FlushWriteBuffer( bool all )
+{
+    uint32_t toWrite = WriteBufferFill;
+
+    if ( !all )
+    {
+        uint32_t end = ( SegmentWrittenSize + WriteBufferFill ) & ~static_cast<uint32_t>( WRITE_BLOCK_SIZE - 1 );
+
+        toWrite = ( end > SegmentWrittenSize ) ? end - SegmentWrittenSize : 0;
+    }
+
+    if ( toWrite != 0 )
+    {
+        uint8_t* nextBuffer = nullptr;
+        uint32_t leftover   = WriteBufferFill - toWrite;
+
+        if ( leftover != 0 )
+        {
+            nextBuffer = AcquireWriteBuffer( );
+            memcpy( nextBuffer, WriteBuffer + toWrite, leftover );
+        }
+
+        if ( Writer.QueueWrite( DataFile, WriteBuffer, toWrite, SegmentWrittenSize ) == XError::Success )
+        {
+            SegmentWrittenSize += toWrite;
+            WriteBuffer         = nextBuffer;
+            WriteBufferFill     = leftover;
+        }
+        else
+        {
+            // drop everything buffered - frames not written completely never get their index entries
+            Writer.ReleaseBuffer( WriteBuffer );
+            if ( nextBuffer != nullptr )
+            {
+                Writer.ReleaseBuffer( nextBuffer );
+            }
+
+            WriteBuffer     = nullptr;
+            WriteBufferFill = 0;
+            SegmentBroken   = true;
+            WriteErrors++;
+        }
+    }
+}
+
+// Wait till queued data are written and then queue index entries of the frames, which got completely
+// written (if some data failed to write, all entries since the last flush are dropped, since it is
+// not known which frames were damaged)
+void XMjpegRecorderData::FlushIndexBuffer( )
+{
+    if ( IndexBufferFill != 0 )
+    {
+        uint32_t entriesToWrite = 0;
+        uint32_t writerErrors;
+
+        Writer.WaitForCompletion( );
+        writerErrors = Writer.WriteErrors( );
+
+        while ( ( entriesToWrite < IndexBufferFill ) &&
+                ( IndexBuffer[entriesToWrite].Offset + IndexBuffer[entriesToWrite].Size <= SegmentWrittenSize ) )
+        {
+            entriesToWrite++;
+        }
+
+        if ( writerErrors != WriterErrors )
+        {
+            WriterErrors = writerErrors;
+        }
+        else if ( entriesToWrite != 0 )
+        {
+            uint32_t size   = entriesToWrite * sizeof( XRecordingIndexEntry );
+            uint8_t* buffer = AcquireWriteBuffer( );
+
+            memcpy( buffer, IndexBuffer, size );
+
+            bool queued = ( Writer.QueueWrite( IndexFile, buffer, size, IndexWrittenSize ) == XError::Success );
+
+            if ( !queued )
+            {
+                // entries are dropped and the segment gets closed
+                Writer.ReleaseBuffer( buffer );
+                SegmentBroken = true;
+                WriteErrors++;
+            }
+            else if ( ActivityFile != -1 )
+            {
+                // motion levels are kept at the same positions as index records
+                buffer = AcquireWriteBuffer( );
+                memcpy( buffer, ActivityBuffer, entriesToWrite );
+
+                if ( Writer.QueueWrite( ActivityFile, buffer, entriesToWrite, IndexWrittenSize / sizeof( XRecordingIndexEntry ) ) != XError::Success )
+                {
+                    Writer.ReleaseBuffer( buffer );
+                    WriteErrors++;
+                }
+            }
+
+            if ( queued )
+            {
+                IndexWrittenSize += size;
+            }
+            Writer.Submit( );
+        }
+
+        IndexBufferFill -= entriesToWrite;
+        memmove( IndexBuffer, IndexBuffer + entriesToWrite, IndexBufferFill * sizeof( XRecordingIndexEntry ) );
+        memmove( ActivityBuffer, ActivityBuffer + entriesToWrite, IndexBufferFill );
+    }
+}
+
+// Get buffer from the asynchronous writer, waiting as long as it takes for disk to catch up
+// (meanwhile the collector keeps taking frames and drops them once its queue is full)
+uint8_t* XMjpegRecorderData::AcquireWriteBuffer( )
+{
+    uint8_t* buffer;
+
+    while ( ( buffer = Writer.AcquireBuffer( MAX_WRITE_DELAY ) ) == nullptr )
+    {
+    }
+
+    return buffer;
+}
+
+// Delete the oldest segments if recordings take too much space or are too old
+void XMjpegRecorderData::DeleteOldSegments( )
+{
+    if ( ( MaxTotalSize != 0 ) || ( MaxAge != 0 ) )
+    {
+        DIR*                            dir       = opendir( Folder.c_str( ) );
+        time_t                          now       = time( nullptr );
+        uint64_t                        totalSize = 0;
+        vector<pair<string, uint64_t>>  segments;
+
+        if ( dir != nullptr )
+        {
+            struct dirent* entry;
+            string         baseName;
+
+            while ( ( entry = readdir( dir ) ) != nullptr )
+            {
+                struct stat dataStat;
+
+                if ( ( XRecordingSegment::IsSegmentFile( entry->d_name, XRecordingSegment::DataExtension, &baseName ) ) &&
+                     ( stat( ( Folder + entry->d_name ).c_str( ), &dataStat ) == 0 ) )
+                {
+                    struct stat indexStat;
+                    struct stat activityStat;
+                    uint64_t    size = static_cast<uint64_t>( dataStat.st_size );
+
+                    if ( stat( ( Folder + baseName + XRecordingSegment::IndexExtension ).c_str( ), &indexStat ) == 0 )
+                    {
+                        size += static_cast<uint64_t>( indexStat.st_size );
+                    }
+                    if ( stat( ( Folder + baseName + XRecordingSegment::ActivityExtension ).c_str( ), &activityStat ) == 0 )
+                    {
+                        size += static_cast<uint64_t>( activityStat.st_size );
+                    }
+
+                    // age of segment is defined by its last frame, i.e. modification time
+                    if ( ( MaxAge != 0 ) && ( baseName != SegmentName ) && ( now - dataStat.st_mtime > static_cast<time_t>( MaxAge ) ) )
+                    {
+                        unlink( ( Folder + baseName + XRecordingSegment::DataExtension ).c_str( ) );
+                        unlink( ( Folder + baseName + XRecordingSegment::IndexExtension ).c_str( ) );
+                        unlink( ( Folder + baseName + XRecordingSegment::ActivityExtension ).c_str( ) );
+                    }
+                    else
+                    {
+                        segments.push_back( make_pair( baseName, size ) );
+                        totalSize += size;
+                    }
+                }
+            }
+
+            closedir( dir );
+        }
+
+        if ( MaxTotalSize != 0 )
+        {
+            // names are times, so sorting them puts the oldest first
+            sort( segments.begin( ), segments.end( ) );
+
+            for ( size_t i = 0; ( i < segments.size( ) ) && ( totalSize > MaxTotalSize ); i++ )
+            {
+                if ( segments[i].first != SegmentName )
+                {
+                    unlink( ( Folder + segments[i].first + XRecordingSegment::DataExtension ).c_str( ) );
+                    unlink( ( Folder + segments[i].first + XRecordingSegment::IndexExtension ).c_str( ) );
+                    unlink( ( Folder + segments[i].first + XRecordingSegment::ActivityExtension ).c_str( ) );
+
+                    totalSize -= segments[i].second;
+                }
+            }
+        }
+    }
+}
+
+} // namespace Private
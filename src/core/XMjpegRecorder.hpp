@@ -0,0 +1,93 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XMJPEG_RECORDER_HPP
+#define XMJPEG_RECORDER_HPP
+
+#include <stdint.h>
+#include <string>
+
+#include "XInterfaces.hpp"
+#include "XVideoSourceToWeb.hpp"
+#include "XMotionDetector.hpp"
+
+namespace Private
+{
+    class XMjpegRecorderData;
+}
+
+/* Records camera images (JPEGs taken from XVideoSourceToWeb, same as provided to web clients)
+   into the specified folder as rotating segments described in XRecordingFormat.hpp.
+
+   Images are collected on one thread and put into a small queue of preallocated frame slots,
+   while another thread writes them to disk. Writes are batched through buffers of XAsyncFileWriter
+   and done in multiples of file system block size, so slow disks delay only the writer thread -
+   frames are dropped if the queue gets full, but camera and web clients never wait for disk.
+
+   If motion detector is set, motion level of every frame is recorded as well, so activity can
+   be searched without looking at images.
+
+   Old segments are deleted when total size of recordings or their age exceeds the specified
+   limits (0 means no limit).
+
+   Note: images are taken all the time while recorder is running, so camera in on-demand
+   mode is kept running as well.
+*/
+class XMjpegRecorder : private Uncopyable
+{
+public:
+    XMjpegRecorder( XVideoSourceToWeb& video2web, const std::string& folder, uint32_t frameRate = 30 );
+    ~XMjpegRecorder( );
+
+    // Folder to write recordings to
+    std::string Folder( ) const;
+
+    // Get/Set duration of a single segment (seconds), default is 600.
+    // Setting is only possible when recorder is not running.
+    uint32_t SegmentDuration( ) const;
+    XMjpegRecorder& SetSegmentDuration( uint32_t seconds );
+
+    // Get/Set maximum total size of recordings (bytes)
+    uint64_t MaxTotalSize( ) const;
+    XMjpegRecorder& SetMaxTotalSize( uint64_t bytes );
+
+    // Get/Set maximum age of recordings (seconds)
+    uint32_t MaxAge( ) const;
+    XMjpegRecorder& SetMaxAge( uint32_t seconds );
+
+    // Set motion detector providing motion levels of recorded frames.
+    // Setting is only possible when recorder is not running.
+    XMjpegRecorder& SetMotionDetector( const XMotionDetector* motionDetector );
+
+    // Start/Stop recording
+    bool Start( );
+    void Stop( );
+
+    // Number of frames written, number of frames dropped because writing was too slow
+    // and number of failed writes since the start
+    uint32_t FramesRecorded( ) const;
+    uint32_t FramesDropped( ) const;
+    uint32_t WriteErrors( ) const;
+
+private:
+    Private::XMjpegRecorderData* mData;
+};
+
+#endif // XMJPEG_RECORDER_HPP
@@ -0,0 +1,632 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <exception>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <jpeglib.h>
+
+#if defined( __SSE2__ )
+    #include <emmintrin.h>
+#elif defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+    #include <arm_neon.h>
+    #define MOTION_USE_NEON
+#endif
+
+#include "XMotionDetector.hpp"
+#include "XJpegDcDecoder.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace Private
+{
+    // Maximum width of the analysed plane
+    #define MAX_ANALYSIS_WIDTH  (160)
+    // Difference of pixel values, which is treated as a change (smaller is noise)
+    #define NOISE_THRESHOLD     (24)
+
+    class JpegDecodingException : public exception
+    {
+    public:
+        virtual const char* what( ) const throw( )
+        {
+            return "JPEG decoding failure";
+        }
+    };
+
+    static void decoder_error_exit( j_common_ptr /* cinfo */ )
+    {
+        throw JpegDecodingException( );
+    }
+
+    static void decoder_output_message( j_common_ptr /* cinfo */ )
+    {
+        // do nothing - kill the message
+    }
+
+    // Provides result of motion detection as object information
+    class MotionInformation : public IObjectInformation
+    {
+    private:
+        const XMotionDetector* Owner;
+
+    public:
+        MotionInformation( const XMotionDetector* owner ) : Owner( owner ) { }
+
+        XError GetProperty( const string& propertyName, string& value ) const;
+        PropertyMap GetAllProperties( ) const;
+    };
+
+    class XMotionDetectorData
+    {
+    public:
+        volatile uint32_t   MotionLevel;
+        volatile uint32_t   FramesAnalysed;
+        volatile uint32_t   AnalysisRate;
+        volatile uint8_t    MotionThreshold;
+
+        XMotionDetector::MotionState State;
+        mutable mutex                StateGuard;
+
+    private:
+        // luma plane of the current image and the running background
+        vector<uint8_t>     Current;
+        vector<uint8_t>     Background;
+        int32_t             PlaneWidth;
+        int32_t             PlaneHeight;
+        bool                HaveBackground;
+        // size of the source image
+        int32_t             ImageWidth;
+        int32_t             ImageHeight;
+        // DC-only decoder of JPEG images and its last output
+        XJpegDcDecoder      DcDecoder;
+        shared_ptr<XImage>  DcImage;
+        // scan line of JPEG decoded at reduced scale by libjpeg (images DC decoder does not support)
+        vector<uint8_t>     DecodedLine;
+
+        steady_clock::time_point NextAnalysisTime;
+
+        struct jpeg_decompress_struct dinfo;
+        struct jpeg_error_mgr         jerr;
+
+    public:
+        XMotionDetectorData( ) :
+            MotionLevel( 0 ), FramesAnalysed( 0 ), AnalysisRate( 5 ), MotionThreshold( 8 ), State( ), StateGuard( ),
+            Current( ), Background( ), PlaneWidth( 0 ), PlaneHeight( 0 ), HaveBackground( false ),
+            ImageWidth( 0 ), ImageHeight( 0 ), DcDecoder( ), DcImage( ), DecodedLine( ), NextAnalysisTime( )
+        {
+            dinfo.err           = jpeg_std_error( &jerr );
+            jerr.error_exit     = decoder_error_exit;
+            jerr.output_message = decoder_output_message;
+
+            jpeg_create_decompress( &dinfo );
+        }
+
+        ~XMotionDetectorData( )
+        {
+            jpeg_destroy_decompress( &dinfo );
+        }
+
+        void ProcessImage( const shared_ptr<const XImage>& image );
+
+    private:
+        bool IsTimeToAnalyse( );
+        void CompareWithBackground( );
+        bool SampleImage( const shared_ptr<const XImage>& image );
+        bool DecodeJpeg( const shared_ptr<const XImage>& image );
+        bool DecodeJpegScaled( const shared_ptr<const XImage>& image );
+        void SetPlaneSize( int32_t width, int32_t height );
+    };
+
+    static uint32_t AnalyseRow( const uint8_t* plane, uint8_t* background, int32_t width, int32_t* first, int32_t* last );
+}
+
+XMotionDetector::XMotionDetector( ) :
+    mData( new Private::XMotionDetectorData( ) )
+{
+}
+
+XMotionDetector::~XMotionDetector( )
+{
+    delete mData;
+}
+
+// Motion level of the last analysed image
+uint8_t XMotionDetector::MotionLevel( ) const
+{
+    return static_cast<uint8_t>( mData->MotionLevel );
+}
+
+// Get result of the last analysis
+XMotionDetector::MotionState XMotionDetector::GetMotionState( ) const
+{
+    lock_guard<mutex> lock( mData->StateGuard );
+
+    return mData->State;
+}
+
+// Number of analysed images
+uint32_t XMotionDetector::FramesAnalysed( ) const
+{
+    return mData->FramesAnalysed;
+}
+
+// Get/Set number of images to analyse per second
+uint32_t XMotionDetector::AnalysisRate( ) const
+{
+    return mData->AnalysisRate;
+}
+XMotionDetector& XMotionDetector::SetAnalysisRate( uint32_t framesPerSecond )
+{
+    mData->AnalysisRate = framesPerSecond;
+    return *this;
+}
+
+// Get/Set motion level starting from which motion is treated as detected
+uint8_t XMotionDetector::MotionThreshold( ) const
+{
+    return mData->MotionThreshold;
+}
+XMotionDetector& XMotionDetector::SetMotionThreshold( uint8_t threshold )
+{
+    mData->MotionThreshold = threshold;
+    return *this;
+}
+
+// Create object providing motion information
+shared_ptr<IObjectInformation> XMotionDetector::CreateMotionInformation( ) const
+{
+    return make_shared<Private::MotionInformation>( this );
+}
+
+// New image is provided by video source
+void XMotionDetector::OnNewImage( const shared_ptr<const XImage>& image )
+{
+    mData->ProcessImage( image );
+}
+
+// Errors of video source are of no interest
+void XMotionDetector::OnError( const string& /* errorMessage */, bool /* fatal */ )
+{
+}
+
+namespace Private
+{
+
+// Make luma plane of the image (if it is time for analysis) and compare it with the background
+void XMotionDetectorData::ProcessImage( const shared_ptr<const XImage>& image )
+{
+    if ( IsTimeToAnalyse( ) )
+    {
+        int32_t oldWidth  = PlaneWidth;
+        int32_t oldHeight = PlaneHeight;
+        bool    planeMade = ( image->Format( ) == XPixelFormat::JPEG ) ? DecodeJpeg( image ) : SampleImage( image );
+
+        if ( ( oldWidth != PlaneWidth ) || ( oldHeight != PlaneHeight ) )
+        {
+            HaveBackground = false;
+        }
+
+        // the plane may be damaged by failed decoding, so it is used only if made successfully
+        if ( planeMade )
+        {
+            if ( HaveBackground )
+            {
+                CompareWithBackground( );
+            }
+            else
+            {
+                Background     = Current;
+                HaveBackground = true;
+            }
+
+            FramesAnalysed++;
+        }
+    }
+}
+
+// Check if it is time to analyse new image, keeping average rate of analysis
+bool XMotionDetectorData::IsTimeToAnalyse( )
+{
+    uint32_t rate = AnalysisRate;
+    bool     ret  = true;
+
+    if ( rate != 0 )
+    {
+        steady_clock::time_point now      = steady_clock::now( );
+        milliseconds             interval = milliseconds( 1000 / rate );
+
+        if ( now < NextAnalysisTime )
+        {
+            ret = false;
+        }
+        else if ( now - NextAnalysisTime >= interval )
+        {
+            // images did not come for a while (or it is the first one)
+            NextAnalysisTime = now + interval;
+        }
+        else
+        {
+            NextAnalysisTime += interval;
+        }
+    }
+
+    return ret;
+}
+
+// Compare current plane with the background, updating the background and the motion state
+void XMotionDetectorData::CompareWithBackground( )
+{
+    uint32_t total   = static_cast<uint32_t>( Current.size( ) );
+    uint32_t changed = 0;
+    int32_t  minX    = PlaneWidth, maxX = -1;
+    int32_t  minY    = PlaneHeight, maxY = -1;
+
+    for ( int32_t y = 0; y < PlaneHeight; y++ )
+    {
+        size_t   offset = static_cast<size_t>( y ) * PlaneWidth;
+        int32_t  first  = -1;
+        int32_t  last   = -1;
+        uint32_t count  = AnalyseRow( Current.data( ) + offset, Background.data( ) + offset, PlaneWidth, &first, &last );
+
+        if ( count != 0 )
+        {
+            changed += count;
+
+            if ( first < minX ) minX = first;
+            if ( last  > maxX ) maxX = last;
+            if ( minY > y ) minY = y;
+            maxY = y;
+        }
+    }
+
+    XMotionDetector::MotionState state = { 0, false, 0, 0, 0, 0 };
+
+    state.Level    = static_cast<uint8_t>( ( total == 0 ) ? 0 : ( changed * 255 + total - 1 ) / total );
+    state.Detected = ( ( state.Level != 0 ) && ( state.Level >= MotionThreshold ) );
+
+    if ( state.Detected )
+    {
+        // map plane's pixels to the area they were taken from
+        state.X      = minX * ImageWidth / PlaneWidth;
+        state.Y      = minY * ImageHeight / PlaneHeight;
+        state.Width  = ( maxX + 1 ) * ImageWidth / PlaneWidth - state.X;
+        state.Height = ( maxY + 1 ) * ImageHeight / PlaneHeight - state.Y;
+    }
+
+    MotionLevel = state.Level;
+
+    lock_guard<mutex> lock( StateGuard );
+    State = state;
+}
+
+// Set size of analysed plane, resizing buffers if needed
+void XMotionDetectorData::SetPlaneSize( int32_t width, int32_t height )
+{
+    PlaneWidth  = width;
+    PlaneHeight = height;
+
+    Current.resize( static_cast<size_t>( width ) * height );
+}
+
+// Take every N-th pixel of uncompressed image, converting it to grayscale
+bool XMotionDetectorData::SampleImage( const shared_ptr<const XImage>& image )
+{
+    int32_t  step       = ( image->Width( ) + MAX_ANALYSIS_WIDTH - 1 ) / MAX_ANALYSIS_WIDTH;
+    uint32_t pixelSize  = 0;
+    bool     ret        = true;
+
+    switch ( image->Format( ) )
+    {
+    case XPixelFormat::Grayscale8:
+        pixelSize = 1;
+        break;
+    case XPixelFormat::RGB24:
+        pixelSize = 3;
+        break;
+    case XPixelFormat::RGBA32:
+        pixelSize = 4;
+        break;
+    default:
+        ret = false;
+    }
+
+    if ( ( ret ) && ( step > 0 ) && ( image->Height( ) >= step ) )
+    {
+        SetPlaneSize( image->Width( ) / step, image->Height( ) / step );
+        ImageWidth  = PlaneWidth  * step;
+        ImageHeight = PlaneHeight * step;
+
+        uint8_t* dst = Current.data( );
+
+        for ( int32_t y = 0; y < PlaneHeight; y++ )
+        {
+            const uint8_t* src = image->Data( ) + static_cast<size_t>( y ) * step * image->Stride( );
+
+            if ( pixelSize == 1 )
+            {
+                for ( int32_t x = 0; x < PlaneWidth; x++, src += step )
+                {
+                    *dst++ = *src;
+                }
+            }
+            else
+            {
+                for ( int32_t x = 0; x < PlaneWidth; x++, src += step * pixelSize )
+                {
+                    *dst++ = static_cast<uint8_t>( ( 77 * src[RedIndex] + 150 * src[GreenIndex] + 29 * src[BlueIndex] ) >> 8 );
+                }
+            }
+        }
+    }
+    else
+    {
+        ret = false;
+    }
+
+    return ret;
+}
+
+// Decode JPEG image at 1/8 scale taking only luma - DC coefficients are decoded directly, while
+// AC coefficients are skipped without dequantization and IDCT
+bool XMotionDetectorData::DecodeJpeg( const shared_ptr<const XImage>& image )
+{
+    XError ecode = DcDecoder.Decode( image, DcImage, XPixelFormat::Grayscale8 );
+    bool   ret   = ( ecode == XError::Success );
+
+    if ( ret )
+    {
+        int32_t decodedWidth = DcImage->Width( );
+        int32_t step         = ( decodedWidth + MAX_ANALYSIS_WIDTH - 1 ) / MAX_ANALYSIS_WIDTH;
+
+        if ( step < 1 )
+        {
+            step = 1;
+        }
+
+        SetPlaneSize( decodedWidth / step, DcImage->Height( ) / step );
+        ImageWidth  = DcDecoder.JpegWidth( );
+        ImageHeight = DcDecoder.JpegHeight( );
+
+        for ( int32_t y = 0; y < PlaneHeight; y++ )
+        {
+            const uint8_t* src = DcImage->Data( ) + static_cast<size_t>( y * step ) * DcImage->Stride( );
+            uint8_t*       dst = Current.data( ) + static_cast<size_t>( y ) * PlaneWidth;
+
+            for ( int32_t x = 0; x < PlaneWidth; x++ )
+            {
+                dst[x] = src[x * step];
+            }
+        }
+    }
+    else if ( ecode == XError::UnsupportedPixelFormat )
+    {
+        // progressive JPEG or alike - let libjpeg do it
+        ret = DecodeJpegScaled( image );
+    }
+
+    return ret;
+}
+
+// Decode JPEG image at 1/8 scale with libjpeg (only DC coefficients are really used then), taking only luma
+bool XMotionDetectorData::DecodeJpegScaled( const shared_ptr<const XImage>& image )
+{
+    bool ret = true;
+
+    try
+    {
+        jpeg_mem_src( &dinfo, image->Data( ), static_cast<unsigned long>( image->Width( ) ) );
+        jpeg_read_header( &dinfo, TRUE );
+
+        dinfo.out_color_space     = JCS_GRAYSCALE;
+        dinfo.scale_num           = 1;
+        dinfo.scale_denom         = 8;
+        dinfo.dct_method          = JDCT_IFAST;
+        dinfo.do_fancy_upsampling = FALSE;
+        dinfo.do_block_smoothing  = FALSE;
+
+        jpeg_start_decompress( &dinfo );
+
+        int32_t  decodedWidth = static_cast<int32_t>( dinfo.output_width );
+        int32_t  step         = ( decodedWidth + MAX_ANALYSIS_WIDTH - 1 ) / MAX_ANALYSIS_WIDTH;
+        JSAMPROW row;
+
+        if ( step < 1 )
+        {
+            step = 1;
+        }
+
+        SetPlaneSize( decodedWidth / step, static_cast<int32_t>( dinfo.output_height ) / step );
+        ImageWidth  = static_cast<int32_t>( dinfo.image_width );
+        ImageHeight = static_cast<int32_t>( dinfo.image_height );
+        DecodedLine.resize( dinfo.output_width );
+        row = DecodedLine.data( );
+
+        while ( dinfo.output_scanline < dinfo.output_height )
+        {
+            int32_t y = static_cast<int32_t>( dinfo.output_scanline );
+
+            jpeg_read_scanlines( &dinfo, &row, 1 );
+
+            if ( ( y % step == 0 ) && ( y / step < PlaneHeight ) )
+            {
+                uint8_t* dst = Current.data( ) + static_cast<size_t>( y / step ) * PlaneWidth;
+
+                for ( int32_t x = 0; x < PlaneWidth; x++ )
+                {
+                    dst[x] = DecodedLine[x * step];
+                }
+            }
+        }
+
+        jpeg_finish_decompress( &dinfo );
+    }
+    catch ( const JpegDecodingException& )
+    {
+        jpeg_abort_decompress( &dinfo );
+        ret = false;
+    }
+
+    return ret;
+}
+
+// Compare row of the plane with the background, counting pixels which differ more than noise threshold and
+// finding the first/last of them (left as -1 if there are none). The background is then moved 1/8 of the
+// way towards the plane (three rounding averages).
+static uint32_t AnalyseRow( const uint8_t* plane, uint8_t* background, int32_t width, int32_t* first, int32_t* last )
+{
+    uint32_t count = 0;
+    int32_t  x     = 0;
+
+#if defined( __SSE2__ )
+    const __m128i threshold = _mm_set1_epi8( static_cast<char>( NOISE_THRESHOLD ) );
+    const __m128i zero      = _mm_setzero_si128( );
+
+    for ( ; x + 16 <= width; x += 16 )
+    {
+        __m128i cur  = _mm_loadu_si128( reinterpret_cast<const __m128i*>( plane + x ) );
+        __m128i bg   = _mm_loadu_si128( reinterpret_cast<const __m128i*>( background + x ) );
+        // absolute difference of unsigned bytes, then bytes above threshold stay non zero
+        __m128i diff = _mm_or_si128( _mm_subs_epu8( cur, bg ), _mm_subs_epu8( bg, cur ) );
+        uint32_t mask = ~static_cast<uint32_t>( _mm_movemask_epi8( _mm_cmpeq_epi8( _mm_subs_epu8( diff, threshold ), zero ) ) ) & 0xFFFF;
+
+        if ( mask != 0 )
+        {
+            count += static_cast<uint32_t>( __builtin_popcount( mask ) );
+
+            if ( *first < 0 )
+            {
+                *first = x + __builtin_ctz( mask );
+            }
+            *last = x + 31 - __builtin_clz( mask );
+        }
+
+        bg = _mm_avg_epu8( bg, _mm_avg_epu8( bg, _mm_avg_epu8( bg, cur ) ) );
+        _mm_storeu_si128( reinterpret_cast<__m128i*>( background + x ), bg );
+    }
+#elif defined( MOTION_USE_NEON )
+    const uint8x16_t threshold = vdupq_n_u8( NOISE_THRESHOLD );
+    uint8_t          lanes[16];
+
+    for ( ; x + 16 <= width; x += 16 )
+    {
+        uint8x16_t cur     = vld1q_u8( plane + x );
+        uint8x16_t bg      = vld1q_u8( background + x );
+        // changed lanes are all ones, so sum of their lowest bits is the number of changed pixels
+        uint8x16_t changed = vcgtq_u8( vabdq_u8( cur, bg ), threshold );
+        uint64x2_t sum     = vpaddlq_u32( vpaddlq_u16( vpaddlq_u8( vshrq_n_u8( changed, 7 ) ) ) );
+        uint32_t   chunk   = static_cast<uint32_t>( vgetq_lane_u64( sum, 0 ) + vgetq_lane_u64( sum, 1 ) );
+
+        if ( chunk != 0 )
+        {
+            count += chunk;
+            vst1q_u8( lanes, changed );
+
+            for ( int32_t i = 0; i < 16; i++ )
+            {
+                if ( lanes[i] != 0 )
+                {
+                    if ( *first < 0 )
+                    {
+                        *first = x + i;
+                    }
+                    *last = x + i;
+                }
+            }
+        }
+
+        bg = vrhaddq_u8( bg, vrhaddq_u8( bg, vrhaddq_u8( bg, cur ) ) );
+        vst1q_u8( background + x, bg );
+    }
+#endif
+
+    for ( ; x < width; x++ )
+    {
+        int cur  = plane[x];
+        int bg   = background[x];
+        int diff = cur - bg;
+
+        if ( ( diff > NOISE_THRESHOLD ) || ( diff < -NOISE_THRESHOLD ) )
+        {
+            count++;
+
+            if ( *first < 0 )
+            {
+                *first = x;
+            }
+            *last = x;
+        }
+
+        // same rounding as SIMD averages
+        bg = ( bg + ( ( bg + ( ( bg + cur + 1 ) >> 1 ) + 1 ) >> 1 ) + 1 ) >> 1;
+        background[x] = static_cast<uint8_t>( bg );
+    }
+
+    return count;
+}
+
+// Get the specified property of motion information
+XError MotionInformation::GetProperty( const string& propertyName, string& value ) const
+{
+    PropertyMap           properties = GetAllProperties( );
+    PropertyMap::iterator it         = properties.find( propertyName );
+    XError                ret        = XError::UnknownProperty;
+
+    if ( it != properties.end( ) )
+    {
+        value = it->second;
+        ret   = XError::Success;
+    }
+
+    return ret;
+}
+
+// Get all properties of motion information (taken from the same analysis result)
+PropertyMap MotionInformation::GetAllProperties( ) const
+{
+    XMotionDetector::MotionState state = Owner->GetMotionState( );
+    PropertyMap                  properties;
+    char                         buffer[32];
+
+    sprintf( buffer, "%u", static_cast<uint32_t>( state.Level ) );
+    properties.insert( PropertyMap::value_type( "level", buffer ) );
+    properties.insert( PropertyMap::value_type( "detected", ( state.Detected ) ? "true" : "false" ) );
+
+    sprintf( buffer, "%d", state.X );
+    properties.insert( PropertyMap::value_type( "x", buffer ) );
+    sprintf( buffer, "%d", state.Y );
+    properties.insert( PropertyMap::value_type( "y", buffer ) );
+    sprintf( buffer, "%d", state.Width );
+    properties.insert( PropertyMap::value_type( "width", buffer ) );
+    sprintf( buffer, "%d", state.Height );
+    properties.insert( PropertyMap::value_type( "height", buffer ) );
+
+    sprintf( buffer, "%u", Owner->FramesAnalysed( ) );
+    properties.insert( PropertyMap::value_type( "framesAnalysed", buffer ) );
+
+    return properties;
+}
+
+} // namespace Private
@@ -0,0 +1,97 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XMOTION_DETECTOR_HPP
+#define XMOTION_DETECTOR_HPP
+
+#include <stdint.h>
+#include <memory>
+
+#include "XInterfaces.hpp"
+#include "IVideoSourceListener.hpp"
+#include "IObjectInformation.hpp"
+
+namespace Private
+{
+    class XMotionDetectorData;
+}
+
+/* Detects motion in camera images.
+
+   Every analysed image is reduced to a small grayscale plane (about 160 pixels wide) - uncompressed
+   images are sampled, JPEG images are decoded at 1/8 scale from DC coefficients only (XJpegDcDecoder).
+   The plane is compared with a running background (SIMD absolute difference and threshold, SSE2 or
+   NEON when available), which then moves 1/8 of the way towards the plane, so that changes which stay
+   long enough become part of it.
+   The motion level is the part of pixels differing from the background more than noise threshold,
+   scaled to [0, 255]. Motion is detected when the level is at or above the motion threshold, in which
+   case bounding rectangle of changed pixels is provided (in coordinates of source images).
+
+   Images are analysed on the thread delivering them (camera's thread), but no more often than the
+   analysis rate - images arriving sooner are ignored and keep the previous result.
+*/
+class XMotionDetector : public IVideoSourceListener, private Uncopyable
+{
+public:
+    // Result of the last analysis
+    struct MotionState
+    {
+        uint8_t  Level;
+        bool     Detected;
+        // region of motion (all zeros if motion is not detected)
+        int32_t  X;
+        int32_t  Y;
+        int32_t  Width;
+        int32_t  Height;
+    };
+
+public:
+    XMotionDetector( );
+    ~XMotionDetector( );
+
+    // Motion level of the last analysed image, [0, 255]
+    uint8_t MotionLevel( ) const;
+
+    // Get result of the last analysis
+    MotionState GetMotionState( ) const;
+
+    // Number of analysed images
+    uint32_t FramesAnalysed( ) const;
+
+    // Get/Set number of images to analyse per second (0 - analyse every image)
+    uint32_t AnalysisRate( ) const;
+    XMotionDetector& SetAnalysisRate( uint32_t framesPerSecond );
+
+    // Get/Set motion level starting from which motion is treated as detected
+    uint8_t MotionThreshold( ) const;
+    XMotionDetector& SetMotionThreshold( uint8_t threshold );
+
+    // Create object providing motion information (level, detected flag, region, etc.)
+    std::shared_ptr<IObjectInformation> CreateMotionInformation( ) const;
+
+    // IVideoSourceListener interface
+    void OnNewImage( const std::shared_ptr<const XImage>& image );
+    void OnError( const std::string& errorMessage, bool fatal );
+
+private:
+    Private::XMotionDetectorData* mData;
+};
+
+#endif // XMOTION_DETECTOR_HPP
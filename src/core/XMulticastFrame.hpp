@@ -0,0 +1,105 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XMULTICAST_FRAME_HPP
+#define XMULTICAST_FRAME_HPP
+
+#include <stdint.h>
+
+/* Format of UDP datagrams used to distribute JPEG images over multicast.
+
+   Every image is split into fragments, each sent as a separate datagram starting with
+   the header below (all fields are in network byte order):
+
+     0: 'C' '2' 'W' 'M'  - magic
+     4: uint32           - frame number, incremented for every sent frame
+     8: uint32           - total size of the frame
+    12: uint32           - offset of the fragment within the frame
+    16: uint16           - fragment index
+    18: uint16           - number of fragments in the frame
+
+   The rest of the datagram is fragment's data.
+*/
+struct XMulticastFragmentHeader
+{
+    // Size of the header and maximum size of fragment's data, so that datagrams fit into Ethernet frames
+    static const uint32_t Size        = 20;
+    static const uint32_t MaxDataSize = 1400;
+    // Limit of the frame size accepted by receivers
+    static const uint32_t MaxFrameSize = 16 * 1024 * 1024;
+
+    uint32_t FrameNumber;
+    uint32_t FrameSize;
+    uint32_t FragmentOffset;
+    uint16_t FragmentIndex;
+    uint16_t FragmentCount;
+
+    // Write header into the specified buffer (must have at least Size bytes)
+    void Write( uint8_t* buffer ) const
+    {
+        buffer[0] = 'C';
+        buffer[1] = '2';
+        buffer[2] = 'W';
+        buffer[3] = 'M';
+        WriteUInt32( buffer + 4,  FrameNumber );
+        WriteUInt32( buffer + 8,  FrameSize );
+        WriteUInt32( buffer + 12, FragmentOffset );
+        buffer[16] = static_cast<uint8_t>( FragmentIndex >> 8 );
+        buffer[17] = static_cast<uint8_t>( FragmentIndex );
+        buffer[18] = static_cast<uint8_t>( FragmentCount >> 8 );
+        buffer[19] = static_cast<uint8_t>( FragmentCount );
+    }
+
+    // Read header from the specified datagram and check it describes a valid fragment
+    bool Read( const uint8_t* datagram, uint32_t datagramSize )
+    {
+        if ( ( datagramSize <= Size ) || ( datagram[0] != 'C' ) || ( datagram[1] != '2' ) ||
+             ( datagram[2] != 'W' ) || ( datagram[3] != 'M' ) )
+        {
+            return false;
+        }
+
+        FrameNumber    = ReadUInt32( datagram + 4 );
+        FrameSize      = ReadUInt32( datagram + 8 );
+        FragmentOffset = ReadUInt32( datagram + 12 );
+        FragmentIndex  = static_cast<uint16_t>( ( datagram[16] << 8 ) | datagram[17] );
+        FragmentCount  = static_cast<uint16_t>( ( datagram[18] << 8 ) | datagram[19] );
+
+        return ( ( FrameSize <= MaxFrameSize ) && ( FragmentIndex < FragmentCount ) &&
+                 ( FragmentOffset < FrameSize ) && ( datagramSize - Size <= FrameSize - FragmentOffset ) );
+    }
+
+private:
+    static void WriteUInt32( uint8_t* buffer, uint32_t value )
+    {
+        buffer[0] = static_cast<uint8_t>( value >> 24 );
+        buffer[1] = static_cast<uint8_t>( value >> 16 );
+        buffer[2] = static_cast<uint8_t>( value >> 8 );
+        buffer[3] = static_cast<uint8_t>( value );
+    }
+
+    static uint32_t ReadUInt32( const uint8_t* buffer )
+    {
+        return ( static_cast<uint32_t>( buffer[0] ) << 24 ) | ( static_cast<uint32_t>( buffer[1] ) << 16 ) |
+               ( static_cast<uint32_t>( buffer[2] ) << 8 ) | buffer[3];
+    }
+};
+
+#endif // XMULTICAST_FRAME_HPP
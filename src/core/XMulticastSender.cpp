@@ -0,0 +1,261 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+#include <string.h>
+#include <stdlib.h>
+
+#include <mongoose.h>
+
+#include "XMulticastSender.hpp"
+#include "XMulticastFrame.hpp"
+#include "XManualResetEvent.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace Private
+{
+    // Size of socket's send buffer, which should be enough to hold few frames
+    #define SEND_BUFFER_SIZE    (1024 * 1024)
+
+    class XMulticastSenderData
+    {
+    public:
+        XVideoSourceToWeb&      Video2Web;
+        string                  GroupAddress;
+        uint16_t                Port;
+        uint32_t                FrameInterval;
+        uint8_t                 Ttl;
+        recursive_mutex         StartSync;
+        thread                  SenderThread;
+        XManualResetEvent       NeedToStop;
+        bool                    IsRunning;
+
+        sock_t                  Socket;
+        struct sockaddr_in      Destination;
+        volatile uint32_t       FramesSent;
+
+        uint8_t*                JpegBuffer;
+        uint32_t                JpegBufferSize;
+        uint32_t                JpegSize;
+        uint32_t                LastSequence;
+
+    public:
+        XMulticastSenderData( XVideoSourceToWeb& video2web, const string& groupAddress, uint16_t port, uint32_t frameRate ) :
+            Video2Web( video2web ), GroupAddress( groupAddress ), Port( port ),
+            FrameInterval( 1000 / ( ( frameRate == 0 ) ? 1 : frameRate ) ), Ttl( 1 ),
+            StartSync( ), SenderThread( ), NeedToStop( ), IsRunning( false ),
+            Socket( INVALID_SOCKET ), Destination( ), FramesSent( 0 ),
+            JpegBuffer( nullptr ), JpegBufferSize( 0 ), JpegSize( 0 ), LastSequence( 0 )
+        {
+        }
+
+        ~XMulticastSenderData( )
+        {
+            free( JpegBuffer );
+        }
+
+        bool Start( );
+        void Stop( );
+
+    private:
+        bool OpenSocket( );
+        void SendFrame( );
+
+        static void SenderThreadHandler( XMulticastSenderData* me );
+    };
+}
+
+XMulticastSender::XMulticastSender( XVideoSourceToWeb& video2web, const string& groupAddress, uint16_t port, uint32_t frameRate ) :
+    mData( new Private::XMulticastSenderData( video2web, groupAddress, port, frameRate ) )
+{
+}
+
+XMulticastSender::~XMulticastSender( )
+{
+    mData->Stop( );
+    delete mData;
+}
+
+// Get/Set time-to-live of sent datagrams
+uint8_t XMulticastSender::Ttl( ) const
+{
+    return mData->Ttl;
+}
+XMulticastSender& XMulticastSender::SetTtl( uint8_t ttl )
+{
+    lock_guard<recursive_mutex> lock( mData->StartSync );
+
+    if ( !mData->IsRunning )
+    {
+        mData->Ttl = ttl;
+    }
+
+    return *this;
+}
+
+// Start sending images
+bool XMulticastSender::Start( )
+{
+    return mData->Start( );
+}
+
+// Stop sending images
+void XMulticastSender::Stop( )
+{
+    mData->Stop( );
+}
+
+// Number of frames sent since the start
+uint32_t XMulticastSender::FramesSent( ) const
+{
+    return mData->FramesSent;
+}
+
+namespace Private
+{
+
+// Open socket and start sending thread
+bool XMulticastSenderData::Start( )
+{
+    lock_guard<recursive_mutex> lock( StartSync );
+
+    if ( ( !IsRunning ) && ( OpenSocket( ) ) )
+    {
+        NeedToStop.Reset( );
+        LastSequence = 0;
+        FramesSent   = 0;
+        IsRunning    = true;
+
+        SenderThread = thread( SenderThreadHandler, this );
+    }
+
+    return IsRunning;
+}
+
+// Stop sending thread and close socket
+void XMulticastSenderData::Stop( )
+{
+    lock_guard<recursive_mutex> lock( StartSync );
+
+    if ( IsRunning )
+    {
+        NeedToStop.Signal( );
+        SenderThread.join( );
+
+        closesocket( Socket );
+        Socket    = INVALID_SOCKET;
+        IsRunning = false;
+    }
+}
+
+// Create UDP socket for sending datagrams to the multicast group
+bool XMulticastSenderData::OpenSocket( )
+{
+    int  ttl        = Ttl;
+    int  bufferSize = SEND_BUFFER_SIZE;
+    bool ret        = false;
+
+    memset( &Destination, 0, sizeof( Destination ) );
+    Destination.sin_family = AF_INET;
+    Destination.sin_port   = htons( Port );
+
+    if ( ( inet_pton( AF_INET, GroupAddress.c_str( ), &Destination.sin_addr ) == 1 ) &&
+         ( IN_MULTICAST( ntohl( Destination.sin_addr.s_addr ) ) ) )
+    {
+        Socket = socket( AF_INET, SOCK_DGRAM, 0 );
+
+        if ( Socket != INVALID_SOCKET )
+        {
+            setsockopt( Socket, SOL_SOCKET, SO_SNDBUF, reinterpret_cast<const char*>( &bufferSize ), sizeof( bufferSize ) );
+
+            if ( setsockopt( Socket, IPPROTO_IP, IP_MULTICAST_TTL, reinterpret_cast<const char*>( &ttl ), sizeof( ttl ) ) == 0 )
+            {
+                ret = true;
+            }
+            else
+            {
+                closesocket( Socket );
+                Socket = INVALID_SOCKET;
+            }
+        }
+    }
+
+    return ret;
+}
+
+// Thread sending the latest camera image at the configured frame rate
+void XMulticastSenderData::SenderThreadHandler( XMulticastSenderData* me )
+{
+    while ( !me->NeedToStop.IsSignaled( ) )
+    {
+        steady_clock::time_point startTime = steady_clock::now( );
+
+        me->SendFrame( );
+
+        uint32_t timeTaken = static_cast<uint32_t>( duration_cast<milliseconds>( steady_clock::now( ) - startTime ).count( ) );
+
+        me->NeedToStop.Wait( ( timeTaken < me->FrameInterval ) ? me->FrameInterval - timeTaken : 1 );
+    }
+}
+
+// Send the latest image (if it was not sent yet) as sequence of fragments
+void XMulticastSenderData::SendFrame( )
+{
+    uint32_t sequence;
+
+    if ( ( Video2Web.GetJpegImage( &JpegBuffer, &JpegBufferSize, &JpegSize, &sequence ) ) && ( sequence != LastSequence ) &&
+         ( JpegSize <= XMulticastFragmentHeader::MaxFrameSize ) )
+    {
+        uint8_t                  datagram[XMulticastFragmentHeader::Size + XMulticastFragmentHeader::MaxDataSize];
+        XMulticastFragmentHeader header;
+
+        LastSequence = sequence;
+
+        header.FrameNumber    = FramesSent + 1;
+        header.FrameSize      = JpegSize;
+        header.FragmentOffset = 0;
+        header.FragmentIndex  = 0;
+        header.FragmentCount  = static_cast<uint16_t>( ( JpegSize + XMulticastFragmentHeader::MaxDataSize - 1 ) / XMulticastFragmentHeader::MaxDataSize );
+
+        while ( header.FragmentOffset < JpegSize )
+        {
+            uint32_t dataSize = min( JpegSize - header.FragmentOffset, static_cast<uint32_t>( XMulticastFragmentHeader::MaxDataSize ) );
+
+            header.Write( datagram );
+            memcpy( datagram + XMulticastFragmentHeader::Size, JpegBuffer + header.FragmentOffset, dataSize );
+
+            sendto( Socket, reinterpret_cast<const char*>( datagram ), XMulticastFragmentHeader::Size + dataSize, 0,
+                    reinterpret_cast<const struct sockaddr*>( &Destination ), sizeof( Destination ) );
+
+            header.FragmentOffset += dataSize;
+            header.FragmentIndex++;
+        }
+
+        FramesSent++;
+    }
+}
+
+} // namespace Private
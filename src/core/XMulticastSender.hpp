@@ -0,0 +1,65 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XMULTICAST_SENDER_HPP
+#define XMULTICAST_SENDER_HPP
+
+#include <stdint.h>
+#include <string>
+
+#include "XInterfaces.hpp"
+#include "XVideoSourceToWeb.hpp"
+
+namespace Private
+{
+    class XMulticastSenderData;
+}
+
+/* Sends camera images to a UDP multicast group, so any number of receivers on LAN can
+   get them while the images are sent only once. Images are JPEGs taken from
+   XVideoSourceToWeb (same as provided to web clients), which are split into fragments
+   described by XMulticastFragmentHeader. XMulticastCamera is the matching receiver.
+
+   Note: images are sent all the time while the sender is running, so camera in on-demand
+   mode is kept running as well.
+*/
+class XMulticastSender : private Uncopyable
+{
+public:
+    XMulticastSender( XVideoSourceToWeb& video2web, const std::string& groupAddress, uint16_t port, uint32_t frameRate = 30 );
+    ~XMulticastSender( );
+
+    // Get/Set time-to-live of sent datagrams (number of routers they can pass), default is 1 (local network only).
+    // Setting is only possible when sender is not running.
+    uint8_t Ttl( ) const;
+    XMulticastSender& SetTtl( uint8_t ttl );
+
+    // Start/Stop sending images
+    bool Start( );
+    void Stop( );
+
+    // Number of frames sent since the start
+    uint32_t FramesSent( ) const;
+
+private:
+    Private::XMulticastSenderData* mData;
+};
+
+#endif // XMULTICAST_SENDER_HPP
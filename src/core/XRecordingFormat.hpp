@@ -0,0 +1,106 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XRECORDING_FORMAT_HPP
+#define XRECORDING_FORMAT_HPP
+
+#include <stdint.h>
+#include <string>
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/* Format of recordings written by XMjpegRecorder.
+
+   Recording is a set of segments, each made of two files named after the time (UTC) the
+   segment was started - YYYYMMDD-HHMMSS.mjpg and YYYYMMDD-HHMMSS.idx.
+
+   The .mjpg file is just JPEG images one after another (MJPEG elementary stream), which
+   many players can open as it is. The .idx file is an array of fixed size records described
+   by the structure below - one per frame, in the order frames were written. Records are in
+   native (little-endian) byte order, so the file can be memory mapped and used as it is.
+
+   If motion detection is done while recording, the segment also has YYYYMMDD-HHMMSS.act file -
+   a column of motion levels (one byte per frame, [0, 255]) in the same order as index records.
+   So activity can be searched by scanning just one byte per frame, looking into index only for
+   time of the found frames. The file can be shorter than the index, if some frames have no level.
+*/
+struct XRecordingIndexEntry
+{
+    // Time the frame was taken, milliseconds since Unix epoch
+    uint64_t Time;
+    // Offset of the frame in the .mjpg file and its size
+    uint32_t Offset;
+    uint32_t Size;
+};
+
+static_assert( sizeof( XRecordingIndexEntry ) == 16, "Recording index entry must be 16 bytes" );
+
+namespace XRecordingSegment
+{
+    static const char* const DataExtension     = ".mjpg";
+    static const char* const IndexExtension    = ".idx";
+    static const char* const ActivityExtension = ".act";
+
+    // Length of segment's base name - YYYYMMDD-HHMMSS
+    static const size_t NameLength = 15;
+
+    // Make base name of the segment started at the specified time (milliseconds since Unix epoch)
+    inline std::string MakeName( uint64_t time )
+    {
+        time_t    seconds = static_cast<time_t>( time / 1000 );
+        struct tm utc;
+        char      buffer[32];
+
+    #ifdef _WIN32
+        gmtime_s( &utc, &seconds );
+    #else
+        gmtime_r( &seconds, &utc );
+    #endif
+
+        snprintf( buffer, sizeof( buffer ), "%04d%02d%02d-%02d%02d%02d", utc.tm_year + 1900, utc.tm_mon + 1, utc.tm_mday,
+                  utc.tm_hour, utc.tm_min, utc.tm_sec );
+
+        return std::string( buffer );
+    }
+
+    // Check if the file name is one of the segment's files, providing its base name
+    inline bool IsSegmentFile( const std::string& fileName, const char* extension, std::string* baseName = nullptr )
+    {
+        bool ret = ( ( fileName.length( ) == NameLength + strlen( extension ) ) &&
+                     ( fileName.compare( NameLength, std::string::npos, extension ) == 0 ) &&
+                     ( fileName[8] == '-' ) );
+
+        for ( size_t i = 0; ( ret ) && ( i < NameLength ); i++ )
+        {
+            ret = ( ( i == 8 ) || ( ( fileName[i] >= '0' ) && ( fileName[i] <= '9' ) ) );
+        }
+
+        if ( ( ret ) && ( baseName != nullptr ) )
+        {
+            *baseName = fileName.substr( 0, NameLength );
+        }
+
+        return ret;
+    }
+}
+
+#endif // XRECORDING_FORMAT_HPP
@@ -0,0 +1,1351 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <map>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "XRecordingPlayer.hpp"
+#include "XRecordingFormat.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace Private
+{
+    // Maximum time to wait before checking if next frame of playback is due
+    #define MAX_PLAYBACK_TIMER  (100)
+    // Gaps between recorded frames (recording was stopped, for example) are shortened to this time
+    #define MAX_PLAYBACK_GAP    (1000)
+    // Size of chunks segment files are sent by
+    #define DOWNLOAD_CHUNK_SIZE (64 * 1024)
+    // Default parameters of activity search - time interval before now, motion level and gap between active frames
+    #define DEFAULT_ACTIVITY_PERIOD     (24 * 3600 * 1000)
+    #define DEFAULT_ACTIVITY_THRESHOLD  (8)
+    #define DEFAULT_ACTIVITY_GAP        (2000)
+
+    // Provides frames of a single segment using its memory mapped index
+    class SegmentReader
+    {
+    private:
+        string                      Name;
+        int                         DataFile;
+        int                         IndexFile;
+        const XRecordingIndexEntry* Index;
+        size_t                      IndexMapSize;
+        uint32_t                    Count;
+        int                         ActivityFile;
+        const uint8_t*              Activity;
+        size_t                      ActivityMapSize;
+
+    public:
+        SegmentReader( ) :
+            Name( ), DataFile( -1 ), IndexFile( -1 ), Index( nullptr ), IndexMapSize( 0 ), Count( 0 ),
+            ActivityFile( -1 ), Activity( nullptr ), ActivityMapSize( 0 )
+        {
+        }
+
+        ~SegmentReader( )
+        {
+            Close( );
+        }
+
+        bool Open( const string& folder, const string& name );
+        void Close( );
+        bool Refresh( );
+
+        const string& SegmentName( ) const { return Name; }
+        uint32_t FramesCount( ) const { return Count; }
+        const XRecordingIndexEntry& Frame( uint32_t index ) const { return Index[index]; }
+
+        // Motion levels of the first ActivityCount() frames
+        uint32_t ActivityCount( ) const { return static_cast<uint32_t>( min( ActivityMapSize, static_cast<size_t>( Count ) ) ); }
+        const uint8_t* MotionLevels( ) const { return Activity; }
+
+        uint32_t FindFrame( uint64_t time ) const;
+        bool ReadFrame( uint32_t index, uint8_t** buffer, uint32_t* bufferSize ) const;
+
+    private:
+        void UnmapIndex( );
+        void UnmapActivity( );
+    };
+
+    // Data read by the handler's worker thread for a connection, which is picked up by the connection's timer
+    struct ReadResult
+    {
+        bool     Ready;
+        bool     Found;
+        bool     Failed;
+        bool     Finished;
+        uint64_t FrameTime;
+        uint8_t* Buffer;
+        uint32_t BufferSize;
+        uint32_t Length;
+        string   Reply;
+
+        ReadResult( ) :
+            Ready( false ), Found( false ), Failed( false ), Finished( false ), FrameTime( 0 ),
+            Buffer( nullptr ), BufferSize( 0 ), Length( 0 ), Reply( )
+        {
+        }
+
+        ~ReadResult( )
+        {
+            free( Buffer );
+        }
+    };
+
+    // Position of playback in recorded segments (accessed only by the worker thread)
+    struct PlaybackCursor
+    {
+        shared_ptr<SegmentReader> Reader;
+        uint32_t                  NextFrame;
+        uint64_t                  EndTime;
+
+        PlaybackCursor( uint64_t endTime ) :
+            Reader( make_shared<SegmentReader>( ) ), NextFrame( 0 ), EndTime( endTime )
+        {
+        }
+    };
+
+    // Segment's file being downloaded - closed once neither the connection nor the worker thread needs it
+    struct DownloadFile
+    {
+        int Handle;
+
+        DownloadFile( int handle ) : Handle( handle ) { }
+        ~DownloadFile( ) { close( Handle ); }
+    };
+
+    // Web request handler providing recorded frames and segments' files; all reading of segments is done
+    // by its worker thread, so the web server's thread is not blocked by disk access
+    class PlaybackRequestHandler : public IWebRequestHandler
+    {
+    private:
+        struct Playback
+        {
+            shared_ptr<PlaybackCursor> Cursor;
+            shared_ptr<ReadResult>     Read;
+            uint64_t                   EndTime;
+            uint64_t                   FirstFrameTime;
+            steady_clock::time_point   StartTime;
+            bool                       SingleFrame;
+            bool                       Started;
+            bool                       Finished;
+        };
+
+        struct Download
+        {
+            shared_ptr<DownloadFile> File;
+            shared_ptr<ReadResult>   Read;
+            uint64_t                 Position;
+            uint64_t                 End;
+            bool                     Reading;
+        };
+
+        typedef function<void( ReadResult& )> ReadJob;
+
+        XRecordingPlayerData*                       Owner;
+        map<uintptr_t, Playback>                    Playbacks;
+        map<uintptr_t, Download>                    Downloads;
+        map<uintptr_t, shared_ptr<ReadResult>>      Replies;
+
+        // reads queued to the worker thread
+        mutex                                       Sync;
+        condition_variable                          JobQueued;
+        deque<pair<shared_ptr<ReadResult>, ReadJob>> Jobs;
+        bool                                        NeedToStop;
+        thread                                      Worker;
+
+    public:
+        PlaybackRequestHandler( const string& uri, XRecordingPlayerData* owner ) :
+            IWebRequestHandler( uri, true ), Owner( owner ), Playbacks( ), Downloads( ), Replies( ),
+            Sync( ), JobQueued( ), Jobs( ), NeedToStop( false ), Worker( )
+        {
+            Worker = thread( WorkerThread, this );
+        }
+
+        ~PlaybackRequestHandler( )
+        {
+            {
+                lock_guard<mutex> lock( Sync );
+                NeedToStop = true;
+            }
+
+            JobQueued.notify_one( );
+            Worker.join( );
+        }
+
+        void HandleHttpRequest( const IWebRequest& request, IWebResponse& response );
+        void HandleTimer( IWebResponse& response );
+        void HandleConnectionClosed( IWebResponse& response );
+
+    private:
+        void HandleListRequest( IWebResponse& response );
+        void HandleFrameRequest( const IWebRequest& request, IWebResponse& response );
+        void HandleFileRequest( const IWebRequest& request, IWebResponse& response, const string& fileName );
+        void HandleActivityRequest( const IWebRequest& request, IWebResponse& response );
+        void HandlePlaybackTimer( IWebResponse& response, map<uintptr_t, Playback>::iterator it );
+        void HandleDownloadTimer( IWebResponse& response, map<uintptr_t, Download>::iterator it );
+        void HandleReplyTimer( IWebResponse& response, map<uintptr_t, shared_ptr<ReadResult>>::iterator it );
+        void SendFrame( IWebResponse& response, const ReadResult& frame, bool asPart );
+
+        void QueueRead( const shared_ptr<ReadResult>& result, const ReadJob& job );
+        bool IsReadDone( const shared_ptr<ReadResult>& result );
+        void QueueNextFrame( const Playback& client );
+
+        static void WorkerThread( PlaybackRequestHandler* me );
+        static void ReadNextFrame( XRecordingPlayerData* owner, PlaybackCursor& cursor, ReadResult& result );
+        static bool ParseTime( const string& str, uint64_t now, uint64_t* time );
+        static int ParseRange( const string& str, uint64_t fileSize, uint64_t* start, uint64_t* end );
+    };
+
+    class XRecordingPlayerData
+    {
+    public:
+        string Folder;
+
+    public:
+        XRecordingPlayerData( const string& folder ) :
+            Folder( folder )
+        {
+            if ( ( !Folder.empty( ) ) && ( Folder.back( ) != '/' ) )
+            {
+                Folder += '/';
+            }
+        }
+
+        vector<string> ListSegments( ) const;
+        bool FindFrame( uint64_t time, SegmentReader& reader, uint32_t* index ) const;
+        bool OpenNextSegment( const string& name, SegmentReader& reader ) const;
+        vector<XRecordingPlayer::ActivityRange> FindActivity( uint64_t from, uint64_t to, uint8_t threshold, uint32_t maxGap ) const;
+
+        static uint64_t Now( );
+    };
+}
+
+XRecordingPlayer::XRecordingPlayer( const string& folder ) :
+    mData( new Private::XRecordingPlayerData( folder ) )
+{
+}
+
+XRecordingPlayer::~XRecordingPlayer( )
+{
+    delete mData;
+}
+
+// Folder with recordings
+string XRecordingPlayer::Folder( ) const
+{
+    return mData->Folder;
+}
+
+// Get the first recorded frame taken at or after the specified time
+XError XRecordingPlayer::GetFrame( uint64_t time, uint8_t** buffer, uint32_t* bufferSize, uint32_t* jpegSize, uint64_t* frameTime ) const
+{
+    Private::SegmentReader reader;
+    uint32_t               index;
+    XError                 ret = XError::Success;
+
+    if ( ( buffer == nullptr ) || ( bufferSize == nullptr ) || ( jpegSize == nullptr ) )
+    {
+        ret = XError::NullPointer;
+    }
+    else if ( !mData->FindFrame( time, reader, &index ) )
+    {
+        ret = XError::Failed;
+    }
+    else if ( !reader.ReadFrame( index, buffer, bufferSize ) )
+    {
+        ret = XError::IOError;
+    }
+    else
+    {
+        *jpegSize = reader.Frame( index ).Size;
+
+        if ( frameTime != nullptr )
+        {
+            *frameTime = reader.Frame( index ).Time;
+        }
+    }
+
+    return ret;
+}
+
+// Find periods of activity
+vector<XRecordingPlayer::ActivityRange> XRecordingPlayer::FindActivity( uint64_t from, uint64_t to, uint8_t threshold, uint32_t maxGap ) const
+{
+    return mData->FindActivity( from, to, threshold, maxGap );
+}
+
+// Create web request handler to provide recordings
+shared_ptr<IWebRequestHandler> XRecordingPlayer::CreatePlaybackHandler( const string& uri ) const
+{
+    return make_shared<Private::PlaybackRequestHandler>( uri, mData );
+}
+
+namespace Private
+{
+
+// Get sorted names of available segments (oldest first)
+vector<string> XRecordingPlayerData::ListSegments( ) const
+{
+    vector<string> segments;
+    DIR*           dir = opendir( Folder.c_str( ) );
+
+    if ( dir != nullptr )
+    {
+        struct dirent* entry;
+        string         baseName;
+
+        while ( ( entry = readdir( dir ) ) != nullptr )
+        {
+            if ( XRecordingSegment::IsSegmentFile( entry->d_name, XRecordingSegment::IndexExtension, &baseName ) )
+            {
+                segments.push_back( baseName );
+            }
+        }
+
+        closedir( dir );
+    }
+
+    // names are times, so sorting them puts the oldest first
+    sort( segments.begin( ), segments.end( ) );
+
+    return segments;
+}
+
+// Find the first frame taken at or after the specified time, opening its segment
+bool XRecordingPlayerData::FindFrame( uint64_t time, SegmentReader& reader, uint32_t* index ) const
+{
+    vector<string>                 segments = ListSegments( );
+    vector<string>::const_iterator it       = upper_bound( segments.begin( ), segments.end( ), XRecordingSegment::MakeName( time ) );
+    bool                           found    = false;
+
+    // start from the last segment started before (or at) the time, then check newer ones
+    // if the time happens to be after its last frame
+    if ( it != segments.begin( ) )
+    {
+        --it;
+    }
+
+    for ( ; ( it != segments.end( ) ) && ( !found ); ++it )
+    {
+        if ( reader.Open( Folder, *it ) )
+        {
+            *index = reader.FindFrame( time );
+            found  = ( *index < reader.FramesCount( ) );
+        }
+    }
+
+    return found;
+}
+
+// Open the first segment (having frames) following the specified one
+bool XRecordingPlayerData::OpenNextSegment( const string& name, SegmentReader& reader ) const
+{
+    vector<string>                 segments = ListSegments( );
+    vector<string>::const_iterator it       = upper_bound( segments.begin( ), segments.end( ), name );
+    bool                           ret      = false;
+
+    for ( ; ( it != segments.end( ) ) && ( !ret ); ++it )
+    {
+        ret = ( ( reader.Open( Folder, *it ) ) && ( reader.FramesCount( ) != 0 ) );
+    }
+
+    return ret;
+}
+
+// Find periods of activity scanning motion levels of segments covering the time interval
+vector<XRecordingPlayer::ActivityRange> XRecordingPlayerData::FindActivity( uint64_t from, uint64_t to, uint8_t threshold, uint32_t maxGap ) const
+{
+    vector<XRecordingPlayer::ActivityRange> ranges;
+    vector<string>                          segments = ListSegments( );
+    vector<string>::const_iterator          it       = upper_bound( segments.begin( ), segments.end( ), XRecordingSegment::MakeName( from ) );
+    string                                  lastName = XRecordingSegment::MakeName( to );
+    XRecordingPlayer::ActivityRange         range    = { 0, 0, 0, 0 };
+    SegmentReader                           reader;
+
+    // level 0 would make everything active
+    if ( threshold == 0 )
+    {
+        threshold = 1;
+    }
+
+    if ( it != segments.begin( ) )
+    {
+        --it;
+    }
+
+    for ( ; ( it != segments.end( ) ) && ( *it <= lastName ); ++it )
+    {
+        if ( ( reader.Open( Folder, *it ) ) && ( reader.ActivityCount( ) != 0 ) )
+        {
+            const uint8_t* levels = reader.MotionLevels( );
+            uint32_t       end    = min( reader.ActivityCount( ), ( to == ~0ull ) ? reader.FramesCount( ) : reader.FindFrame( to + 1 ) );
+
+            for ( uint32_t i = reader.FindFrame( from ); i < end; i++ )
+            {
+                if ( levels[i] >= threshold )
+                {
+                    uint64_t time = reader.Frame( i ).Time;
+
+                    if ( ( range.Frames != 0 ) && ( time - range.End <= maxGap ) )
+                    {
+                        range.End = time;
+                        range.Frames++;
+                    }
+                    else
+                    {
+                        if ( range.Frames != 0 )
+                        {
+                            ranges.push_back( range );
+                        }
+
+                        range.Start     = time;
+                        range.End       = time;
+                        range.Frames    = 1;
+                        range.PeakLevel = 0;
+                    }
+
+                    if ( levels[i] > range.PeakLevel )
+                    {
+                        range.PeakLevel = levels[i];
+                    }
+                }
+            }
+        }
+    }
+
+    if ( range.Frames != 0 )
+    {
+        ranges.push_back( range );
+    }
+
+    return ranges;
+}
+
+// Current time as milliseconds since Unix epoch
+uint64_t XRecordingPlayerData::Now( )
+{
+    return static_cast<uint64_t>( duration_cast<milliseconds>( system_clock::now( ).time_since_epoch( ) ).count( ) );
+}
+
+// Open data and index files of the segment, mapping the index (and motion levels, if available)
+bool SegmentReader::Open( const string& folder, const string& name )
+{
+    Close( );
+
+    DataFile     = open( ( folder + name + XRecordingSegment::DataExtension ).c_str( ), O_RDONLY );
+    IndexFile    = open( ( folder + name + XRecordingSegment::IndexExtension ).c_str( ), O_RDONLY );
+    // motion levels are optional
+    ActivityFile = open( ( folder + name + XRecordingSegment::ActivityExtension ).c_str( ), O_RDONLY );
+
+    if ( ( DataFile == -1 ) || ( IndexFile == -1 ) || ( !Refresh( ) ) )
+    {
+        Close( );
+    }
+    else
+    {
+        Name = name;
+    }
+
+    return ( DataFile != -1 );
+}
+
+// Close segment's files
+void SegmentReader::Close( )
+{
+    UnmapIndex( );
+    UnmapActivity( );
+
+    if ( DataFile != -1 )
+    {
+        close( DataFile );
+        DataFile = -1;
+    }
+    if ( IndexFile != -1 )
+    {
+        close( IndexFile );
+        IndexFile = -1;
+    }
+    if ( ActivityFile != -1 )
+    {
+        close( ActivityFile );
+        ActivityFile = -1;
+    }
+
+    Name.clear( );
+}
+
+// Map index again if the segment has grown since it was mapped (it is still being recorded)
+bool SegmentReader::Refresh( )
+{
+    struct stat dataStat;
+    struct stat indexStat;
+    bool        ret = false;
+
+    if ( ( fstat( DataFile, &dataStat ) == 0 ) && ( fstat( IndexFile, &indexStat ) == 0 ) )
+    {
+        // incomplete record at the end (if it is being written) is ignored
+        size_t indexSize = static_cast<size_t>( indexStat.st_size ) / sizeof( XRecordingIndexEntry ) * sizeof( XRecordingIndexEntry );
+        size_t entries   = 0;
+
+        ret = true;
+
+        if ( indexSize != IndexMapSize )
+        {
+            UnmapIndex( );
+
+            if ( indexSize != 0 )
+            {
+                void* map = mmap( nullptr, indexSize, PROT_READ, MAP_SHARED, IndexFile, 0 );
+
+                if ( map != MAP_FAILED )
+                {
+                    Index        = static_cast<const XRecordingIndexEntry*>( map );
+                    IndexMapSize = indexSize;
+                }
+                else
+                {
+                    ret = false;
+                }
+            }
+        }
+
+        entries = IndexMapSize / sizeof( XRecordingIndexEntry );
+
+        // offsets grow from record to record, so records pointing beyond the end of data file
+        // (damaged segment, for example) are all at the end and are found by binary search as well
+        if ( entries != 0 )
+        {
+            uint64_t dataSize = static_cast<uint64_t>( dataStat.st_size );
+
+            Count = static_cast<uint32_t>( partition_point( Index, Index + entries,
+                [dataSize]( const XRecordingIndexEntry& entry )
+                {
+                    return static_cast<uint64_t>( entry.Offset ) + entry.Size <= dataSize;
+                } ) - Index );
+        }
+    }
+
+    if ( ActivityFile != -1 )
+    {
+        struct stat activityStat;
+
+        if ( ( fstat( ActivityFile, &activityStat ) == 0 ) && ( static_cast<size_t>( activityStat.st_size ) != ActivityMapSize ) )
+        {
+            UnmapActivity( );
+
+            if ( activityStat.st_size != 0 )
+            {
+                void* map = mmap( nullptr, static_cast<size_t>( activityStat.st_size ), PROT_READ, MAP_SHARED, ActivityFile, 0 );
+
+                if ( map != MAP_FAILED )
+                {
+                    Activity        = static_cast<const uint8_t*>( map );
+                    ActivityMapSize = static_cast<size_t>( activityStat.st_size );
+                }
+            }
+        }
+    }
+
+    return ret;
+}
+
+// Unmap segment's index
+void SegmentReader::UnmapIndex( )
+{
+    if ( Index != nullptr )
+    {
+        munmap( const_cast<XRecordingIndexEntry*>( Index ), IndexMapSize );
+    }
+
+    Index        = nullptr;
+    IndexMapSize = 0;
+    Count        = 0;
+}
+
+// Unmap segment's motion levels
+void SegmentReader::UnmapActivity( )
+{
+    if ( Activity != nullptr )
+    {
+        munmap( const_cast<uint8_t*>( Activity ), ActivityMapSize );
+    }
+
+    Activity        = nullptr;
+    ActivityMapSize = 0;
+}
+
+// Find the first frame taken at or after the specified time (FramesCount() if there is none)
+uint32_t SegmentReader::FindFrame( uint64_t time ) const
+{
+    return static_cast<uint32_t>( lower_bound( Index, Index + Count, time,
+        []( const XRecordingIndexEntry& entry, uint64_t value )
+        {
+            return entry.Time < value;
+        } ) - Index );
+}
+
+// Read the specified frame into the buffer, reallocating it if needed
+bool SegmentReader::ReadFrame( uint32_t index, uint8_t** buffer, uint32_t* bufferSize ) const
+{
+    const XRecordingIndexEntry& entry = Index[index];
+    bool                        ret   = true;
+
+    if ( ( *buffer == nullptr ) || ( *bufferSize < entry.Size ) )
+    {
+        uint8_t* newBuffer = static_cast<uint8_t*>( realloc( *buffer, entry.Size ) );
+
+        if ( newBuffer == nullptr )
+        {
+            ret = false;
+        }
+        else
+        {
+            *buffer     = newBuffer;
+            *bufferSize = entry.Size;
+        }
+    }
+
+    if ( ret )
+    {
+        ret = ( pread( DataFile, *buffer, entry.Size, static_cast<off_t>( entry.Offset ) ) == static_cast<ssize_t>( entry.Size ) );
+    }
+
+    return ret;
+}
+
+// Parse time, which is either milliseconds since Unix epoch or (if negative) milliseconds before now
+bool PlaybackRequestHandler::ParseTime( const string& str, uint64_t now, uint64_t* time )
+{
+    char*     end   = nullptr;
+    long long value = strtoll( str.c_str( ), &end, 10 );
+    bool      ret   = ( ( !str.empty( ) ) && ( *end == '\0' ) );
+
+    if ( ret )
+    {
+        if ( value >= 0 )
+        {
+            *time = static_cast<uint64_t>( value );
+        }
+        else
+        {
+            *time = ( static_cast<uint64_t>( -value ) > now ) ? 0 : now - static_cast<uint64_t>( -value );
+        }
+    }
+
+    return ret;
+}
+
+// Parse value of Range header. Returns 1 if a single byte range is requested (end is exclusive),
+// 0 if the whole file must be provided (no range, multiple ranges or unknown syntax) and -1 if
+// the range can not be satisfied.
+int PlaybackRequestHandler::ParseRange( const string& str, uint64_t fileSize, uint64_t* start, uint64_t* end )
+{
+    int ret = 0;
+
+    if ( ( str.compare( 0, 6, "bytes=" ) == 0 ) && ( str.find( ',' ) == string::npos ) )
+    {
+        const char*        rangeStr = str.c_str( ) + 6;
+        char*              ptr      = nullptr;
+        unsigned long long first    = 0;
+        unsigned long long last     = 0;
+
+        if ( *rangeStr == '-' )
+        {
+            // suffix range - the specified number of the last bytes
+            last = strtoull( rangeStr + 1, &ptr, 10 );
+
+            if ( ( ptr != rangeStr + 1 ) && ( *ptr == '\0' ) )
+            {
+                if ( ( last == 0 ) || ( fileSize == 0 ) )
+                {
+                    ret = -1;
+                }
+                else
+                {
+                    *start = ( last < fileSize ) ? fileSize - last : 0;
+                    *end   = fileSize;
+                    ret    = 1;
+                }
+            }
+        }
+        else if ( ( *rangeStr >= '0' ) && ( *rangeStr <= '9' ) )
+        {
+            first = strtoull( rangeStr, &ptr, 10 );
+
+            if ( *ptr == '-' )
+            {
+                const char* lastStr = ptr + 1;
+
+                last = ( *lastStr == '\0' ) ? ~0ull : strtoull( lastStr, &ptr, 10 );
+
+                if ( ( ( *lastStr == '\0' ) || ( ( *ptr == '\0' ) && ( ptr != lastStr ) ) ) && ( last >= first ) )
+                {
+                    if ( first >= fileSize )
+                    {
+                        ret = -1;
+                    }
+                    else
+                    {
+                        *start = first;
+                        *end   = ( last >= fileSize - 1 ) ? fileSize : last + 1;
+                        ret    = 1;
+                    }
+                }
+            }
+        }
+    }
+
+    return ret;
+}
+
+// Handle request - list of segments, playback of frames or segment's file
+void PlaybackRequestHandler::HandleHttpRequest( const IWebRequest& request, IWebResponse& response )
+{
+    string uri = request.Uri( );
+
+    if ( uri.length( ) == Uri( ).length( ) )
+    {
+        if ( request.GetVariable( "from" ).empty( ) )
+        {
+            HandleListRequest( response );
+        }
+        else
+        {
+            HandleFrameRequest( request, response );
+        }
+    }
+    else if ( uri.compare( Uri( ).length( ), string::npos, "/activity" ) == 0 )
+    {
+        HandleActivityRequest( request, response );
+    }
+    else if ( ( uri[Uri( ).length( )] == '/' ) &&
+              ( ( XRecordingSegment::IsSegmentFile( uri.substr( Uri( ).length( ) + 1 ), XRecordingSegment::DataExtension ) ) ||
+                ( XRecordingSegment::IsSegmentFile( uri.substr( Uri( ).length( ) + 1 ), XRecordingSegment::IndexExtension ) ) ) )
+    {
+        // only names of segments' files are accepted, so nothing else can be accessed
+        HandleFileRequest( request, response, uri.substr( Uri( ).length( ) + 1 ) );
+    }
+    else
+    {
+        response.SendError( 404 );
+    }
+}
+
+// Provide JSON list of recorded segments
+void PlaybackRequestHandler::HandleListRequest( IWebResponse& response )
+{
+    shared_ptr<ReadResult> result = make_shared<ReadResult>( );
+    XRecordingPlayerData*  owner  = Owner;
+
+    QueueRead( result, [owner]( ReadResult& read )
+    {
+        vector<string> segments = owner->ListSegments( );
+        SegmentReader  reader;
+        char           buffer[256];
+        bool           first    = true;
+
+        read.Reply = "{\"status\":\"OK\",\"recordings\":[";
+
+        for ( const string& name : segments )
+        {
+            if ( ( reader.Open( owner->Folder, name ) ) && ( reader.FramesCount( ) != 0 ) )
+            {
+                const XRecordingIndexEntry& firstFrame = reader.Frame( 0 );
+                const XRecordingIndexEntry& lastFrame  = reader.Frame( reader.FramesCount( ) - 1 );
+
+                snprintf( buffer, sizeof( buffer ), "%s{\"name\":\"%s\",\"frames\":%u,\"start\":%llu,\"end\":%llu,\"size\":%u}",
+                          ( first ) ? "" : ",", name.c_str( ), reader.FramesCount( ),
+                          static_cast<unsigned long long>( firstFrame.Time ), static_cast<unsigned long long>( lastFrame.Time ),
+                          lastFrame.Offset + lastFrame.Size );
+
+                read.Reply += buffer;
+                first       = false;
+            }
+        }
+
+        read.Reply += "]}";
+    } );
+
+    Replies[response.ConnectionId( )] = result;
+    response.SetTimer( 1 );
+}
+
+// Provide JSON list of activity periods
+void PlaybackRequestHandler::HandleActivityRequest( const IWebRequest& request, IWebResponse& response )
+{
+    string       fromStr      = request.GetVariable( "from" );
+    string       toStr        = request.GetVariable( "to" );
+    string       thresholdStr = request.GetVariable( "threshold" );
+    string       gapStr       = request.GetVariable( "gap" );
+    uint64_t     now          = XRecordingPlayerData::Now( );
+    uint64_t     from         = ( now > DEFAULT_ACTIVITY_PERIOD ) ? now - DEFAULT_ACTIVITY_PERIOD : 0;
+    uint64_t     to           = now;
+    unsigned int threshold    = DEFAULT_ACTIVITY_THRESHOLD;
+    unsigned int gap          = DEFAULT_ACTIVITY_GAP;
+
+    if ( ( ( !fromStr.empty( ) ) && ( !ParseTime( fromStr, now, &from ) ) ) ||
+         ( ( !toStr.empty( ) ) && ( !ParseTime( toStr, now, &to ) ) ) )
+    {
+        response.SendError( 400, "Invalid time" );
+    }
+    else if ( ( ( !thresholdStr.empty( ) ) && ( ( sscanf( thresholdStr.c_str( ), "%u", &threshold ) != 1 ) || ( threshold > 255 ) ) ) ||
+              ( ( !gapStr.empty( ) ) && ( sscanf( gapStr.c_str( ), "%u", &gap ) != 1 ) ) )
+    {
+        response.SendError( 400, "Invalid threshold or gap" );
+    }
+    else
+    {
+        shared_ptr<ReadResult> result = make_shared<ReadResult>( );
+        XRecordingPlayerData*  owner  = Owner;
+
+        QueueRead( result, [owner, from, to, threshold, gap]( ReadResult& read )
+        {
+            vector<XRecordingPlayer::ActivityRange> ranges = owner->FindActivity( from, to, static_cast<uint8_t>( threshold ), gap );
+            char                                    buffer[128];
+
+            read.Reply = "{\"status\":\"OK\",\"activity\":[";
+
+            for ( size_t i = 0; i < ranges.size( ); i++ )
+            {
+                snprintf( buffer, sizeof( buffer ), "%s{\"start\":%llu,\"end\":%llu,\"frames\":%u,\"peak\":%u}",
+                          ( i == 0 ) ? "" : ",",
+                          static_cast<unsigned long long>( ranges[i].Start ), static_cast<unsigned long long>( ranges[i].End ),
+                          ranges[i].Frames, static_cast<uint32_t>( ranges[i].PeakLevel ) );
+
+                read.Reply += buffer;
+            }
+
+            read.Reply += "]}";
+        } );
+
+        Replies[response.ConnectionId( )] = result;
+        response.SetTimer( 1 );
+    }
+}
+
+// Provide single frame or start playing frames of the specified period
+void PlaybackRequestHandler::HandleFrameRequest( const IWebRequest& request, IWebResponse& response )
+{
+    string   toStr = request.GetVariable( "to" );
+    uint64_t now   = XRecordingPlayerData::Now( );
+    uint64_t from  = 0;
+    uint64_t to    = now;
+
+    if ( ( !ParseTime( request.GetVariable( "from" ), now, &from ) ) || ( ( !toStr.empty( ) ) && ( !ParseTime( toStr, now, &to ) ) ) )
+    {
+        response.SendError( 400, "Invalid time" );
+    }
+    else
+    {
+        // the first frame is searched by the worker thread - reply is sent once it is found (or not)
+        Playback&                  client = Playbacks[response.ConnectionId( )];
+        shared_ptr<PlaybackCursor> cursor = make_shared<PlaybackCursor>( to );
+        XRecordingPlayerData*      owner  = Owner;
+
+        client.Cursor         = cursor;
+        client.Read           = make_shared<ReadResult>( );
+        client.EndTime        = to;
+        client.FirstFrameTime = 0;
+        client.StartTime      = steady_clock::now( );
+        client.SingleFrame    = ( request.GetVariable( "format" ) == "jpeg" );
+        client.Started        = false;
+        client.Finished       = false;
+
+        QueueRead( client.Read, [owner, cursor, from]( ReadResult& read )
+        {
+            if ( owner->FindFrame( from, *cursor->Reader, &cursor->NextFrame ) )
+            {
+                ReadNextFrame( owner, *cursor, read );
+            }
+        } );
+
+        response.SetTimer( 1 );
+    }
+}
+
+// Provide segment's file (or the requested range of it)
+void PlaybackRequestHandler::HandleFileRequest( const IWebRequest& request, IWebResponse& response, const string& fileName )
+{
+    map<string, string> headers = request.Headers( );
+    string              range;
+    struct stat         fileStat;
+    int                 file    = open( ( Owner->Folder + fileName ).c_str( ), O_RDONLY );
+
+    for ( const auto& header : headers )
+    {
+        if ( strcasecmp( header.first.c_str( ), "Range" ) == 0 )
+        {
+            range = header.second;
+        }
+    }
+
+    if ( ( file == -1 ) || ( fstat( file, &fileStat ) != 0 ) )
+    {
+        response.SendError( 404 );
+    }
+    else
+    {
+        // segment being recorded keeps growing, so its current size is provided
+        uint64_t    fileSize    = static_cast<uint64_t>( fileStat.st_size );
+        uint64_t    start       = 0;
+        uint64_t    end         = fileSize;
+        int         rangeResult = ParseRange( range, fileSize, &start, &end );
+        const char* contentType = ( XRecordingSegment::IsSegmentFile( fileName, XRecordingSegment::DataExtension ) ) ?
+                                  "video/x-motion-jpeg" : "application/octet-stream";
+
+        if ( rangeResult < 0 )
+        {
+            response.Printf( "HTTP/1.1 416 Range Not Satisfiable\r\n"
+                             "Content-Range: bytes */%llu\r\n"
+                             "Content-Length: 0\r\n"
+                             "\r\n", static_cast<unsigned long long>( fileSize ) );
+        }
+        else
+        {
+            if ( rangeResult == 0 )
+            {
+                response.Printf( "HTTP/1.1 200 OK\r\n" );
+            }
+            else
+            {
+                response.Printf( "HTTP/1.1 206 Partial Content\r\n"
+                                 "Content-Range: bytes %llu-%llu/%llu\r\n",
+                                 static_cast<unsigned long long>( start ), static_cast<unsigned long long>( end - 1 ),
+                                 static_cast<unsigned long long>( fileSize ) );
+            }
+
+            response.Printf( "Content-Type: %s\r\n"
+                             "Content-Length: %llu\r\n"
+                             "Accept-Ranges: bytes\r\n"
+                             "Connection: close\r\n"
+                             "\r\n", contentType, static_cast<unsigned long long>( end - start ) );
+
+            // file is read by chunks on the worker thread and sent from timer events, so big files are not kept in memory
+            Download& client = Downloads[response.ConnectionId( )];
+
+            client.File     = make_shared<DownloadFile>( file );
+            client.Read     = make_shared<ReadResult>( );
+            client.Position = start;
+            client.End      = end;
+            client.Reading  = false;
+            file            = -1;
+
+            response.SetTimer( 1 );
+        }
+    }
+
+    if ( file != -1 )
+    {
+        close( file );
+    }
+}
+
+// Send frame either as a complete reply or as a part of MJPEG stream
+void PlaybackRequestHandler::SendFrame( IWebResponse& response, const ReadResult& frame, bool asPart )
+{
+    if ( asPart )
+    {
+        response.Printf( "--myboundary\r\n"
+                         "Content-Type: image/jpeg\r\n"
+                         "Content-Length: %u\r\n"
+                         "X-Frame-Time: %llu\r\n"
+                         "\r\n", frame.Length, static_cast<unsigned long long>( frame.FrameTime ) );
+    }
+    else
+    {
+        response.Printf( "HTTP/1.1 200 OK\r\n"
+                         "Content-Type: image/jpeg\r\n"
+                         "Content-Length: %u\r\n"
+                         "X-Frame-Time: %llu\r\n"
+                         "Cache-Control: no-store, must-revalidate\r\nPragma: no-cache\r\nExpires: 0\r\n"
+                         "\r\n", frame.Length, static_cast<unsigned long long>( frame.FrameTime ) );
+    }
+
+    response.Send( frame.Buffer, frame.Length );
+}
+
+// Timer event for the connection waiting for reply, playing recording or downloading file
+void PlaybackRequestHandler::HandleTimer( IWebResponse& response )
+{
+    map<uintptr_t, Playback>::iterator               playbackIt = Playbacks.find( response.ConnectionId( ) );
+    map<uintptr_t, Download>::iterator               downloadIt = Downloads.find( response.ConnectionId( ) );
+    map<uintptr_t, shared_ptr<ReadResult>>::iterator replyIt    = Replies.find( response.ConnectionId( ) );
+
+    if ( playbackIt != Playbacks.end( ) )
+    {
+        HandlePlaybackTimer( response, playbackIt );
+    }
+    else if ( downloadIt != Downloads.end( ) )
+    {
+        HandleDownloadTimer( response, downloadIt );
+    }
+    else if ( replyIt != Replies.end( ) )
+    {
+        HandleReplyTimer( response, replyIt );
+    }
+    else
+    {
+        response.CloseConnection( );
+    }
+}
+
+// Send JSON reply once the worker thread has prepared it
+void PlaybackRequestHandler::HandleReplyTimer( IWebResponse& response, map<uintptr_t, shared_ptr<ReadResult>>::iterator it )
+{
+    if ( !IsReadDone( it->second ) )
+    {
+        response.SetTimer( 1 );
+    }
+    else
+    {
+        const string& reply = it->second->Reply;
+
+        response.Printf( "HTTP/1.1 200 OK\r\n"
+                         "Content-Type: application/json\r\n"
+                         "Content-Length: %u\r\n"
+                         "Cache-Control: no-store, must-revalidate\r\nPragma: no-cache\r\nExpires: 0\r\n"
+                         "\r\n", static_cast<uint32_t>( reply.length( ) ) );
+
+        response.Send( reinterpret_cast<const uint8_t*>( reply.data( ) ), reply.length( ) );
+
+        Replies.erase( it );
+    }
+}
+
+// Provide next frame of playback when it is due
+void PlaybackRequestHandler::HandlePlaybackTimer( IWebResponse& response, map<uintptr_t, Playback>::iterator it )
+{
+    Playback& client = it->second;
+    uint32_t  delay  = MAX_PLAYBACK_TIMER;
+
+    if ( !IsReadDone( client.Read ) )
+    {
+        // still waiting for the worker thread
+        response.SetTimer( 1 );
+        return;
+    }
+
+    if ( !client.Started )
+    {
+        const ReadResult& first = *client.Read;
+
+        if ( !first.Found )
+        {
+            if ( first.Failed )
+            {
+                response.SendError( 500, "Failed reading frame" );
+            }
+            else
+            {
+                response.SendError( 404, "No frames for the specified time" );
+            }
+
+            Playbacks.erase( it );
+            return;
+        }
+
+        if ( client.SingleFrame )
+        {
+            SendFrame( response, first, false );
+            Playbacks.erase( it );
+            return;
+        }
+
+        response.Printf( "HTTP/1.1 200 OK\r\n"
+                         "Cache-Control: no-store, must-revalidate\r\nPragma: no-cache\r\nExpires: 0\r\n"
+                         "Connection: close\r\n"
+                         "Content-Type: multipart/x-mixed-replace; boundary=--myboundary\r\n"
+                         "\r\n" );
+
+        client.Started        = true;
+        client.FirstFrameTime = first.FrameTime;
+        client.StartTime      = steady_clock::now( );
+    }
+
+    if ( client.Finished )
+    {
+        // nothing more to read, waiting for the last frames to go out
+    }
+    else if ( client.Read->Found )
+    {
+        uint64_t elapsed = static_cast<uint64_t>( duration_cast<milliseconds>( steady_clock::now( ) - client.StartTime ).count( ) );
+        uint64_t dueTime = ( client.Read->FrameTime > client.FirstFrameTime ) ? client.Read->FrameTime - client.FirstFrameTime : 0;
+
+        if ( dueTime > elapsed + MAX_PLAYBACK_GAP )
+        {
+            // don't make client wait while recording was not done
+            client.FirstFrameTime += dueTime - elapsed - MAX_PLAYBACK_GAP;
+            dueTime                = elapsed + MAX_PLAYBACK_GAP;
+        }
+
+        // keep original timing of frames, but don't try sending too much on slow connections
+        if ( ( dueTime <= elapsed ) && ( response.ToSendDataLength( ) < 2 * client.Read->Length ) )
+        {
+            SendFrame( response, *client.Read, true );
+            // read the next frame while this one is going out
+            QueueNextFrame( client );
+            delay = 1;
+        }
+        else if ( dueTime > elapsed )
+        {
+            delay = static_cast<uint32_t>( dueTime - elapsed );
+            if ( delay > MAX_PLAYBACK_TIMER )
+            {
+                delay = MAX_PLAYBACK_TIMER;
+            }
+        }
+    }
+    else if ( ( client.Read->Finished ) || ( XRecordingPlayerData::Now( ) > client.EndTime ) )
+    {
+        // next frame is out of the requested period (or will be, when it gets recorded)
+        client.Finished = true;
+    }
+    else
+    {
+        // the segment may be still recorded, or there may be next one - check again later;
+        // unreadable frame is skipped straight away
+        if ( client.Read->Failed )
+        {
+            delay = 1;
+        }
+
+        QueueNextFrame( client );
+    }
+
+    if ( ( client.Finished ) && ( response.ToSendDataLength( ) == 0 ) )
+    {
+        // all frames of the requested period are sent
+        Playbacks.erase( it );
+        response.CloseConnection( );
+    }
+    else
+    {
+        response.SetTimer( delay );
+    }
+}
+
+// Send next chunk of the downloaded file and queue reading of the one after it
+void PlaybackRequestHandler::HandleDownloadTimer( IWebResponse& response, map<uintptr_t, Download>::iterator it )
+{
+    Download& client = it->second;
+
+    if ( client.Reading )
+    {
+        if ( !IsReadDone( client.Read ) )
+        {
+            response.SetTimer( 1 );
+            return;
+        }
+
+        if ( response.ToSendDataLength( ) >= 2 * DOWNLOAD_CHUNK_SIZE )
+        {
+            response.SetTimer( 10 );
+            return;
+        }
+
+        if ( client.Read->Length != 0 )
+        {
+            response.Send( client.Read->Buffer, client.Read->Length );
+            client.Position += client.Read->Length;
+        }
+        else
+        {
+            // file was truncated or deleted (old segment) - nothing can be done, since headers are sent
+            client.Position = client.End;
+        }
+
+        client.Reading = false;
+    }
+
+    if ( client.Position < client.End )
+    {
+        shared_ptr<DownloadFile> file   = client.File;
+        uint64_t                 offset = client.Position;
+        uint32_t                 toRead = static_cast<uint32_t>( min( static_cast<uint64_t>( DOWNLOAD_CHUNK_SIZE ), client.End - client.Position ) );
+
+        QueueRead( client.Read, [file, offset, toRead]( ReadResult& read )
+        {
+            ssize_t ret = -1;
+
+            if ( read.BufferSize < DOWNLOAD_CHUNK_SIZE )
+            {
+                uint8_t* newBuffer = static_cast<uint8_t*>( realloc( read.Buffer, DOWNLOAD_CHUNK_SIZE ) );
+
+                if ( newBuffer != nullptr )
+                {
+                    read.Buffer     = newBuffer;
+                    read.BufferSize = DOWNLOAD_CHUNK_SIZE;
+                }
+            }
+
+            if ( read.BufferSize >= DOWNLOAD_CHUNK_SIZE )
+            {
+                ret = pread( file->Handle, read.Buffer, toRead, static_cast<off_t>( offset ) );
+            }
+
+            read.Length = ( ret > 0 ) ? static_cast<uint32_t>( ret ) : 0;
+        } );
+
+        client.Reading = true;
+    }
+
+    if ( ( !client.Reading ) && ( response.ToSendDataLength( ) == 0 ) )
+    {
+        Downloads.erase( it );
+        response.CloseConnection( );
+    }
+    else
+    {
+        response.SetTimer( ( response.ToSendDataLength( ) < 2 * DOWNLOAD_CHUNK_SIZE ) ? 1 : 10 );
+    }
+}
+
+// Connection playing recording, downloading file or waiting for reply has gone
+void PlaybackRequestHandler::HandleConnectionClosed( IWebResponse& response )
+{
+    // reads in progress keep their buffers and files alive until the worker thread is done with them
+    Downloads.erase( response.ConnectionId( ) );
+    Playbacks.erase( response.ConnectionId( ) );
+    Replies.erase( response.ConnectionId( ) );
+}
+
+// Queue reading to the worker thread - the result must not be touched until the read is done
+void PlaybackRequestHandler::QueueRead( const shared_ptr<ReadResult>& result, const ReadJob& job )
+{
+    {
+        lock_guard<mutex> lock( Sync );
+
+        result->Ready = false;
+        Jobs.push_back( make_pair( result, job ) );
+    }
+
+    JobQueued.notify_one( );
+}
+
+// Check if the worker thread is done with the queued read
+bool PlaybackRequestHandler::IsReadDone( const shared_ptr<ReadResult>& result )
+{
+    lock_guard<mutex> lock( Sync );
+    return result->Ready;
+}
+
+// Queue reading of the next frame of playback
+void PlaybackRequestHandler::QueueNextFrame( const Playback& client )
+{
+    shared_ptr<PlaybackCursor> cursor = client.Cursor;
+    XRecordingPlayerData*      owner  = Owner;
+
+    QueueRead( client.Read, [owner, cursor]( ReadResult& read )
+    {
+        ReadNextFrame( owner, *cursor, read );
+    } );
+}
+
+// Read the next frame of playback, moving to the next segment if the current one has no more frames
+void PlaybackRequestHandler::ReadNextFrame( XRecordingPlayerData* owner, PlaybackCursor& cursor, ReadResult& result )
+{
+    result.Found    = false;
+    result.Failed   = false;
+    result.Finished = false;
+
+    if ( cursor.NextFrame >= cursor.Reader->FramesCount( ) )
+    {
+        // the segment may be still recorded, or there may be next one
+        cursor.Reader->Refresh( );
+
+        if ( cursor.NextFrame >= cursor.Reader->FramesCount( ) )
+        {
+            shared_ptr<SegmentReader> nextReader = make_shared<SegmentReader>( );
+
+            if ( owner->OpenNextSegment( cursor.Reader->SegmentName( ), *nextReader ) )
+            {
+                cursor.Reader    = nextReader;
+                cursor.NextFrame = 0;
+            }
+        }
+    }
+
+    if ( cursor.NextFrame < cursor.Reader->FramesCount( ) )
+    {
+        const XRecordingIndexEntry& entry = cursor.Reader->Frame( cursor.NextFrame );
+
+        if ( entry.Time > cursor.EndTime )
+        {
+            result.Finished = true;
+        }
+        else
+        {
+            result.Found     = cursor.Reader->ReadFrame( cursor.NextFrame, &result.Buffer, &result.BufferSize );
+            result.Failed    = !result.Found;
+            result.FrameTime = entry.Time;
+            result.Length    = entry.Size;
+            // unreadable frames are skipped
+            cursor.NextFrame++;
+        }
+    }
+}
+
+// Thread doing all reading of segments for the handler's connections
+void PlaybackRequestHandler::WorkerThread( PlaybackRequestHandler* me )
+{
+    unique_lock<mutex> lock( me->Sync );
+
+    while ( !me->NeedToStop )
+    {
+        if ( me->Jobs.empty( ) )
+        {
+            me->JobQueued.wait( lock );
+        }
+        else
+        {
+            pair<shared_ptr<ReadResult>, ReadJob> job = me->Jobs.front( );
+
+            me->Jobs.pop_front( );
+            lock.unlock( );
+
+            job.second( *job.first );
+
+            lock.lock( );
+            job.first->Ready = true;
+        }
+    }
+}
+
+} // namespace Private
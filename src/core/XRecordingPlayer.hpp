@@ -0,0 +1,90 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XRECORDING_PLAYER_HPP
+#define XRECORDING_PLAYER_HPP
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "XInterfaces.hpp"
+#include "XError.hpp"
+#include "XWebServer.hpp"
+
+namespace Private
+{
+    class XRecordingPlayerData;
+}
+
+/* Provides frames from recordings made by XMjpegRecorder (see XRecordingFormat.hpp).
+
+   Segments are found by their names, which are sortable times, and index file of a segment
+   is memory mapped, so a frame is found with binary search over its fixed size records -
+   nothing is parsed or scanned. Index records are checked against size of the data file,
+   so frames still being written (or lost) are never provided.
+
+   If motion levels were recorded, periods of activity are found by scanning only the column
+   of levels (one byte per frame) - index is looked into only for time of active frames, and
+   images are not touched at all.
+
+   Frame time is milliseconds since Unix epoch.
+*/
+class XRecordingPlayer : private Uncopyable
+{
+public:
+    // Period of recorded activity
+    struct ActivityRange
+    {
+        uint64_t Start;
+        uint64_t End;
+        uint32_t Frames;
+        uint8_t  PeakLevel;
+    };
+
+public:
+    XRecordingPlayer( const std::string& folder );
+    ~XRecordingPlayer( );
+
+    // Folder with recordings
+    std::string Folder( ) const;
+
+    // Get the first recorded frame taken at or after the specified time. The buffer is (re)allocated
+    // with realloc() if it is too small.
+    XError GetFrame( uint64_t time, uint8_t** buffer, uint32_t* bufferSize, uint32_t* jpegSize, uint64_t* frameTime = nullptr ) const;
+
+    // Find periods of the specified time interval, where motion level of recorded frames is at or
+    // above the threshold. Active frames separated by no more than the specified gap (milliseconds) are
+    // put into the same period.
+    std::vector<ActivityRange> FindActivity( uint64_t from, uint64_t to, uint8_t threshold, uint32_t maxGap ) const;
+
+    // Create web request handler to provide recordings. Without variables it provides JSON list of
+    // segments. With "from" variable it provides either a single JPEG or MJPEG stream playing frames
+    // from the specified time with their original timing. Files of segments are available as
+    // sub-content of the URI (uri/YYYYMMDD-HHMMSS.mjpg, for example), supporting HTTP Range requests.
+    // Periods of activity are provided as JSON by uri/activity.
+    std::shared_ptr<IWebRequestHandler> CreatePlaybackHandler( const std::string& uri ) const;
+
+private:
+    Private::XRecordingPlayerData* mData;
+};
+
+#endif // XRECORDING_PLAYER_HPP
@@ -0,0 +1,813 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <vector>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <random>
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <mongoose.h>
+
+#include "XRtspServer.hpp"
+#include "XManualResetEvent.hpp"
+#include "XStringTools.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace Private
+{
+    // Maximum size of RTP packet's payload, so that packets fit into Ethernet frames
+    #define RTP_MAX_PAYLOAD     (1400)
+    #define RTP_HEADER_SIZE     (12)
+    #define RTP_JPEG_PAYLOAD    (26)
+    #define RTSP_MAX_REQUEST    (8 * 1024)
+
+    // Information about JPEG image required to send it as RTP/JPEG (RFC 2435)
+    struct RtpJpegImage
+    {
+        uint8_t        Type;
+        uint8_t        Width8;
+        uint8_t        Height8;
+        uint16_t       RestartInterval;
+        const uint8_t* QuantizationTables[2];
+        const uint8_t* ScanData;
+        uint32_t       ScanSize;
+    };
+
+    // RTSP session - one per RTSP connection
+    class RtspSession
+    {
+    public:
+        string             Id;
+        bool               IsSetUp;
+        bool               Playing;
+        bool               Interleaved;
+        uint8_t            RtpChannel;
+        uint16_t           ClientRtpPort;
+        struct sockaddr_in ClientAddress;
+        uint16_t           Sequence;
+        uint32_t           Ssrc;
+
+    public:
+        RtspSession( const string& id, uint32_t ssrc ) :
+            Id( id ), IsSetUp( false ), Playing( false ), Interleaved( false ), RtpChannel( 0 ),
+            ClientRtpPort( 0 ), ClientAddress( ), Sequence( 0 ), Ssrc( ssrc )
+        {
+        }
+    };
+
+    class XRtspServerData
+    {
+    public:
+        XVideoSourceToWeb&      Video2Web;
+        uint16_t                Port;
+        uint32_t                FrameInterval;
+        recursive_mutex         StartSync;
+        thread                  ServerThread;
+        XManualResetEvent       NeedToStop;
+        bool                    IsRunning;
+
+        struct mg_mgr           EventManager;
+        sock_t                  RtpSocket;
+        uint16_t                RtpPort;
+        mt19937                 RandomGenerator;
+        volatile uint32_t       PlayingClients;
+        volatile uint32_t       RejectedFrames;
+
+        uint8_t*                JpegBuffer;
+        uint32_t                JpegBufferSize;
+        uint32_t                JpegSize;
+        uint32_t                LastSequence;
+        vector<uint8_t>         Payloads;
+        vector<uint32_t>        PayloadSizes;
+
+    public:
+        XRtspServerData( XVideoSourceToWeb& video2web, uint16_t port, uint32_t frameRate ) :
+            Video2Web( video2web ), Port( port ), FrameInterval( 1000 / ( ( frameRate == 0 ) ? 1 : frameRate ) ),
+            StartSync( ), ServerThread( ), NeedToStop( ), IsRunning( false ),
+            EventManager( ), RtpSocket( INVALID_SOCKET ), RtpPort( 0 ),
+            RandomGenerator( static_cast<uint32_t>( steady_clock::now( ).time_since_epoch( ).count( ) ) ), PlayingClients( 0 ), RejectedFrames( 0 ),
+            JpegBuffer( nullptr ), JpegBufferSize( 0 ), JpegSize( 0 ), LastSequence( 0 ), Payloads( ), PayloadSizes( )
+        {
+        }
+
+        ~XRtspServerData( )
+        {
+            free( JpegBuffer );
+        }
+
+        bool Start( );
+        void Stop( );
+
+    private:
+        bool OpenRtpSocket( );
+        void SendNextFrame( );
+        bool PacketizeJpeg( );
+        void SendFrame( struct mg_connection* connection, RtspSession* session, uint32_t timestamp );
+
+        void HandleRequest( struct mg_connection* connection, RtspSession* session, const string& request );
+
+        static void ServerThreadHandler( XRtspServerData* me );
+        static void EventHandler( struct mg_connection* connection, int event, void* param );
+    };
+}
+
+XRtspServer::XRtspServer( XVideoSourceToWeb& video2web, uint16_t port, uint32_t frameRate ) :
+    mData( new Private::XRtspServerData( video2web, port, frameRate ) )
+{
+}
+
+XRtspServer::~XRtspServer( )
+{
+    mData->Stop( );
+    delete mData;
+}
+
+// Get/Set port to listen on
+uint16_t XRtspServer::Port( ) const
+{
+    return mData->Port;
+}
+XRtspServer& XRtspServer::SetPort( uint16_t port )
+{
+    lock_guard<recursive_mutex> lock( mData->StartSync );
+
+    if ( !mData->IsRunning )
+    {
+        mData->Port = port;
+    }
+
+    return *this;
+}
+
+// Start RTSP server
+bool XRtspServer::Start( )
+{
+    return mData->Start( );
+}
+
+// Stop RTSP server
+void XRtspServer::Stop( )
+{
+    mData->Stop( );
+}
+
+// Number of clients currently receiving video
+uint32_t XRtspServer::PlayingClientsCount( ) const
+{
+    return mData->PlayingClients;
+}
+
+// Number of images, which could not be streamed since their JPEG format is not supported by RTP/JPEG
+uint32_t XRtspServer::RejectedFramesCount( ) const
+{
+    return mData->RejectedFrames;
+}
+
+namespace Private
+{
+
+// Start listening for RTSP connections
+bool XRtspServerData::Start( )
+{
+    lock_guard<recursive_mutex> lock( StartSync );
+
+    if ( !IsRunning )
+    {
+        char strPort[16];
+
+        sprintf( strPort, "%u", Port );
+
+        mg_mgr_init( &EventManager, this );
+
+        if ( ( mg_bind( &EventManager, strPort, EventHandler ) != nullptr ) && ( OpenRtpSocket( ) ) )
+        {
+            NeedToStop.Reset( );
+            LastSequence   = 0;
+            PlayingClients = 0;
+            IsRunning      = true;
+
+            ServerThread = thread( ServerThreadHandler, this );
+        }
+        else
+        {
+            if ( RtpSocket != INVALID_SOCKET )
+            {
+                closesocket( RtpSocket );
+                RtpSocket = INVALID_SOCKET;
+            }
+
+            mg_mgr_free( &EventManager );
+        }
+    }
+
+    return IsRunning;
+}
+
+// Stop RTSP server closing all connections
+void XRtspServerData::Stop( )
+{
+    lock_guard<recursive_mutex> lock( StartSync );
+
+    if ( IsRunning )
+    {
+        NeedToStop.Signal( );
+        ServerThread.join( );
+
+        // sessions are deleted on close events
+        mg_mgr_free( &EventManager );
+
+        closesocket( RtpSocket );
+        RtpSocket = INVALID_SOCKET;
+        IsRunning = false;
+    }
+}
+
+// Create UDP socket to send RTP packets from
+bool XRtspServerData::OpenRtpSocket( )
+{
+    struct sockaddr_in address;
+    socklen_t          addressLength = sizeof( address );
+    bool               ret           = false;
+
+    memset( &address, 0, sizeof( address ) );
+    address.sin_family      = AF_INET;
+    address.sin_addr.s_addr = htonl( INADDR_ANY );
+    address.sin_port        = 0;
+
+    RtpSocket = socket( AF_INET, SOCK_DGRAM, 0 );
+
+    if ( ( RtpSocket != INVALID_SOCKET ) &&
+         ( ::bind( RtpSocket, reinterpret_cast<struct sockaddr*>( &address ), sizeof( address ) ) == 0 ) &&
+         ( getsockname( RtpSocket, reinterpret_cast<struct sockaddr*>( &address ), &addressLength ) == 0 ) )
+    {
+        RtpPort = ntohs( address.sin_port );
+        ret     = true;
+    }
+
+    return ret;
+}
+
+// Thread serving RTSP connections and sending video to clients
+void XRtspServerData::ServerThreadHandler( XRtspServerData* me )
+{
+    steady_clock::time_point lastFrameTime = steady_clock::now( );
+
+    while ( !me->NeedToStop.IsSignaled( ) )
+    {
+        mg_mgr_poll( &me->EventManager, 5 );
+
+        if ( ( me->PlayingClients != 0 ) &&
+             ( duration_cast<milliseconds>( steady_clock::now( ) - lastFrameTime ).count( ) >= me->FrameInterval ) )
+        {
+            lastFrameTime = steady_clock::now( );
+            me->SendNextFrame( );
+        }
+    }
+}
+
+// Send the latest camera image to all playing clients (if it was not sent already)
+void XRtspServerData::SendNextFrame( )
+{
+    uint32_t sequence;
+
+    if ( ( Video2Web.GetJpegImage( &JpegBuffer, &JpegBufferSize, &JpegSize, &sequence ) ) && ( sequence != LastSequence ) )
+    {
+        uint32_t timestamp = static_cast<uint32_t>( duration_cast<microseconds>( steady_clock::now( ).time_since_epoch( ) ).count( ) * 9 / 100 );
+
+        LastSequence = sequence;
+
+        // packets' payload is prepared once and then sent to every client with its own RTP header
+        if ( PacketizeJpeg( ) )
+        {
+            for ( struct mg_connection* connection = mg_next( &EventManager, nullptr ); connection != nullptr;
+                  connection = mg_next( &EventManager, connection ) )
+            {
+                RtspSession* session = static_cast<RtspSession*>( connection->user_data );
+
+                if ( ( session != nullptr ) && ( session->Playing ) )
+                {
+                    SendFrame( connection, session, timestamp );
+                }
+            }
+        }
+        else
+        {
+            // clients get nothing - counted, so the application could tell why
+            RejectedFrames++;
+        }
+    }
+}
+
+// Find information required for RTP/JPEG header
+static bool ParseJpeg( const uint8_t* jpeg, uint32_t size, RtpJpegImage& image )
+{
+    const uint8_t* tables[4]  = { nullptr, nullptr, nullptr, nullptr };
+    uint8_t        tableIds[2] = { 0, 0 };
+    bool           gotFrame    = false;
+    uint32_t       i           = 2;
+
+    image.RestartInterval = 0;
+    image.ScanData        = nullptr;
+
+    if ( ( size < 4 ) || ( jpeg[0] != 0xFF ) || ( jpeg[1] != 0xD8 ) )
+    {
+        return false;
+    }
+
+    while ( ( i + 4 <= size ) && ( image.ScanData == nullptr ) )
+    {
+        if ( jpeg[i] != 0xFF )
+        {
+            return false;
+        }
+
+        uint8_t        marker  = jpeg[i + 1];
+        uint32_t       length  = ( static_cast<uint32_t>( jpeg[i + 2] ) << 8 ) | jpeg[i + 3];
+        const uint8_t* segment = jpeg + i + 4;
+
+        if ( marker == 0xFF )
+        {
+            // fill byte
+            i++;
+            continue;
+        }
+
+        if ( ( length < 2 ) || ( i + 2 + length > size ) )
+        {
+            return false;
+        }
+
+        length -= 2;
+
+        if ( marker == 0xDB )
+        {
+            // quantization tables - only 8 bit precision is supported by RFC 2435
+            for ( uint32_t j = 0; j + 65 <= length; j += 65 )
+            {
+                if ( ( segment[j] >> 4 ) != 0 )
+                {
+                    return false;
+                }
+                tables[segment[j] & 3] = segment + j + 1;
+            }
+        }
+        else if ( marker == 0xC0 )
+        {
+            // baseline frame with Y, Cb and Cr components, where chroma has half resolution
+            if ( ( length < 15 ) || ( segment[0] != 8 ) || ( segment[5] != 3 ) ||
+                 ( segment[10] != 0x11 ) || ( segment[13] != 0x11 ) || ( segment[11] != segment[14] ) )
+            {
+                return false;
+            }
+
+            uint32_t height = ( static_cast<uint32_t>( segment[1] ) << 8 ) | segment[2];
+            uint32_t width  = ( static_cast<uint32_t>( segment[3] ) << 8 ) | segment[4];
+
+            if ( ( width > 2040 ) || ( height > 2040 ) )
+            {
+                return false;
+            }
+
+            if ( segment[7] == 0x21 )
+            {
+                image.Type = 0;
+            }
+            else if ( segment[7] == 0x22 )
+            {
+                image.Type = 1;
+            }
+            else
+            {
+                return false;
+            }
+
+            image.Width8  = static_cast<uint8_t>( ( width  + 7 ) / 8 );
+            image.Height8 = static_cast<uint8_t>( ( height + 7 ) / 8 );
+            tableIds[0]   = segment[8]  & 3;
+            tableIds[1]   = segment[11] & 3;
+            gotFrame      = true;
+        }
+        else if ( ( marker >= 0xC1 ) && ( marker <= 0xCF ) && ( marker != 0xC4 ) && ( marker != 0xC8 ) && ( marker != 0xCC ) )
+        {
+            // progressive, lossless, arithmetic, etc.
+            return false;
+        }
+        else if ( marker == 0xDD )
+        {
+            if ( length < 2 )
+            {
+                return false;
+            }
+
+            image.RestartInterval = static_cast<uint16_t>( ( segment[0] << 8 ) | segment[1] );
+        }
+        else if ( marker == 0xDA )
+        {
+            uint32_t scanEnd = size;
+
+            if ( ( jpeg[size - 2] == 0xFF ) && ( jpeg[size - 1] == 0xD9 ) )
+            {
+                scanEnd -= 2;
+            }
+
+            image.ScanData = jpeg + i + 2 + length + 2;
+            image.ScanSize = scanEnd - ( i + 2 + length + 2 );
+        }
+
+        i += 2 + length + 2;
+    }
+
+    image.QuantizationTables[0] = tables[tableIds[0]];
+    image.QuantizationTables[1] = tables[tableIds[1]];
+
+    if ( image.RestartInterval != 0 )
+    {
+        image.Type += 64;
+    }
+
+    return ( ( gotFrame ) && ( image.ScanData != nullptr ) &&
+             ( image.QuantizationTables[0] != nullptr ) && ( image.QuantizationTables[1] != nullptr ) );
+}
+
+// Split JPEG scan data into RTP payloads, each starting with RTP/JPEG headers
+bool XRtspServerData::PacketizeJpeg( )
+{
+    RtpJpegImage image = { };
+    bool         ret = ParseJpeg( JpegBuffer, JpegSize, image );
+
+    if ( ret )
+    {
+        uint32_t offset = 0;
+
+        Payloads.resize( ( image.ScanSize / ( RTP_MAX_PAYLOAD - 160 ) + 1 ) * RTP_MAX_PAYLOAD );
+        PayloadSizes.clear( );
+
+        while ( offset < image.ScanSize )
+        {
+            uint8_t* payload = Payloads.data( ) + PayloadSizes.size( ) * RTP_MAX_PAYLOAD;
+            uint32_t size    = 8;
+
+            // main JPEG header
+            payload[0] = 0;
+            payload[1] = static_cast<uint8_t>( offset >> 16 );
+            payload[2] = static_cast<uint8_t>( offset >> 8 );
+            payload[3] = static_cast<uint8_t>( offset );
+            payload[4] = image.Type;
+            payload[5] = 255;   // quantization tables are provided in-band
+            payload[6] = image.Width8;
+            payload[7] = image.Height8;
+
+            if ( image.RestartInterval != 0 )
+            {
+                // restart marker header - the whole scan is a single chunk
+                payload[size++] = static_cast<uint8_t>( image.RestartInterval >> 8 );
+                payload[size++] = static_cast<uint8_t>( image.RestartInterval );
+                payload[size++] = 0xFF;
+                payload[size++] = 0xFF;
+            }
+
+            if ( offset == 0 )
+            {
+                // quantization table header goes into the first packet only
+                payload[size++] = 0;
+                payload[size++] = 0;
+                payload[size++] = 0;
+                payload[size++] = 128;
+
+                memcpy( payload + size, image.QuantizationTables[0], 64 );
+                memcpy( payload + size + 64, image.QuantizationTables[1], 64 );
+                size += 128;
+            }
+
+            uint32_t toCopy = min( image.ScanSize - offset, static_cast<uint32_t>( RTP_MAX_PAYLOAD ) - size );
+
+            memcpy( payload + size, image.ScanData + offset, toCopy );
+            PayloadSizes.push_back( size + toCopy );
+            offset += toCopy;
+        }
+    }
+
+    return ret;
+}
+
+// Send prepared RTP payloads to the specified client
+void XRtspServerData::SendFrame( struct mg_connection* connection, RtspSession* session, uint32_t timestamp )
+{
+    uint8_t  packet[4 + RTP_HEADER_SIZE + RTP_MAX_PAYLOAD];
+    uint8_t* rtpPacket = ( session->Interleaved ) ? packet + 4 : packet;
+    size_t   count     = PayloadSizes.size( );
+
+    // skip the frame if client did not receive the previous one yet - no point in building backlog
+    if ( ( session->Interleaved ) && ( connection->send_mbuf.len > JpegSize ) )
+    {
+        return;
+    }
+
+    for ( size_t i = 0; i < count; i++ )
+    {
+        uint32_t rtpSize = RTP_HEADER_SIZE + PayloadSizes[i];
+
+        rtpPacket[0]  = 0x80;
+        rtpPacket[1]  = static_cast<uint8_t>( RTP_JPEG_PAYLOAD | ( ( i == count - 1 ) ? 0x80 : 0 ) );
+        rtpPacket[2]  = static_cast<uint8_t>( session->Sequence >> 8 );
+        rtpPacket[3]  = static_cast<uint8_t>( session->Sequence );
+        rtpPacket[4]  = static_cast<uint8_t>( timestamp >> 24 );
+        rtpPacket[5]  = static_cast<uint8_t>( timestamp >> 16 );
+        rtpPacket[6]  = static_cast<uint8_t>( timestamp >> 8 );
+        rtpPacket[7]  = static_cast<uint8_t>( timestamp );
+        rtpPacket[8]  = static_cast<uint8_t>( session->Ssrc >> 24 );
+        rtpPacket[9]  = static_cast<uint8_t>( session->Ssrc >> 16 );
+        rtpPacket[10] = static_cast<uint8_t>( session->Ssrc >> 8 );
+        rtpPacket[11] = static_cast<uint8_t>( session->Ssrc );
+
+        memcpy( rtpPacket + RTP_HEADER_SIZE, Payloads.data( ) + i * RTP_MAX_PAYLOAD, PayloadSizes[i] );
+
+        session->Sequence++;
+
+        if ( session->Interleaved )
+        {
+            packet[0] = '$';
+            packet[1] = session->RtpChannel;
+            packet[2] = static_cast<uint8_t>( rtpSize >> 8 );
+            packet[3] = static_cast<uint8_t>( rtpSize );
+
+            mg_send( connection, packet, static_cast<int>( rtpSize + 4 ) );
+        }
+        else
+        {
+            sendto( RtpSocket, reinterpret_cast<const char*>( rtpPacket ), rtpSize, 0,
+                    reinterpret_cast<const struct sockaddr*>( &session->ClientAddress ), sizeof( session->ClientAddress ) );
+        }
+    }
+}
+
+// Handle events of RTSP connections
+void XRtspServerData::EventHandler( struct mg_connection* connection, int event, void* /* param */ )
+{
+    XRtspServerData* me      = static_cast<XRtspServerData*>( connection->mgr->user_data );
+    RtspSession*     session = static_cast<RtspSession*>( connection->user_data );
+
+    if ( event == MG_EV_ACCEPT )
+    {
+        char sessionId[16];
+
+        sprintf( sessionId, "%08X", static_cast<uint32_t>( me->RandomGenerator( ) ) );
+
+        connection->user_data = new RtspSession( sessionId, static_cast<uint32_t>( me->RandomGenerator( ) ) );
+    }
+    else if ( event == MG_EV_RECV )
+    {
+        struct mbuf& io = connection->recv_mbuf;
+
+        while ( ( session != nullptr ) && ( io.len != 0 ) )
+        {
+            if ( io.buf[0] == '$' )
+            {
+                // interleaved RTCP packet from client - not interested
+                if ( io.len < 4 )
+                {
+                    break;
+                }
+
+                size_t packetSize = 4 + ( ( static_cast<uint8_t>( io.buf[2] ) << 8 ) | static_cast<uint8_t>( io.buf[3] ) );
+
+                if ( io.len < packetSize )
+                {
+                    break;
+                }
+
+                mbuf_remove( &io, packetSize );
+            }
+            else
+            {
+                static const char* headerEnd = "\r\n\r\n";
+
+                char* found = search( io.buf, io.buf + io.len, headerEnd, headerEnd + 4 );
+
+                if ( found == io.buf + io.len )
+                {
+                    if ( io.len > RTSP_MAX_REQUEST )
+                    {
+                        connection->flags |= MG_F_CLOSE_IMMEDIATELY;
+                    }
+                    break;
+                }
+
+                string        request( io.buf, found + 4 );
+                string        contentLength;
+                size_t        requestSize = request.length( );
+                unsigned long bodySize    = 0;
+
+                if ( StringFindHeaderValue( request, "Content-Length", contentLength ) )
+                {
+                    bodySize = strtoul( contentLength.c_str( ), nullptr, 10 );
+                }
+
+                // don't buffer bodies of any size clients claim to send
+                if ( ( requestSize > RTSP_MAX_REQUEST ) || ( bodySize > RTSP_MAX_REQUEST - requestSize ) )
+                {
+                    string cseq;
+
+                    StringFindHeaderValue( request, "CSeq", cseq );
+
+                    mg_printf( connection, "RTSP/1.0 413 Request Entity Too Large\r\n"
+                                           "CSeq: %s\r\n"
+                                           "Server: cam2web\r\n"
+                                           "Content-Length: 0\r\n"
+                                           "\r\n", cseq.c_str( ) );
+
+                    connection->flags |= MG_F_SEND_AND_CLOSE;
+                    mbuf_remove( &io, io.len );
+                    break;
+                }
+
+                requestSize += bodySize;
+
+                if ( io.len < requestSize )
+                {
+                    break;
+                }
+
+                me->HandleRequest( connection, session, request );
+                mbuf_remove( &io, requestSize );
+            }
+        }
+    }
+    else if ( event == MG_EV_CLOSE )
+    {
+        if ( session != nullptr )
+        {
+            if ( session->Playing )
+            {
+                me->PlayingClients--;
+            }
+
+            delete session;
+            connection->user_data = nullptr;
+        }
+    }
+}
+
+// Handle single RTSP request
+void XRtspServerData::HandleRequest( struct mg_connection* connection, RtspSession* session, const string& request )
+{
+    size_t methodEnd = request.find( ' ' );
+    size_t urlEnd    = request.find( ' ', methodEnd + 1 );
+    string method    = request.substr( 0, methodEnd );
+    string url       = ( urlEnd == string::npos ) ? string( ) : request.substr( methodEnd + 1, urlEnd - methodEnd - 1 );
+    string cseq;
+    string status    = "200 OK";
+    string headers;
+    string body;
+
+    StringFindHeaderValue( request, "CSeq", cseq );
+
+    if ( url.empty( ) )
+    {
+        // request line without URL
+        status = "400 Bad Request";
+    }
+    else if ( method == "OPTIONS" )
+    {
+        headers = "Public: OPTIONS, DESCRIBE, SETUP, PLAY, PAUSE, TEARDOWN, GET_PARAMETER\r\n";
+    }
+    else if ( method == "DESCRIBE" )
+    {
+        body = "v=0\r\n"
+               "o=- " + session->Id + " 1 IN IP4 0.0.0.0\r\n"
+               "s=cam2web\r\n"
+               "c=IN IP4 0.0.0.0\r\n"
+               "t=0 0\r\n"
+               "m=video 0 RTP/AVP 26\r\n"
+               "a=control:track0\r\n";
+
+        headers = "Content-Base: " + url + ( ( url.back( ) == '/' ) ? "" : "/" ) + "\r\n"
+                  "Content-Type: application/sdp\r\n";
+    }
+    else if ( method == "SETUP" )
+    {
+        string transport;
+
+        StringFindHeaderValue( request, "Transport", transport );
+
+        if ( transport.find( "RTP/AVP/TCP" ) != string::npos )
+        {
+            size_t   interleavedStart = transport.find( "interleaved=" );
+            uint32_t channel          = ( interleavedStart == string::npos ) ? 0 : strtoul( transport.c_str( ) + interleavedStart + 12, nullptr, 10 );
+
+            session->Interleaved = true;
+            session->RtpChannel  = static_cast<uint8_t>( channel );
+            session->IsSetUp     = true;
+
+            headers = "Transport: RTP/AVP/TCP;unicast;interleaved=" + to_string( channel ) + "-" + to_string( channel + 1 ) + "\r\n";
+        }
+        else if ( transport.find( "client_port=" ) != string::npos )
+        {
+            uint32_t clientPort = strtoul( transport.c_str( ) + transport.find( "client_port=" ) + 12, nullptr, 10 );
+
+            // RTP packets go to the address RTSP connection came from
+            memset( &session->ClientAddress, 0, sizeof( session->ClientAddress ) );
+            session->ClientAddress          = connection->sa.sin;
+            session->ClientAddress.sin_port = htons( static_cast<uint16_t>( clientPort ) );
+            session->ClientRtpPort          = static_cast<uint16_t>( clientPort );
+            session->Interleaved            = false;
+            session->IsSetUp                = true;
+
+            headers = "Transport: RTP/AVP;unicast;client_port=" + to_string( clientPort ) + "-" + to_string( clientPort + 1 ) +
+                      ";server_port=" + to_string( RtpPort ) + "-" + to_string( RtpPort + 1 ) + "\r\n";
+        }
+        else
+        {
+            status = "461 Unsupported Transport";
+        }
+
+        if ( session->IsSetUp )
+        {
+            headers += "Session: " + session->Id + ";timeout=60\r\n";
+        }
+    }
+    else if ( ( method == "PLAY" ) || ( method == "PAUSE" ) )
+    {
+        if ( !session->IsSetUp )
+        {
+            status = "455 Method Not Valid in This State";
+        }
+        else
+        {
+            bool play = ( method == "PLAY" );
+
+            if ( play != session->Playing )
+            {
+                session->Playing = play;
+
+                if ( play )
+                {
+                    PlayingClients++;
+                    // make sure new client gets an image without waiting for the next one from camera
+                    LastSequence = 0;
+                }
+                else
+                {
+                    PlayingClients--;
+                }
+            }
+
+            headers = "Session: " + session->Id + "\r\n";
+
+            if ( play )
+            {
+                headers += "Range: npt=0.000-\r\n";
+            }
+        }
+    }
+    else if ( method == "TEARDOWN" )
+    {
+        headers = "Session: " + session->Id + "\r\n";
+        connection->flags |= MG_F_SEND_AND_CLOSE;
+    }
+    else if ( ( method == "GET_PARAMETER" ) || ( method == "SET_PARAMETER" ) )
+    {
+        // used by clients as keep-alive
+        headers = "Session: " + session->Id + "\r\n";
+    }
+    else
+    {
+        status = "501 Not Implemented";
+    }
+
+    mg_printf( connection, "RTSP/1.0 %s\r\n"
+                           "CSeq: %s\r\n"
+                           "Server: cam2web\r\n"
+                           "%s"
+                           "Content-Length: %u\r\n"
+                           "\r\n"
+                           "%s",
+                           status.c_str( ), cseq.c_str( ), headers.c_str( ), static_cast<uint32_t>( body.length( ) ), body.c_str( ) );
+}
+
+} // namespace Private
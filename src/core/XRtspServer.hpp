@@ -0,0 +1,70 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XRTSP_SERVER_HPP
+#define XRTSP_SERVER_HPP
+
+#include <stdint.h>
+
+#include "XInterfaces.hpp"
+#include "XVideoSourceToWeb.hpp"
+
+namespace Private
+{
+    class XRtspServerData;
+}
+
+/* RTSP server streaming camera images as RTP/JPEG (RFC 2435).
+
+   JPEG images are taken from XVideoSourceToWeb, so they are encoded only once for both
+   HTTP and RTSP clients. RTP packets are sent either over UDP or interleaved into the
+   RTSP connection (TCP), depending on what client asks for. When UDP is used, frames are
+   simply lost on slow networks, while TCP clients skip frames if their connection is
+   still busy sending previous ones.
+
+   Only baseline JPEGs with 4:2:2 or 4:2:0 chroma subsampling can be sent, which is
+   what libjpeg and most cameras produce.
+*/
+class XRtspServer : private Uncopyable
+{
+public:
+    XRtspServer( XVideoSourceToWeb& video2web, uint16_t port = 8554, uint32_t frameRate = 30 );
+    ~XRtspServer( );
+
+    // Get/Set port to listen on (setting is only possible when server is not running)
+    uint16_t Port( ) const;
+    XRtspServer& SetPort( uint16_t port );
+
+    // Start/Stop the RTSP server
+    bool Start( );
+    void Stop( );
+
+    // Number of clients currently receiving video
+    uint32_t PlayingClientsCount( ) const;
+
+    // Number of images, which were not sent to clients since their JPEG format is not supported
+    // (progressive, 4:4:4 or 4:4:0 subsampled, etc.)
+    uint32_t RejectedFramesCount( ) const;
+
+private:
+    Private::XRtspServerData* mData;
+};
+
+#endif // XRTSP_SERVER_HPP
@@ -0,0 +1,241 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <vector>
+
+#include "XSceneChangeDetector.hpp"
+
+using namespace std;
+
+namespace Private
+{
+    // Difference of samples, which is treated as a change (smaller is noise)
+    #define SCENE_NOISE_THRESHOLD (16)
+
+    // Default number of images in a row, which can be reported as unchanged
+    #define DEFAULT_MAX_REPEATS   (100)
+
+    // Pixel layouts samples can be taken from
+    enum class SampledFormat
+    {
+        Unknown = 0,
+        Grayscale8,
+        RGB24,
+        RGBA32,
+        YUYV
+    };
+
+    class XSceneChangeDetectorData
+    {
+    public:
+        int32_t         GridStep;
+        uint32_t        MaxRepeats;
+        uint32_t        Repeats;
+        vector<uint8_t> Reference;
+        vector<uint8_t> Samples;
+        int32_t         Width;
+        int32_t         Height;
+        SampledFormat   Format;
+
+    public:
+        XSceneChangeDetectorData( int32_t gridStep ) :
+            GridStep( ( gridStep < 2 ) ? 2 : gridStep ), MaxRepeats( DEFAULT_MAX_REPEATS ), Repeats( 0 ), Reference( ), Samples( ), Width( 0 ), Height( 0 ), Format( SampledFormat::Unknown )
+        {
+        }
+
+        bool IsChanged( const uint8_t* data, int32_t width, int32_t height, int32_t stride, SampledFormat format );
+        void TakeSamples( const uint8_t* data, int32_t width, int32_t height, int32_t stride, SampledFormat format );
+    };
+}
+
+XSceneChangeDetector::XSceneChangeDetector( int32_t gridStep ) :
+    mData( new Private::XSceneChangeDetectorData( gridStep ) )
+{
+}
+
+XSceneChangeDetector::~XSceneChangeDetector( )
+{
+    delete mData;
+}
+
+// Check if the image differs noticeably from the reference (or can not be compared with it)
+bool XSceneChangeDetector::IsChanged( const shared_ptr<const XImage>& image )
+{
+    Private::SampledFormat format = Private::SampledFormat::Unknown;
+
+    if ( image )
+    {
+        switch ( image->Format( ) )
+        {
+        case XPixelFormat::Grayscale8:
+            format = Private::SampledFormat::Grayscale8;
+            break;
+        case XPixelFormat::RGB24:
+            format = Private::SampledFormat::RGB24;
+            break;
+        case XPixelFormat::RGBA32:
+            format = Private::SampledFormat::RGBA32;
+            break;
+        default:
+            break;
+        }
+    }
+
+    return ( format == Private::SampledFormat::Unknown ) ? true :
+           mData->IsChanged( image->Data( ), image->Width( ), image->Height( ), image->Stride( ), format );
+}
+
+// Check if YUYV frame differs noticeably from the reference
+bool XSceneChangeDetector::IsChanged( const uint8_t* yuyvData, int32_t width, int32_t height, int32_t stride )
+{
+    return ( yuyvData == nullptr ) ? true :
+           mData->IsChanged( yuyvData, width, height, stride, Private::SampledFormat::YUYV );
+}
+
+// Get/Set maximum number of images in a row reported as unchanged
+uint32_t XSceneChangeDetector::MaxRepeats( ) const
+{
+    return mData->MaxRepeats;
+}
+void XSceneChangeDetector::SetMaxRepeats( uint32_t count )
+{
+    mData->MaxRepeats = count;
+}
+
+// Make samples of the last checked image the reference
+void XSceneChangeDetector::UpdateReference( )
+{
+    mData->Reference = mData->Samples;
+}
+
+// Forget the reference, so the next image is treated as changed
+void XSceneChangeDetector::Reset( )
+{
+    mData->Reference.clear( );
+    mData->Repeats = 0;
+    mData->Width   = 0;
+    mData->Height  = 0;
+    mData->Format  = Private::SampledFormat::Unknown;
+}
+
+namespace Private
+{
+
+// Take samples of the image and compare them with the reference
+bool XSceneChangeDetectorData::IsChanged( const uint8_t* data, int32_t width, int32_t height, int32_t stride, SampledFormat format )
+{
+    bool ret = true;
+
+    TakeSamples( data, width, height, stride, format );
+
+    if ( ( width == Width ) && ( height == Height ) && ( format == Format ) &&
+         ( !Reference.empty( ) ) && ( Samples.size( ) == Reference.size( ) ) )
+    {
+        size_t count      = Samples.size( );
+        size_t changed    = 0;
+        // single outliers (sensor noise of dark scenes) are tolerated
+        size_t maxChanged = count / 1024;
+
+        for ( size_t i = 0; ( i < count ) && ( changed <= maxChanged ); i++ )
+        {
+            int diff = static_cast<int>( Samples[i] ) - static_cast<int>( Reference[i] );
+
+            if ( ( diff > SCENE_NOISE_THRESHOLD ) || ( diff < -SCENE_NOISE_THRESHOLD ) )
+            {
+                changed++;
+            }
+        }
+
+        ret = ( changed > maxChanged );
+    }
+    else
+    {
+        Width  = width;
+        Height = height;
+        Format = format;
+    }
+
+    // changes below the threshold still get out from time to time
+    if ( ret )
+    {
+        Repeats = 0;
+    }
+    else if ( ( MaxRepeats != 0 ) && ( ++Repeats > MaxRepeats ) )
+    {
+        Repeats = 0;
+        ret     = true;
+    }
+
+    return ret;
+}
+
+// Take average luma of 2x2 pixels at every node of the sampling grid
+void XSceneChangeDetectorData::TakeSamples( const uint8_t* data, int32_t width, int32_t height, int32_t stride, SampledFormat format )
+{
+    int32_t columns   = ( width  - 1 ) / GridStep;
+    int32_t rows      = ( height - 1 ) / GridStep;
+    int32_t pixelSize = ( format == SampledFormat::Grayscale8 ) ? 1 :
+                        ( format == SampledFormat::RGB24 ) ? 3 :
+                        ( format == SampledFormat::RGBA32 ) ? 4 : 2;
+
+    if ( ( columns <= 0 ) || ( rows <= 0 ) )
+    {
+        Samples.clear( );
+        return;
+    }
+
+    Samples.resize( static_cast<size_t>( columns ) * rows );
+
+    uint8_t* dst = Samples.data( );
+
+    for ( int32_t y = 0; y < rows; y++ )
+    {
+        const uint8_t* row1 = data + static_cast<size_t>( y * GridStep + GridStep / 2 ) * stride;
+        const uint8_t* row2 = row1 + stride;
+
+        for ( int32_t x = 0; x < columns; x++ )
+        {
+            int32_t  offset = ( x * GridStep + GridStep / 2 ) * pixelSize;
+            uint32_t sum;
+
+            if ( ( pixelSize == 1 ) || ( format == SampledFormat::YUYV ) )
+            {
+                // luma of YUYV pixels goes every second byte
+                int32_t next = ( pixelSize == 1 ) ? 1 : 2;
+
+                sum = ( static_cast<uint32_t>( row1[offset] ) + row1[offset + next] + row2[offset] + row2[offset + next] ) * 4;
+            }
+            else
+            {
+                const uint8_t* p[4] = { row1 + offset, row1 + offset + pixelSize, row2 + offset, row2 + offset + pixelSize };
+
+                sum = 0;
+                for ( int i = 0; i < 4; i++ )
+                {
+                    sum += p[i][RedIndex] + 2 * p[i][GreenIndex] + p[i][BlueIndex];
+                }
+            }
+
+            *dst++ = static_cast<uint8_t>( sum >> 4 );
+        }
+    }
+}
+
+} // namespace Private
@@ -0,0 +1,74 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XSCENE_CHANGE_DETECTOR_HPP
+#define XSCENE_CHANGE_DETECTOR_HPP
+
+#include <stdint.h>
+#include <memory>
+
+#include "XInterfaces.hpp"
+#include "XImage.hpp"
+
+namespace Private
+{
+    class XSceneChangeDetectorData;
+}
+
+/* Finds if uncompressed image differs noticeably from the reference one, looking only at a sparse
+   grid of samples (each is average luma of 2x2 pixels). Only a few of the samples may change
+   (sensor noise of dark scenes) before the image is treated as changed.
+
+   Comparing with the reference, rather than with the previous image, makes slow changes (light at
+   dawn, for example) accumulate until they are noticed. Samples of the last checked image become
+   the reference when UpdateReference() is called - after the image was encoded/provided, for example.
+   Changes too small to ever get noticed (slow fade stopping just below the threshold, for example) are
+   not kept back forever - after the set number of unchanged images in a row, the next one is reported
+   as changed.
+*/
+class XSceneChangeDetector : private Uncopyable
+{
+public:
+    // Grid step is the distance between samples in pixels
+    XSceneChangeDetector( int32_t gridStep = 16 );
+    ~XSceneChangeDetector( );
+
+    // Check if the image differs from the reference (or can not be compared with it). Grayscale8,
+    // RGB24 and RGBA32 images are supported, others are always treated as changed.
+    bool IsChanged( const std::shared_ptr<const XImage>& image );
+
+    // Same check for YUYV (YUY2) frame as provided by cameras
+    bool IsChanged( const uint8_t* yuyvData, int32_t width, int32_t height, int32_t stride );
+
+    // Get/Set maximum number of images in a row reported as unchanged (0 - no limit). Default is 100.
+    uint32_t MaxRepeats( ) const;
+    void SetMaxRepeats( uint32_t count );
+
+    // Make samples of the last checked image the reference
+    void UpdateReference( );
+
+    // Forget the reference, so the next image is treated as changed
+    void Reset( );
+
+private:
+    Private::XSceneChangeDetectorData* mData;
+};
+
+#endif // XSCENE_CHANGE_DETECTOR_HPP
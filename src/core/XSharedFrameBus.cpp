@@ -0,0 +1,588 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "XSharedFrameBus.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace Private
+{
+    #define BUS_MAGIC       (0x46573243) // "C2WF"
+    #define BUS_VERSION     (1)
+    #define BUS_ALIGNMENT   (64)
+
+    // Header at the start of the shared memory object
+    struct BusHeader
+    {
+        uint32_t         Magic;
+        uint32_t         Version;
+        uint32_t         SlotCount;
+        uint32_t         SlotSize;      // total size of a slot, including its header
+        atomic<uint32_t> Closed;        // writer has abandoned this object (re-open by name)
+        uint32_t         Reserved;
+        atomic<uint64_t> LatestFrame;   // number of the last completely written frame
+    };
+
+    // Header of every slot, followed by frame's data
+    struct SlotHeader
+    {
+        atomic<uint32_t> Sequence;      // odd while writer updates the slot
+        uint32_t         DataSize;
+        int32_t          Width;
+        int32_t          Height;
+        int32_t          Stride;
+        uint32_t         Format;
+        uint64_t         FrameNumber;
+        uint64_t         Timestamp;
+    };
+
+    static_assert( sizeof( BusHeader )  <= BUS_ALIGNMENT, "Frame bus header is too big" );
+    static_assert( sizeof( SlotHeader ) <= BUS_ALIGNMENT, "Frame bus slot header is too big" );
+    static_assert( ( ATOMIC_INT_LOCK_FREE == 2 ) && ( ATOMIC_LLONG_LOCK_FREE == 2 ), "Frame bus needs lock free atomics to work across processes" );
+
+    static inline SlotHeader* GetSlot( uint8_t* memory, uint32_t slot )
+    {
+        const BusHeader* header = reinterpret_cast<const BusHeader*>( memory );
+        return reinterpret_cast<SlotHeader*>( memory + BUS_ALIGNMENT + static_cast<size_t>( slot ) * header->SlotSize );
+    }
+
+    static inline size_t GetMemorySize( uint32_t slotCount, uint32_t slotSize )
+    {
+        return BUS_ALIGNMENT + static_cast<size_t>( slotCount ) * slotSize;
+    }
+
+    static inline string GetObjectName( const string& name )
+    {
+        return ( ( !name.empty( ) ) && ( name[0] == '/' ) ) ? name : string( "/" ) + name;
+    }
+
+    static uint64_t GetTimestamp( )
+    {
+        struct timespec ts;
+
+        clock_gettime( CLOCK_MONOTONIC, &ts );
+
+        return static_cast<uint64_t>( ts.tv_sec ) * 1000000 + ts.tv_nsec / 1000;
+    }
+
+    class XSharedFrameWriterData
+    {
+    public:
+        string           Name;
+        uint32_t         SlotCount;
+        mode_t           AccessMode;
+        uint8_t*         Memory;
+        size_t           MemorySize;
+        atomic<uint64_t> FramesPublished;
+        mutable mutex    ErrorSync;
+        XError           LastError;
+
+    public:
+        XSharedFrameWriterData( const string& name, uint32_t slotCount, uint32_t accessMode ) :
+            Name( GetObjectName( name ) ), SlotCount( ( slotCount < 2 ) ? 2 : slotCount ),
+            AccessMode( static_cast<mode_t>( accessMode & 0777 ) ), Memory( nullptr ), MemorySize( 0 ), FramesPublished( 0 ), ErrorSync( ), LastError( )
+        {
+        }
+
+        ~XSharedFrameWriterData( )
+        {
+            Destroy( );
+        }
+
+        XError Create( uint32_t dataSize );
+        void Destroy( );
+        void SetError( XError error );
+    };
+
+    class XSharedFrameReaderData
+    {
+    public:
+        string   Name;
+        uint8_t* Memory;
+        size_t   MemorySize;
+
+    public:
+        XSharedFrameReaderData( ) :
+            Name( ), Memory( nullptr ), MemorySize( 0 )
+        {
+        }
+
+        XError Map( );
+        void Unmap( );
+        bool CheckReopen( );
+    };
+}
+
+XSharedFrameWriter::XSharedFrameWriter( const string& name, uint32_t slotCount, uint32_t accessMode ) :
+    mData( new Private::XSharedFrameWriterData( name, slotCount, accessMode ) )
+{
+}
+
+XSharedFrameWriter::~XSharedFrameWriter( )
+{
+    delete mData;
+}
+
+// New video frame notification - copy it into the next slot of the ring
+void XSharedFrameWriter::OnNewImage( const shared_ptr<const XImage>& image )
+{
+    uint32_t dataSize = ( image->Format( ) == XPixelFormat::JPEG ) ?
+                        static_cast<uint32_t>( image->Width( ) ) :
+                        static_cast<uint32_t>( image->Stride( ) * image->Height( ) );
+    XError   ret      = XError::Success;
+
+    if ( ( mData->Memory == nullptr ) ||
+         ( dataSize > reinterpret_cast<Private::BusHeader*>( mData->Memory )->SlotSize - BUS_ALIGNMENT ) )
+    {
+        ret = mData->Create( dataSize );
+    }
+
+    if ( ret )
+    {
+        Private::BusHeader*  header      = reinterpret_cast<Private::BusHeader*>( mData->Memory );
+        uint64_t             frameNumber = header->LatestFrame.load( memory_order_relaxed ) + 1;
+        Private::SlotHeader* slot        = Private::GetSlot( mData->Memory, static_cast<uint32_t>( frameNumber % header->SlotCount ) );
+        uint32_t             sequence    = slot->Sequence.load( memory_order_relaxed );
+
+        // make sequence odd, so readers know the slot is being updated
+        slot->Sequence.store( sequence + 1, memory_order_relaxed );
+        atomic_thread_fence( memory_order_release );
+
+        slot->DataSize    = dataSize;
+        slot->Width       = image->Width( );
+        slot->Height      = image->Height( );
+        slot->Stride      = image->Stride( );
+        slot->Format      = static_cast<uint32_t>( image->Format( ) );
+        slot->FrameNumber = frameNumber;
+        slot->Timestamp   = Private::GetTimestamp( );
+
+        memcpy( reinterpret_cast<uint8_t*>( slot ) + BUS_ALIGNMENT, image->Data( ), dataSize );
+
+        slot->Sequence.store( sequence + 2, memory_order_release );
+        header->LatestFrame.store( frameNumber, memory_order_release );
+
+        mData->FramesPublished++;
+    }
+
+    mData->SetError( ret );
+}
+
+// Video source error notification - ignored
+void XSharedFrameWriter::OnError( const string& /* errorMessage */, bool /* fatal */ )
+{
+}
+
+// Name of the shared memory object
+string XSharedFrameWriter::Name( ) const
+{
+    return mData->Name;
+}
+
+// Number of frames published so far
+uint64_t XSharedFrameWriter::FramesPublished( ) const
+{
+    return mData->FramesPublished;
+}
+
+// Last error happened while publishing frames
+XError XSharedFrameWriter::LastError( ) const
+{
+    lock_guard<mutex> lock( mData->ErrorSync );
+    return mData->LastError;
+}
+
+XSharedFrameReader::XSharedFrameReader( ) :
+    mData( new Private::XSharedFrameReaderData( ) )
+{
+}
+
+XSharedFrameReader::~XSharedFrameReader( )
+{
+    mData->Unmap( );
+    delete mData;
+}
+
+// Open frame bus with the specified name
+XError XSharedFrameReader::Open( const string& name )
+{
+    mData->Unmap( );
+    mData->Name = Private::GetObjectName( name );
+
+    return mData->Map( );
+}
+
+// Close the frame bus
+void XSharedFrameReader::Close( )
+{
+    mData->Unmap( );
+    mData->Name.clear( );
+}
+
+// Check if frame bus is open
+bool XSharedFrameReader::IsOpen( ) const
+{
+    return ( mData->Memory != nullptr );
+}
+
+// Number of the latest frame published by writer (0 if nothing yet)
+uint64_t XSharedFrameReader::LatestFrameNumber( )
+{
+    uint64_t frameNumber = 0;
+
+    if ( mData->CheckReopen( ) )
+    {
+        frameNumber = reinterpret_cast<const Private::BusHeader*>( mData->Memory )->LatestFrame.load( memory_order_acquire );
+    }
+
+    return frameNumber;
+}
+
+// Wait for a frame newer than the specified one; returns false on timeout (milliseconds)
+bool XSharedFrameReader::WaitForFrame( uint64_t lastFrameNumber, uint32_t timeout )
+{
+    steady_clock::time_point startTime = steady_clock::now( );
+    bool                     ret       = false;
+
+    // writer does not signal anything, so simply poll - frames don't come more often than few ms anyway
+    while ( ( !( ret = ( LatestFrameNumber( ) > lastFrameNumber ) ) ) &&
+            ( duration_cast<milliseconds>( steady_clock::now( ) - startTime ).count( ) < timeout ) )
+    {
+        this_thread::sleep_for( milliseconds( 1 ) );
+    }
+
+    return ret;
+}
+
+// Get the latest frame without copying its data
+XError XSharedFrameReader::GetLatestFrame( XSharedFrame& frame )
+{
+    XError ret = XError::DeivceNotReady;
+
+    if ( mData->CheckReopen( ) )
+    {
+        const Private::BusHeader* header = reinterpret_cast<const Private::BusHeader*>( mData->Memory );
+
+        // writer may be updating the slot right now, so try few times
+        for ( int attempt = 0; attempt < 4; attempt++ )
+        {
+            uint64_t frameNumber = header->LatestFrame.load( memory_order_acquire );
+
+            if ( frameNumber == 0 )
+            {
+                break;
+            }
+
+            uint32_t                   slotIndex = static_cast<uint32_t>( frameNumber % header->SlotCount );
+            const Private::SlotHeader* slot      = Private::GetSlot( mData->Memory, slotIndex );
+            uint32_t                   sequence  = slot->Sequence.load( memory_order_acquire );
+
+            if ( ( sequence & 1 ) == 0 )
+            {
+                frame.Data        = reinterpret_cast<const uint8_t*>( slot ) + BUS_ALIGNMENT;
+                frame.DataSize    = slot->DataSize;
+                frame.Width       = slot->Width;
+                frame.Height      = slot->Height;
+                frame.Stride      = slot->Stride;
+                frame.Format      = static_cast<XPixelFormat>( slot->Format );
+                frame.FrameNumber = slot->FrameNumber;
+                frame.Timestamp   = slot->Timestamp;
+                frame.Slot        = slotIndex;
+                frame.Sequence    = sequence;
+
+                if ( ( frame.DataSize <= header->SlotSize - BUS_ALIGNMENT ) && ( IsFrameValid( frame ) ) )
+                {
+                    ret = XError::Success;
+                    break;
+                }
+            }
+
+            this_thread::yield( );
+        }
+    }
+
+    return ret;
+}
+
+// Check if the frame's slot was not overwritten since the frame was obtained
+bool XSharedFrameReader::IsFrameValid( const XSharedFrame& frame ) const
+{
+    bool ret = false;
+
+    if ( mData->Memory != nullptr )
+    {
+        const Private::SlotHeader* slot = Private::GetSlot( mData->Memory, frame.Slot );
+
+        atomic_thread_fence( memory_order_acquire );
+        ret = ( slot->Sequence.load( memory_order_relaxed ) == frame.Sequence );
+    }
+
+    return ret;
+}
+
+// Copy the latest frame into the specified image (re-allocated if needed)
+XError XSharedFrameReader::CopyLatestFrame( shared_ptr<XImage>& image, uint64_t* frameNumber )
+{
+    XSharedFrame frame;
+    XError       ret;
+
+    for ( int attempt = 0; attempt < 4; attempt++ )
+    {
+        ret = GetLatestFrame( frame );
+
+        if ( ret )
+        {
+            int32_t width  = ( frame.Format == XPixelFormat::JPEG ) ? static_cast<int32_t>( frame.DataSize ) : frame.Width;
+            int32_t height = ( frame.Format == XPixelFormat::JPEG ) ? 1 : frame.Height;
+
+            if ( ( !image ) || ( image->Width( ) != width ) || ( image->Height( ) != height ) || ( image->Format( ) != frame.Format ) )
+            {
+                image = XImage::Allocate( width, height, frame.Format );
+            }
+
+            if ( !image )
+            {
+                ret = XError::OutOfMemory;
+                break;
+            }
+
+            if ( ( frame.Format == XPixelFormat::JPEG ) || ( image->Stride( ) == frame.Stride ) )
+            {
+                memcpy( image->Data( ), frame.Data, frame.DataSize );
+            }
+            else
+            {
+                // stride of the writer's image may differ from the default one
+                int32_t lineSize = ( image->Stride( ) < frame.Stride ) ? image->Stride( ) : frame.Stride;
+
+                for ( int32_t y = 0; y < height; y++ )
+                {
+                    memcpy( image->Data( ) + y * image->Stride( ), frame.Data + y * frame.Stride, lineSize );
+                }
+            }
+
+            if ( IsFrameValid( frame ) )
+            {
+                if ( frameNumber != nullptr )
+                {
+                    *frameNumber = frame.FrameNumber;
+                }
+                break;
+            }
+
+            ret = XError::Failed;
+        }
+    }
+
+    return ret;
+}
+
+namespace Private
+{
+
+// (Re)create shared memory object with slots big enough for the specified data size
+XError XSharedFrameWriterData::Create( uint32_t dataSize )
+{
+    // leave some room for JPEG images growing a bit
+    uint32_t slotSize   = ( ( dataSize + dataSize / 4 + BUS_ALIGNMENT - 1 ) & ~( BUS_ALIGNMENT - 1 ) ) + BUS_ALIGNMENT;
+    size_t   memorySize = GetMemorySize( SlotCount, slotSize );
+    uint64_t lastFrame  = 0;
+    XError   ret        = XError::Success;
+
+    if ( Memory != nullptr )
+    {
+        lastFrame = reinterpret_cast<BusHeader*>( Memory )->LatestFrame.load( memory_order_relaxed );
+    }
+
+    Destroy( );
+
+    int fd = shm_open( Name.c_str( ), O_RDWR | O_CREAT | O_EXCL, AccessMode );
+
+    // set the mode explicitly, since the one given to shm_open() is masked with process' umask
+    if ( ( fd == -1 ) || ( fchmod( fd, AccessMode ) != 0 ) )
+    {
+        if ( fd != -1 )
+        {
+            close( fd );
+            shm_unlink( Name.c_str( ) );
+        }
+        ret = XError::IOError;
+    }
+    else
+    {
+        if ( ftruncate( fd, static_cast<off_t>( memorySize ) ) != 0 )
+        {
+            ret = XError::OutOfMemory;
+        }
+        else
+        {
+            void* memory = mmap( nullptr, memorySize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+
+            if ( memory == MAP_FAILED )
+            {
+                ret = XError::OutOfMemory;
+            }
+            else
+            {
+                BusHeader* header = reinterpret_cast<BusHeader*>( memory );
+
+                // memory is zero initialized by ftruncate(), so slots' sequences are all 0
+                header->SlotCount = SlotCount;
+                header->SlotSize  = slotSize;
+                header->Closed.store( 0, memory_order_relaxed );
+                header->LatestFrame.store( lastFrame, memory_order_relaxed );
+                header->Version   = BUS_VERSION;
+
+                // magic is the last thing to set - readers don't look further without it
+                atomic_thread_fence( memory_order_release );
+                header->Magic     = BUS_MAGIC;
+
+                Memory     = static_cast<uint8_t*>( memory );
+                MemorySize = memorySize;
+            }
+        }
+
+        close( fd );
+
+        if ( !ret )
+        {
+            shm_unlink( Name.c_str( ) );
+        }
+    }
+
+    return ret;
+}
+
+// Mark shared memory object as closed and remove it
+void XSharedFrameWriterData::Destroy( )
+{
+    if ( Memory != nullptr )
+    {
+        // readers, which still have it mapped, will see it and re-open by name
+        reinterpret_cast<BusHeader*>( Memory )->Closed.store( 1, memory_order_release );
+        munmap( Memory, MemorySize );
+
+        Memory     = nullptr;
+        MemorySize = 0;
+    }
+
+    // remove also anything left from previous runs
+    shm_unlink( Name.c_str( ) );
+}
+
+// Remember the last error
+void XSharedFrameWriterData::SetError( XError error )
+{
+    lock_guard<mutex> lock( ErrorSync );
+    LastError = error;
+}
+
+// Map shared memory object into reader's address space
+XError XSharedFrameReaderData::Map( )
+{
+    XError ret = XError::Success;
+    int    fd  = shm_open( Name.c_str( ), O_RDONLY, 0 );
+
+    if ( fd == -1 )
+    {
+        ret = XError::DeivceNotReady;
+    }
+    else
+    {
+        struct stat st;
+
+        if ( ( fstat( fd, &st ) != 0 ) || ( static_cast<size_t>( st.st_size ) < BUS_ALIGNMENT ) )
+        {
+            ret = XError::DeivceNotReady;
+        }
+        else
+        {
+            void* memory = mmap( nullptr, static_cast<size_t>( st.st_size ), PROT_READ, MAP_SHARED, fd, 0 );
+
+            if ( memory == MAP_FAILED )
+            {
+                ret = XError::OutOfMemory;
+            }
+            else
+            {
+                const BusHeader* header = static_cast<const BusHeader*>( memory );
+
+                atomic_thread_fence( memory_order_acquire );
+
+                if ( ( header->Magic != BUS_MAGIC ) || ( header->Version != BUS_VERSION ) ||
+                     ( GetMemorySize( header->SlotCount, header->SlotSize ) > static_cast<size_t>( st.st_size ) ) )
+                {
+                    munmap( memory, static_cast<size_t>( st.st_size ) );
+                    ret = XError::ConfigurationNotSupported;
+                }
+                else
+                {
+                    Memory     = static_cast<uint8_t*>( memory );
+                    MemorySize = static_cast<size_t>( st.st_size );
+                }
+            }
+        }
+
+        close( fd );
+    }
+
+    return ret;
+}
+
+// Unmap shared memory
+void XSharedFrameReaderData::Unmap( )
+{
+    if ( Memory != nullptr )
+    {
+        munmap( Memory, MemorySize );
+        Memory     = nullptr;
+        MemorySize = 0;
+    }
+}
+
+// Make sure the mapped memory is still used by writer, re-open it otherwise
+bool XSharedFrameReaderData::CheckReopen( )
+{
+    if ( ( Memory != nullptr ) &&
+         ( reinterpret_cast<const BusHeader*>( Memory )->Closed.load( memory_order_acquire ) != 0 ) )
+    {
+        Unmap( );
+    }
+
+    if ( ( Memory == nullptr ) && ( !Name.empty( ) ) )
+    {
+        Map( );
+    }
+
+    return ( Memory != nullptr );
+}
+
+} // namespace Private
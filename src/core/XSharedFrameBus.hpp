@@ -0,0 +1,121 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XSHARED_FRAME_BUS_HPP
+#define XSHARED_FRAME_BUS_HPP
+
+#include <stdint.h>
+#include <string>
+#include <memory>
+
+#include "XInterfaces.hpp"
+#include "XImage.hpp"
+#include "IVideoSourceListener.hpp"
+
+/* Frame bus passing video frames to other processes on the same machine through POSIX shared
+   memory (/dev/shm/<name>).
+
+   The shared memory object is a ring of fixed size slots. Every slot is protected by its own
+   sequence counter (seqlock) - writer makes it odd while updating the slot and even when done.
+   Readers never block the writer - they access slot's data in place and then check if the
+   sequence counter is still the same, i.e. the data were not overwritten while being read.
+
+   If a frame does not fit into slots anymore, the writer creates new shared memory object with
+   bigger slots and marks the old one as closed, so readers re-open it by name.
+*/
+
+namespace Private
+{
+    class XSharedFrameWriterData;
+    class XSharedFrameReaderData;
+}
+
+// Frame as it is seen by a reader - points directly into the shared memory
+struct XSharedFrame
+{
+    const uint8_t* Data;
+    uint32_t       DataSize;
+    int32_t        Width;
+    int32_t        Height;
+    int32_t        Stride;
+    XPixelFormat   Format;
+    uint64_t       FrameNumber;
+    uint64_t       Timestamp;   // microseconds of CLOCK_MONOTONIC
+    uint32_t       Slot;
+    uint32_t       Sequence;
+};
+
+// Video source listener, which publishes every image it gets into the shared memory ring. The shared
+// memory object gets the specified access mode (only owner can read camera frames by default).
+class XSharedFrameWriter : public IVideoSourceListener, private Uncopyable
+{
+public:
+    XSharedFrameWriter( const std::string& name, uint32_t slotCount = 4, uint32_t accessMode = 0600 );
+    ~XSharedFrameWriter( );
+
+    // New video frame notification - copy it into the next slot of the ring
+    void OnNewImage( const std::shared_ptr<const XImage>& image );
+    // Video source error notification - ignored
+    void OnError( const std::string& errorMessage, bool fatal );
+
+    // Name of the shared memory object
+    std::string Name( ) const;
+    // Number of frames published so far
+    uint64_t FramesPublished( ) const;
+    // Last error happened while publishing frames
+    XError LastError( ) const;
+
+private:
+    Private::XSharedFrameWriterData* mData;
+};
+
+// Client side of the frame bus, which maps the shared memory read-only
+class XSharedFrameReader : private Uncopyable
+{
+public:
+    XSharedFrameReader( );
+    ~XSharedFrameReader( );
+
+    // Open frame bus with the specified name
+    XError Open( const std::string& name );
+    // Close the frame bus
+    void Close( );
+    // Check if frame bus is open
+    bool IsOpen( ) const;
+
+    // Number of the latest frame published by writer (0 if nothing yet)
+    uint64_t LatestFrameNumber( );
+    // Wait for a frame newer than the specified one; returns false on timeout (milliseconds)
+    bool WaitForFrame( uint64_t lastFrameNumber, uint32_t timeout );
+
+    // Get the latest frame without copying its data. The frame must be validated with
+    // IsFrameValid() once its data are consumed - writer may overwrite the slot at any time.
+    XError GetLatestFrame( XSharedFrame& frame );
+    // Check if the frame's slot was not overwritten since the frame was obtained
+    bool IsFrameValid( const XSharedFrame& frame ) const;
+
+    // Copy the latest frame into the specified image (re-allocated if needed)
+    XError CopyLatestFrame( std::shared_ptr<XImage>& image, uint64_t* frameNumber = nullptr );
+
+private:
+    Private::XSharedFrameReaderData* mData;
+};
+
+#endif // XSHARED_FRAME_BUS_HPP
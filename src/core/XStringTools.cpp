@@ -72,3 +72,32 @@ string& StringReplace( string& s, const string& lookFor, const string& replaceWi
 
     return s;
 }
+
+// Find value of the specified header in a block of "Name: value" lines separated with CRLF
+bool StringFindHeaderValue( const string& headers, const string& name, string& value )
+{
+    size_t nameLength = name.length( );
+
+    for ( size_t lineStart = 0; lineStart < headers.length( ); )
+    {
+        size_t lineEnd = headers.find( "\r\n", lineStart );
+
+        if ( lineEnd == string::npos )
+        {
+            lineEnd = headers.length( );
+        }
+
+        if ( ( lineEnd - lineStart > nameLength ) && ( headers[lineStart + nameLength] == ':' ) &&
+             ( equal( name.begin( ), name.end( ), headers.begin( ) + lineStart,
+                      []( char c1, char c2 ) { return tolower( c1 ) == tolower( c2 ); } ) ) )
+        {
+            value = headers.substr( lineStart + nameLength + 1, lineEnd - lineStart - nameLength - 1 );
+            StringTrim( value );
+            return true;
+        }
+
+        lineStart = lineEnd + 2;
+    }
+
+    return false;
+}
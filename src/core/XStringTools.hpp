@@ -33,4 +33,7 @@ std::string& StringTrim( std::string& s );
 // Replace sub-string within a string
 std::string& StringReplace( std::string& s, const std::string& lookFor, const std::string& replaceWith );
 
+// Find value of the specified header in a block of "Name: value" lines separated with CRLF (name is case insensitive)
+bool StringFindHeaderValue( const std::string& headers, const std::string& name, std::string& value );
+
 #endif // XSTRING_TOOLS_HPP
@@ -0,0 +1,730 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <string.h>
+#include <time.h>
+#include <vector>
+#include <mutex>
+
+#if defined( __SSE2__ )
+    #include <emmintrin.h>
+#elif defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+    #include <arm_neon.h>
+    #define OVERLAY_USE_NEON
+#endif
+
+#include "XTextOverlayFilter.hpp"
+
+using namespace std;
+
+namespace Private
+{
+    // Size of font's glyphs and size of their cells (with outline around glyphs) before scaling
+    #define GLYPH_WIDTH         (5)
+    #define GLYPH_HEIGHT        (8)
+    #define CELL_WIDTH          (GLYPH_WIDTH + 2)
+    #define CELL_HEIGHT         (GLYPH_HEIGHT + 2)
+    // Range of characters provided by the font
+    #define FIRST_CHARACTER     (32)
+    #define LAST_CHARACTER      (126)
+    #define CHARACTERS_COUNT    (LAST_CHARACTER - FIRST_CHARACTER + 1)
+    // Maximum scale of the font
+    #define MAX_SCALE           (8)
+    // Distance from image edges to the overlay (pixels)
+    #define OVERLAY_MARGIN      (8)
+    // Maximum length of text after expanding time fields
+    #define MAX_EXPANDED_LENGTH (1024)
+
+    // Kinds of atlas pixels
+    enum
+    {
+        PixelBackground = 0,
+        PixelOutline    = 1,
+        PixelText       = 2,
+        PixelKinds      = 3
+    };
+
+    // 5x8 font for printable ASCII characters - a byte per row, bit 4 is the leftmost pixel, the last
+    // row is used by descenders only
+    static const uint8_t Font[CHARACTERS_COUNT][GLYPH_HEIGHT] =
+    {
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // space
+    { 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04, 0x00 }, // !
+    { 0x0A, 0x0A, 0x0A, 0x00, 0x00, 0x00, 0x00, 0x00 }, // "
+    { 0x0A, 0x0A, 0x1F, 0x0A, 0x1F, 0x0A, 0x0A, 0x00 }, // #
+    { 0x04, 0x0F, 0x14, 0x0E, 0x05, 0x1E, 0x04, 0x00 }, // $
+    { 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03, 0x00 }, // %
+    { 0x0C, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0D, 0x00 }, // &
+    { 0x04, 0x04, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00 }, // '
+    { 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02, 0x00 }, // (
+    { 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08, 0x00 }, // )
+    { 0x00, 0x04, 0x15, 0x0E, 0x15, 0x04, 0x00, 0x00 }, // *
+    { 0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00, 0x00 }, // +
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x04, 0x08 }, // ,
+    { 0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00, 0x00 }, // -
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C, 0x00 }, // .
+    { 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00, 0x00 }, // /
+    { 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E, 0x00 }, // 0
+    { 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E, 0x00 }, // 1
+    { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F, 0x00 }, // 2
+    { 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E, 0x00 }, // 3
+    { 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02, 0x00 }, // 4
+    { 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E, 0x00 }, // 5
+    { 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E, 0x00 }, // 6
+    { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08, 0x00 }, // 7
+    { 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E, 0x00 }, // 8
+    { 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C, 0x00 }, // 9
+    { 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00, 0x00 }, // :
+    { 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x04, 0x08, 0x00 }, // ;
+    { 0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02, 0x00 }, // <
+    { 0x00, 0x00, 0x1F, 0x00, 0x1F, 0x00, 0x00, 0x00 }, // =
+    { 0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08, 0x00 }, // >
+    { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04, 0x00 }, // ?
+    { 0x0E, 0x11, 0x01, 0x0D, 0x15, 0x15, 0x0E, 0x00 }, // @
+    { 0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11, 0x00 }, // A
+    { 0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E, 0x00 }, // B
+    { 0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E, 0x00 }, // C
+    { 0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C, 0x00 }, // D
+    { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F, 0x00 }, // E
+    { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10, 0x00 }, // F
+    { 0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F, 0x00 }, // G
+    { 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11, 0x00 }, // H
+    { 0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E, 0x00 }, // I
+    { 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C, 0x00 }, // J
+    { 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11, 0x00 }, // K
+    { 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F, 0x00 }, // L
+    { 0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11, 0x00 }, // M
+    { 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11, 0x00 }, // N
+    { 0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E, 0x00 }, // O
+    { 0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10, 0x00 }, // P
+    { 0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D, 0x00 }, // Q
+    { 0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11, 0x00 }, // R
+    { 0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E, 0x00 }, // S
+    { 0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x00 }, // T
+    { 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E, 0x00 }, // U
+    { 0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04, 0x00 }, // V
+    { 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A, 0x00 }, // W
+    { 0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11, 0x00 }, // X
+    { 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04, 0x04, 0x00 }, // Y
+    { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F, 0x00 }, // Z
+    { 0x0E, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0E, 0x00 }, // [
+    { 0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00, 0x00 }, // backslash
+    { 0x0E, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0E, 0x00 }, // ]
+    { 0x04, 0x0A, 0x11, 0x00, 0x00, 0x00, 0x00, 0x00 }, // ^
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F, 0x00 }, // _
+    { 0x08, 0x04, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00 }, // `
+    { 0x00, 0x00, 0x0E, 0x01, 0x0F, 0x11, 0x0F, 0x00 }, // a
+    { 0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x1E, 0x00 }, // b
+    { 0x00, 0x00, 0x0E, 0x10, 0x10, 0x11, 0x0E, 0x00 }, // c
+    { 0x01, 0x01, 0x0D, 0x13, 0x11, 0x11, 0x0F, 0x00 }, // d
+    { 0x00, 0x00, 0x0E, 0x11, 0x1F, 0x10, 0x0E, 0x00 }, // e
+    { 0x06, 0x09, 0x08, 0x1C, 0x08, 0x08, 0x08, 0x00 }, // f
+    { 0x00, 0x00, 0x0F, 0x11, 0x11, 0x0F, 0x01, 0x0E }, // g
+    { 0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x11, 0x00 }, // h
+    { 0x04, 0x00, 0x0C, 0x04, 0x04, 0x04, 0x0E, 0x00 }, // i
+    { 0x02, 0x00, 0x06, 0x02, 0x02, 0x02, 0x12, 0x0C }, // j
+    { 0x10, 0x10, 0x12, 0x14, 0x18, 0x14, 0x12, 0x00 }, // k
+    { 0x0C, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E, 0x00 }, // l
+    { 0x00, 0x00, 0x1A, 0x15, 0x15, 0x11, 0x11, 0x00 }, // m
+    { 0x00, 0x00, 0x16, 0x19, 0x11, 0x11, 0x11, 0x00 }, // n
+    { 0x00, 0x00, 0x0E, 0x11, 0x11, 0x11, 0x0E, 0x00 }, // o
+    { 0x00, 0x00, 0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10 }, // p
+    { 0x00, 0x00, 0x0F, 0x11, 0x11, 0x0F, 0x01, 0x01 }, // q
+    { 0x00, 0x00, 0x16, 0x19, 0x10, 0x10, 0x10, 0x00 }, // r
+    { 0x00, 0x00, 0x0E, 0x10, 0x0E, 0x01, 0x1E, 0x00 }, // s
+    { 0x08, 0x08, 0x1C, 0x08, 0x08, 0x09, 0x06, 0x00 }, // t
+    { 0x00, 0x00, 0x11, 0x11, 0x11, 0x13, 0x0D, 0x00 }, // u
+    { 0x00, 0x00, 0x11, 0x11, 0x11, 0x0A, 0x04, 0x00 }, // v
+    { 0x00, 0x00, 0x11, 0x11, 0x15, 0x15, 0x0A, 0x00 }, // w
+    { 0x00, 0x00, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x00 }, // x
+    { 0x00, 0x00, 0x11, 0x11, 0x11, 0x0F, 0x01, 0x0E }, // y
+    { 0x00, 0x00, 0x1F, 0x02, 0x04, 0x08, 0x1F, 0x00 }, // z
+    { 0x02, 0x04, 0x04, 0x08, 0x04, 0x04, 0x02, 0x00 }, // {
+    { 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x00 }, // |
+    { 0x08, 0x04, 0x04, 0x02, 0x04, 0x04, 0x08, 0x00 }, // }
+    { 0x00, 0x00, 0x08, 0x15, 0x02, 0x00, 0x00, 0x00 }  // ~
+    };
+
+    // Divide product of two 8 bit values by 255 with rounding (exact for [0, 255*255])
+    static inline uint8_t MultiplyDiv255( uint32_t a, uint32_t b )
+    {
+        uint32_t t = a * b + 128;
+        return static_cast<uint8_t>( ( t + ( t >> 8 ) ) >> 8 );
+    }
+
+    static void BlendRow( uint8_t* dst, const uint8_t* colors, const uint8_t* factors, uint32_t count );
+
+    class XTextOverlayFilterData
+    {
+    public:
+        mutable mutex                   Sync;
+        string                          Text;
+        XTextOverlayFilter::Position    Position;
+        uint32_t                        Scale;
+        uint32_t                        TextColor;
+        uint32_t                        BackgroundColor;
+        uint8_t                         BackgroundOpacity;
+        // incremented on changes of settings affecting look of the overlay (not its text or position)
+        uint32_t                        StyleVersion;
+
+    private:
+        // atlas of glyphs - kind of every pixel of every character's cell at the current scale
+        vector<uint8_t>                 Atlas;
+        uint32_t                        AtlasScale;
+        uint32_t                        CellWidth;
+        uint32_t                        CellHeight;
+
+        // the overlay, blended as dst = color + dst * factor / 255, in the layout of images
+        XPixelFormat                    LayoutFormat;
+        uint32_t                        LayoutStyle;
+        uint32_t                        BytesPerPixel;
+        uint32_t                        Rows;
+        uint32_t                        Columns;
+        uint32_t                        OverlayWidth;
+        uint32_t                        OverlayHeight;
+        uint32_t                        OverlayStride;
+        vector<uint8_t>                 Colors;
+        vector<uint8_t>                 Factors;
+        uint8_t                         KindColors[PixelKinds][4];
+        uint8_t                         KindFactors[PixelKinds][4];
+        // characters currently rendered into the overlay's cells (0 - not rendered yet)
+        vector<char>                    Cells;
+
+        // text with expanded time fields, split into lines
+        string                          SourceText;
+        time_t                          ExpandedTime;
+        string                          ExpandedText;
+        vector<string>                  Lines;
+
+    public:
+        XTextOverlayFilterData( const string& text, XTextOverlayFilter::Position position ) :
+            Sync( ), Text( text ), Position( position ), Scale( 1 ),
+            TextColor( 0xFFFFFF ), BackgroundColor( 0x000000 ), BackgroundOpacity( 0 ), StyleVersion( 0 ),
+            Atlas( ), AtlasScale( 0 ), CellWidth( 0 ), CellHeight( 0 ),
+            LayoutFormat( XPixelFormat::Unknown ), LayoutStyle( 0 ), BytesPerPixel( 0 ), Rows( 0 ), Columns( 0 ),
+            OverlayWidth( 0 ), OverlayHeight( 0 ), OverlayStride( 0 ), Colors( ), Factors( ), Cells( ),
+            SourceText( ), ExpandedTime( 0 ), ExpandedText( ), Lines( )
+        {
+        }
+
+        XError Process( shared_ptr<XImage>& image );
+
+    private:
+        bool ExpandText( const string& text );
+        void BuildAtlas( uint32_t scale );
+        void Layout( XPixelFormat format, uint32_t rows, uint32_t columns, uint32_t textColor, uint32_t backgroundColor, uint8_t backgroundOpacity );
+        void RenderCell( uint32_t row, uint32_t column, char c );
+    };
+}
+
+XTextOverlayFilter::XTextOverlayFilter( const string& text, Position position ) :
+    mData( new Private::XTextOverlayFilterData( text, position ) )
+{
+
+}
+
+XTextOverlayFilter::~XTextOverlayFilter( )
+{
+    delete mData;
+}
+
+// Get/Set text to show
+string XTextOverlayFilter::Text( ) const
+{
+    lock_guard<mutex> lock( mData->Sync );
+    return mData->Text;
+}
+void XTextOverlayFilter::SetText( const string& text )
+{
+    lock_guard<mutex> lock( mData->Sync );
+    mData->Text = text;
+}
+
+// Get/Set corner of the image to put text into
+XTextOverlayFilter::Position XTextOverlayFilter::GetPosition( ) const
+{
+    lock_guard<mutex> lock( mData->Sync );
+    return mData->Position;
+}
+void XTextOverlayFilter::SetPosition( Position position )
+{
+    lock_guard<mutex> lock( mData->Sync );
+    mData->Position = position;
+}
+
+// Get/Set scale of the font
+uint32_t XTextOverlayFilter::Scale( ) const
+{
+    lock_guard<mutex> lock( mData->Sync );
+    return mData->Scale;
+}
+void XTextOverlayFilter::SetScale( uint32_t scale )
+{
+    lock_guard<mutex> lock( mData->Sync );
+
+    if ( scale < 1 )         scale = 1;
+    if ( scale > MAX_SCALE ) scale = MAX_SCALE;
+
+    mData->Scale = scale;
+    mData->StyleVersion++;
+}
+
+// Get/Set text color
+uint32_t XTextOverlayFilter::TextColor( ) const
+{
+    lock_guard<mutex> lock( mData->Sync );
+    return mData->TextColor;
+}
+void XTextOverlayFilter::SetTextColor( uint32_t color )
+{
+    lock_guard<mutex> lock( mData->Sync );
+    mData->TextColor = color & 0xFFFFFF;
+    mData->StyleVersion++;
+}
+
+// Get/Set color of text's outline/background
+uint32_t XTextOverlayFilter::BackgroundColor( ) const
+{
+    lock_guard<mutex> lock( mData->Sync );
+    return mData->BackgroundColor;
+}
+void XTextOverlayFilter::SetBackgroundColor( uint32_t color )
+{
+    lock_guard<mutex> lock( mData->Sync );
+    mData->BackgroundColor = color & 0xFFFFFF;
+    mData->StyleVersion++;
+}
+
+// Get/Set opacity of background behind the text
+uint8_t XTextOverlayFilter::BackgroundOpacity( ) const
+{
+    lock_guard<mutex> lock( mData->Sync );
+    return mData->BackgroundOpacity;
+}
+void XTextOverlayFilter::SetBackgroundOpacity( uint8_t opacity )
+{
+    lock_guard<mutex> lock( mData->Sync );
+    mData->BackgroundOpacity = opacity;
+    mData->StyleVersion++;
+}
+
+// Name of the filter
+string XTextOverlayFilter::Name( ) const
+{
+    return "Text overlay";
+}
+
+// Blend text overlay into the image
+XError XTextOverlayFilter::Process( shared_ptr<XImage>& image, XImagePool& /* pool */ )
+{
+    return mData->Process( image );
+}
+
+namespace Private
+{
+
+// Blend text overlay into the image
+XError XTextOverlayFilterData::Process( shared_ptr<XImage>& image )
+{
+    XTextOverlayFilter::Position position;
+    string                       text;
+    uint32_t                     scale, textColor, backgroundColor, styleVersion;
+    uint8_t                      backgroundOpacity;
+    XError                       ret = XError::Success;
+
+    {
+        lock_guard<mutex> lock( Sync );
+
+        text              = Text;
+        position          = Position;
+        scale             = Scale;
+        textColor         = TextColor;
+        backgroundColor   = BackgroundColor;
+        backgroundOpacity = BackgroundOpacity;
+        styleVersion      = StyleVersion;
+    }
+
+    if ( ( !image ) || ( image->Data( ) == nullptr ) )
+    {
+        ret = XError::NullPointer;
+    }
+    else if ( ( !text.empty( ) ) &&
+              ( ( image->Format( ) == XPixelFormat::Grayscale8 ) ||
+                ( image->Format( ) == XPixelFormat::RGB24 ) ||
+                ( image->Format( ) == XPixelFormat::RGBA32 ) ) )
+    {
+        bool     textChanged = ExpandText( text );
+        uint32_t rows        = static_cast<uint32_t>( Lines.size( ) );
+        uint32_t columns     = 0;
+
+        for ( const string& line : Lines )
+        {
+            if ( line.length( ) > columns )
+            {
+                columns = static_cast<uint32_t>( line.length( ) );
+            }
+        }
+
+        if ( columns != 0 )
+        {
+            if ( scale != AtlasScale )
+            {
+                BuildAtlas( scale );
+            }
+
+            if ( ( image->Format( ) != LayoutFormat ) || ( styleVersion != LayoutStyle ) ||
+                 ( rows != Rows ) || ( columns != Columns ) || ( Cells.empty( ) ) )
+            {
+                Layout( image->Format( ), rows, columns, textColor, backgroundColor, backgroundOpacity );
+                LayoutStyle = styleVersion;
+                textChanged = true;
+            }
+
+            // re-render only cells showing different characters
+            if ( textChanged )
+            {
+                for ( uint32_t row = 0; row < Rows; row++ )
+                {
+                    const string& line = Lines[row];
+
+                    for ( uint32_t column = 0; column < Columns; column++ )
+                    {
+                        char c = ( column < line.length( ) ) ? line[column] : ' ';
+
+                        if ( ( c < FIRST_CHARACTER ) || ( c > LAST_CHARACTER ) )
+                        {
+                            c = '?';
+                        }
+
+                        if ( Cells[row * Columns + column] != c )
+                        {
+                            RenderCell( row, column, c );
+                        }
+                    }
+                }
+            }
+
+            // put the overlay into the requested corner, clipping it to the image
+            int32_t imageWidth  = image->Width( );
+            int32_t imageHeight = image->Height( );
+            int32_t overlayX    = OVERLAY_MARGIN;
+            int32_t overlayY    = OVERLAY_MARGIN;
+            int32_t srcX        = 0;
+            int32_t srcY        = 0;
+
+            if ( ( position == XTextOverlayFilter::Position::TopRight ) || ( position == XTextOverlayFilter::Position::BottomRight ) )
+            {
+                overlayX = imageWidth - static_cast<int32_t>( OverlayWidth ) - OVERLAY_MARGIN;
+            }
+            if ( ( position == XTextOverlayFilter::Position::BottomLeft ) || ( position == XTextOverlayFilter::Position::BottomRight ) )
+            {
+                overlayY = imageHeight - static_cast<int32_t>( OverlayHeight ) - OVERLAY_MARGIN;
+            }
+
+            if ( overlayX < 0 )
+            {
+                srcX     = -overlayX;
+                overlayX = 0;
+            }
+            if ( overlayY < 0 )
+            {
+                srcY     = -overlayY;
+                overlayY = 0;
+            }
+
+            int32_t width  = static_cast<int32_t>( OverlayWidth )  - srcX;
+            int32_t height = static_cast<int32_t>( OverlayHeight ) - srcY;
+
+            if ( width  > imageWidth  - overlayX ) width  = imageWidth  - overlayX;
+            if ( height > imageHeight - overlayY ) height = imageHeight - overlayY;
+
+            if ( ( width > 0 ) && ( height > 0 ) )
+            {
+                uint32_t       count   = static_cast<uint32_t>( width ) * BytesPerPixel;
+                size_t         offset  = static_cast<size_t>( srcY ) * OverlayStride + srcX * BytesPerPixel;
+                const uint8_t* colors  = Colors.data( )  + offset;
+                const uint8_t* factors = Factors.data( ) + offset;
+                int32_t        stride  = image->Stride( );
+                uint8_t*       dst     = image->Data( ) + overlayY * stride + overlayX * BytesPerPixel;
+
+                for ( int32_t y = 0; y < height; y++ )
+                {
+                    BlendRow( dst, colors, factors, count );
+
+                    dst     += stride;
+                    colors  += OverlayStride;
+                    factors += OverlayStride;
+                }
+            }
+        }
+    }
+
+    return ret;
+}
+
+// Expand time fields of the text (if any) and split it into lines. Returns true if lines changed.
+bool XTextOverlayFilterData::ExpandText( const string& text )
+{
+    bool changed = false;
+
+    if ( text.find( '%' ) == string::npos )
+    {
+        if ( ( text != SourceText ) || ( ExpandedTime != 0 ) )
+        {
+            ExpandedText = text;
+            ExpandedTime = 0;
+            changed      = true;
+        }
+    }
+    else
+    {
+        time_t now = time( nullptr );
+
+        // time fields have resolution of a second at best, so expand them only once a second
+        if ( ( text != SourceText ) || ( now != ExpandedTime ) )
+        {
+            char      buffer[MAX_EXPANDED_LENGTH];
+            struct tm local;
+
+        #ifdef _WIN32
+            localtime_s( &local, &now );
+        #else
+            localtime_r( &now, &local );
+        #endif
+
+            if ( strftime( buffer, sizeof( buffer ), text.c_str( ), &local ) == 0 )
+            {
+                buffer[0] = '\0';
+            }
+
+            ExpandedTime = now;
+
+            if ( ExpandedText != buffer )
+            {
+                ExpandedText = buffer;
+                changed      = true;
+            }
+        }
+    }
+
+    SourceText = text;
+
+    if ( changed )
+    {
+        size_t start = 0;
+
+        Lines.clear( );
+
+        for ( ; ; )
+        {
+            size_t end = ExpandedText.find( '\n', start );
+
+            Lines.push_back( ExpandedText.substr( start, ( end == string::npos ) ? string::npos : end - start ) );
+
+            if ( end == string::npos )
+            {
+                break;
+            }
+            start = end + 1;
+        }
+    }
+
+    return changed;
+}
+
+// Rasterise all glyphs of the font at the specified scale, marking text and outline pixels
+void XTextOverlayFilterData::BuildAtlas( uint32_t scale )
+{
+    uint8_t cell[CELL_HEIGHT][CELL_WIDTH];
+
+    CellWidth  = CELL_WIDTH  * scale;
+    CellHeight = CELL_HEIGHT * scale;
+    AtlasScale = scale;
+
+    Atlas.resize( CHARACTERS_COUNT * CellWidth * CellHeight );
+
+    for ( uint32_t c = 0; c < CHARACTERS_COUNT; c++ )
+    {
+        memset( cell, PixelBackground, sizeof( cell ) );
+
+        // glyph's pixels and outline of 1 pixel around them
+        for ( int y = 0; y < GLYPH_HEIGHT; y++ )
+        {
+            for ( int x = 0; x < GLYPH_WIDTH; x++ )
+            {
+                if ( ( Font[c][y] & ( 0x10 >> x ) ) != 0 )
+                {
+                    for ( int oy = 0; oy < 3; oy++ )
+                    {
+                        for ( int ox = 0; ox < 3; ox++ )
+                        {
+                            if ( cell[y + oy][x + ox] == PixelBackground )
+                            {
+                                cell[y + oy][x + ox] = PixelOutline;
+                            }
+                        }
+                    }
+                    cell[y + 1][x + 1] = PixelText;
+                }
+            }
+        }
+
+        uint8_t* ptr = Atlas.data( ) + c * CellWidth * CellHeight;
+
+        for ( uint32_t y = 0; y < CellHeight; y++ )
+        {
+            for ( uint32_t x = 0; x < CellWidth; x++ )
+            {
+                *ptr++ = cell[y / scale][x / scale];
+            }
+        }
+    }
+}
+
+// Allocate overlay for the specified number of text rows/columns and prepare blending values of atlas pixels
+void XTextOverlayFilterData::Layout( XPixelFormat format, uint32_t rows, uint32_t columns, uint32_t textColor, uint32_t backgroundColor, uint8_t backgroundOpacity )
+{
+    uint8_t kindOpacity[PixelKinds] = { backgroundOpacity, 255, 255 };
+    uint8_t kindRgb[PixelKinds][3];
+
+    for ( int kind = 0; kind < PixelKinds; kind++ )
+    {
+        uint32_t color = ( kind == PixelText ) ? textColor : backgroundColor;
+
+        kindRgb[kind][RedIndex]   = static_cast<uint8_t>( color >> 16 );
+        kindRgb[kind][GreenIndex] = static_cast<uint8_t>( color >> 8 );
+        kindRgb[kind][BlueIndex]  = static_cast<uint8_t>( color );
+    }
+
+    BytesPerPixel = ( format == XPixelFormat::Grayscale8 ) ? 1 : ( ( format == XPixelFormat::RGB24 ) ? 3 : 4 );
+
+    for ( int kind = 0; kind < PixelKinds; kind++ )
+    {
+        uint8_t opacity = kindOpacity[kind];
+
+        if ( format == XPixelFormat::Grayscale8 )
+        {
+            uint32_t luma = ( kindRgb[kind][RedIndex] * 77 + kindRgb[kind][GreenIndex] * 150 + kindRgb[kind][BlueIndex] * 29 + 128 ) >> 8;
+
+            KindColors[kind][0]  = MultiplyDiv255( luma, opacity );
+            KindFactors[kind][0] = static_cast<uint8_t>( 255 - opacity );
+        }
+        else
+        {
+            for ( int i = 0; i < 3; i++ )
+            {
+                KindColors[kind][i]  = MultiplyDiv255( kindRgb[kind][i], opacity );
+                KindFactors[kind][i] = static_cast<uint8_t>( 255 - opacity );
+            }
+            // alpha channel of RGBA images is kept as is
+            KindColors[kind][3]  = 0;
+            KindFactors[kind][3] = 255;
+        }
+    }
+
+    LayoutFormat  = format;
+    Rows          = rows;
+    Columns       = columns;
+    OverlayWidth  = columns * CellWidth;
+    OverlayHeight = rows * CellHeight;
+    OverlayStride = OverlayWidth * BytesPerPixel;
+
+    Colors.resize( OverlayStride * OverlayHeight );
+    Factors.resize( OverlayStride * OverlayHeight );
+
+    Cells.assign( rows * columns, 0 );
+}
+
+// Render the character into the specified cell of the overlay
+void XTextOverlayFilterData::RenderCell( uint32_t row, uint32_t column, char c )
+{
+    const uint8_t* kinds   = Atlas.data( ) + ( c - FIRST_CHARACTER ) * CellWidth * CellHeight;
+    size_t         offset  = static_cast<size_t>( row * CellHeight ) * OverlayStride + column * CellWidth * BytesPerPixel;
+    uint8_t*       colors  = Colors.data( )  + offset;
+    uint8_t*       factors = Factors.data( ) + offset;
+
+    for ( uint32_t y = 0; y < CellHeight; y++ )
+    {
+        uint8_t* colorsRow  = colors;
+        uint8_t* factorsRow = factors;
+
+        for ( uint32_t x = 0; x < CellWidth; x++, kinds++ )
+        {
+            memcpy( colorsRow,  KindColors[*kinds],  BytesPerPixel );
+            memcpy( factorsRow, KindFactors[*kinds], BytesPerPixel );
+
+            colorsRow  += BytesPerPixel;
+            factorsRow += BytesPerPixel;
+        }
+
+        colors  += OverlayStride;
+        factors += OverlayStride;
+    }
+
+    Cells[row * Columns + column] = c;
+}
+
+// Blend a row of overlay into image: dst = color + dst * factor / 255
+void BlendRow( uint8_t* dst, const uint8_t* colors, const uint8_t* factors, uint32_t count )
+{
+    uint32_t i = 0;
+
+#if defined( __SSE2__ )
+    const __m128i zero  = _mm_setzero_si128( );
+    const __m128i round = _mm_set1_epi16( 128 );
+
+    for ( ; i + 16 <= count; i += 16 )
+    {
+        __m128i d  = _mm_loadu_si128( reinterpret_cast<const __m128i*>( dst + i ) );
+        __m128i f  = _mm_loadu_si128( reinterpret_cast<const __m128i*>( factors + i ) );
+        __m128i c  = _mm_loadu_si128( reinterpret_cast<const __m128i*>( colors + i ) );
+        __m128i lo = _mm_add_epi16( _mm_mullo_epi16( _mm_unpacklo_epi8( d, zero ), _mm_unpacklo_epi8( f, zero ) ), round );
+        __m128i hi = _mm_add_epi16( _mm_mullo_epi16( _mm_unpackhi_epi8( d, zero ), _mm_unpackhi_epi8( f, zero ) ), round );
+
+        lo = _mm_srli_epi16( _mm_add_epi16( lo, _mm_srli_epi16( lo, 8 ) ), 8 );
+        hi = _mm_srli_epi16( _mm_add_epi16( hi, _mm_srli_epi16( hi, 8 ) ), 8 );
+
+        _mm_storeu_si128( reinterpret_cast<__m128i*>( dst + i ), _mm_adds_epu8( _mm_packus_epi16( lo, hi ), c ) );
+    }
+#elif defined( OVERLAY_USE_NEON )
+    for ( ; i + 16 <= count; i += 16 )
+    {
+        uint8x16_t d  = vld1q_u8( dst + i );
+        uint8x16_t f  = vld1q_u8( factors + i );
+        uint8x16_t c  = vld1q_u8( colors + i );
+        uint16x8_t lo = vmull_u8( vget_low_u8( d ),  vget_low_u8( f ) );
+        uint16x8_t hi = vmull_u8( vget_high_u8( d ), vget_high_u8( f ) );
+
+        // ( x + 128 + ( ( x + 128 ) >> 8 ) ) >> 8
+        uint8x16_t r  = vcombine_u8( vraddhn_u16( lo, vrshrq_n_u16( lo, 8 ) ), vraddhn_u16( hi, vrshrq_n_u16( hi, 8 ) ) );
+
+        vst1q_u8( dst + i, vqaddq_u8( r, c ) );
+    }
+#endif
+
+    for ( ; i < count; i++ )
+    {
+        uint32_t v = colors[i] + MultiplyDiv255( dst[i], factors[i] );
+
+        dst[i] = static_cast<uint8_t>( ( v > 255 ) ? 255 : v );
+    }
+}
+
+} // namespace Private
@@ -0,0 +1,97 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XTEXT_OVERLAY_FILTER_HPP
+#define XTEXT_OVERLAY_FILTER_HPP
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+
+#include "XInterfaces.hpp"
+#include "IVideoFilter.hpp"
+
+namespace Private
+{
+    class XTextOverlayFilterData;
+}
+
+/* Video filter burning text (camera name, time stamp, etc.) into images.
+
+   The text may contain strftime() conversion fields (like "%Y-%m-%d %H:%M:%S"), which are expanded
+   with local time, and new line characters to split it into several lines. Characters outside of
+   printable ASCII range are shown as '?'.
+
+   Glyphs of a built-in 5x8 font are rasterised once into an atlas (at the selected scale), with
+   outline around them. The overlay itself is kept pre-blended in the layout of the images - a color
+   to add and a factor to multiply image's pixels with - and only cells of characters which changed
+   since the previous image are re-rendered from the atlas (a couple of digits of a time stamp every
+   second). So processing an image only blends the overlay's rectangle into it (SSE2 or NEON when
+   available), the rest of the image is not touched.
+
+   Grayscale, RGB24 and RGBA32 images are supported (grayscale ones get luminance of the colors),
+   JPEG images are left untouched.
+*/
+class XTextOverlayFilter : public IVideoFilter, private Uncopyable
+{
+public:
+    enum class Position
+    {
+        TopLeft = 0,
+        TopRight,
+        BottomLeft,
+        BottomRight
+    };
+
+public:
+    XTextOverlayFilter( const std::string& text = std::string( ), Position position = Position::TopLeft );
+    ~XTextOverlayFilter( );
+
+    // Get/Set text to show (empty - nothing is shown)
+    std::string Text( ) const;
+    void SetText( const std::string& text );
+
+    // Get/Set corner of the image to put text into
+    Position GetPosition( ) const;
+    void SetPosition( Position position );
+
+    // Get/Set scale of the font, [1, 8] (1 - characters are 7x10 pixels, including outline)
+    uint32_t Scale( ) const;
+    void SetScale( uint32_t scale );
+
+    // Get/Set text color and color of its outline/background (0xRRGGBB)
+    uint32_t TextColor( ) const;
+    void SetTextColor( uint32_t color );
+    uint32_t BackgroundColor( ) const;
+    void SetBackgroundColor( uint32_t color );
+
+    // Get/Set opacity of background behind the text, [0, 255] (0 - only outline of characters is drawn)
+    uint8_t BackgroundOpacity( ) const;
+    void SetBackgroundOpacity( uint8_t opacity );
+
+    // IVideoFilter interface
+    std::string Name( ) const;
+    XError Process( std::shared_ptr<XImage>& image, XImagePool& pool );
+
+private:
+    Private::XTextOverlayFilterData* mData;
+};
+
+#endif // XTEXT_OVERLAY_FILTER_HPP
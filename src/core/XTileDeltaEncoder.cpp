@@ -0,0 +1,286 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <vector>
+#include <algorithm>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "XTileDeltaEncoder.hpp"
+#include "XJpegEncoder.hpp"
+
+using namespace std;
+
+namespace Private
+{
+    #define TILE_RECORD_HEADER_SIZE (8)
+    #define TILE_BUFFER_SIZE        (64 * 1024)
+
+    class XTileDeltaEncoderData
+    {
+    public:
+        XJpegEncoder        JpegEncoder;
+        uint32_t            TileSize;
+        uint32_t            ChangeThreshold;
+        shared_ptr<XImage>  ReferenceImage;
+        uint32_t            BaseSequence;
+        uint32_t            Sequence;
+        uint16_t            TilesCount;
+        vector<uint8_t>     Delta;
+        uint32_t            DeltaSize;
+        uint8_t*            TileBuffer;
+        uint32_t            TileBufferSize;
+
+    public:
+        XTileDeltaEncoderData( uint16_t jpegQuality, uint32_t tileSize, uint32_t changeThreshold ) :
+            JpegEncoder( jpegQuality, true ),
+            TileSize( ( tileSize < 16 ) ? 16 : ( tileSize & ~15 ) ), ChangeThreshold( changeThreshold ),
+            ReferenceImage( ), BaseSequence( 0 ), Sequence( 0 ), TilesCount( 0 ), Delta( ), DeltaSize( 0 ),
+            TileBuffer( nullptr ), TileBufferSize( 0 )
+        {
+            TileBuffer = static_cast<uint8_t*>( malloc( TILE_BUFFER_SIZE ) );
+
+            if ( TileBuffer != nullptr )
+            {
+                TileBufferSize = TILE_BUFFER_SIZE;
+            }
+        }
+
+        ~XTileDeltaEncoderData( )
+        {
+            free( TileBuffer );
+        }
+
+        XError Update( const shared_ptr<const XImage>& image, uint32_t sequence );
+
+    private:
+        bool IsTileChanged( const XImage* image, int32_t x, int32_t y, int32_t width, int32_t height ) const;
+        XError AddTile( const shared_ptr<const XImage>& image, int32_t x, int32_t y, int32_t width, int32_t height );
+    };
+}
+
+XTileDeltaEncoder::XTileDeltaEncoder( uint16_t jpegQuality, uint32_t tileSize, uint32_t changeThreshold ) :
+    mData( new Private::XTileDeltaEncoderData( jpegQuality, tileSize, changeThreshold ) )
+{
+}
+
+XTileDeltaEncoder::~XTileDeltaEncoder( )
+{
+    delete mData;
+}
+
+// Get/Set JPEG quality used for tiles
+uint16_t XTileDeltaEncoder::JpegQuality( ) const
+{
+    return mData->JpegEncoder.Quality( );
+}
+void XTileDeltaEncoder::SetJpegQuality( uint16_t quality )
+{
+    mData->JpegEncoder.SetQuality( quality );
+}
+
+// Encode tiles changed since the previous update
+XError XTileDeltaEncoder::Update( const shared_ptr<const XImage>& image, uint32_t sequence )
+{
+    return mData->Update( image, sequence );
+}
+
+// Forget reference image
+void XTileDeltaEncoder::Reset( )
+{
+    mData->ReferenceImage.reset( );
+    mData->BaseSequence = 0;
+    mData->Sequence     = 0;
+    mData->TilesCount   = 0;
+    mData->DeltaSize    = 0;
+}
+
+// Sequence number of the image the delta is based on
+uint32_t XTileDeltaEncoder::BaseSequence( ) const
+{
+    return mData->BaseSequence;
+}
+
+// Sequence number of the image the delta brings to
+uint32_t XTileDeltaEncoder::Sequence( ) const
+{
+    return mData->Sequence;
+}
+
+// Number of tiles in the last delta
+uint16_t XTileDeltaEncoder::TilesCount( ) const
+{
+    return mData->TilesCount;
+}
+
+// Encoded tiles of the last delta
+const uint8_t* XTileDeltaEncoder::DeltaData( ) const
+{
+    return mData->Delta.data( );
+}
+uint32_t XTileDeltaEncoder::DeltaSize( ) const
+{
+    return mData->DeltaSize;
+}
+
+namespace Private
+{
+
+// Compare the image with the reference one and encode changed tiles
+XError XTileDeltaEncoderData::Update( const shared_ptr<const XImage>& image, uint32_t sequence )
+{
+    XError ret = XError::Success;
+
+    TilesCount = 0;
+    DeltaSize  = 0;
+
+    if ( !image )
+    {
+        ret = XError::NullPointer;
+    }
+    else if ( ( image->Format( ) != XPixelFormat::RGB24 ) && ( image->Format( ) != XPixelFormat::Grayscale8 ) )
+    {
+        // tiles are encoded with XJpegEncoder, which supports only these
+        ret = XError::UnsupportedPixelFormat;
+    }
+    else if ( ( !ReferenceImage ) || ( ReferenceImage->Width( ) != image->Width( ) ) ||
+              ( ReferenceImage->Height( ) != image->Height( ) ) || ( ReferenceImage->Format( ) != image->Format( ) ) )
+    {
+        // nothing to compare with - clients need complete image
+        ReferenceImage = image->Clone( );
+        BaseSequence   = 0;
+        Sequence       = sequence;
+
+        if ( !ReferenceImage )
+        {
+            ret = XError::OutOfMemory;
+        }
+    }
+    else
+    {
+        int32_t width  = image->Width( );
+        int32_t height = image->Height( );
+
+        for ( int32_t y = 0; ( y < height ) && ( ret == XError::Success ); y += TileSize )
+        {
+            int32_t tileHeight = min( static_cast<int32_t>( TileSize ), height - y );
+
+            for ( int32_t x = 0; ( x < width ) && ( ret == XError::Success ); x += TileSize )
+            {
+                int32_t tileWidth = min( static_cast<int32_t>( TileSize ), width - x );
+
+                if ( IsTileChanged( image.get( ), x, y, tileWidth, tileHeight ) )
+                {
+                    ret = AddTile( image, x, y, tileWidth, tileHeight );
+                }
+            }
+        }
+
+        BaseSequence = Sequence;
+        Sequence     = sequence;
+
+        if ( ret != XError::Success )
+        {
+            // reference image may be partially updated, so start over
+            ReferenceImage.reset( );
+            BaseSequence = 0;
+            TilesCount   = 0;
+            DeltaSize    = 0;
+        }
+    }
+
+    return ret;
+}
+
+// Check if mean absolute difference between tile of the image and the reference image exceeds the threshold
+bool XTileDeltaEncoderData::IsTileChanged( const XImage* image, int32_t x, int32_t y, int32_t width, int32_t height ) const
+{
+    int32_t  pixelSize = ( image->Format( ) == XPixelFormat::Grayscale8 ) ? 1 : 3;
+    int32_t  lineSize  = width * pixelSize;
+    uint32_t limit     = ChangeThreshold * static_cast<uint32_t>( lineSize * height );
+    uint32_t diff      = 0;
+
+    for ( int32_t row = 0; ( row < height ) && ( diff <= limit ); row++ )
+    {
+        const uint8_t* ptr1 = image->Data( ) + ( y + row ) * image->Stride( ) + x * pixelSize;
+        const uint8_t* ptr2 = ReferenceImage->Data( ) + ( y + row ) * ReferenceImage->Stride( ) + x * pixelSize;
+
+        for ( int32_t i = 0; i < lineSize; i++ )
+        {
+            diff += static_cast<uint32_t>( abs( static_cast<int>( ptr1[i] ) - static_cast<int>( ptr2[i] ) ) );
+        }
+    }
+
+    return ( diff > limit );
+}
+
+// Encode tile of the image, add it to delta and update reference image
+XError XTileDeltaEncoderData::AddTile( const shared_ptr<const XImage>& image, int32_t x, int32_t y, int32_t width, int32_t height )
+{
+    shared_ptr<XImage> tile          = image->SubImage( x, y, width, height );
+    shared_ptr<XImage> referenceTile = ReferenceImage->SubImage( x, y, width, height );
+    XError             ret           = XError::OutOfMemory;
+
+    if ( ( tile ) && ( referenceTile ) )
+    {
+        uint8_t* oldTileBuffer = TileBuffer;
+        uint32_t jpegSize      = TileBufferSize;
+
+        ret = JpegEncoder.EncodeToMemory( tile, &TileBuffer, &jpegSize );
+
+        if ( TileBuffer != oldTileBuffer )
+        {
+            // encoder allocated bigger buffer since the tile did not fit
+            free( oldTileBuffer );
+            TileBufferSize = jpegSize;
+        }
+
+        if ( ret == XError::Success )
+        {
+
+            if ( Delta.size( ) < DeltaSize + TILE_RECORD_HEADER_SIZE + jpegSize )
+            {
+                Delta.resize( ( DeltaSize + TILE_RECORD_HEADER_SIZE + jpegSize ) * 3 / 2 );
+            }
+
+            uint8_t* record = Delta.data( ) + DeltaSize;
+
+            record[0] = static_cast<uint8_t>( x >> 8 );
+            record[1] = static_cast<uint8_t>( x );
+            record[2] = static_cast<uint8_t>( y >> 8 );
+            record[3] = static_cast<uint8_t>( y );
+            record[4] = static_cast<uint8_t>( jpegSize >> 24 );
+            record[5] = static_cast<uint8_t>( jpegSize >> 16 );
+            record[6] = static_cast<uint8_t>( jpegSize >> 8 );
+            record[7] = static_cast<uint8_t>( jpegSize );
+            memcpy( record + TILE_RECORD_HEADER_SIZE, TileBuffer, jpegSize );
+
+            DeltaSize += TILE_RECORD_HEADER_SIZE + jpegSize;
+            TilesCount++;
+
+            ret = tile->CopyData( referenceTile );
+        }
+    }
+
+    return ret;
+}
+
+} // namespace Private
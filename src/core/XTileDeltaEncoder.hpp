@@ -0,0 +1,77 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XTILE_DELTA_ENCODER_HPP
+#define XTILE_DELTA_ENCODER_HPP
+
+#include <stdint.h>
+#include <memory>
+
+#include "XInterfaces.hpp"
+#include "XImage.hpp"
+#include "XError.hpp"
+
+namespace Private
+{
+    class XTileDeltaEncoderData;
+}
+
+/* Splits images into square tiles and JPEG encodes only those, which changed compared to
+   the reference image - the image clients get after applying all the previous deltas.
+
+   Tile is considered changed if mean absolute difference of its pixels' values exceeds
+   the specified threshold. Small changes don't get lost, since the reference image is
+   updated only for the tiles which were encoded, so the difference accumulates.
+
+   Delta data is a sequence of tile records: X and Y coordinates (16 bit each), JPEG size
+   (32 bit) and then the JPEG itself; all values are big-endian.
+*/
+class XTileDeltaEncoder : private Uncopyable
+{
+public:
+    XTileDeltaEncoder( uint16_t jpegQuality = 85, uint32_t tileSize = 64, uint32_t changeThreshold = 6 );
+    ~XTileDeltaEncoder( );
+
+    // Get/Set JPEG quality used for tiles
+    uint16_t JpegQuality( ) const;
+    void SetJpegQuality( uint16_t quality );
+
+    // Compare the image with the reference one and encode tiles, which changed. If reference image
+    // is not available (first image or its size/format changed), then no delta is produced and
+    // base sequence is set to 0. Only RGB24 and Grayscale8 images are supported.
+    XError Update( const std::shared_ptr<const XImage>& image, uint32_t sequence );
+
+    // Forget reference image, so the next update does not produce delta
+    void Reset( );
+
+    // Sequence number of the image the delta is based on and the image it brings to
+    uint32_t BaseSequence( ) const;
+    uint32_t Sequence( ) const;
+
+    // Encoded tiles of the last delta
+    uint16_t TilesCount( ) const;
+    const uint8_t* DeltaData( ) const;
+    uint32_t DeltaSize( ) const;
+
+private:
+    Private::XTileDeltaEncoderData* mData;
+};
+
+#endif // XTILE_DELTA_ENCODER_HPP
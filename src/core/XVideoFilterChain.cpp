@@ -0,0 +1,400 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <stdio.h>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <chrono>
+
+#include "XVideoFilterChain.hpp"
+#include "XImageTripleBuffer.hpp"
+#include "XManualResetEvent.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace Private
+{
+    // Number of images kept in the pool - working image, outputs of filters and an image held by listener
+    #define POOL_SIZE (4)
+
+    // Filter and its timing statistics
+    class FilterData
+    {
+    public:
+        shared_ptr<IVideoFilter> Filter;
+        uint32_t                 Calls;
+        uint32_t                 LastTime;
+        uint32_t                 MaxTime;
+        uint64_t                 TotalTime;
+
+    public:
+        FilterData( const shared_ptr<IVideoFilter>& filter ) :
+            Filter( filter ), Calls( 0 ), LastTime( 0 ), MaxTime( 0 ), TotalTime( 0 )
+        {
+        }
+    };
+
+    // Information about filters' processing time
+    class FilterStatsInformation : public IObjectInformation
+    {
+    private:
+        XVideoFilterChainData* Owner;
+
+    public:
+        FilterStatsInformation( XVideoFilterChainData* owner ) : Owner( owner ) { }
+
+        XError GetProperty( const string& propertyName, string& value ) const;
+        PropertyMap GetAllProperties( ) const;
+    };
+
+    class XVideoFilterChainData
+    {
+    public:
+        bool                  UseOwnThread;
+        mutable mutex         Sync;
+        vector<FilterData>    Filters;
+        IVideoSourceListener* Listener;
+        XImagePool            Pool;
+        shared_ptr<XImage>    JpegImage;
+
+        XImageTripleBuffer    Images;
+        XManualResetEvent     NewImageEvent;
+        XManualResetEvent     NeedToStop;
+        thread                FilterThread;
+
+    public:
+        XVideoFilterChainData( bool useOwnThread ) :
+            UseOwnThread( useOwnThread ), Sync( ), Filters( ), Listener( nullptr ), Pool( POOL_SIZE ), JpegImage( ),
+            Images( ), NewImageEvent( ), NeedToStop( ), FilterThread( )
+        {
+            if ( UseOwnThread )
+            {
+                FilterThread = thread( FilterThreadHandler, this );
+            }
+        }
+
+        ~XVideoFilterChainData( )
+        {
+            if ( FilterThread.joinable( ) )
+            {
+                NeedToStop.Signal( );
+                NewImageEvent.Signal( );
+                FilterThread.join( );
+            }
+        }
+
+        IVideoSourceListener* GetListener( );
+        void RunFilters( shared_ptr<XImage>& image );
+        void NotifyError( const string& errorMessage, bool fatal );
+
+        static void FilterThreadHandler( XVideoFilterChainData* me );
+    };
+}
+
+XVideoFilterChain::XVideoFilterChain( bool useOwnThread ) :
+    mData( new Private::XVideoFilterChainData( useOwnThread ) )
+{
+}
+
+XVideoFilterChain::~XVideoFilterChain( )
+{
+    delete mData;
+}
+
+// Add filter to the end of the chain
+void XVideoFilterChain::Add( const shared_ptr<IVideoFilter>& filter )
+{
+    if ( filter )
+    {
+        lock_guard<mutex> lock( mData->Sync );
+        mData->Filters.push_back( Private::FilterData( filter ) );
+    }
+}
+
+// Set listener to receive filtered images
+IVideoSourceListener* XVideoFilterChain::SetListener( IVideoSourceListener* listener )
+{
+    lock_guard<mutex>     lock( mData->Sync );
+    IVideoSourceListener* oldListener = mData->Listener;
+
+    mData->Listener = listener;
+
+    return oldListener;
+}
+
+// Check if filters are run on a dedicated thread
+bool XVideoFilterChain::UsesOwnThread( ) const
+{
+    return mData->UseOwnThread;
+}
+
+// New video frame notification - run filters
+void XVideoFilterChain::OnNewImage( const shared_ptr<const XImage>& image )
+{
+    bool noFilters;
+
+    {
+        lock_guard<mutex> lock( mData->Sync );
+        noFilters = mData->Filters.empty( );
+    }
+
+    if ( noFilters )
+    {
+        // nothing to do, so don't waste time on copying
+        IVideoSourceListener* listener = mData->GetListener( );
+
+        if ( listener != nullptr )
+        {
+            listener->OnNewImage( image );
+        }
+    }
+    else if ( mData->UseOwnThread )
+    {
+        XError ret = mData->Images.Publish( image );
+
+        if ( ret )
+        {
+            mData->NewImageEvent.Signal( );
+        }
+        else
+        {
+            mData->NotifyError( ret.ToString( ), false );
+        }
+    }
+    else
+    {
+        shared_ptr<XImage> workImage;
+        XError             ret;
+
+        // get a copy of the source image to work on
+        if ( image->Format( ) == XPixelFormat::JPEG )
+        {
+            // size of JPEG images changes all the time, so don't bother with the pool
+            ret       = image->CopyDataOrClone( mData->JpegImage );
+            workImage = mData->JpegImage;
+        }
+        else
+        {
+            workImage = mData->Pool.Acquire( image->Width( ), image->Height( ), image->Format( ) );
+            ret       = ( workImage ) ? image->CopyData( workImage ) : XError( XError::OutOfMemory );
+        }
+
+        if ( ret )
+        {
+            mData->RunFilters( workImage );
+        }
+        else
+        {
+            mData->NotifyError( ret.ToString( ), false );
+        }
+    }
+}
+
+// Video source error notification - pass it further
+void XVideoFilterChain::OnError( const string& errorMessage, bool fatal )
+{
+    mData->NotifyError( errorMessage, fatal );
+}
+
+// Get number of filters in the chain
+uint32_t XVideoFilterChain::FilterCount( ) const
+{
+    lock_guard<mutex> lock( mData->Sync );
+    return static_cast<uint32_t>( mData->Filters.size( ) );
+}
+
+// Get processing time statistics of the specified filter
+XVideoFilterTiming XVideoFilterChain::FilterTiming( uint32_t index ) const
+{
+    lock_guard<mutex>  lock( mData->Sync );
+    XVideoFilterTiming timing = { };
+
+    if ( index < mData->Filters.size( ) )
+    {
+        const Private::FilterData& filterData = mData->Filters[index];
+
+        timing.Calls       = filterData.Calls;
+        timing.LastTime    = filterData.LastTime;
+        timing.MaxTime     = filterData.MaxTime;
+        timing.AverageTime = ( filterData.Calls == 0 ) ? 0 : static_cast<uint32_t>( filterData.TotalTime / filterData.Calls );
+    }
+
+    return timing;
+}
+
+// Create object providing processing time information of all filters
+shared_ptr<IObjectInformation> XVideoFilterChain::CreateStatsInformation( ) const
+{
+    return make_shared<Private::FilterStatsInformation>( mData );
+}
+
+namespace Private
+{
+
+// Get current listener
+IVideoSourceListener* XVideoFilterChainData::GetListener( )
+{
+    lock_guard<mutex> lock( Sync );
+    return Listener;
+}
+
+// Notify listener about an error
+void XVideoFilterChainData::NotifyError( const string& errorMessage, bool fatal )
+{
+    IVideoSourceListener* listener = GetListener( );
+
+    if ( listener != nullptr )
+    {
+        listener->OnError( errorMessage, fatal );
+    }
+}
+
+// Run all filters on the image and pass result to the listener
+void XVideoFilterChainData::RunFilters( shared_ptr<XImage>& image )
+{
+    vector<shared_ptr<IVideoFilter>> filters;
+
+    // take a copy of the filter list, so that Add() may grow it while filters run
+    {
+        lock_guard<mutex> lock( Sync );
+
+        filters.reserve( Filters.size( ) );
+        for ( const FilterData& filterData : Filters )
+        {
+            filters.push_back( filterData.Filter );
+        }
+    }
+
+    for ( size_t i = 0; i < filters.size( ); i++ )
+    {
+        steady_clock::time_point startTime = steady_clock::now( );
+        XError                   ret       = filters[i]->Process( image, Pool );
+        uint32_t                 time      = static_cast<uint32_t>( duration_cast<microseconds>( steady_clock::now( ) - startTime ).count( ) );
+
+        {
+            // filters are only appended, so index still refers to the same filter
+            lock_guard<mutex> lock( Sync );
+            FilterData&       filterData = Filters[i];
+
+            filterData.Calls++;
+            filterData.LastTime   = time;
+            filterData.TotalTime += time;
+
+            if ( time > filterData.MaxTime )
+            {
+                filterData.MaxTime = time;
+            }
+        }
+
+        if ( ( !ret ) || ( !image ) )
+        {
+            NotifyError( filters[i]->Name( ) + " filter failed: " + ( ( image ) ? ret.ToString( ) : "no image provided" ), false );
+            return;
+        }
+    }
+
+    IVideoSourceListener* listener = GetListener( );
+
+    if ( listener != nullptr )
+    {
+        listener->OnNewImage( image );
+    }
+}
+
+// Thread running filters on the latest image provided by video source
+void XVideoFilterChainData::FilterThreadHandler( XVideoFilterChainData* me )
+{
+    shared_ptr<XImage> image;
+
+    while ( true )
+    {
+        me->NewImageEvent.Wait( );
+        me->NewImageEvent.Reset( );
+
+        if ( me->NeedToStop.IsSignaled( ) )
+        {
+            break;
+        }
+
+        // the acquired image belongs to this thread till the next call, so can be modified in place
+        while ( me->Images.Acquire( image ) )
+        {
+            me->RunFilters( image );
+        }
+    }
+}
+
+// Get processing time of the specified filter as JSON object
+XError FilterStatsInformation::GetProperty( const string& propertyName, string& value ) const
+{
+    XError ret = XError::UnknownProperty;
+
+    lock_guard<mutex> lock( Owner->Sync );
+
+    for ( const auto& filterData : Owner->Filters )
+    {
+        if ( filterData.Filter->Name( ) == propertyName )
+        {
+            char buffer[128];
+
+            sprintf( buffer, "{\"calls\":\"%u\",\"last\":\"%u\",\"average\":\"%u\",\"max\":\"%u\"}",
+                     filterData.Calls, filterData.LastTime,
+                     ( filterData.Calls == 0 ) ? 0 : static_cast<uint32_t>( filterData.TotalTime / filterData.Calls ),
+                     filterData.MaxTime );
+
+            value = buffer;
+            ret   = XError::Success;
+            break;
+        }
+    }
+
+    return ret;
+}
+
+// Get processing time of all filters
+PropertyMap FilterStatsInformation::GetAllProperties( ) const
+{
+    PropertyMap    properties;
+    vector<string> names;
+    string         value;
+
+    {
+        lock_guard<mutex> lock( Owner->Sync );
+
+        for ( const auto& filterData : Owner->Filters )
+        {
+            names.push_back( filterData.Filter->Name( ) );
+        }
+    }
+
+    for ( const auto& name : names )
+    {
+        if ( GetProperty( name, value ) )
+        {
+            properties.insert( PropertyMap::value_type( name, value ) );
+        }
+    }
+
+    return properties;
+}
+
+} // namespace Private
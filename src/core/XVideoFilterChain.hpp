@@ -0,0 +1,85 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XVIDEO_FILTER_CHAIN_HPP
+#define XVIDEO_FILTER_CHAIN_HPP
+
+#include <stdint.h>
+#include <memory>
+
+#include "XInterfaces.hpp"
+#include "IVideoFilter.hpp"
+#include "IVideoSourceListener.hpp"
+#include "IObjectInformation.hpp"
+
+namespace Private
+{
+    class XVideoFilterChainData;
+}
+
+// Processing time statistics of a video filter (microseconds)
+typedef struct
+{
+    uint32_t Calls;
+    uint32_t LastTime;
+    uint32_t AverageTime;
+    uint32_t MaxTime;
+}
+XVideoFilterTiming;
+
+/* Chain of video filters put between a video source and its listener.
+
+   The chain is set as listener of a video source and passes filtered images to its own listener.
+   Source image is copied only once into a pooled working image, which is then modified by filters
+   in place (or replaced by pooled images they output). Filtering is done either on the video
+   source's thread or on a dedicated thread, which always picks the latest frame.
+*/
+class XVideoFilterChain : public IVideoSourceListener, private Uncopyable
+{
+public:
+    XVideoFilterChain( bool useOwnThread = false );
+    ~XVideoFilterChain( );
+
+    // Add filter to the end of the chain (must be done before the chain gets any images)
+    void Add( const std::shared_ptr<IVideoFilter>& filter );
+
+    // Set listener to receive filtered images, returning the old one
+    IVideoSourceListener* SetListener( IVideoSourceListener* listener );
+
+    // Check if filters are run on a dedicated thread
+    bool UsesOwnThread( ) const;
+
+    // New video frame notification - run filters
+    void OnNewImage( const std::shared_ptr<const XImage>& image );
+    // Video source error notification - pass it further
+    void OnError( const std::string& errorMessage, bool fatal );
+
+    // Get number of filters in the chain and processing time statistics of the specified filter
+    uint32_t FilterCount( ) const;
+    XVideoFilterTiming FilterTiming( uint32_t index ) const;
+
+    // Create object providing processing time information of all filters
+    std::shared_ptr<IObjectInformation> CreateStatsInformation( ) const;
+
+private:
+    Private::XVideoFilterChainData* mData;
+};
+
+#endif // XVIDEO_FILTER_CHAIN_HPP
@@ -18,9 +18,14 @@
     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
 */
 
+#include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
 #include <mutex>
 #include <chrono>
+#include <map>
+#include <set>
+#include <vector>
 
 // If we have C++14, then shared_timed_mutex is a better option for BufferGuard,
 // so it could allow one writer and multiple readers. However mongoose web server
@@ -31,6 +36,12 @@
 
 #include "XVideoSourceToWeb.hpp"
 #include "XJpegEncoder.hpp"
+#include "XJpegEncoderPool.hpp"
+#include "XJpegTranscoder.hpp"
+#include "XSceneChangeDetector.hpp"
+#include "XTileDeltaEncoder.hpp"
+#include "XImageTripleBuffer.hpp"
+#include "XManualResetEvent.hpp"
 
 using namespace std;
 using namespace std::chrono;
@@ -39,6 +50,16 @@ namespace Private
 {
     #define JPEG_BUFFER_SIZE (1024 * 1024)
 
+    // Time to wait for the first image encoded by pool of encoders (milliseconds)
+    #define ENCODER_POOL_WAIT_TIME (2000)
+
+    // Interval of checking if on-demand video source provided its first image (milliseconds)
+    #define FIRST_IMAGE_POLL_INTERVAL (20)
+
+    // Types of messages sent by WebSocket handler in tiles mode
+    #define TILES_KEY_FRAME   (0)
+    #define TILES_DELTA_FRAME (1)
+
     // Listener for video source events
     class VideoListener : public IVideoSourceListener
     {
@@ -52,61 +73,213 @@ namespace Private
         void OnError( const string& errorMessage, bool fatal );
     };
 
-    // Web request handler providing camera images as JPEGs
-    class JpegRequestHandler : public IWebRequestHandler
+    // Base for web request handlers replying with camera images. While on-demand video source is
+    // starting, the reply is deferred with a timer, so web server's thread never waits for the first image.
+    class ImageRequestHandler : public IWebRequestHandler
     {
-    private:
+    protected:
         XVideoSourceToWebData* Owner;
 
+    private:
+        // connections waiting for video source to start (accessed only from web server's thread)
+        set<uintptr_t>         WaitingConnections;
+
     public:
-        JpegRequestHandler( const string& uri, XVideoSourceToWebData* owner ) :
-            IWebRequestHandler( uri, false ), Owner( owner )
+        ImageRequestHandler( const string& uri, XVideoSourceToWebData* owner ) :
+            IWebRequestHandler( uri, false ), Owner( owner ), WaitingConnections( )
         {
         }
 
         void HandleHttpRequest( const IWebRequest& request, IWebResponse& response );
+        void HandleTimer( IWebResponse& response );
+        void HandleConnectionClosed( IWebResponse& response );
+
+    protected:
+        // Reply to the request, when images are available
+        virtual void HandleImageRequest( IWebResponse& response ) = 0;
+        // Timer set by the reply (streaming handlers)
+        virtual void HandleStreamTimer( IWebResponse& /* response */ ) { }
+
+    private:
+        void Reply( IWebResponse& response );
+    };
+
+    // Web request handler providing camera images as JPEGs
+    class JpegRequestHandler : public ImageRequestHandler
+    {
+    public:
+        JpegRequestHandler( const string& uri, XVideoSourceToWebData* owner ) :
+            ImageRequestHandler( uri, owner )
+        {
+        }
+
+    protected:
+        void HandleImageRequest( IWebResponse& response );
     };
 
     // Web request handler providing camera images as MJPEG stream
-    class MjpegRequestHandler : public IWebRequestHandler
+    class MjpegRequestHandler : public ImageRequestHandler
     {
     private:
-        XVideoSourceToWebData* Owner;
         uint32_t               FrameInterval;
 
     public:
         MjpegRequestHandler( const string& uri, uint32_t frameRate, XVideoSourceToWebData* owner ) :
-            IWebRequestHandler( uri, false ), Owner( owner ), FrameInterval( 1000 / frameRate )
+            ImageRequestHandler( uri, owner ), FrameInterval( 1000 / frameRate )
+        {
+        }
+
+    protected:
+        void HandleImageRequest( IWebResponse& response );
+        void HandleStreamTimer( IWebResponse& response );
+    };
+
+    // Web request handler providing camera images in their native format
+    class RawRequestHandler : public ImageRequestHandler
+    {
+    public:
+        RawRequestHandler( const string& uri, XVideoSourceToWebData* owner ) :
+            ImageRequestHandler( uri, owner )
+        {
+        }
+
+    protected:
+        void HandleImageRequest( IWebResponse& response );
+    };
+
+    // Web request handler providing camera images in their native format as multipart stream
+    class RawStreamRequestHandler : public ImageRequestHandler
+    {
+    private:
+        uint32_t               FrameInterval;
+
+    public:
+        RawStreamRequestHandler( const string& uri, uint32_t frameRate, XVideoSourceToWebData* owner ) :
+            ImageRequestHandler( uri, owner ), FrameInterval( 1000 / frameRate )
+        {
+        }
+
+    protected:
+        void HandleImageRequest( IWebResponse& response );
+        void HandleStreamTimer( IWebResponse& response );
+    };
+
+    // Web request handler providing camera images as binary WebSocket messages. Clients acknowledge
+    // received frames and no more than the specified number of frames are sent without acknowledgement.
+    // In tiles mode only changed tiles of images are sent, while complete images (key frames) are sent
+    // from time to time or when a client missed some of the changes.
+    class WebSocketRequestHandler : public IWebRequestHandler
+    {
+    private:
+        // State of a connected client (accessed only from web server's thread)
+        struct ClientState
+        {
+            steady_clock::time_point         StartTime;
+            uint32_t                         LastFrameId;
+            uint32_t                         LastAckedFrameId;
+            uint32_t                         LastSequence;
+            uint32_t                         RoundTripTime;
+            vector<steady_clock::time_point> SendTimes;
+            bool                             NeedKeyFrame;
+            steady_clock::time_point         LastKeyFrameTime;
+        };
+
+        XVideoSourceToWebData*       Owner;
+        uint32_t                     FrameInterval;
+        uint32_t                     MaxFramesInFlight;
+        bool                         TilesMode;
+        uint32_t                     KeyFrameInterval;
+        map<uintptr_t, ClientState>  Clients;
+
+    public:
+        WebSocketRequestHandler( const string& uri, uint32_t frameRate, uint32_t maxFramesInFlight,
+                                 bool tilesMode, uint32_t keyFrameInterval, XVideoSourceToWebData* owner ) :
+            IWebRequestHandler( uri, false ), Owner( owner ), FrameInterval( 1000 / frameRate ),
+            MaxFramesInFlight( ( maxFramesInFlight == 0 ) ? 1 : maxFramesInFlight ),
+            TilesMode( tilesMode ), KeyFrameInterval( keyFrameInterval ), Clients( )
         {
         }
 
         void HandleHttpRequest( const IWebRequest& request, IWebResponse& response );
         void HandleTimer( IWebResponse& response );
+        bool HandleWebSocketConnect( const IWebRequest& request, IWebResponse& response );
+        void HandleWebSocketMessage( IWebResponse& response, const uint8_t* data, size_t length );
+        void HandleConnectionClosed( IWebResponse& response );
+    };
+
+    // Information about video source to web statistics
+    class StatsInformation : public IObjectInformation
+    {
+    private:
+        XVideoSourceToWebData* Owner;
+
+    public:
+        StatsInformation( XVideoSourceToWebData* owner ) : Owner( owner ) { }
+
+        XError GetProperty( const string& propertyName, string& value ) const;
+        PropertyMap GetAllProperties( ) const;
     };
 
     // Private implementation details for the XVideoSourceToWeb
     class XVideoSourceToWebData
     {
     public:
-        volatile bool      NewImageAvailable;
         volatile bool      VideoSourceError;
         XError             InternalError;
         uint8_t*           JpegBuffer;
         uint32_t           JpegBufferSize;
         uint32_t           JpegSize;
+        uint32_t           JpegSequence;
+        uint32_t           FramesEncoded;
+        uint32_t           FramesRepeated;
+        // headers describing the encoded image (motion state, etc.)
+        string             FrameMetadata;
+        const XMotionDetector* MotionDetector;
+        // queues of asynchronous listeners reported by statistics
+        vector<pair<string, const XAsyncVideoSourceListener*>> ListenerQueues;
+        mutex              QueuesGuard;
         VideoListener      VideoSourceListener;
+        // images are passed from video source's thread to web server's thread through the
+        // triple buffer, so that capture never waits for encoding (and vice versa)
+        XImageTripleBuffer CameraImages;
         shared_ptr<XImage> CameraImage;
+        uint32_t           CameraImageSequence;
+        bool               JpegIsUpToDate;
         string             VideoSourceErrorMessage;
         mutex              ImageGuard;
         mutex              BufferGuard;
         XJpegEncoder       JpegEncoder;
+        // uncompressed images are encoded concurrently, if there are more encoding threads
+        shared_ptr<XJpegEncoderPool> EncoderPool;
+        // JPEG images from video source are requantized to lower quality, if enabled
+        XJpegTranscoder    JpegTranscoder;
+        volatile bool      TranscodeJpeg;
+        // images of static scenes are not re-encoded, the previous JPEG is provided instead
+        XSceneChangeDetector SceneChanges;
+        uint16_t           EncodedQuality;
+        bool               JpegIsRepeat;
+        // tiles, which changed since the previous image (encoded only if there are clients for them)
+        XTileDeltaEncoder  TileEncoder;
+
+        // on-demand mode - video source is started when its images are requested
+        shared_ptr<IVideoSource>  OnDemandSource;
+        uint32_t                  FirstImageTimeout;
+        mutex                     OnDemandGuard;
+        steady_clock::time_point  LastImageRequestTime;
+        // set while started video source did not provide its first image and timeout did not expire
+        bool                      Starting;
+        steady_clock::time_point  FirstImageDeadline;
+        volatile bool             WaitingForImage;
+        XManualResetEvent         ImageArrivedEvent;
 
     public:
         XVideoSourceToWebData( uint16_t jpegQuality ) :
-            NewImageAvailable( false ), VideoSourceError( false ), InternalError( XError::Success ),
-            JpegBuffer( nullptr ), JpegBufferSize( 0 ), JpegSize( 0 ), VideoSourceListener( this ),
-            CameraImage( ), VideoSourceErrorMessage( ), ImageGuard( ), BufferGuard( ),
-            JpegEncoder( jpegQuality, true )
+            VideoSourceError( false ), InternalError( XError::Success ),
+            JpegBuffer( nullptr ), JpegBufferSize( 0 ), JpegSize( 0 ), JpegSequence( 0 ), FramesEncoded( 0 ), FramesRepeated( 0 ), FrameMetadata( ), MotionDetector( nullptr ), ListenerQueues( ), QueuesGuard( ), VideoSourceListener( this ),
+            CameraImages( ), CameraImage( ), CameraImageSequence( 0 ), JpegIsUpToDate( false ), VideoSourceErrorMessage( ), ImageGuard( ), BufferGuard( ),
+            JpegEncoder( jpegQuality, true ), EncoderPool( ), JpegTranscoder( jpegQuality ), TranscodeJpeg( false ), SceneChanges( ), EncodedQuality( 0 ), JpegIsRepeat( false ), TileEncoder( jpegQuality ),
+            OnDemandSource( ), FirstImageTimeout( 0 ), OnDemandGuard( ), LastImageRequestTime( ),
+            Starting( false ), FirstImageDeadline( ), WaitingForImage( false ), ImageArrivedEvent( )
         {
             // allocate initial buffer for JPEG images
             JpegBuffer = (uint8_t*) malloc( JPEG_BUFFER_SIZE );
@@ -126,7 +299,15 @@ namespace Private
 
         bool IsError( );
         void ReportError( IWebResponse& response );
+        void AcquireCameraImage( );
         void EncodeCameraImage( );
+        void EncodeCameraImageConcurrently( );
+        void TakeEncodedImages( uint32_t timeout );
+        void UpdateFrameMetadata( );
+        void EncodeCameraImageTiles( );
+        uint32_t RawImageSize( ) const;
+        void SendRawImage( IWebResponse& response, bool streamPart );
+        bool ActivateVideoSource( );
     };
 }
 
@@ -158,7 +339,95 @@ shared_ptr<IWebRequestHandler> XVideoSourceToWeb::CreateMjpegHandler( const stri
     return make_shared<Private::MjpegRequestHandler>( uri, frameRate, mData );
 }
 
-// Get/Set JPEG quality (valid only if camera provides uncompressed images)
+// Create web request handler to provide camera images in their native pixel format
+shared_ptr<IWebRequestHandler> XVideoSourceToWeb::CreateRawHandler( const string& uri ) const
+{
+    return make_shared<Private::RawRequestHandler>( uri, mData );
+}
+
+// Create web request handler to provide camera images in their native pixel format as multipart stream
+shared_ptr<IWebRequestHandler> XVideoSourceToWeb::CreateRawStreamHandler( const string& uri, uint32_t frameRate ) const
+{
+    return make_shared<Private::RawStreamRequestHandler>( uri, frameRate, mData );
+}
+
+// Create web request handler to provide camera images over WebSocket with flow control
+shared_ptr<IWebRequestHandler> XVideoSourceToWeb::CreateWebSocketHandler( const string& uri, uint32_t frameRate, uint32_t maxFramesInFlight ) const
+{
+    return make_shared<Private::WebSocketRequestHandler>( uri, frameRate, maxFramesInFlight, false, 0, mData );
+}
+
+// Create web request handler to provide changed tiles of camera images over WebSocket
+shared_ptr<IWebRequestHandler> XVideoSourceToWeb::CreateTilesStreamHandler( const string& uri, uint32_t frameRate,
+                                                                            uint32_t keyFrameInterval, uint32_t maxFramesInFlight ) const
+{
+    return make_shared<Private::WebSocketRequestHandler>( uri, frameRate, maxFramesInFlight, true, keyFrameInterval, mData );
+}
+
+// Get the latest camera image as JPEG
+XError XVideoSourceToWeb::GetJpegImage( uint8_t** buffer, uint32_t* bufferSize, uint32_t* jpegSize, uint32_t* sequence )
+{
+    XError ret = XError::Success;
+
+    if ( ( buffer == nullptr ) || ( bufferSize == nullptr ) || ( jpegSize == nullptr ) )
+    {
+        ret = XError::NullPointer;
+    }
+    else
+    {
+        // on-demand video source is not activated - only web clients count as somebody watching it
+        if ( !mData->IsError( ) )
+        {
+            mData->EncodeCameraImage( );
+        }
+
+        if ( mData->IsError( ) )
+        {
+            ret = ( mData->InternalError != XError::Success ) ? mData->InternalError : XError( XError::DeivceNotReady );
+        }
+        else
+        {
+            lock_guard<mutex> lock( mData->BufferGuard );
+
+            if ( mData->JpegSize == 0 )
+            {
+                ret = XError::DeivceNotReady;
+            }
+            else
+            {
+                if ( ( *buffer == nullptr ) || ( *bufferSize < mData->JpegSize ) )
+                {
+                    uint8_t* newBuffer = static_cast<uint8_t*>( realloc( *buffer, mData->JpegSize ) );
+
+                    if ( newBuffer == nullptr )
+                    {
+                        ret = XError::OutOfMemory;
+                    }
+                    else
+                    {
+                        *buffer     = newBuffer;
+                        *bufferSize = mData->JpegSize;
+                    }
+                }
+
+                if ( ret )
+                {
+                    memcpy( *buffer, mData->JpegBuffer, mData->JpegSize );
+                    *jpegSize = mData->JpegSize;
+
+                    if ( sequence != nullptr )
+                    {
+                        *sequence = mData->JpegSequence;
+                    }
+                }
+            }
+        }
+    }
+
+    return ret;
+}
+
+// Get/Set JPEG quality (applies to JPEG images coming from camera only if transcoding is enabled)
 uint16_t XVideoSourceToWeb::JpegQuality( ) const
 {
     return mData->JpegEncoder.Quality( );
@@ -166,26 +435,155 @@ uint16_t XVideoSourceToWeb::JpegQuality( ) const
 void XVideoSourceToWeb::SetJpegQuality( uint16_t quality )
 {
     mData->JpegEncoder.SetQuality( quality );
+    mData->JpegTranscoder.SetQuality( quality );
+    mData->TileEncoder.SetJpegQuality( quality );
+
+    lock_guard<mutex> lock( mData->BufferGuard );
+
+    if ( mData->EncoderPool )
+    {
+        mData->EncoderPool->SetQuality( quality );
+    }
+}
+
+// Get/Set transcoding of JPEG images coming from camera to the set quality
+bool XVideoSourceToWeb::JpegTranscoding( ) const
+{
+    return mData->TranscodeJpeg;
+}
+void XVideoSourceToWeb::SetJpegTranscoding( bool enable )
+{
+    mData->TranscodeJpeg = enable;
+}
+
+// Get/Set number of threads encoding uncompressed images
+uint32_t XVideoSourceToWeb::EncoderThreads( ) const
+{
+    lock_guard<mutex> lock( mData->BufferGuard );
+
+    return ( mData->EncoderPool ) ? mData->EncoderPool->EncodersCount( ) : 1;
+}
+void XVideoSourceToWeb::SetEncoderThreads( uint32_t count )
+{
+    lock_guard<mutex> lock( mData->BufferGuard );
+
+    if ( count > 1 )
+    {
+        mData->EncoderPool = make_shared<XJpegEncoderPool>( count, mData->JpegEncoder.Quality( ), true );
+    }
+    else
+    {
+        mData->EncoderPool.reset( );
+    }
+}
+
+// Get number of frames received from video source
+uint32_t XVideoSourceToWeb::FramesReceived( ) const
+{
+    return mData->CameraImages.ImagesPublished( );
+}
+
+// Get number of frames, which were replaced by newer ones before getting encoded
+uint32_t XVideoSourceToWeb::FramesSkipped( ) const
+{
+    return mData->CameraImages.ImagesSkipped( );
+}
+
+// Get number of encoded frames
+uint32_t XVideoSourceToWeb::FramesEncoded( ) const
+{
+    return mData->FramesEncoded;
+}
+
+// Get number of frames, which were not encoded since scene did not change
+uint32_t XVideoSourceToWeb::FramesRepeated( ) const
+{
+    return mData->FramesRepeated;
+}
+
+// Create object providing statistics information (frames received/skipped/encoded)
+shared_ptr<IObjectInformation> XVideoSourceToWeb::CreateStatsInformation( ) const
+{
+    return make_shared<Private::StatsInformation>( mData );
+}
+
+// Set motion detector, which state is provided together with JPEG images
+void XVideoSourceToWeb::SetMotionDetector( const XMotionDetector* motionDetector )
+{
+    lock_guard<mutex> lock( mData->BufferGuard );
+
+    mData->MotionDetector = motionDetector;
+}
+
+// Add asynchronous listener, whose queue is reported by statistics
+void XVideoSourceToWeb::AddListenerQueue( const string& name, const XAsyncVideoSourceListener* listener )
+{
+    lock_guard<mutex> lock( mData->QueuesGuard );
+
+    if ( listener != nullptr )
+    {
+        mData->ListenerQueues.push_back( make_pair( name, listener ) );
+    }
+}
+
+// Enable on-demand mode for the specified video source
+void XVideoSourceToWeb::EnableOnDemandMode( const shared_ptr<IVideoSource>& videoSource, uint32_t firstImageTimeout )
+{
+    lock_guard<mutex> lock( mData->OnDemandGuard );
+
+    mData->OnDemandSource       = videoSource;
+    mData->FirstImageTimeout    = firstImageTimeout;
+    mData->LastImageRequestTime = steady_clock::now( );
+}
+
+// Get time (milliseconds) since images were requested last time
+uint32_t XVideoSourceToWeb::VideoSourceIdleTime( )
+{
+    lock_guard<mutex> lock( mData->OnDemandGuard );
+
+    return static_cast<uint32_t>( duration_cast<milliseconds>( steady_clock::now( ) - mData->LastImageRequestTime ).count( ) );
+}
+
+// Stop on-demand video source if its images were not requested for the specified time
+bool XVideoSourceToWeb::StopIdleVideoSource( uint32_t idleTimeout )
+{
+    lock_guard<mutex> lock( mData->OnDemandGuard );
+    bool              stopped = false;
+
+    if ( ( mData->OnDemandSource ) && ( mData->OnDemandSource->IsRunning( ) ) &&
+         ( duration_cast<milliseconds>( steady_clock::now( ) - mData->LastImageRequestTime ).count( ) >= idleTimeout ) )
+    {
+        mData->OnDemandSource->SignalToStop( );
+        mData->OnDemandSource->WaitForStop( );
+        mData->Starting        = false;
+        mData->WaitingForImage = false;
+        stopped = true;
+    }
+
+    return stopped;
 }
 
 namespace Private
 {
 
-// On new image from video source - make a copy of it
+// On new image from video source - make a copy of it (never waits for the web side)
 void VideoListener::OnNewImage( const shared_ptr<const XImage>& image )
 {
-    lock_guard<mutex> lock( Owner->ImageGuard );
+    Owner->InternalError = Owner->CameraImages.Publish( image );
 
-    Owner->InternalError = image->CopyDataOrClone( Owner->CameraImage );
-    
-    if ( Owner->InternalError == XError::Success )
+    if ( Owner->WaitingForImage )
     {
-        Owner->NewImageAvailable = true;
+        Owner->ImageArrivedEvent.Signal( );
     }
 
     // since we got an image from video source, clear any error reported by it
-    Owner->VideoSourceErrorMessage.clear( );
-    Owner->VideoSourceError = false;
+    if ( Owner->VideoSourceError )
+    {
+        lock_guard<mutex> lock( Owner->ImageGuard );
+
+        Owner->VideoSourceErrorMessage.clear( );
+        Owner->VideoSourceError = false;
+    }
 }
 
 // An error coming from video source
@@ -195,10 +593,54 @@ void VideoListener::OnError( const string& errorMessage, bool /* fatal */ )
 
     Owner->VideoSourceErrorMessage = errorMessage;
     Owner->VideoSourceError = true;
+
+    if ( Owner->WaitingForImage )
+    {
+        Owner->ImageArrivedEvent.Signal( );
+    }
+}
+
+// Handle request for camera images - reply now or when on-demand video source gets started
+void ImageRequestHandler::HandleHttpRequest( const IWebRequest& /* request */, IWebResponse& response )
+{
+    Reply( response );
+}
+
+// Timer event for the connection - either it waits for video source or the reply set it
+void ImageRequestHandler::HandleTimer( IWebResponse& response )
+{
+    if ( WaitingConnections.erase( response.ConnectionId( ) ) != 0 )
+    {
+        Reply( response );
+    }
+    else
+    {
+        HandleStreamTimer( response );
+    }
+}
+
+// Connection got closed - forget it if it was waiting for video source
+void ImageRequestHandler::HandleConnectionClosed( IWebResponse& response )
+{
+    WaitingConnections.erase( response.ConnectionId( ) );
+}
+
+// Reply to the request if video source is ready, or check it again a bit later
+void ImageRequestHandler::Reply( IWebResponse& response )
+{
+    if ( Owner->ActivateVideoSource( ) )
+    {
+        HandleImageRequest( response );
+    }
+    else
+    {
+        WaitingConnections.insert( response.ConnectionId( ) );
+        response.SetTimer( FIRST_IMAGE_POLL_INTERVAL );
+    }
 }
 
 // Handle JPEG request - provide current camera image
-void JpegRequestHandler::HandleHttpRequest( const IWebRequest& /* request */, IWebResponse& response )
+void JpegRequestHandler::HandleImageRequest( IWebResponse& response )
 {
     if ( !Owner->IsError( ) )
     {
@@ -222,8 +664,9 @@ void JpegRequestHandler::HandleHttpRequest( const IWebRequest& /* request */, IW
             response.Printf( "HTTP/1.1 200 OK\r\n"
                              "Content-Type: image/jpeg\r\n"
                              "Content-Length: %u\r\n"
+                             "%s"
                              "Cache-Control: no-store, must-revalidate\r\nPragma: no-cache\r\nExpires: 0\r\n"
-                             "\r\n",  Owner->JpegSize );
+                             "\r\n",  Owner->JpegSize, Owner->FrameMetadata.c_str( ) );
     
             response.Send( Owner->JpegBuffer, Owner->JpegSize );
         }
@@ -231,7 +674,7 @@ void JpegRequestHandler::HandleHttpRequest( const IWebRequest& /* request */, IW
 }
 
 // Handle MJPEG request - continuously provide camera images as MJPEG stream
-void MjpegRequestHandler::HandleHttpRequest( const IWebRequest& /* request */, IWebResponse& response )
+void MjpegRequestHandler::HandleImageRequest( IWebResponse& response )
 {
     uint32_t handlingTime = 0;
 
@@ -269,7 +712,8 @@ void MjpegRequestHandler::HandleHttpRequest( const IWebRequest& /* request */, I
             response.Printf( "--myboundary\r\n"
                              "Content-Type: image/jpeg\r\n"
                              "Content-Length: %u\r\n"
-                             "\r\n",  Owner->JpegSize );
+                             "%s"
+                             "\r\n",  Owner->JpegSize, Owner->FrameMetadata.c_str( ) );
     
             response.Send( Owner->JpegBuffer, Owner->JpegSize );
     
@@ -283,10 +727,17 @@ void MjpegRequestHandler::HandleHttpRequest( const IWebRequest& /* request */, I
 }
 
 // Timer event for then connection handling MJPEG request - provide new image
-void MjpegRequestHandler::HandleTimer( IWebResponse& response )
+void MjpegRequestHandler::HandleStreamTimer( IWebResponse& response )
 {
     uint32_t handlingTime = 0;
 
+    // video source was stopped and is starting again
+    if ( !Owner->ActivateVideoSource( ) )
+    {
+        response.SetTimer( FrameInterval );
+        return;
+    }
+
     if ( !Owner->IsError( ) )
     {
         steady_clock::time_point startTime = steady_clock::now( );
@@ -312,7 +763,8 @@ void MjpegRequestHandler::HandleTimer( IWebResponse& response )
             response.Printf( "--myboundary\r\n"
                              "Content-Type: image/jpeg\r\n"
                              "Content-Length: %u\r\n"
-                             "\r\n",  Owner->JpegSize );
+                             "%s"
+                             "\r\n",  Owner->JpegSize, Owner->FrameMetadata.c_str( ) );
             response.Send( Owner->JpegBuffer, Owner->JpegSize );
         }
 
@@ -324,77 +776,743 @@ void MjpegRequestHandler::HandleTimer( IWebResponse& response )
     }
 }
 
-// Check if any errors happened
-bool XVideoSourceToWebData::IsError( )
+// Handle raw image request - provide current camera image in its native format
+void RawRequestHandler::HandleImageRequest( IWebResponse& response )
 {
-    return ( ( InternalError != XError::Success ) || ( VideoSourceError ) );
-}
+    if ( !Owner->IsError( ) )
+    {
+        Owner->AcquireCameraImage( );
+    }
 
-// Report an error as HTTP response
-void XVideoSourceToWebData::ReportError( IWebResponse& response )
-{
-    if ( InternalError != XError::Success )
+    if ( Owner->IsError( ) )
     {
-        response.SendError( 500, InternalError.ToString( ).c_str( ) );
+        Owner->ReportError( response );
     }
-    else if ( VideoSourceError )
+    else
     {
-        lock_guard<mutex> imageLock( ImageGuard );
+        lock_guard<mutex> lock( Owner->BufferGuard );
 
-        response.SendError( 500, VideoSourceErrorMessage.c_str( ) );
+        if ( !Owner->CameraImage )
+        {
+            response.SendError( 500, "No image from video source" );
+        }
+        else
+        {
+            Owner->SendRawImage( response, false );
+        }
     }
 }
 
-// Encode current camera image as JPEG
-void XVideoSourceToWebData::EncodeCameraImage( )
+// Handle raw stream request - continuously provide camera images in their native format
+void RawStreamRequestHandler::HandleImageRequest( IWebResponse& response )
 {
-    if ( NewImageAvailable )
+    if ( !Owner->IsError( ) )
     {
-        lock_guard<mutex> imageLock( ImageGuard );
-        lock_guard<mutex> bufferLock( BufferGuard );
+        Owner->AcquireCameraImage( );
+    }
 
-        if ( JpegBuffer == nullptr )
+    if ( Owner->IsError( ) )
+    {
+        Owner->ReportError( response );
+    }
+    else
+    {
+        lock_guard<mutex> lock( Owner->BufferGuard );
+
+        if ( !Owner->CameraImage )
         {
-            InternalError = XError::OutOfMemory;
+            response.SendError( 500, "No image from video source" );
         }
         else
         {
-            if ( CameraImage->Format( ) == XPixelFormat::JPEG )
-            {
-                // check allocated buffer size
-                if ( JpegBufferSize < static_cast<uint32_t>( CameraImage->Width( ) ) )
-                {
-                    // make new size 10% bigger than needed
-                    uint32_t newSize = CameraImage->Width( ) + CameraImage->Width( ) / 10;
+            response.Printf( "HTTP/1.1 200 OK\r\n"
+                             "Cache-Control: no-store, must-revalidate\r\nPragma: no-cache\r\nExpires: 0\r\n"
+                             "Connection: close\r\n"
+                             "Content-Type: multipart/x-mixed-replace; boundary=--myboundary\r\n"
+                             "\r\n" );
 
-                    JpegBuffer = (uint8_t*) realloc( JpegBuffer, newSize );
-                    if ( JpegBuffer != nullptr )
-                    {
-                        JpegBufferSize = newSize;
-                    }
-                    else
+            Owner->SendRawImage( response, true );
+
+            response.SetTimer( FrameInterval );
+        }
+    }
+}
+
+// Timer event for the connection handling raw stream request - provide new image
+void RawStreamRequestHandler::HandleStreamTimer( IWebResponse& response )
+{
+    uint32_t handlingTime = 0;
+
+    // video source was stopped and is starting again
+    if ( !Owner->ActivateVideoSource( ) )
+    {
+        response.SetTimer( FrameInterval );
+        return;
+    }
+
+    if ( Owner->IsError( ) )
+    {
+        response.CloseConnection( );
+    }
+    else
+    {
+        steady_clock::time_point startTime = steady_clock::now( );
+        bool                     noImage;
+
+        Owner->AcquireCameraImage( );
+
+        {
+            lock_guard<mutex> lock( Owner->BufferGuard );
+
+            noImage = ( !Owner->CameraImage );
+
+            // raw images are big, so don't queue more than one on slow connections
+            if ( ( !noImage ) && ( response.ToSendDataLength( ) < Owner->RawImageSize( ) ) )
+            {
+                Owner->SendRawImage( response, true );
+            }
+        }
+
+        if ( noImage )
+        {
+            response.CloseConnection( );
+            return;
+        }
+
+        handlingTime = static_cast<uint32_t>( duration_cast<std::chrono::milliseconds>( steady_clock::now( ) - startTime ).count( ) );
+
+        response.SetTimer( ( handlingTime >= FrameInterval ) ? 1 : FrameInterval - handlingTime );
+    }
+}
+
+// Put 32 bit value into buffer using big-endian byte order
+static void WriteUInt32BE( uint8_t* buffer, uint32_t value )
+{
+    buffer[0] = static_cast<uint8_t>( value >> 24 );
+    buffer[1] = static_cast<uint8_t>( value >> 16 );
+    buffer[2] = static_cast<uint8_t>( value >> 8 );
+    buffer[3] = static_cast<uint8_t>( value );
+}
+
+// Plain HTTP request to WebSocket handler - not supported
+void WebSocketRequestHandler::HandleHttpRequest( const IWebRequest& /* request */, IWebResponse& response )
+{
+    response.SendError( 400, "WebSocket connection is expected" );
+}
+
+// New WebSocket client - start sending images to it as soon as handshake is done
+bool WebSocketRequestHandler::HandleWebSocketConnect( const IWebRequest& /* request */, IWebResponse& response )
+{
+    ClientState& client = Clients[response.ConnectionId( )];
+
+    client.StartTime        = steady_clock::now( );
+    client.LastFrameId      = 0;
+    client.LastAckedFrameId = 0;
+    client.LastSequence     = 0;
+    client.RoundTripTime    = 0;
+    client.SendTimes.assign( MaxFramesInFlight, client.StartTime );
+    client.NeedKeyFrame     = true;
+    client.LastKeyFrameTime = client.StartTime;
+
+    response.SetTimer( 1 );
+
+    return true;
+}
+
+// Timer event for the WebSocket connection - send new image if client is not behind
+void WebSocketRequestHandler::HandleTimer( IWebResponse& response )
+{
+    map<uintptr_t, ClientState>::iterator itClient = Clients.find( response.ConnectionId( ) );
+    uint32_t                              handlingTime = 0;
+
+    if ( itClient == Clients.end( ) )
+    {
+        return;
+    }
+
+    ClientState& client = itClient->second;
+
+    // don't wait for on-demand video source to start, check it again a bit later
+    if ( !Owner->ActivateVideoSource( ) )
+    {
+        response.SetTimer( FIRST_IMAGE_POLL_INTERVAL );
+        return;
+    }
+
+    steady_clock::time_point startTime = steady_clock::now( );
+
+    if ( !Owner->IsError( ) )
+    {
+        Owner->EncodeCameraImage( );
+
+        if ( TilesMode )
+        {
+            Owner->EncodeCameraImageTiles( );
+        }
+    }
+
+    if ( ( Owner->IsError( ) ) || ( Owner->JpegSize == 0 ) )
+    {
+        response.CloseConnection( );
+    }
+    else
+    {
+        lock_guard<mutex> lock( Owner->BufferGuard );
+
+        // no frames are queued while client did not confirm enough of the previous ones, so
+        // the latest image is always sent when it catches up
+        if ( ( client.LastFrameId - client.LastAckedFrameId < MaxFramesInFlight ) && ( Owner->JpegSequence != client.LastSequence ) )
+        {
+            steady_clock::time_point now = steady_clock::now( );
+            uint32_t                 time = static_cast<uint32_t>( duration_cast<std::chrono::milliseconds>( now - client.StartTime ).count( ) );
+            uint8_t                  header[28];
+            bool                     sendDelta   = false;
+            bool                     sendMessage = true;
+
+            if ( TilesMode )
+            {
+                if ( duration_cast<std::chrono::milliseconds>( now - client.LastKeyFrameTime ).count( ) >= KeyFrameInterval )
+                {
+                    client.NeedKeyFrame = true;
+                }
+
+                // delta can be used only if client has exactly the image it is based on
+                sendDelta = ( ( !client.NeedKeyFrame ) &&
+                              ( Owner->TileEncoder.BaseSequence( ) != 0 ) &&
+                              ( Owner->TileEncoder.BaseSequence( ) == client.LastSequence ) &&
+                              ( Owner->TileEncoder.Sequence( ) == Owner->JpegSequence ) );
+
+                if ( ( sendDelta ) && ( Owner->TileEncoder.TilesCount( ) == 0 ) )
+                {
+                    // nothing changed - client already has the image
+                    client.LastSequence = Owner->JpegSequence;
+                    sendMessage         = false;
+                }
+            }
+
+            if ( sendMessage )
+            {
+                client.LastFrameId++;
+                client.LastSequence = Owner->JpegSequence;
+                client.SendTimes[client.LastFrameId % MaxFramesInFlight] = now;
+
+                // message prefix: frame ID, server time (ms), last round trip time (ms), frames in flight / limit
+                WriteUInt32BE( header,      client.LastFrameId );
+                WriteUInt32BE( header + 4,  time );
+                WriteUInt32BE( header + 8,  client.RoundTripTime );
+                WriteUInt32BE( header + 12, ( ( client.LastFrameId - client.LastAckedFrameId ) << 16 ) | MaxFramesInFlight );
+
+                if ( !TilesMode )
+                {
+                    response.SendWebSocketMessage( header, 16, Owner->JpegBuffer, Owner->JpegSize );
+                }
+                else if ( sendDelta )
+                {
+                    // type, reserved, number of tiles and then the tiles
+                    header[16] = TILES_DELTA_FRAME;
+                    header[17] = 0;
+                    header[18] = static_cast<uint8_t>( Owner->TileEncoder.TilesCount( ) >> 8 );
+                    header[19] = static_cast<uint8_t>( Owner->TileEncoder.TilesCount( ) );
+
+                    response.SendWebSocketMessage( header, 20, Owner->TileEncoder.DeltaData( ), Owner->TileEncoder.DeltaSize( ) );
+                }
+                else
+                {
+                    // key frame is a single tile covering complete image
+                    header[16] = TILES_KEY_FRAME;
+                    header[17] = 0;
+                    header[18] = 0;
+                    header[19] = 1;
+                    WriteUInt32BE( header + 20, 0 );
+                    WriteUInt32BE( header + 24, Owner->JpegSize );
+
+                    response.SendWebSocketMessage( header, 28, Owner->JpegBuffer, Owner->JpegSize );
+
+                    client.NeedKeyFrame     = false;
+                    client.LastKeyFrameTime = now;
+                }
+            }
+        }
+
+        handlingTime = static_cast<uint32_t>( duration_cast<std::chrono::milliseconds>( steady_clock::now( ) - startTime ).count( ) );
+
+        response.SetTimer( ( handlingTime >= FrameInterval ) ? 1 : FrameInterval - handlingTime );
+    }
+}
+
+// Message from WebSocket client - acknowledgement of received frame (its ID as text)
+void WebSocketRequestHandler::HandleWebSocketMessage( IWebResponse& response, const uint8_t* data, size_t length )
+{
+    map<uintptr_t, ClientState>::iterator itClient = Clients.find( response.ConnectionId( ) );
+
+    if ( itClient != Clients.end( ) )
+    {
+        ClientState& client  = itClient->second;
+        string       message( reinterpret_cast<const char*>( data ), length );
+        uint32_t     frameId = static_cast<uint32_t>( strtoul( message.c_str( ), nullptr, 10 ) );
+
+        if ( message == "key" )
+        {
+            // client asks for complete image (in tiles mode)
+            client.NeedKeyFrame = true;
+        }
+
+        // acknowledgement confirms all the previous frames as well
+        if ( ( frameId > client.LastAckedFrameId ) && ( frameId <= client.LastFrameId ) )
+        {
+            client.LastAckedFrameId = frameId;
+            client.RoundTripTime    = static_cast<uint32_t>( duration_cast<std::chrono::milliseconds>(
+                                      steady_clock::now( ) - client.SendTimes[frameId % MaxFramesInFlight] ).count( ) );
+        }
+    }
+}
+
+// WebSocket client has gone
+void WebSocketRequestHandler::HandleConnectionClosed( IWebResponse& response )
+{
+    Clients.erase( response.ConnectionId( ) );
+}
+
+// Update changed tiles for the current camera image (if not done yet)
+void XVideoSourceToWebData::EncodeCameraImageTiles( )
+{
+    lock_guard<mutex> bufferLock( BufferGuard );
+
+    if ( ( CameraImage ) && ( CameraImage->Format( ) != XPixelFormat::JPEG ) && ( TileEncoder.Sequence( ) != CameraImageSequence ) )
+    {
+        if ( TileEncoder.Update( CameraImage, CameraImageSequence ) != XError::Success )
+        {
+            // clients will get key frames only
+            TileEncoder.Reset( );
+        }
+    }
+}
+
+// Check if any errors happened
+bool XVideoSourceToWebData::IsError( )
+{
+    return ( ( InternalError != XError::Success ) || ( VideoSourceError ) );
+}
+
+// Report an error as HTTP response
+void XVideoSourceToWebData::ReportError( IWebResponse& response )
+{
+    if ( InternalError != XError::Success )
+    {
+        response.SendError( 500, InternalError.ToString( ).c_str( ) );
+    }
+    else if ( VideoSourceError )
+    {
+        lock_guard<mutex> imageLock( ImageGuard );
+
+        response.SendError( 500, VideoSourceErrorMessage.c_str( ) );
+    }
+}
+
+// Take the latest camera image from the triple buffer (if there is a new one)
+void XVideoSourceToWebData::AcquireCameraImage( )
+{
+    if ( CameraImages.IsNewImageAvailable( ) )
+    {
+        lock_guard<mutex> bufferLock( BufferGuard );
+
+        if ( CameraImages.Acquire( CameraImage, &CameraImageSequence ) )
+        {
+            JpegIsUpToDate = false;
+        }
+    }
+}
+
+// Encode current camera image as JPEG
+void XVideoSourceToWebData::EncodeCameraImage( )
+{
+    AcquireCameraImage( );
+
+    lock_guard<mutex> bufferLock( BufferGuard );
+
+    if ( ( EncoderPool ) && ( CameraImage ) && ( CameraImage->Format( ) != XPixelFormat::JPEG ) )
+    {
+        EncodeCameraImageConcurrently( );
+    }
+    else if ( ( CameraImage ) && ( !JpegIsUpToDate ) )
+    {
+        JpegIsUpToDate = true;
+        JpegIsRepeat   = false;
+        JpegSequence   = CameraImageSequence;
+
+        if ( JpegBuffer == nullptr )
+        {
+            InternalError = XError::OutOfMemory;
+        }
+        else
+        {
+            if ( CameraImage->Format( ) == XPixelFormat::JPEG )
+            {
+                bool transcoded = false;
+
+                if ( TranscodeJpeg )
+                {
+                    // requantize to lower quality (buffer is re-allocated if too small by transcoder)
+                    JpegSize   = JpegBufferSize;
+                    transcoded = ( JpegTranscoder.TranscodeToMemory( CameraImage, &JpegBuffer, &JpegSize ) == XError::Success );
+
+                    if ( ( transcoded ) && ( JpegBufferSize < JpegSize ) )
                     {
-                        InternalError = XError::OutOfMemory;
+                        JpegBufferSize = JpegSize;
                     }
                 }
 
-                if ( JpegBuffer != nullptr )
+                if ( !transcoded )
                 {
-                    // just copy JPEG data if we got already encoded image
-                    memcpy( JpegBuffer, CameraImage->Data( ), CameraImage->Width( ) );
-                    JpegSize = CameraImage->Width( );
+                    // check allocated buffer size
+                    if ( JpegBufferSize < static_cast<uint32_t>( CameraImage->Width( ) ) )
+                    {
+                        // make new size 10% bigger than needed
+                        uint32_t newSize = CameraImage->Width( ) + CameraImage->Width( ) / 10;
+
+                        JpegBuffer = (uint8_t*) realloc( JpegBuffer, newSize );
+                        if ( JpegBuffer != nullptr )
+                        {
+                            JpegBufferSize = newSize;
+                        }
+                        else
+                        {
+                            InternalError = XError::OutOfMemory;
+                        }
+                    }
+
+                    if ( JpegBuffer != nullptr )
+                    {
+                        // just copy JPEG data if we got already encoded image
+                        memcpy( JpegBuffer, CameraImage->Data( ), CameraImage->Width( ) );
+                        JpegSize = CameraImage->Width( );
+                    }
                 }
             }
+            else if ( ( !SceneChanges.IsChanged( CameraImage ) ) && ( JpegSize != 0 ) &&
+                      ( EncodedQuality == JpegEncoder.Quality( ) ) )
+            {
+                // nothing changed noticeably since the last encoded image, so it is provided again
+                JpegIsRepeat = true;
+            }
             else
             {
                 // encode image as JPEG (buffer is re-allocated if too small by encoder)
-                JpegSize      = JpegBufferSize;
-                InternalError = JpegEncoder.EncodeToMemory( CameraImage, &JpegBuffer, &JpegSize );
+                EncodedQuality = JpegEncoder.Quality( );
+                JpegSize       = JpegBufferSize;
+                InternalError  = JpegEncoder.EncodeToMemory( CameraImage, &JpegBuffer, &JpegSize );
+
+                if ( InternalError == XError::Success )
+                {
+                    SceneChanges.UpdateReference( );
+                }
+                else
+                {
+                    SceneChanges.Reset( );
+                }
+            }
+
+            if ( JpegIsRepeat )
+            {
+                FramesRepeated++;
             }
+            else
+            {
+                FramesEncoded++;
+            }
+
+            UpdateFrameMetadata( );
         }
+    }
+}
+
+// Submit current camera image to the pool of encoders and take images it encoded so far (BufferGuard
+// must be locked). Waits for the pool only if there is no JPEG to provide yet.
+void XVideoSourceToWebData::EncodeCameraImageConcurrently( )
+{
+    TakeEncodedImages( 0 );
+
+    if ( !JpegIsUpToDate )
+    {
+        if ( ( !SceneChanges.IsChanged( CameraImage ) ) && ( JpegSize != 0 ) &&
+             ( EncodedQuality == EncoderPool->Quality( ) ) && ( EncoderPool->InFlight( ) == 0 ) )
+        {
+            // nothing changed noticeably since the last encoded image, so it is provided again
+            JpegIsUpToDate = true;
+            JpegIsRepeat   = true;
+            JpegSequence   = CameraImageSequence;
 
-        NewImageAvailable = false;
+            FramesRepeated++;
+            UpdateFrameMetadata( );
+        }
+        else if ( EncoderPool->Submit( CameraImage, CameraImageSequence ) == XError::Success )
+        {
+            // if all encoders are busy, the image is submitted next time (unless a newer one replaces it)
+            JpegIsUpToDate = true;
+            EncodedQuality = EncoderPool->Quality( );
+            SceneChanges.UpdateReference( );
+        }
     }
+
+    if ( JpegSize == 0 )
+    {
+        TakeEncodedImages( ENCODER_POOL_WAIT_TIME );
+    }
+}
+
+// Take images encoded by the pool in their order, so the latest of them ends in the JPEG buffer (BufferGuard
+// must be locked). Waits the specified time (milliseconds) for the first one only.
+void XVideoSourceToWebData::TakeEncodedImages( uint32_t timeout )
+{
+    uint32_t sequence = 0;
+    XError   error;
+
+    while ( ( error = EncoderPool->Take( &JpegBuffer, &JpegBufferSize, &JpegSize, &sequence, timeout ) ) != XError::DeivceNotReady )
+    {
+        InternalError = error;
+        timeout       = 0;
+
+        if ( error == XError::Success )
+        {
+            JpegIsRepeat = false;
+            JpegSequence = sequence;
+
+            FramesEncoded++;
+            UpdateFrameMetadata( );
+        }
+        else
+        {
+            SceneChanges.Reset( );
+        }
+    }
+}
+
+// Describe the just encoded image with extra headers (BufferGuard must be locked)
+void XVideoSourceToWebData::UpdateFrameMetadata( )
+{
+    FrameMetadata.clear( );
+
+    if ( JpegIsRepeat )
+    {
+        FrameMetadata = "X-Image-Repeated: 1\r\n";
+    }
+
+    if ( MotionDetector != nullptr )
+    {
+        XMotionDetector::MotionState state = MotionDetector->GetMotionState( );
+        char                         buffer[128];
+
+        sprintf( buffer, "X-Motion-Level: %u\r\n"
+                         "X-Motion-Region: %d,%d,%d,%d\r\n",
+                         static_cast<uint32_t>( state.Level ), state.X, state.Y, state.Width, state.Height );
+
+        FrameMetadata += buffer;
+    }
+}
+
+// Get size of the current camera image's data (BufferGuard must be locked)
+uint32_t XVideoSourceToWebData::RawImageSize( ) const
+{
+    return ( CameraImage->Format( ) == XPixelFormat::JPEG ) ? static_cast<uint32_t>( CameraImage->Width( ) ) :
+                                                              static_cast<uint32_t>( CameraImage->Stride( ) * CameraImage->Height( ) );
+}
+
+// Send current camera image as it is, either as complete response or as part of multipart stream (BufferGuard must be locked)
+void XVideoSourceToWebData::SendRawImage( IWebResponse& response, bool streamPart )
+{
+    static const char* formatNames[] = { "Unknown", "Grayscale8", "RGB24", "RGBA32", "JPEG" };
+
+    XPixelFormat format    = CameraImage->Format( );
+    int          formatId  = static_cast<int>( format );
+    uint32_t     imageSize = RawImageSize( );
+
+    if ( streamPart )
+    {
+        response.Printf( "--myboundary\r\n" );
+    }
+    else
+    {
+        response.Printf( "HTTP/1.1 200 OK\r\n"
+                         "Cache-Control: no-store, must-revalidate\r\nPragma: no-cache\r\nExpires: 0\r\n" );
+    }
+
+    response.Printf( "Content-Type: %s\r\n"
+                     "Content-Length: %u\r\n"
+                     "X-Image-Width: %d\r\n"
+                     "X-Image-Height: %d\r\n"
+                     "X-Image-Stride: %d\r\n"
+                     "X-Image-Format: %s\r\n"
+                     "X-Image-Sequence: %u\r\n"
+                     "\r\n",
+                     ( format == XPixelFormat::JPEG ) ? "image/jpeg" : "application/octet-stream",
+                     imageSize, CameraImage->Width( ), CameraImage->Height( ), CameraImage->Stride( ),
+                     ( formatId < static_cast<int>( sizeof( formatNames ) / sizeof( formatNames[0] ) ) ) ? formatNames[formatId] : "Unknown",
+                     CameraImageSequence );
+
+    response.Send( CameraImage->Data( ), imageSize );
+}
+
+// Start on-demand video source if it is not running. Returns false while started video source did not
+// provide its first image (or error) and the first image timeout did not expire yet, true otherwise.
+bool XVideoSourceToWebData::ActivateVideoSource( )
+{
+    lock_guard<mutex> lock( OnDemandGuard );
+    bool              ready = true;
+
+    if ( OnDemandSource )
+    {
+        steady_clock::time_point now = steady_clock::now( );
+
+        LastImageRequestTime = now;
+
+        if ( ( !Starting ) && ( !OnDemandSource->IsRunning( ) ) )
+        {
+            {
+                lock_guard<mutex> bufferLock( BufferGuard );
+                lock_guard<mutex> imageLock( ImageGuard );
+
+                // forget anything left from the previous run
+                CameraImages.Acquire( CameraImage );
+                CameraImage.reset( );
+                JpegSize      = 0;
+                InternalError = XError::Success;
+
+                VideoSourceErrorMessage.clear( );
+                VideoSourceError = false;
+            }
+
+            ImageArrivedEvent.Reset( );
+            WaitingForImage = true;
+
+            if ( OnDemandSource->Start( ) )
+            {
+                Starting           = true;
+                FirstImageDeadline = now + milliseconds( FirstImageTimeout );
+            }
+            else
+            {
+                WaitingForImage = false;
+            }
+        }
+
+        if ( Starting )
+        {
+            if ( ( ImageArrivedEvent.IsSignaled( ) ) || ( now >= FirstImageDeadline ) )
+            {
+                Starting        = false;
+                WaitingForImage = false;
+            }
+            else
+            {
+                ready = false;
+            }
+        }
+    }
+
+    return ready;
+}
+
+// Get the specified statistics property
+XError StatsInformation::GetProperty( const string& propertyName, string& value ) const
+{
+    XError   ret     = XError::Success;
+    uint32_t counter = 0;
+    char     buffer[32];
+
+    if ( propertyName == "framesReceived" )
+    {
+        counter = Owner->CameraImages.ImagesPublished( );
+    }
+    else if ( propertyName == "framesSkipped" )
+    {
+        counter = Owner->CameraImages.ImagesSkipped( );
+    }
+    else if ( propertyName == "framesEncoded" )
+    {
+        counter = Owner->FramesEncoded;
+    }
+    else if ( propertyName == "framesRepeated" )
+    {
+        counter = Owner->FramesRepeated;
+    }
+    else
+    {
+        lock_guard<mutex> lock( Owner->QueuesGuard );
+
+        ret = XError::UnknownProperty;
+
+        for ( const auto& queue : Owner->ListenerQueues )
+        {
+            if ( propertyName.compare( 0, queue.first.length( ), queue.first ) == 0 )
+            {
+                string counterName = propertyName.substr( queue.first.length( ) );
+
+                ret = XError::Success;
+
+                if ( counterName == "QueueDepth" )
+                {
+                    counter = queue.second->QueueDepth( );
+                }
+                else if ( counterName == "FramesDelivered" )
+                {
+                    counter = queue.second->FramesDelivered( );
+                }
+                else if ( counterName == "FramesDropped" )
+                {
+                    counter = queue.second->FramesDropped( );
+                }
+                else
+                {
+                    ret = XError::UnknownProperty;
+                }
+
+                if ( ret )
+                {
+                    break;
+                }
+            }
+        }
+    }
+
+    if ( ret )
+    {
+        sprintf( buffer, "%u", counter );
+        value = buffer;
+    }
+
+    return ret;
+}
+
+// Get all statistics properties
+PropertyMap StatsInformation::GetAllProperties( ) const
+{
+    static const char* names[]        = { "framesReceived", "framesSkipped", "framesEncoded", "framesRepeated" };
+    static const char* queueCounters[] = { "QueueDepth", "FramesDelivered", "FramesDropped" };
+    PropertyMap        properties;
+    vector<string>     allNames( begin( names ), end( names ) );
+    string             value;
+
+    {
+        lock_guard<mutex> lock( Owner->QueuesGuard );
+
+        for ( const auto& queue : Owner->ListenerQueues )
+        {
+            for ( auto counter : queueCounters )
+            {
+                allNames.push_back( queue.first + counter );
+            }
+        }
+    }
+
+    for ( const string& name : allNames )
+    {
+        if ( GetProperty( name, value ) )
+        {
+            properties.insert( PropertyMap::value_type( name, value ) );
+        }
+    }
+
+    return properties;
 }
 
 } // namespace Private
@@ -25,8 +25,12 @@
 #include <memory>
 
 #include "XInterfaces.hpp"
+#include "IVideoSource.hpp"
 #include "IVideoSourceListener.hpp"
+#include "IObjectInformation.hpp"
 #include "XWebServer.hpp"
+#include "XMotionDetector.hpp"
+#include "XAsyncVideoSourceListener.hpp"
 
 namespace Private
 {
@@ -48,10 +52,82 @@ public:
     // Create web request handler to provide camera images as MJPEG stream
     std::shared_ptr<IWebRequestHandler> CreateMjpegHandler( const std::string& uri, uint32_t frameRate ) const;
 
-    // Get/Set JPEG quality (valid only if camera provides uncompressed images)
+    // Create web request handler to provide camera images in their native pixel format
+    // (image's size, stride and format are given in X-Image-* headers)
+    std::shared_ptr<IWebRequestHandler> CreateRawHandler( const std::string& uri ) const;
+
+    // Create web request handler to provide camera images in their native pixel format as multipart stream
+    std::shared_ptr<IWebRequestHandler> CreateRawStreamHandler( const std::string& uri, uint32_t frameRate ) const;
+
+    // Create web request handler to provide camera images as binary WebSocket messages. Each message is
+    // a JPEG prefixed with 16 bytes of metadata; clients must acknowledge frames by sending back their IDs,
+    // since no more than the specified number of frames is sent without acknowledgement.
+    std::shared_ptr<IWebRequestHandler> CreateWebSocketHandler( const std::string& uri, uint32_t frameRate,
+                                                                uint32_t maxFramesInFlight = 2 ) const;
+
+    // Create web request handler to provide changed tiles of camera images over WebSocket (flow control is
+    // same as above). Messages carry either complete image (key frame) or JPEG encoded tiles, which changed
+    // since the previous message. Key frames are sent at the specified interval (milliseconds) and when
+    // client missed some changes. Only uncompressed video sources get deltas.
+    std::shared_ptr<IWebRequestHandler> CreateTilesStreamHandler( const std::string& uri, uint32_t frameRate,
+                                                                  uint32_t keyFrameInterval = 10000,
+                                                                  uint32_t maxFramesInFlight = 2 ) const;
+
+    // Get the latest camera image as JPEG, so that other servers (RTSP, for example) share the same
+    // encoding with web handlers. The buffer is (re)allocated with realloc() if it is too small.
+    // Sequence number of the image allows finding if it is the same as the one provided last time.
+    // On-demand video source is not started by this call, nor does it count as a request for images.
+    XError GetJpegImage( uint8_t** buffer, uint32_t* bufferSize, uint32_t* jpegSize, uint32_t* sequence = nullptr );
+
+    // Get/Set JPEG quality (applies to JPEG images coming from camera only if transcoding is enabled)
     uint16_t JpegQuality( ) const;
     void SetJpegQuality( uint16_t quality );
 
+    // Get/Set transcoding of JPEG images coming from camera (MJPEG cameras, relays). If enabled, the images
+    // are requantized to the set quality (only if it is lower than theirs) without decoding them to pixels
+    // (see XJpegTranscoder). Disabled by default - JPEG images are provided as they come.
+    bool JpegTranscoding( ) const;
+    void SetJpegTranscoding( bool enable );
+
+    // Get/Set number of threads encoding uncompressed images (1 by default). With more threads, consecutive
+    // images are encoded concurrently by a pool of encoders (see XJpegEncoderPool), so frame rate of high
+    // resolution cameras is not limited by time needed to encode one image. Provided JPEG may then be behind
+    // the latest camera image by up to that number of images. Should be set before video source is started.
+    uint32_t EncoderThreads( ) const;
+    void SetEncoderThreads( uint32_t count );
+
+    // Get number of frames received from video source, number of frames replaced
+    // by newer ones before getting encoded, number of encoded frames and number of frames
+    // provided as the previous JPEG, since scene did not change noticeably (uncompressed
+    // images are checked on a sparse grid of samples before encoding)
+    uint32_t FramesReceived( ) const;
+    uint32_t FramesSkipped( ) const;
+    uint32_t FramesEncoded( ) const;
+    uint32_t FramesRepeated( ) const;
+
+    // Create object providing statistics information (frames received/skipped/encoded/repeated)
+    std::shared_ptr<IObjectInformation> CreateStatsInformation( ) const;
+
+    // Set motion detector analysing images of the same video source. Its state at the time an image
+    // gets encoded is provided with the JPEG as X-Motion-Level and X-Motion-Region headers (JPEG and
+    // MJPEG handlers). The detector should get images before this object to have them analysed already.
+    void SetMotionDetector( const XMotionDetector* motionDetector );
+
+    // Add asynchronous listener of the same video source, whose queue is reported by statistics
+    // information as <name>QueueDepth, <name>FramesDelivered and <name>FramesDropped
+    void AddListenerQueue( const std::string& name, const XAsyncVideoSourceListener* listener );
+
+    // Enable on-demand mode for the specified video source. The source is started when its images
+    // are requested (replies of web handlers are deferred up to the specified number of milliseconds
+    // until the first image arrives, without blocking web server's thread) and should be stopped
+    // from time to time by calling StopIdleVideoSource(). Only requests of web handlers keep it running -
+    // users of GetJpegImage() get images only while somebody watches the camera over HTTP/WebSocket.
+    void EnableOnDemandMode( const std::shared_ptr<IVideoSource>& videoSource, uint32_t firstImageTimeout = 3000 );
+    // Get time (milliseconds) since images were requested last time
+    uint32_t VideoSourceIdleTime( );
+    // Stop on-demand video source if its images were not requested for the specified time (milliseconds)
+    bool StopIdleVideoSource( uint32_t idleTimeout );
+
 private:
     Private::XVideoSourceToWebData* mData;
 };
@@ -207,6 +207,27 @@ namespace Private
             mConnection->user_data = mHandler;
             mg_set_timer( mConnection, mg_time( ) + (double) msec / 1000 );
         }
+
+        // Send message over WebSocket connection
+        void SendWebSocketMessage( const uint8_t* buffer, size_t length, bool binary )
+        {
+            mg_send_websocket_frame( mConnection, ( binary ) ? WEBSOCKET_OP_BINARY : WEBSOCKET_OP_TEXT, buffer, length );
+        }
+
+        // Send binary message over WebSocket connection, composing it from header and data buffers
+        void SendWebSocketMessage( const uint8_t* header, size_t headerLength, const uint8_t* data, size_t dataLength )
+        {
+            struct mg_str parts[2] = { { reinterpret_cast<const char*>( header ), headerLength },
+                                       { reinterpret_cast<const char*>( data ), dataLength } };
+
+            mg_send_websocket_framev( mConnection, WEBSOCKET_OP_BINARY, parts, 2 );
+        }
+
+        // Identifier of the connection associated with the response
+        uintptr_t ConnectionId( ) const
+        {
+            return reinterpret_cast<uintptr_t>( mConnection );
+        }
     };
 
     /* ================================================================= */
@@ -217,16 +238,18 @@ namespace Private
     public:
         shared_ptr<IWebRequestHandler>  Handler;
         UserGroup                       AllowedUserGroup;
+        bool                            AllowLocalConnections;
         steady_clock::time_point        LastAccessTime;
         bool                            WasAccessed;
     public:
         RequestHandlerData( ) :
-            Handler( ), AllowedUserGroup( UserGroup::Anyone ),
+            Handler( ), AllowedUserGroup( UserGroup::Anyone ), AllowLocalConnections( false ),
             LastAccessTime( ), WasAccessed( false )
         { }
 
-        RequestHandlerData( const shared_ptr<IWebRequestHandler>& handler, UserGroup allowedUserGroup ) :
-            Handler( handler), AllowedUserGroup( allowedUserGroup )
+        RequestHandlerData( const shared_ptr<IWebRequestHandler>& handler, UserGroup allowedUserGroup, bool allowLocalConnections ) :
+            Handler( handler), AllowedUserGroup( allowedUserGroup ), AllowLocalConnections( allowLocalConnections ),
+            LastAccessTime( ), WasAccessed( false )
         { }
     };
 
@@ -288,7 +311,7 @@ namespace Private
         bool Start( );
         void Stop( );
         void Cleanup( );
-        void AddHandler( const shared_ptr<IWebRequestHandler>& handler, UserGroup userGroup );
+        void AddHandler( const shared_ptr<IWebRequestHandler>& handler, UserGroup userGroup, bool allowLocalConnections );
         void RemoveHandler( const shared_ptr<IWebRequestHandler>& handler );
         void ClearHandlers( );
         RequestHandlerData* FindHandler( const string& uri );
@@ -429,9 +452,9 @@ steady_clock::time_point XWebServer::LastAccessTime( const string& handlerUri, b
 }
 
 // Add new web request handler
-XWebServer& XWebServer::AddHandler( const shared_ptr<IWebRequestHandler>& handler, UserGroup allowedUserGroup )
+XWebServer& XWebServer::AddHandler( const shared_ptr<IWebRequestHandler>& handler, UserGroup allowedUserGroup, bool allowLocalConnections )
 {
-    mData->AddHandler( handler, allowedUserGroup );
+    mData->AddHandler( handler, allowedUserGroup, allowLocalConnections );
     return *this;
 }
 
@@ -571,17 +594,18 @@ void XWebServerData::Cleanup( )
 }
 
 // Add web server request handler
-void XWebServerData::AddHandler( const shared_ptr<IWebRequestHandler>& handler, UserGroup allowedUserGroup )
+void XWebServerData::AddHandler( const shared_ptr<IWebRequestHandler>& handler, UserGroup allowedUserGroup, bool allowLocalConnections )
 {
     lock_guard<recursive_mutex> lock( DataSync );
 
     if ( handler->CanHandleSubContent( ) )
     {
-        FolderHandlers.push_back( RequestHandlerData( handler, allowedUserGroup ) );
+        FolderHandlers.push_back( RequestHandlerData( handler, allowedUserGroup, allowLocalConnections ) );
     }
     else
     {
-        FileHandlers.insert( pair<string, RequestHandlerData>( handler->Uri( ), RequestHandlerData( handler, allowedUserGroup ) ) );
+        FileHandlers.insert( pair<string, RequestHandlerData>( handler->Uri( ),
+                             RequestHandlerData( handler, allowedUserGroup, allowLocalConnections ) ) );
     }
 }
 
@@ -902,6 +926,16 @@ UserGroup XWebServerData::CheckDigestAuth( struct http_message* msg )
     return userGroup;
 }
 
+// Check if connection comes from the local machine
+static bool IsLocalConnection( struct mg_connection* connection )
+{
+    char address[64];
+
+    mg_conn_addr_to_str( connection, address, sizeof( address ), MG_SOCK_STRINGIFY_IP | MG_SOCK_STRINGIFY_REMOTE );
+
+    return ( ( strncmp( address, "127.", 4 ) == 0 ) || ( strcmp( address, "::1" ) == 0 ) );
+}
+
 // Mangoose web server event handler
 void XWebServerData::eventHandler( struct mg_connection* connection, int event, void* param )
 {
@@ -928,7 +962,8 @@ void XWebServerData::eventHandler( struct mg_connection* connection, int event,
 
         if ( handlerData != nullptr )
         {
-            if ( static_cast<int>( authUserGroup ) < static_cast<int>( handlerData->AllowedUserGroup ) )
+            if ( ( static_cast<int>( authUserGroup ) < static_cast<int>( handlerData->AllowedUserGroup ) ) &&
+                 ( ( !handlerData->AllowLocalConnections ) || ( !IsLocalConnection( connection ) ) ) )
             {
                 http_send_digest_auth_request( connection, self->ActiveAuthDomain.c_str( ) );
             }
@@ -953,6 +988,65 @@ void XWebServerData::eventHandler( struct mg_connection* connection, int event,
             response.SendError( 404 );
         }
     }
+    else if ( event == MG_EV_WEBSOCKET_HANDSHAKE_REQUEST )
+    {
+        struct http_message* message = static_cast<struct http_message*>( param );
+        MangooseWebRequest   request( message );
+        MangooseWebResponse  response( connection );
+        string               uri           = request.Uri( );
+        UserGroup            authUserGroup = self->CheckDigestAuth( message );
+
+        while ( ( uri.back( ) == '/' ) && ( uri.length( ) != 1 ) )
+        {
+            uri.pop_back( );
+        }
+
+        RequestHandlerData*  handlerData   = self->FindHandler( uri );
+
+        if ( handlerData == nullptr )
+        {
+            response.SendError( 404 );
+        }
+        else if ( ( static_cast<int>( authUserGroup ) < static_cast<int>( handlerData->AllowedUserGroup ) ) &&
+                  ( ( !handlerData->AllowLocalConnections ) || ( !IsLocalConnection( connection ) ) ) )
+        {
+            http_send_digest_auth_request( connection, self->ActiveAuthDomain.c_str( ) );
+        }
+        else
+        {
+            response.SetHandler( handlerData->Handler.get( ) );
+
+            if ( handlerData->Handler->HandleWebSocketConnect( request, response ) )
+            {
+                // the handler gets all further events of the connection
+                connection->user_data = handlerData->Handler.get( );
+
+                handlerData->WasAccessed    = true;
+                handlerData->LastAccessTime = steady_clock::now( );
+            }
+            else if ( connection->send_mbuf.len == 0 )
+            {
+                response.SendError( 400, "WebSocket is not supported" );
+            }
+        }
+
+        // any response sent means handshake is not done
+        if ( connection->user_data == nullptr )
+        {
+            connection->flags |= MG_F_SEND_AND_CLOSE;
+        }
+    }
+    else if ( event == MG_EV_WEBSOCKET_FRAME )
+    {
+        if ( connection->user_data != nullptr )
+        {
+            struct websocket_message* message = static_cast<struct websocket_message*>( param );
+            IWebRequestHandler*       handler = static_cast<IWebRequestHandler*>( connection->user_data );
+            MangooseWebResponse       response( connection, handler );
+
+            handler->HandleWebSocketMessage( response, message->data, message->size );
+        }
+    }
     else if ( event == MG_EV_TIMER )
     {
         if ( connection->user_data != nullptr )
@@ -960,11 +1054,27 @@ void XWebServerData::eventHandler( struct mg_connection* connection, int event,
             IWebRequestHandler* handler = static_cast<IWebRequestHandler*>( connection->user_data );
             MangooseWebResponse response( connection, handler );
 
-            connection->user_data = nullptr;
+            // WebSocket connections stay with their handler
+            if ( ( connection->flags & MG_F_IS_WEBSOCKET ) == 0 )
+            {
+                connection->user_data = nullptr;
+            }
 
             handler->HandleTimer( response );
         }
     }
+    else if ( event == MG_EV_CLOSE )
+    {
+        if ( connection->user_data != nullptr )
+        {
+            IWebRequestHandler* handler = static_cast<IWebRequestHandler*>( connection->user_data );
+            MangooseWebResponse response( connection, handler );
+
+            connection->user_data = nullptr;
+
+            handler->HandleConnectionClosed( response );
+        }
+    }
 
     if ( ( event != MG_EV_POLL ) && ( event != MG_EV_CLOSE ) )
     {
@@ -85,6 +85,14 @@ public:
     // Generate timer event for the connection associated with the response
     // after the specified number of milliseconds
     virtual void SetTimer( uint32_t msec ) = 0;
+
+    // Send message over WebSocket connection
+    virtual void SendWebSocketMessage( const uint8_t* buffer, size_t length, bool binary = true ) = 0;
+    // Send binary message over WebSocket connection, composing it from header and data buffers
+    virtual void SendWebSocketMessage( const uint8_t* header, size_t headerLength, const uint8_t* data, size_t dataLength ) = 0;
+
+    // Identifier of the connection associated with the response (unique while the connection is open)
+    virtual uintptr_t ConnectionId( ) const = 0;
 };
 
 /* ================================================================= */
@@ -107,6 +115,17 @@ public:
     // Handle timer event
     virtual void HandleTimer( IWebResponse& ) { };
 
+    // Handle WebSocket connection request - return true to accept it. Messages can be sent only
+    // after the request is handled, so a timer must be set for that (rejected by default).
+    virtual bool HandleWebSocketConnect( const IWebRequest&, IWebResponse& ) { return false; };
+
+    // Handle message received over accepted WebSocket connection
+    virtual void HandleWebSocketMessage( IWebResponse&, const uint8_t* /* data */, size_t /* length */ ) { };
+
+    // Handle closing of a connection, which is served by the handler - accepted WebSocket
+    // connection or a connection waiting for timer event
+    virtual void HandleConnectionClosed( IWebResponse& ) { };
+
 private:
     std::string mUri;
     bool        mCanHandleSubContent;
@@ -165,8 +184,9 @@ public:
     uint16_t Port( ) const;
     XWebServer& SetPort( uint16_t port );
 
-    // Add/Remove web handler
-    XWebServer& AddHandler( const std::shared_ptr<IWebRequestHandler>& handler, UserGroup allowedUserGroup = UserGroup::Anyone );
+    // Add/Remove web handler (local connections may be allowed to bypass authentication)
+    XWebServer& AddHandler( const std::shared_ptr<IWebRequestHandler>& handler, UserGroup allowedUserGroup = UserGroup::Anyone,
+                            bool allowLocalConnections = false );
     void RemoveHandler( const std::shared_ptr<IWebRequestHandler>& handler );
 
     // Remove all handlers
@@ -0,0 +1,716 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <vector>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <chrono>
+
+#include <string.h>
+#include <stdlib.h>
+
+#include <mongoose.h>
+
+#include "XHttpMjpegCamera.hpp"
+#include "XManualResetEvent.hpp"
+#include "XStringTools.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace Private
+{
+    // Maximum size of HTTP headers and JPEG images accepted from the stream
+    #define MAX_HEADER_SIZE     (8 * 1024)
+    #define MAX_FRAME_SIZE      (32 * 1024 * 1024)
+    // Time to wait before re-connecting and time of silence after which connection is considered lost
+    #define RECONNECT_INTERVAL  (1000)
+    #define RECEIVE_TIMEOUT     (10000)
+
+    enum class ParserState
+    {
+        ResponseHeader,
+        PartHeader,
+        PartBody
+    };
+
+    // Incremental parser of multipart HTTP stream - data are fed as they come from network. Images
+    // are collected in a buffer, which only grows when a bigger image is received.
+    class MjpegStreamParser
+    {
+    private:
+        XHttpMjpegCameraData* Owner;
+        ParserState           State;
+        string                Header;
+        string                Delimiter;
+        vector<uint8_t>       Frame;
+        uint32_t              FrameSize;
+        uint32_t              ContentLength;
+
+    public:
+        MjpegStreamParser( XHttpMjpegCameraData* owner ) :
+            Owner( owner ), State( ParserState::ResponseHeader ), Header( ), Delimiter( ),
+            Frame( ), FrameSize( 0 ), ContentLength( 0 )
+        {
+            Header.reserve( MAX_HEADER_SIZE );
+        }
+
+        void Reset( );
+        bool Process( const uint8_t* data, size_t length );
+
+    private:
+        size_t ProcessHeader( const uint8_t* data, size_t length, bool* headerDone );
+        bool ParseResponseHeader( );
+        bool ParsePartHeader( );
+        bool StoreFrameData( const uint8_t* data, size_t length );
+        void FrameDone( uint32_t frameSize );
+    };
+
+    // Private details of the implementation
+    class XHttpMjpegCameraData
+    {
+    private:
+        mutable recursive_mutex Sync;
+        thread                  ControlThread;
+        XManualResetEvent       NeedToStop;
+        IVideoSourceListener*   Listener;
+        bool                    Running;
+
+        string                  Host;
+        string                  Path;
+        MjpegStreamParser       Parser;
+        struct mg_connection*   Connection;
+        bool                    StreamFailed;
+        steady_clock::time_point LastReceiveTime;
+
+    public:
+        string                  Url;
+        uint32_t                FramesReceived;
+
+    public:
+        XHttpMjpegCameraData( ) :
+            Sync( ), ControlThread( ), NeedToStop( ), Listener( nullptr ), Running( false ),
+            Host( ), Path( ), Parser( this ), Connection( nullptr ), StreamFailed( false ), LastReceiveTime( ),
+            Url( ), FramesReceived( 0 )
+        {
+        }
+
+        bool Start( );
+        void SignalToStop( );
+        void WaitForStop( );
+        bool IsRunning( );
+        IVideoSourceListener* SetListener( IVideoSourceListener* listener );
+
+        void SetUrl( const string& url );
+
+        void NotifyNewImage( const std::shared_ptr<const XImage>& image );
+        void NotifyError( const string& errorMessage, bool fatal = false );
+
+        static void ControlThreadHanlder( XHttpMjpegCameraData* me );
+
+    private:
+        bool ParseUrl( );
+        void ReceiveLoop( );
+
+        static void EventHandler( struct mg_connection* connection, int event, void* param );
+    };
+}
+
+const shared_ptr<XHttpMjpegCamera> XHttpMjpegCamera::Create( )
+{
+    return shared_ptr<XHttpMjpegCamera>( new XHttpMjpegCamera );
+}
+
+XHttpMjpegCamera::XHttpMjpegCamera( ) :
+    mData( new Private::XHttpMjpegCameraData( ) )
+{
+}
+
+XHttpMjpegCamera::~XHttpMjpegCamera( )
+{
+    mData->WaitForStop( );
+    delete mData;
+}
+
+// Start the video source
+bool XHttpMjpegCamera::Start( )
+{
+    return mData->Start( );
+}
+
+// Signal video source to stop
+void XHttpMjpegCamera::SignalToStop( )
+{
+    mData->SignalToStop( );
+}
+
+// Wait till video source stops
+void XHttpMjpegCamera::WaitForStop( )
+{
+    mData->WaitForStop( );
+}
+
+// Check if video source is still running
+bool XHttpMjpegCamera::IsRunning( )
+{
+    return mData->IsRunning( );
+}
+
+// Get number of frames received since the start of the video source
+uint32_t XHttpMjpegCamera::FramesReceived( )
+{
+    return mData->FramesReceived;
+}
+
+// Set video source listener
+IVideoSourceListener* XHttpMjpegCamera::SetListener( IVideoSourceListener* listener )
+{
+    return mData->SetListener( listener );
+}
+
+// Get/Set URL of the MJPEG stream
+string XHttpMjpegCamera::Url( ) const
+{
+    return mData->Url;
+}
+void XHttpMjpegCamera::SetUrl( const string& url )
+{
+    mData->SetUrl( url );
+}
+
+namespace Private
+{
+
+// Start video source so it initializes and begins providing video frames
+bool XHttpMjpegCameraData::Start( )
+{
+    lock_guard<recursive_mutex> lock( Sync );
+    bool                        ret = true;
+
+    if ( !IsRunning( ) )
+    {
+        if ( !ParseUrl( ) )
+        {
+            ret = false;
+        }
+        else
+        {
+            NeedToStop.Reset( );
+            Running = true;
+            FramesReceived = 0;
+
+            ControlThread = thread( ControlThreadHanlder, this );
+        }
+    }
+
+    return ret;
+}
+
+// Signal video to stop, so it could finalize and clean-up
+void XHttpMjpegCameraData::SignalToStop( )
+{
+    lock_guard<recursive_mutex> lock( Sync );
+
+    if ( IsRunning( ) )
+    {
+        NeedToStop.Signal( );
+    }
+}
+
+// Wait till video source (its thread) stops
+void XHttpMjpegCameraData::WaitForStop( )
+{
+    SignalToStop( );
+
+    if ( ( IsRunning( ) ) || ( ControlThread.joinable( ) ) )
+    {
+        ControlThread.join( );
+    }
+}
+
+// Check if video source is still running
+bool XHttpMjpegCameraData::IsRunning( )
+{
+    lock_guard<recursive_mutex> lock( Sync );
+
+    if ( ( !Running ) && ( ControlThread.joinable( ) ) )
+    {
+        ControlThread.join( );
+    }
+
+    return Running;
+}
+
+// Set video source listener
+IVideoSourceListener* XHttpMjpegCameraData::SetListener( IVideoSourceListener* listener )
+{
+    lock_guard<recursive_mutex> lock( Sync );
+    IVideoSourceListener* oldListener = Listener;
+
+    Listener = listener;
+
+    return oldListener;
+}
+
+// Set URL of the MJPEG stream
+void XHttpMjpegCameraData::SetUrl( const string& url )
+{
+    lock_guard<recursive_mutex> lock( Sync );
+
+    if ( !IsRunning( ) )
+    {
+        Url = url;
+    }
+}
+
+// Notify listener with a new image
+void XHttpMjpegCameraData::NotifyNewImage( const std::shared_ptr<const XImage>& image )
+{
+    IVideoSourceListener* myListener;
+
+    {
+        lock_guard<recursive_mutex> lock( Sync );
+        myListener = Listener;
+    }
+
+    if ( myListener != nullptr )
+    {
+        myListener->OnNewImage( image );
+    }
+}
+
+// Notify listener about error
+void XHttpMjpegCameraData::NotifyError( const string& errorMessage, bool fatal )
+{
+    IVideoSourceListener* myListener;
+
+    {
+        lock_guard<recursive_mutex> lock( Sync );
+        myListener = Listener;
+    }
+
+    if ( myListener != nullptr )
+    {
+        myListener->OnError( errorMessage, fatal );
+    }
+}
+
+// Split URL into host:port and path parts (only plain HTTP is supported)
+bool XHttpMjpegCameraData::ParseUrl( )
+{
+    static const char* httpPrefix = "http://";
+
+    string address = Url;
+    bool   ret     = true;
+
+    if ( address.compare( 0, strlen( httpPrefix ), httpPrefix ) == 0 )
+    {
+        address.erase( 0, strlen( httpPrefix ) );
+    }
+
+    size_t pathStart = address.find( '/' );
+
+    if ( pathStart == string::npos )
+    {
+        Host = address;
+        Path = "/";
+    }
+    else
+    {
+        Host = address.substr( 0, pathStart );
+        Path = address.substr( pathStart );
+    }
+
+    if ( ( Host.empty( ) ) || ( Host.find( '@' ) != string::npos ) || ( address.find( "://" ) != string::npos ) )
+    {
+        ret = false;
+    }
+    else if ( Host.find( ':' ) == string::npos )
+    {
+        Host += ":80";
+    }
+
+    return ret;
+}
+
+// Background thread receiving MJPEG stream
+void XHttpMjpegCameraData::ControlThreadHanlder( XHttpMjpegCameraData* me )
+{
+    me->ReceiveLoop( );
+
+    {
+        lock_guard<recursive_mutex> lock( me->Sync );
+        me->Running = false;
+    }
+}
+
+// Connect to the MJPEG stream and keep receiving it (re-connecting if needed) until stop is requested
+void XHttpMjpegCameraData::ReceiveLoop( )
+{
+    struct mg_mgr mgr;
+
+    mg_mgr_init( &mgr, this );
+
+    while ( !NeedToStop.IsSignaled( ) )
+    {
+        Parser.Reset( );
+        StreamFailed    = false;
+        LastReceiveTime = steady_clock::now( );
+        Connection      = mg_connect( &mgr, Host.c_str( ), EventHandler );
+
+        if ( Connection == nullptr )
+        {
+            NotifyError( "Failed connecting to " + Host );
+        }
+        else
+        {
+            while ( ( Connection != nullptr ) && ( !NeedToStop.IsSignaled( ) ) )
+            {
+                mg_mgr_poll( &mgr, 100 );
+
+                if ( ( Connection != nullptr ) &&
+                     ( ( StreamFailed ) ||
+                       ( duration_cast<milliseconds>( steady_clock::now( ) - LastReceiveTime ).count( ) > RECEIVE_TIMEOUT ) ) )
+                {
+                    if ( !StreamFailed )
+                    {
+                        NotifyError( "Timeout receiving MJPEG stream" );
+                    }
+
+                    Connection->flags |= MG_F_CLOSE_IMMEDIATELY;
+                    mg_mgr_poll( &mgr, 0 );
+                }
+            }
+        }
+
+        // close connection if stop was requested or give it some time before re-connecting
+        if ( NeedToStop.Wait( RECONNECT_INTERVAL ) )
+        {
+            break;
+        }
+    }
+
+    mg_mgr_free( &mgr );
+    Connection = nullptr;
+}
+
+// Handle events of the connection to MJPEG stream
+void XHttpMjpegCameraData::EventHandler( struct mg_connection* connection, int event, void* param )
+{
+    XHttpMjpegCameraData* me = static_cast<XHttpMjpegCameraData*>( connection->mgr->user_data );
+
+    switch ( event )
+    {
+    case MG_EV_CONNECT:
+        if ( *static_cast<int*>( param ) != 0 )
+        {
+            me->NotifyError( "Failed connecting to " + me->Host );
+        }
+        else
+        {
+            mg_printf( connection, "GET %s HTTP/1.1\r\n"
+                                   "Host: %s\r\n"
+                                   "Connection: close\r\n"
+                                   "\r\n", me->Path.c_str( ), me->Host.c_str( ) );
+        }
+        break;
+
+    case MG_EV_RECV:
+        me->LastReceiveTime = steady_clock::now( );
+
+        if ( !me->StreamFailed )
+        {
+            me->StreamFailed = !me->Parser.Process( reinterpret_cast<const uint8_t*>( connection->recv_mbuf.buf ), connection->recv_mbuf.len );
+        }
+
+        mbuf_remove( &connection->recv_mbuf, connection->recv_mbuf.len );
+        break;
+
+    case MG_EV_CLOSE:
+        if ( connection == me->Connection )
+        {
+            me->Connection = nullptr;
+        }
+        break;
+    }
+}
+
+// Reset parser to wait for new HTTP response
+void MjpegStreamParser::Reset( )
+{
+    State         = ParserState::ResponseHeader;
+    FrameSize     = 0;
+    ContentLength = 0;
+
+    Header.clear( );
+    Delimiter.clear( );
+}
+
+// Process next chunk of data received from network
+bool MjpegStreamParser::Process( const uint8_t* data, size_t length )
+{
+    bool ret = true;
+
+    while ( ( length != 0 ) && ( ret ) )
+    {
+        if ( State == ParserState::PartBody )
+        {
+            if ( ContentLength != 0 )
+            {
+                size_t toCopy = ContentLength - FrameSize;
+
+                if ( toCopy > length )
+                {
+                    toCopy = length;
+                }
+
+                ret     = StoreFrameData( data, toCopy );
+                data   += toCopy;
+                length -= toCopy;
+
+                if ( ( ret ) && ( FrameSize == ContentLength ) )
+                {
+                    FrameDone( FrameSize );
+                }
+            }
+            else
+            {
+                // no content length, so need to search for the next delimiter
+                size_t searchStart = ( FrameSize > Delimiter.length( ) ) ? FrameSize - Delimiter.length( ) : 0;
+                size_t chunkStart  = FrameSize;
+
+                ret = StoreFrameData( data, length );
+
+                if ( ret )
+                {
+                    uint8_t* frameEnd = Frame.data( ) + FrameSize;
+                    uint8_t* found    = search( Frame.data( ) + searchStart, frameEnd, Delimiter.begin( ), Delimiter.end( ) );
+
+                    if ( found == frameEnd )
+                    {
+                        data  += length;
+                        length = 0;
+                    }
+                    else
+                    {
+                        uint32_t frameSize = static_cast<uint32_t>( found - Frame.data( ) );
+                        // whatever follows the delimiter's line break belongs to headers of the next part
+                        size_t   nextPart  = frameSize + 2;
+
+                        FrameDone( frameSize );
+
+                        // the delimiter may start in previously received data, so its first bytes go to
+                        // the header directly (no allocation - header has reserved capacity)
+                        if ( nextPart < chunkStart )
+                        {
+                            Header.assign( reinterpret_cast<const char*>( Frame.data( ) ) + nextPart, chunkStart - nextPart );
+                            nextPart = chunkStart;
+                        }
+
+                        // the rest of received data is parsed in place
+                        data   += nextPart - chunkStart;
+                        length -= nextPart - chunkStart;
+                    }
+                }
+            }
+        }
+        else
+        {
+            bool   headerDone = false;
+            size_t processed  = ProcessHeader( data, length, &headerDone );
+
+            data   += processed;
+            length -= processed;
+
+            if ( Header.length( ) > MAX_HEADER_SIZE )
+            {
+                Owner->NotifyError( "HTTP header is too long" );
+                ret = false;
+            }
+            else if ( headerDone )
+            {
+                ret = ( State == ParserState::ResponseHeader ) ? ParseResponseHeader( ) : ParsePartHeader( );
+                Header.clear( );
+            }
+        }
+    }
+
+    return ret;
+}
+
+// Collect header bytes until empty line is found; returns number of consumed bytes
+size_t MjpegStreamParser::ProcessHeader( const uint8_t* data, size_t length, bool* headerDone )
+{
+    size_t i = 0;
+
+    // skip line breaks between previous part's body and the next delimiter
+    if ( ( State == ParserState::PartHeader ) && ( Header.empty( ) ) )
+    {
+        while ( ( i < length ) && ( ( data[i] == '\r' ) || ( data[i] == '\n' ) ) )
+        {
+            i++;
+        }
+    }
+
+    for ( ; i < length; i++ )
+    {
+        Header.push_back( static_cast<char>( data[i] ) );
+
+        if ( ( data[i] == '\n' ) && ( Header.length( ) >= 4 ) && ( Header.compare( Header.length( ) - 4, 4, "\r\n\r\n" ) == 0 ) )
+        {
+            *headerDone = true;
+            i++;
+            break;
+        }
+    }
+
+    return i;
+}
+
+// Check HTTP response is OK and it is a multipart stream
+bool MjpegStreamParser::ParseResponseHeader( )
+{
+    string contentType;
+    bool   ret = false;
+
+    if ( ( Header.compare( 0, 5, "HTTP/" ) != 0 ) || ( Header.find( ' ' ) == string::npos ) ||
+         ( atoi( Header.c_str( ) + Header.find( ' ' ) + 1 ) != 200 ) )
+    {
+        Owner->NotifyError( "MJPEG stream request failed: " + Header.substr( 0, Header.find( "\r\n" ) ) );
+    }
+    else if ( ( !StringFindHeaderValue( Header, "Content-Type", contentType ) ) ||
+              ( contentType.find( "multipart/" ) != 0 ) ||
+              ( contentType.find( "boundary=" ) == string::npos ) )
+    {
+        Owner->NotifyError( "Not a multipart stream" );
+    }
+    else
+    {
+        string boundary = contentType.substr( contentType.find( "boundary=" ) + 9 );
+
+        boundary = boundary.substr( 0, boundary.find( ';' ) );
+
+        if ( ( boundary.length( ) >= 2 ) && ( boundary.front( ) == '"' ) && ( boundary.back( ) == '"' ) )
+        {
+            boundary = boundary.substr( 1, boundary.length( ) - 2 );
+        }
+
+        // some servers put dashes into the boundary declaration as well, so ignore those
+        while ( ( !boundary.empty( ) ) && ( boundary[0] == '-' ) )
+        {
+            boundary.erase( 0, 1 );
+        }
+
+        if ( boundary.empty( ) )
+        {
+            Owner->NotifyError( "Not a multipart stream" );
+        }
+        else
+        {
+            Delimiter = "\r\n--" + boundary;
+            State     = ParserState::PartHeader;
+            ret       = true;
+        }
+    }
+
+    return ret;
+}
+
+// Get length of the next part's content if it is provided
+bool MjpegStreamParser::ParsePartHeader( )
+{
+    string contentLength;
+
+    ContentLength = 0;
+    FrameSize     = 0;
+
+    if ( StringFindHeaderValue( Header, "Content-Length", contentLength ) )
+    {
+        long length = strtol( contentLength.c_str( ), nullptr, 10 );
+
+        if ( ( length <= 0 ) || ( length > MAX_FRAME_SIZE ) )
+        {
+            Owner->NotifyError( "Invalid size of image in MJPEG stream" );
+            return false;
+        }
+
+        ContentLength = static_cast<uint32_t>( length );
+
+        if ( Frame.size( ) < ContentLength )
+        {
+            Frame.resize( ContentLength );
+        }
+    }
+
+    State = ParserState::PartBody;
+
+    return true;
+}
+
+// Append data to the image being collected
+bool MjpegStreamParser::StoreFrameData( const uint8_t* data, size_t length )
+{
+    bool ret = true;
+
+    if ( FrameSize + length > MAX_FRAME_SIZE )
+    {
+        Owner->NotifyError( "Image in MJPEG stream is too big" );
+        ret = false;
+    }
+    else
+    {
+        if ( Frame.size( ) < FrameSize + length )
+        {
+            // grow with some reserve, since size of next images is not known
+            Frame.resize( FrameSize + length + ( FrameSize + length ) / 4 );
+        }
+
+        memcpy( Frame.data( ) + FrameSize, data, length );
+        FrameSize += static_cast<uint32_t>( length );
+    }
+
+    return ret;
+}
+
+// Provide collected image to listener and get ready for the next part
+void MjpegStreamParser::FrameDone( uint32_t frameSize )
+{
+    if ( ( frameSize > 2 ) && ( Frame[0] == 0xFF ) && ( Frame[1] == 0xD8 ) )
+    {
+        // image wraps parser's buffer, so listeners must copy it if they need to keep it
+        shared_ptr<XImage> image = XImage::Create( Frame.data( ), frameSize, 1, frameSize, XPixelFormat::JPEG );
+
+        if ( image )
+        {
+            Owner->FramesReceived++;
+            Owner->NotifyNewImage( image );
+        }
+    }
+    else
+    {
+        Owner->NotifyError( "Not a JPEG image in MJPEG stream" );
+    }
+
+    State     = ParserState::PartHeader;
+    FrameSize = 0;
+}
+
+} // namespace Private
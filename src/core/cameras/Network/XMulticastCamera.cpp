@@ -0,0 +1,493 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <chrono>
+
+#include <string.h>
+
+#include <mongoose.h>
+
+#include "XMulticastCamera.hpp"
+#include "XMulticastFrame.hpp"
+#include "XManualResetEvent.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace Private
+{
+    // Size of socket's receive buffer - big enough to survive short stalls of the receiving thread
+    #define RECEIVE_BUFFER_SIZE (2 * 1024 * 1024)
+    // Time of silence after which error is reported
+    #define RECEIVE_TIMEOUT     (10000)
+    // How far back frame number can be for a fragment to be considered a late one (and not a restart of sender)
+    #define MAX_FRAME_REORDER   (256)
+
+    // Re-assembles frames from fragments. Frame buffer only grows when a bigger frame is received.
+    class MulticastFrameAssembler
+    {
+    private:
+        XMulticastCameraData* Owner;
+        vector<uint8_t>       Frame;
+        vector<bool>          FragmentReceived;
+        uint32_t              FrameNumber;
+        uint32_t              FrameSize;
+        uint32_t              FragmentsLeft;
+        bool                  Assembling;
+        bool                  GotFirstFrame;
+
+    public:
+        MulticastFrameAssembler( XMulticastCameraData* owner ) :
+            Owner( owner ), Frame( ), FragmentReceived( ), FrameNumber( 0 ), FrameSize( 0 ),
+            FragmentsLeft( 0 ), Assembling( false ), GotFirstFrame( false )
+        {
+        }
+
+        void Reset( );
+        void Process( const uint8_t* datagram, uint32_t datagramSize );
+
+    private:
+        void StartFrame( const XMulticastFragmentHeader& header );
+        void FrameDone( );
+    };
+
+    // Private details of the implementation
+    class XMulticastCameraData
+    {
+    private:
+        mutable recursive_mutex Sync;
+        thread                  ControlThread;
+        XManualResetEvent       NeedToStop;
+        IVideoSourceListener*   Listener;
+        bool                    Running;
+
+        MulticastFrameAssembler Assembler;
+
+    public:
+        string                  GroupAddress;
+        uint16_t                Port;
+        uint32_t                FramesReceived;
+        uint32_t                FramesDropped;
+
+    public:
+        XMulticastCameraData( ) :
+            Sync( ), ControlThread( ), NeedToStop( ), Listener( nullptr ), Running( false ),
+            Assembler( this ), GroupAddress( ), Port( 0 ), FramesReceived( 0 ), FramesDropped( 0 )
+        {
+        }
+
+        bool Start( );
+        void SignalToStop( );
+        void WaitForStop( );
+        bool IsRunning( );
+        IVideoSourceListener* SetListener( IVideoSourceListener* listener );
+
+        void SetGroup( const string& groupAddress, uint16_t port );
+
+        void NotifyNewImage( const std::shared_ptr<const XImage>& image );
+        void NotifyError( const string& errorMessage, bool fatal = false );
+
+        static void ControlThreadHanlder( XMulticastCameraData* me );
+
+    private:
+        sock_t OpenSocket( );
+        void ReceiveLoop( sock_t socket );
+    };
+}
+
+const shared_ptr<XMulticastCamera> XMulticastCamera::Create( )
+{
+    return shared_ptr<XMulticastCamera>( new XMulticastCamera );
+}
+
+XMulticastCamera::XMulticastCamera( ) :
+    mData( new Private::XMulticastCameraData( ) )
+{
+}
+
+XMulticastCamera::~XMulticastCamera( )
+{
+    mData->WaitForStop( );
+    delete mData;
+}
+
+// Start the video source
+bool XMulticastCamera::Start( )
+{
+    return mData->Start( );
+}
+
+// Signal video source to stop
+void XMulticastCamera::SignalToStop( )
+{
+    mData->SignalToStop( );
+}
+
+// Wait till video source stops
+void XMulticastCamera::WaitForStop( )
+{
+    mData->WaitForStop( );
+}
+
+// Check if video source is still running
+bool XMulticastCamera::IsRunning( )
+{
+    return mData->IsRunning( );
+}
+
+// Get number of frames received since the start of the video source
+uint32_t XMulticastCamera::FramesReceived( )
+{
+    return mData->FramesReceived;
+}
+
+// Get number of frames dropped because of lost fragments
+uint32_t XMulticastCamera::FramesDropped( )
+{
+    return mData->FramesDropped;
+}
+
+// Set video source listener
+IVideoSourceListener* XMulticastCamera::SetListener( IVideoSourceListener* listener )
+{
+    return mData->SetListener( listener );
+}
+
+// Get/Set multicast group to receive frames from
+string XMulticastCamera::GroupAddress( ) const
+{
+    return mData->GroupAddress;
+}
+uint16_t XMulticastCamera::Port( ) const
+{
+    return mData->Port;
+}
+void XMulticastCamera::SetGroup( const string& groupAddress, uint16_t port )
+{
+    mData->SetGroup( groupAddress, port );
+}
+
+namespace Private
+{
+
+// Start video source so it initializes and begins providing video frames
+bool XMulticastCameraData::Start( )
+{
+    lock_guard<recursive_mutex> lock( Sync );
+
+    if ( !IsRunning( ) )
+    {
+        NeedToStop.Reset( );
+        Running        = true;
+        FramesReceived = 0;
+        FramesDropped  = 0;
+
+        ControlThread = thread( ControlThreadHanlder, this );
+    }
+
+    return true;
+}
+
+// Signal video to stop, so it could finalize and clean-up
+void XMulticastCameraData::SignalToStop( )
+{
+    lock_guard<recursive_mutex> lock( Sync );
+
+    if ( IsRunning( ) )
+    {
+        NeedToStop.Signal( );
+    }
+}
+
+// Wait till video source (its thread) stops
+void XMulticastCameraData::WaitForStop( )
+{
+    SignalToStop( );
+
+    if ( ( IsRunning( ) ) || ( ControlThread.joinable( ) ) )
+    {
+        ControlThread.join( );
+    }
+}
+
+// Check if video source is still running
+bool XMulticastCameraData::IsRunning( )
+{
+    lock_guard<recursive_mutex> lock( Sync );
+
+    if ( ( !Running ) && ( ControlThread.joinable( ) ) )
+    {
+        ControlThread.join( );
+    }
+
+    return Running;
+}
+
+// Set video source listener
+IVideoSourceListener* XMulticastCameraData::SetListener( IVideoSourceListener* listener )
+{
+    lock_guard<recursive_mutex> lock( Sync );
+    IVideoSourceListener* oldListener = Listener;
+
+    Listener = listener;
+
+    return oldListener;
+}
+
+// Set multicast group to receive frames from
+void XMulticastCameraData::SetGroup( const string& groupAddress, uint16_t port )
+{
+    lock_guard<recursive_mutex> lock( Sync );
+
+    if ( !IsRunning( ) )
+    {
+        GroupAddress = groupAddress;
+        Port         = port;
+    }
+}
+
+// Notify listener with a new image
+void XMulticastCameraData::NotifyNewImage( const std::shared_ptr<const XImage>& image )
+{
+    IVideoSourceListener* myListener;
+
+    {
+        lock_guard<recursive_mutex> lock( Sync );
+        myListener = Listener;
+    }
+
+    if ( myListener != nullptr )
+    {
+        myListener->OnNewImage( image );
+    }
+}
+
+// Notify listener about error
+void XMulticastCameraData::NotifyError( const string& errorMessage, bool fatal )
+{
+    IVideoSourceListener* myListener;
+
+    {
+        lock_guard<recursive_mutex> lock( Sync );
+        myListener = Listener;
+    }
+
+    if ( myListener != nullptr )
+    {
+        myListener->OnError( errorMessage, fatal );
+    }
+}
+
+// Background thread receiving frames
+void XMulticastCameraData::ControlThreadHanlder( XMulticastCameraData* me )
+{
+    sock_t socket = me->OpenSocket( );
+
+    if ( socket == INVALID_SOCKET )
+    {
+        me->NotifyError( "Failed joining multicast group", true );
+    }
+    else
+    {
+        me->ReceiveLoop( socket );
+        closesocket( socket );
+    }
+
+    {
+        lock_guard<recursive_mutex> lock( me->Sync );
+        me->Running = false;
+    }
+}
+
+// Create UDP socket and join the multicast group
+sock_t XMulticastCameraData::OpenSocket( )
+{
+    struct sockaddr_in address;
+    struct ip_mreq     request;
+    int                reuse      = 1;
+    int                bufferSize = RECEIVE_BUFFER_SIZE;
+    sock_t             ret        = INVALID_SOCKET;
+
+    memset( &address, 0, sizeof( address ) );
+    memset( &request, 0, sizeof( request ) );
+
+    address.sin_family      = AF_INET;
+    address.sin_addr.s_addr = htonl( INADDR_ANY );
+    address.sin_port        = htons( Port );
+
+    request.imr_interface.s_addr = htonl( INADDR_ANY );
+
+    if ( inet_pton( AF_INET, GroupAddress.c_str( ), &request.imr_multiaddr ) == 1 )
+    {
+        ret = socket( AF_INET, SOCK_DGRAM, 0 );
+
+        if ( ret != INVALID_SOCKET )
+        {
+            // allow several receivers on the same machine
+            setsockopt( ret, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>( &reuse ), sizeof( reuse ) );
+            setsockopt( ret, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const char*>( &bufferSize ), sizeof( bufferSize ) );
+
+            if ( ( ::bind( ret, reinterpret_cast<struct sockaddr*>( &address ), sizeof( address ) ) != 0 ) ||
+                 ( setsockopt( ret, IPPROTO_IP, IP_ADD_MEMBERSHIP, reinterpret_cast<const char*>( &request ), sizeof( request ) ) != 0 ) )
+            {
+                closesocket( ret );
+                ret = INVALID_SOCKET;
+            }
+        }
+    }
+
+    return ret;
+}
+
+// Keep receiving fragments until stop is requested
+void XMulticastCameraData::ReceiveLoop( sock_t socket )
+{
+    vector<uint8_t>          datagram( 64 * 1024 );
+    steady_clock::time_point lastReceiveTime = steady_clock::now( );
+    bool                     timeoutReported = false;
+
+    Assembler.Reset( );
+
+    while ( !NeedToStop.IsSignaled( ) )
+    {
+        struct timeval timeout = { 0, 100000 };
+        fd_set         readSet;
+
+        FD_ZERO( &readSet );
+        FD_SET( socket, &readSet );
+
+        if ( select( static_cast<int>( socket + 1 ), &readSet, nullptr, nullptr, &timeout ) > 0 )
+        {
+            int received = recv( socket, reinterpret_cast<char*>( datagram.data( ) ), static_cast<int>( datagram.size( ) ), 0 );
+
+            if ( received > 0 )
+            {
+                Assembler.Process( datagram.data( ), static_cast<uint32_t>( received ) );
+                lastReceiveTime = steady_clock::now( );
+                timeoutReported = false;
+            }
+        }
+        else if ( ( !timeoutReported ) &&
+                  ( duration_cast<milliseconds>( steady_clock::now( ) - lastReceiveTime ).count( ) > RECEIVE_TIMEOUT ) )
+        {
+            NotifyError( "No frames received from multicast group" );
+            timeoutReported = true;
+        }
+    }
+}
+
+// Forget about any partially received frame
+void MulticastFrameAssembler::Reset( )
+{
+    Assembling    = false;
+    GotFirstFrame = false;
+}
+
+// Process single datagram
+void MulticastFrameAssembler::Process( const uint8_t* datagram, uint32_t datagramSize )
+{
+    XMulticastFragmentHeader header;
+
+    if ( !header.Read( datagram, datagramSize ) )
+    {
+        return;
+    }
+
+    if ( ( !Assembling ) || ( header.FrameNumber != FrameNumber ) )
+    {
+        int32_t diff = static_cast<int32_t>( header.FrameNumber - FrameNumber );
+
+        if ( ( GotFirstFrame ) && ( diff <= 0 ) && ( diff > -MAX_FRAME_REORDER ) )
+        {
+            // late fragment of a frame, which is already done/dropped
+            return;
+        }
+
+        if ( Assembling )
+        {
+            Owner->FramesDropped++;
+        }
+        if ( ( GotFirstFrame ) && ( diff > 1 ) && ( diff < MAX_FRAME_REORDER ) )
+        {
+            // frames, which were lost completely
+            Owner->FramesDropped += diff - 1;
+        }
+
+        StartFrame( header );
+    }
+
+    if ( ( header.FrameSize == FrameSize ) && ( header.FragmentCount == FragmentReceived.size( ) ) &&
+         ( !FragmentReceived[header.FragmentIndex] ) )
+    {
+        memcpy( Frame.data( ) + header.FragmentOffset, datagram + XMulticastFragmentHeader::Size,
+                datagramSize - XMulticastFragmentHeader::Size );
+
+        FragmentReceived[header.FragmentIndex] = true;
+
+        if ( --FragmentsLeft == 0 )
+        {
+            FrameDone( );
+        }
+    }
+}
+
+// Start collecting new frame
+void MulticastFrameAssembler::StartFrame( const XMulticastFragmentHeader& header )
+{
+    if ( Frame.size( ) < header.FrameSize )
+    {
+        Frame.resize( header.FrameSize );
+    }
+
+    FragmentReceived.assign( header.FragmentCount, false );
+
+    FrameNumber   = header.FrameNumber;
+    FrameSize     = header.FrameSize;
+    FragmentsLeft = header.FragmentCount;
+    Assembling    = true;
+    GotFirstFrame = true;
+}
+
+// All fragments are collected - provide the frame to listener
+void MulticastFrameAssembler::FrameDone( )
+{
+    Assembling = false;
+
+    if ( ( FrameSize > 2 ) && ( Frame[0] == 0xFF ) && ( Frame[1] == 0xD8 ) )
+    {
+        // image wraps assembler's buffer, so listeners must copy it if they need to keep it
+        shared_ptr<XImage> image = XImage::Create( Frame.data( ), FrameSize, 1, FrameSize, XPixelFormat::JPEG );
+
+        if ( image )
+        {
+            Owner->FramesReceived++;
+            Owner->NotifyNewImage( image );
+        }
+    }
+    else
+    {
+        Owner->NotifyError( "Not a JPEG image received from multicast group" );
+    }
+}
+
+} // namespace Private
@@ -0,0 +1,77 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XMULTICAST_CAMERA_HPP
+#define XMULTICAST_CAMERA_HPP
+
+#include <memory>
+#include <string>
+
+#include "IVideoSource.hpp"
+#include "XInterfaces.hpp"
+
+namespace Private
+{
+    class XMulticastCameraData;
+}
+
+// Class which provides JPEG images received from UDP multicast group, where they are sent
+// by XMulticastSender. Frames are re-assembled from fragments; frames with lost fragments
+// are dropped.
+class XMulticastCamera : public IVideoSource, private Uncopyable
+{
+protected:
+    XMulticastCamera( );
+
+public:
+    ~XMulticastCamera( );
+
+    static const std::shared_ptr<XMulticastCamera> Create( );
+
+    // Start video source so it initializes and begins providing video frames
+    bool Start( );
+    // Signal source video to stop, so it could finalize and clean-up
+    void SignalToStop( );
+    // Wait till video source (its thread) stops
+    void WaitForStop( );
+    // Check if video source is still running
+    bool IsRunning( );
+
+    // Get number of frames received since the start of the video source
+    uint32_t FramesReceived( );
+    // Get number of frames dropped because some of their fragments were lost
+    uint32_t FramesDropped( );
+
+    // Set video source listener returning the old one
+    IVideoSourceListener* SetListener( IVideoSourceListener* listener );
+
+public: // Set of poperties, which can be set only when video source is NOT running.
+        // If it is running, then setting these properties is silently ignored.
+
+    // Get/Set multicast group address and port to receive frames from
+    std::string GroupAddress( ) const;
+    uint16_t Port( ) const;
+    void SetGroup( const std::string& groupAddress, uint16_t port );
+
+private:
+    Private::XMulticastCameraData* mData;
+};
+
+#endif // XMULTICAST_CAMERA_HPP
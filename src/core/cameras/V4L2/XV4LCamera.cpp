@@ -32,6 +32,8 @@
 
 #include "XV4LCamera.hpp"
 #include "XManualResetEvent.hpp"
+#include "XJpegDcDecoder.hpp"
+#include "XSceneChangeDetector.hpp"
 
 using namespace std;
 using namespace std::chrono;
@@ -40,6 +42,11 @@ namespace Private
 {
     #define BUFFER_COUNT        (4)
 
+    // Distance between luma samples used to find if scene changed
+    #define SCENE_GRID_STEP       (16)
+    // Time (milliseconds) to keep full frame rate after the last change of scene
+    #define SCENE_ACTIVE_TIME     (2000)
+
     // Private details of the implementation
     class XV4LCameraData
     {
@@ -58,9 +65,19 @@ namespace Private
 
         map<XVideoProperty, int32_t> PropertiesToSet;
 
+        // scene is checked on luma of YUYV frames or on 1/8 size image made of DC coefficients of MJPEG frames
+        XSceneChangeDetector     YuyvSceneChanges;
+        XSceneChangeDetector     JpegSceneChanges;
+        XJpegDcDecoder           DcDecoder;
+        shared_ptr<XImage>       DcImage;
+        steady_clock::time_point LastSceneChangeTime;
+        steady_clock::time_point LastFrameTime;
+
     public:
         uint32_t                VideoDevice;
         uint32_t                FramesReceived;
+        uint32_t                FramesDiscarded;
+        volatile uint32_t       IdleFrameRate;
         uint32_t                FrameWidth;
         uint32_t                FrameHeight;
         uint32_t                FrameRate;
@@ -70,8 +87,9 @@ namespace Private
         XV4LCameraData( ) :
             Sync( ), ConfigSync( ), ControlThread( ), NeedToStop( ), Listener( nullptr ), Running( false ),
             VideoFd( -1 ), VideoStreamingActive( false ), MappedBuffers( ), MappedBufferLength( ), PropertiesToSet( ),
+            YuyvSceneChanges( SCENE_GRID_STEP ), JpegSceneChanges( SCENE_GRID_STEP / 8 ), DcDecoder( ), DcImage( ), LastSceneChangeTime( ), LastFrameTime( ),
             VideoDevice( 0 ),
-            FramesReceived( 0 ), FrameWidth( 640 ), FrameHeight( 480 ), FrameRate( 30 ), JpegEncoding( true )
+            FramesReceived( 0 ), FramesDiscarded( 0 ), IdleFrameRate( 0 ), FrameWidth( 640 ), FrameHeight( 480 ), FrameRate( 30 ), JpegEncoding( true )
         {
         }
 
@@ -98,6 +116,7 @@ namespace Private
     private:
         bool Init( );
         void VideoCaptureLoop( );
+        bool IsFrameNeeded( const uint8_t* data, uint32_t size, steady_clock::time_point now );
         void Cleanup( );
 
     };
@@ -148,6 +167,12 @@ uint32_t XV4LCamera::FramesReceived( )
     return mData->FramesReceived;
 }
 
+// Get number of frames discarded due to reduced frame rate of static scene
+uint32_t XV4LCamera::FramesDiscarded( )
+{
+    return mData->FramesDiscarded;
+}
+
 // Set video source listener
 IVideoSourceListener* XV4LCamera::SetListener( IVideoSourceListener* listener )
 {
@@ -198,6 +223,16 @@ void XV4LCamera::EnableJpegEncoding( bool enable )
     mData->EnableJpegEncoding( enable );
 }
 
+// Get/Set frame rate to use while scene is static
+uint32_t XV4LCamera::IdleFrameRate( ) const
+{
+    return mData->IdleFrameRate;
+}
+void XV4LCamera::SetIdleFrameRate( uint32_t frameRate )
+{
+    mData->IdleFrameRate = frameRate;
+}
+
 // Set the specified video property
 XError XV4LCamera::SetVideoProperty( XVideoProperty property, int32_t value )
 {
@@ -228,7 +263,8 @@ bool XV4LCameraData::Start( )
     {
         NeedToStop.Reset( );
         Running = true;
-        FramesReceived = 0;
+        FramesReceived  = 0;
+        FramesDiscarded = 0;
 
         ControlThread = thread( ControlThreadHanlder, this );
     }
@@ -501,6 +537,22 @@ bool XV4LCameraData::Init( )
     return ret;
 }
 
+static const uint32_t nativeVideoProperties[] =
+{
+    V4L2_CID_BRIGHTNESS,
+    V4L2_CID_CONTRAST,
+    V4L2_CID_SATURATION,
+    V4L2_CID_HUE,
+    V4L2_CID_SHARPNESS,
+    V4L2_CID_GAIN,
+    V4L2_CID_BACKLIGHT_COMPENSATION,
+    V4L2_CID_RED_BALANCE,
+    V4L2_CID_BLUE_BALANCE,
+    V4L2_CID_AUTO_WHITE_BALANCE,
+    V4L2_CID_HFLIP,
+    V4L2_CID_VFLIP
+};
+
 // Stop camera capture and clean-up
 void XV4LCameraData::Cleanup( )
 {
@@ -529,6 +581,22 @@ void XV4LCameraData::Cleanup( )
     // close the video device
     if ( VideoFd != -1 )
     {
+        lock_guard<recursive_mutex> propertiesLock( Sync );
+
+        // remember current values of video properties, so they are restored when device is opened again
+        for ( int i = static_cast<int>( XVideoProperty::Brightness ); i <= static_cast<int>( XVideoProperty::VerticalFlip ); i++ )
+        {
+            v4l2_control control;
+
+            control.id = nativeVideoProperties[i];
+
+            if ( ( PropertiesToSet.find( static_cast<XVideoProperty>( i ) ) == PropertiesToSet.end( ) ) &&
+                 ( ioctl( VideoFd, VIDIOC_G_CTRL, &control ) >= 0 ) )
+            {
+                PropertiesToSet[static_cast<XVideoProperty>( i )] = control.value;
+            }
+        }
+
         close( VideoFd );
         VideoFd = -1;
     }
@@ -603,6 +671,12 @@ void XV4LCameraData::VideoCaptureLoop( )
         }
     }
 
+    // start at full frame rate
+    YuyvSceneChanges.Reset( );
+    JpegSceneChanges.Reset( );
+    LastSceneChangeTime = steady_clock::now( );
+    LastFrameTime       = LastSceneChangeTime;
+
     // acquire images untill we've been told to stop
     while ( !NeedToStop.Wait( sleepTime ) )
     {
@@ -619,6 +693,18 @@ void XV4LCameraData::VideoCaptureLoop( )
         {
             NotifyError( "Failed to dequeue capture buffer" );
         }
+        else if ( ( IdleFrameRate != 0 ) && ( !IsFrameNeeded( MappedBuffers[videoBuffer.index], videoBuffer.bytesused, startTime ) ) )
+        {
+            // nothing changed and it is not yet time for the next frame of static scene
+            FramesReceived++;
+            FramesDiscarded++;
+
+            ecode = ioctl( VideoFd, VIDIOC_QBUF, &videoBuffer );
+            if ( ecode < 0 )
+            {
+                NotifyError( "Failed to requeue capture buffer" );
+            }
+        }
         else
         {
             shared_ptr<XImage> image;
@@ -657,6 +743,53 @@ void XV4LCameraData::VideoCaptureLoop( )
     }
 }
 
+// Check if the captured frame should be provided while idle frame rate is enabled - scene changed since
+// the last provided frame, it changed recently or the next frame of static scene is due
+bool XV4LCameraData::IsFrameNeeded( const uint8_t* data, uint32_t size, steady_clock::time_point now )
+{
+    uint32_t              idleRate = IdleFrameRate;
+    XSceneChangeDetector* detector = nullptr;
+    // let broken frames go, whatever they are
+    bool                  changed  = true;
+
+    if ( JpegEncoding )
+    {
+        // DC coefficients are enough to see a change, while only entropy decoding is done to get them
+        if ( DcDecoder.Decode( data, size, DcImage ) == XError::Success )
+        {
+            detector = &JpegSceneChanges;
+            changed  = detector->IsChanged( DcImage );
+        }
+    }
+    else if ( size >= FrameWidth * FrameHeight * 2 )
+    {
+        detector = &YuyvSceneChanges;
+        changed  = detector->IsChanged( data, static_cast<int32_t>( FrameWidth ), static_cast<int32_t>( FrameHeight ),
+                                        static_cast<int32_t>( FrameWidth * 2 ) );
+    }
+
+    if ( changed )
+    {
+        LastSceneChangeTime = now;
+    }
+
+    bool needed = ( ( now - LastSceneChangeTime < milliseconds( SCENE_ACTIVE_TIME ) ) ||
+                    ( now - LastFrameTime >= milliseconds( 1000 / idleRate ) ) );
+
+    if ( needed )
+    {
+        LastFrameTime = now;
+
+        // further frames are compared with the provided one
+        if ( detector != nullptr )
+        {
+            detector->UpdateReference( );
+        }
+    }
+
+    return needed;
+}
+
 // Background control thread - performs camera init/clean-up and runs video loop
 void XV4LCameraData::ControlThreadHanlder( XV4LCameraData* me )
 {    
@@ -718,29 +851,13 @@ void XV4LCameraData::EnableJpegEncoding( bool enable )
     }
 }
 
-static const uint32_t nativeVideoProperties[] =
-{
-    V4L2_CID_BRIGHTNESS,
-    V4L2_CID_CONTRAST,
-    V4L2_CID_SATURATION,
-    V4L2_CID_HUE,
-    V4L2_CID_SHARPNESS,
-    V4L2_CID_GAIN,
-    V4L2_CID_BACKLIGHT_COMPENSATION,
-    V4L2_CID_RED_BALANCE,
-    V4L2_CID_BLUE_BALANCE,
-    V4L2_CID_AUTO_WHITE_BALANCE,
-    V4L2_CID_HFLIP,
-    V4L2_CID_VFLIP
-};
-
 // Set the specified video property
 XError XV4LCameraData::SetVideoProperty( XVideoProperty property, int32_t value )
 {
     lock_guard<recursive_mutex> lock( Sync );
     XError                      ret = XError::Success;
 
-    if ( ( property < XVideoProperty::Brightness ) || ( property > XVideoProperty::Gain ) )
+    if ( ( property < XVideoProperty::Brightness ) || ( property > XVideoProperty::VerticalFlip ) )
     {
         ret = XError::UnknownProperty;
     }
@@ -775,7 +892,7 @@ XError XV4LCameraData::GetVideoProperty( XVideoProperty property, int32_t* value
     {
         ret = XError::NullPointer;
     }
-    else if ( ( property < XVideoProperty::Brightness ) || ( property > XVideoProperty::Gain ) )
+    else if ( ( property < XVideoProperty::Brightness ) || ( property > XVideoProperty::VerticalFlip ) )
     {
         ret = XError::UnknownProperty;
     }
@@ -812,7 +929,7 @@ XError XV4LCameraData::GetVideoPropertyRange( XVideoProperty property, int32_t*
     {
         ret = XError::NullPointer;
     }
-    else if ( ( property < XVideoProperty::Brightness ) || ( property > XVideoProperty::Gain ) )
+    else if ( ( property < XVideoProperty::Brightness ) || ( property > XVideoProperty::VerticalFlip ) )
     {
         ret = XError::UnknownProperty;
     }
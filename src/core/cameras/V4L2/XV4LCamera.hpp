@@ -69,6 +69,8 @@ public:
 
     // Get number of frames received since the start of the video source
     uint32_t FramesReceived( );
+    // Get number of frames discarded due to reduced frame rate of static scene
+    uint32_t FramesDiscarded( );
 
     // Set video source listener returning the old one
     IVideoSourceListener* SetListener( IVideoSourceListener* listener );
@@ -95,6 +97,14 @@ public: // Set of poperties, which can be set only when device is NOT running.
 
 public:
 
+    // Get/Set frame rate to use while scene is static (0 - disabled, default). Camera keeps capturing
+    // at its frame rate, but frames are discarded right after dequeuing (before decoding or notifying
+    // listener), unless scene changed since the last provided frame or a frame is due by the idle rate.
+    // Full rate is kept for a couple of seconds after the last change. Change of scene is checked on a
+    // sparse grid of luma samples (of YUYV frames or of DC coefficients of MJPEG frames' blocks).
+    uint32_t IdleFrameRate( ) const;
+    void SetIdleFrameRate( uint32_t frameRate );
+
     // Set the specified video property. The device does not have to be running. If it is not,
     // the setting will be cached and applied as soon as the device gets running.
     XError SetVideoProperty( XVideoProperty property, int32_t value );
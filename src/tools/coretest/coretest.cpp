@@ -0,0 +1,206 @@
+/*
+    coretest - checks core classes against known inputs
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <vector>
+
+#include "XImage.hpp"
+#include "XSceneChangeDetector.hpp"
+#include "XJpegEncoder.hpp"
+#include "XJpegDcDecoder.hpp"
+
+using namespace std;
+
+bool TestSceneRealChange( );
+bool TestSceneSmallChange( );
+bool TestSceneNoRepeatLimit( );
+bool TestDcDecoderValidJpeg( );
+bool TestDcDecoderOversubscribedTable( );
+
+// Tests to run and their names
+static const struct
+{
+    const char* Name;
+    bool      (*Run)( );
+}
+Tests[] =
+{
+    { "Scene change is reported at once",           TestSceneRealChange    },
+    { "Small scene change is reported eventually",  TestSceneSmallChange   },
+    { "Repeats are not limited if asked so",        TestSceneNoRepeatLimit },
+    { "JPEG is decoded at 1/8 size",                TestDcDecoderValidJpeg },
+    { "Over-subscribed Huffman table is rejected",  TestDcDecoderOversubscribedTable }
+};
+
+int main( int argc, char* argv[] )
+{
+    int failed = 0;
+
+    for ( size_t i = 0; i < sizeof( Tests ) / sizeof( Tests[0] ); i++ )
+    {
+        bool passed = Tests[i].Run( );
+
+        printf( "%-48s %s\n", Tests[i].Name, ( passed ) ? "OK" : "FAILED" );
+
+        if ( !passed )
+        {
+            failed++;
+        }
+    }
+
+    printf( "\n%d of %d tests failed\n", failed, static_cast<int>( sizeof( Tests ) / sizeof( Tests[0] ) ) );
+
+    return ( failed == 0 ) ? 0 : 1;
+}
+
+// Make grayscale image filled with the specified value
+static shared_ptr<XImage> MakeGrayImage( uint8_t value )
+{
+    shared_ptr<XImage> image = XImage::Allocate( 320, 240, XPixelFormat::Grayscale8 );
+
+    if ( image )
+    {
+        memset( image->Data( ), value, static_cast<size_t>( image->Stride( ) ) * image->Height( ) );
+    }
+
+    return image;
+}
+
+// Check images one by one as video source would provide them, returning number of the first image
+// reported as changed (reference is updated then, as if the image got encoded) or 0 if none was
+static uint32_t FindFirstChanged( XSceneChangeDetector& detector, uint8_t value, uint32_t count )
+{
+    shared_ptr<XImage> image = MakeGrayImage( value );
+    uint32_t           ret   = 0;
+
+    for ( uint32_t i = 1; ( i <= count ) && ( ret == 0 ); i++ )
+    {
+        if ( detector.IsChanged( image ) )
+        {
+            detector.UpdateReference( );
+            ret = i;
+        }
+    }
+
+    return ret;
+}
+
+// Scene changing well above noise level must be reported with the first changed image
+bool TestSceneRealChange( )
+{
+    XSceneChangeDetector detector;
+
+    return ( FindFirstChanged( detector, 100, 1 ) == 1 ) &&
+           ( FindFirstChanged( detector, 100, 10 ) == 0 ) &&
+           ( FindFirstChanged( detector, 160, 10 ) == 1 );
+}
+
+// Change below noise threshold (end of a slow fade) must not keep the old image forever - it gets
+// reported after the set number of repeats and becomes the reference
+bool TestSceneSmallChange( )
+{
+    XSceneChangeDetector detector;
+
+    detector.SetMaxRepeats( 30 );
+
+    return ( FindFirstChanged( detector, 100, 1 ) == 1 ) &&
+           ( FindFirstChanged( detector, 108, 100 ) == 31 ) &&
+           ( FindFirstChanged( detector, 108, 30 ) == 0 );
+}
+
+// With no limit set, image which does not change noticeably is never reported
+bool TestSceneNoRepeatLimit( )
+{
+    XSceneChangeDetector detector;
+
+    detector.SetMaxRepeats( 0 );
+
+    return ( FindFirstChanged( detector, 100, 1 ) == 1 ) &&
+           ( FindFirstChanged( detector, 108, 1000 ) == 0 );
+}
+
+// Encode gray image as JPEG
+static vector<uint8_t> MakeJpeg( uint8_t value )
+{
+    shared_ptr<XImage> image      = MakeGrayImage( value );
+    uint32_t           bufferSize = 64 * 1024;
+    uint8_t*           buffer     = static_cast<uint8_t*>( malloc( bufferSize ) );
+    vector<uint8_t>    jpeg;
+    XJpegEncoder       encoder;
+
+    if ( ( image ) && ( buffer != nullptr ) && ( encoder.EncodeToMemory( image, &buffer, &bufferSize ) == XError::Success ) )
+    {
+        jpeg.assign( buffer, buffer + bufferSize );
+    }
+
+    free( buffer );
+
+    return jpeg;
+}
+
+// Image encoded by libjpeg must be decoded into image of 1/8 size with the same luma
+bool TestDcDecoderValidJpeg( )
+{
+    vector<uint8_t>    jpeg = MakeJpeg( 100 );
+    shared_ptr<XImage> image;
+    XJpegDcDecoder     decoder;
+    bool               ret  = false;
+
+    if ( ( !jpeg.empty( ) ) && ( decoder.Decode( jpeg.data( ), static_cast<uint32_t>( jpeg.size( ) ), image ) == XError::Success ) &&
+         ( image->Width( ) == 40 ) && ( image->Height( ) == 30 ) )
+    {
+        int diff = static_cast<int>( image->Data( )[0] ) - 100;
+
+        ret = ( diff >= -2 ) && ( diff <= 2 );
+    }
+
+    return ret;
+}
+
+// DHT with more codes than fit into their length (255 codes of 1 bit) must fail decoding instead
+// of building lookup table out of its bounds
+bool TestDcDecoderOversubscribedTable( )
+{
+    vector<uint8_t>    jpeg = MakeJpeg( 100 );
+    vector<uint8_t>    dht( 4 + 1 + 16 + 255, 0 );
+    shared_ptr<XImage> image;
+    XJpegDcDecoder     decoder;
+
+    if ( jpeg.size( ) < 2 )
+    {
+        return false;
+    }
+
+    // marker with its length, then DC table 0 having 255 codes of length 1
+    dht[0] = 0xFF;
+    dht[1] = 0xC4;
+    dht[2] = static_cast<uint8_t>( ( dht.size( ) - 2 ) >> 8 );
+    dht[3] = static_cast<uint8_t>( dht.size( ) - 2 );
+    dht[4] = 0x00;
+    dht[5] = 255;
+
+    // put it right after SOI
+    jpeg.insert( jpeg.begin( ) + 2, dht.begin( ), dht.end( ) );
+
+    return ( decoder.Decode( jpeg.data( ), static_cast<uint32_t>( jpeg.size( ) ), image ) != XError::Success );
+}
@@ -0,0 +1,290 @@
+/*
+    writebench - compares ways of writing recordings to disk
+
+    Copyright (C) 2017, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <chrono>
+#include <vector>
+
+#include "XAsyncFileWriter.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+// Size of buffers used by asynchronous writer
+#define BUFFER_SIZE (1024 * 1024)
+
+// Results of a single benchmark run
+struct BenchmarkResult
+{
+    double   Seconds;
+    double   MaxFrameTime;
+    uint32_t Errors;
+};
+
+void ShowUsage( );
+bool WritePlain( const char* fileName, const vector<uint8_t>& frame, uint32_t framesCount, bool sync, BenchmarkResult* result );
+bool WriteAsync( const char* fileName, const vector<uint8_t>& frame, uint32_t framesCount, bool forceThreadPool, BenchmarkResult* result );
+void PrintResult( const char* name, uint32_t totalSize, const BenchmarkResult& result );
+void PrepareRun( const char* fileName );
+
+int main( int argc, char* argv[] )
+{
+    const char* fileName    = "writebench.tmp";
+    uint32_t    totalSizeMb = 512;
+    uint32_t    frameSizeKb = 100;
+    bool        sync        = false;
+    int         ret         = 0;
+
+    for ( int i = 1; i < argc; i++ )
+    {
+        if ( strncmp( argv[i], "-file:", 6 ) == 0 )
+        {
+            fileName = argv[i] + 6;
+        }
+        else if ( strncmp( argv[i], "-size:", 6 ) == 0 )
+        {
+            totalSizeMb = static_cast<uint32_t>( atoi( argv[i] + 6 ) );
+        }
+        else if ( strncmp( argv[i], "-frame:", 7 ) == 0 )
+        {
+            frameSizeKb = static_cast<uint32_t>( atoi( argv[i] + 7 ) );
+        }
+        else if ( strcmp( argv[i], "-sync" ) == 0 )
+        {
+            sync = true;
+        }
+        else
+        {
+            ShowUsage( );
+            return -1;
+        }
+    }
+
+    if ( ( totalSizeMb == 0 ) || ( totalSizeMb > 4000 ) || ( frameSizeKb == 0 ) || ( frameSizeKb > 1024 ) )
+    {
+        ShowUsage( );
+        return -1;
+    }
+
+    // odd frame size, so writes are not naturally aligned - same as with JPEGs
+    vector<uint8_t> frame( frameSizeKb * 1024 + 17 );
+    uint32_t        framesCount = static_cast<uint32_t>( ( static_cast<uint64_t>( totalSizeMb ) * 1024 * 1024 ) / frame.size( ) );
+    uint32_t        totalSize   = static_cast<uint32_t>( framesCount * frame.size( ) );
+    BenchmarkResult result;
+
+    for ( size_t i = 0; i < frame.size( ); i++ )
+    {
+        frame[i] = static_cast<uint8_t>( i * 31 );
+    }
+
+    printf( "Writing %u frames of %u bytes to %s\n\n", framesCount, static_cast<uint32_t>( frame.size( ) ), fileName );
+    printf( "%-24s %10s %16s %8s\n", "Method", "MB/s", "Max frame (ms)", "Errors" );
+
+    PrepareRun( fileName );
+    if ( WritePlain( fileName, frame, framesCount, sync, &result ) )
+    {
+        PrintResult( ( sync ) ? "write() + fdatasync()" : "write()", totalSize, result );
+    }
+    else
+    {
+        ret = 1;
+    }
+
+    PrepareRun( fileName );
+    if ( WriteAsync( fileName, frame, framesCount, false, &result ) )
+    {
+        PrintResult( "io_uring", totalSize, result );
+    }
+    else
+    {
+        printf( "%-24s %10s\n", "io_uring", "not available" );
+    }
+
+    PrepareRun( fileName );
+    if ( WriteAsync( fileName, frame, framesCount, true, &result ) )
+    {
+        PrintResult( "thread pool", totalSize, result );
+    }
+    else
+    {
+        ret = 1;
+    }
+
+    unlink( fileName );
+
+    return ret;
+}
+
+// Show tool's usage
+void ShowUsage( )
+{
+    printf( "writebench - compares ways of writing recordings to disk \n\n" );
+    printf( "Usage: writebench [-file:<path>] [-size:<MB>] [-frame:<KB>] [-sync] \n\n" );
+    printf( "  -file:  File to write (deleted at the end). Default is writebench.tmp. \n" );
+    printf( "  -size:  Amount of data to write, 1-4000 MB. Default is 512. \n" );
+    printf( "  -frame: Size of a single frame, 1-1024 KB. Default is 100. \n" );
+    printf( "  -sync:  Call fdatasync() after every frame written with write(). \n" );
+}
+
+// Remove file of the previous run and let disk finish its writes, so runs don't affect each other
+void PrepareRun( const char* fileName )
+{
+    unlink( fileName );
+    sync( );
+}
+
+// Write every frame with write() - the way it is done without asynchronous writer
+bool WritePlain( const char* fileName, const vector<uint8_t>& frame, uint32_t framesCount, bool sync, BenchmarkResult* result )
+{
+    int file = open( fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+
+    if ( file == -1 )
+    {
+        printf( "Failed opening %s \n", fileName );
+        return false;
+    }
+
+    steady_clock::time_point startTime = steady_clock::now( );
+
+    result->MaxFrameTime = 0;
+    result->Errors       = 0;
+
+    for ( uint32_t i = 0; i < framesCount; i++ )
+    {
+        steady_clock::time_point frameTime = steady_clock::now( );
+
+        if ( write( file, frame.data( ), frame.size( ) ) != static_cast<ssize_t>( frame.size( ) ) )
+        {
+            result->Errors++;
+        }
+        if ( sync )
+        {
+            fdatasync( file );
+        }
+
+        double taken = duration<double, milli>( steady_clock::now( ) - frameTime ).count( );
+
+        if ( taken > result->MaxFrameTime )
+        {
+            result->MaxFrameTime = taken;
+        }
+    }
+
+    fdatasync( file );
+    result->Seconds = duration<double>( steady_clock::now( ) - startTime ).count( );
+
+    close( file );
+
+    return true;
+}
+
+// Copy frames into buffers of asynchronous writer and queue them, when full
+bool WriteAsync( const char* fileName, const vector<uint8_t>& frame, uint32_t framesCount, bool forceThreadPool, BenchmarkResult* result )
+{
+    XAsyncFileWriter writer( 16, BUFFER_SIZE );
+    int              file = open( fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+    bool             ret  = false;
+
+    writer.SetForceThreadPool( forceThreadPool );
+
+    if ( ( file != -1 ) && ( writer.Start( ) ) &&
+         ( writer.ActiveBackend( ) == ( ( forceThreadPool ) ? XAsyncFileWriter::Backend::ThreadPool : XAsyncFileWriter::Backend::IoUring ) ) )
+    {
+        steady_clock::time_point startTime = steady_clock::now( );
+        uint8_t*                 buffer    = nullptr;
+        uint32_t                 fill      = 0;
+        uint64_t                 offset    = 0;
+
+        result->MaxFrameTime = 0;
+
+        for ( uint32_t i = 0; i < framesCount; i++ )
+        {
+            steady_clock::time_point frameTime = steady_clock::now( );
+            const uint8_t*           data      = frame.data( );
+            uint32_t                 remaining = static_cast<uint32_t>( frame.size( ) );
+
+            while ( remaining != 0 )
+            {
+                if ( buffer == nullptr )
+                {
+                    while ( ( buffer = writer.AcquireBuffer( 1000 ) ) == nullptr )
+                    {
+                    }
+                }
+
+                uint32_t toCopy = ( remaining < BUFFER_SIZE - fill ) ? remaining : BUFFER_SIZE - fill;
+
+                memcpy( buffer + fill, data, toCopy );
+                fill      += toCopy;
+                data      += toCopy;
+                remaining -= toCopy;
+
+                if ( fill == BUFFER_SIZE )
+                {
+                    writer.QueueWrite( file, buffer, fill, offset );
+                    offset += fill;
+                    buffer  = nullptr;
+                    fill    = 0;
+                }
+            }
+
+            writer.Submit( );
+
+            double taken = duration<double, milli>( steady_clock::now( ) - frameTime ).count( );
+
+            if ( taken > result->MaxFrameTime )
+            {
+                result->MaxFrameTime = taken;
+            }
+        }
+
+        if ( buffer != nullptr )
+        {
+            writer.QueueWrite( file, buffer, fill, offset );
+        }
+
+        writer.WaitForCompletion( );
+        fdatasync( file );
+
+        result->Seconds = duration<double>( steady_clock::now( ) - startTime ).count( );
+        result->Errors  = writer.WriteErrors( );
+
+        writer.Stop( );
+        ret = true;
+    }
+
+    if ( file != -1 )
+    {
+        close( file );
+    }
+
+    return ret;
+}
+
+// Print results of a benchmark run
+void PrintResult( const char* name, uint32_t totalSize, const BenchmarkResult& result )
+{
+    printf( "%-24s %10.1f %16.2f %8u\n", name, totalSize / ( 1024.0 * 1024.0 ) / result.Seconds, result.MaxFrameTime, result.Errors );
+}